@@ -0,0 +1,49 @@
+# Memory of many client connections: one OpcUA.ClientHost port vs. one port per client.
+#
+#   mix run bench/client_host_bench.exs [clients]
+#
+# Every session of a host still owns a UA_Client (with its own event loop and buffers), so the
+# host saves the OS processes, not the per-connection memory of the stack. Memory is the resident
+# set size of the port OS processes once every client is connected.
+alias OpcUA.{Client, ClientHost, Server}
+
+clients =
+  case System.argv() do
+    [clients] -> String.to_integer(clients)
+    [] -> 100
+  end
+
+{:ok, s_pid} = Server.start_link()
+:ok = Server.set_default_config(s_pid)
+:ok = Server.set_port(s_pid, 4090)
+:ok = Server.start(s_pid)
+
+rss_kb = fn os_pids ->
+  {output, 0} = System.cmd("ps", ["-o", "rss=", "-p", Enum.join(os_pids, ",")])
+  output |> String.split() |> Enum.map(&String.to_integer/1) |> Enum.sum()
+end
+
+os_pid = fn c_pid -> c_pid |> :sys.get_state() |> Map.fetch!(:port) |> Port.info(:os_pid) |> elem(1) end
+
+connect = fn opts ->
+  for _ <- 1..clients do
+    {:ok, c_pid} = Client.start_link(opts)
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4090/")
+    c_pid
+  end
+end
+
+measure = fn name, c_pids ->
+  os_pids = c_pids |> Enum.map(os_pid) |> Enum.uniq()
+  rss = rss_kb.(os_pids)
+  IO.puts("#{name}: #{length(os_pids)} OS processes, #{rss} KiB RSS (#{Float.round(rss / clients, 1)} KiB per connection)")
+  Enum.each(c_pids, &GenServer.stop/1)
+end
+
+{:ok, host} = ClientHost.start_link()
+IO.puts("#{clients} connections")
+measure.("host", connect.(host: host))
+ClientHost.stop(host)
+
+measure.("ports", connect.([]))
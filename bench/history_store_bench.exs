@@ -0,0 +1,92 @@
+# Ingestion and read throughput of the server on-disk history store.
+#
+#   mix run bench/history_store_bench.exs [clients] [writes_per_client] [buffered_values]
+#
+# The store alone is measured first by priv/history_store_bench (no port nor network, target
+# 50k samples/s). Then every client writes its own node concurrently (one Write request per
+# value), so the store ingests `clients` streams of samples end to end, and the history is read
+# back with one HistoryRead.
+alias OpcUA.{Client, NodeId, QualifiedName, Server}
+
+{clients, writes, buffered} =
+  case System.argv() do
+    [clients, writes, buffered] -> {String.to_integer(clients), String.to_integer(writes), String.to_integer(buffered)}
+    [clients, writes] -> {String.to_integer(clients), String.to_integer(writes), 1024}
+    [clients] -> {String.to_integer(clients), 10_000, 1024}
+    [] -> {8, 10_000, 1024}
+  end
+
+store_bench = :opex62541 |> :code.priv_dir() |> to_string() |> Server.set_ld_library_path() |> Path.join("history_store_bench")
+{output, status} = System.cmd(store_bench, [], stderr_to_stdout: true)
+IO.write("store only:\n" <> output)
+if status != 0, do: IO.puts("store only: below target or failed (exit #{status})")
+IO.puts("end to end:")
+
+path = Path.join(System.tmp_dir!(), "opex_history_bench_#{System.unique_integer([:positive])}")
+
+{:ok, s_pid} = Server.start_link()
+:ok = Server.set_default_config(s_pid)
+:ok = Server.set_port(s_pid, 4090)
+{:ok, ns_index} = Server.add_namespace(s_pid, "Bench")
+:ok = Server.set_history_store(s_pid, path, segment_size: 16 * 1024 * 1024)
+
+node_ids =
+  for i <- 1..clients do
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "BenchTag#{i}")
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: node_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "BenchTag#{i}"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.write_node_access_level(s_pid, node_id, 3)
+    :ok = Server.set_node_history(s_pid, node_id, buffered, store: :disk)
+    node_id
+  end
+
+:ok = Server.start(s_pid)
+
+c_pids =
+  for _ <- 1..clients do
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4090/")
+    c_pid
+  end
+
+start_time = DateTime.utc_now()
+
+{write_us, _} =
+  :timer.tc(fn ->
+    Enum.zip(c_pids, node_ids)
+    |> Task.async_stream(
+      fn {c_pid, node_id} -> for i <- 1..writes, do: :ok = Client.write_node_value(c_pid, node_id, 10, i * 1.0) end,
+      max_concurrency: clients,
+      timeout: :infinity
+    )
+    |> Stream.run()
+  end)
+
+total = clients * writes
+IO.puts("#{clients} clients x #{writes} writes, #{buffered} values buffered per node")
+IO.puts("ingest: #{total} samples in #{div(write_us, 1000)} ms (#{round(total / (write_us / 1_000_000))} samples/s)")
+
+# Let the flush interval append the buffered values.
+Process.sleep(1_500)
+
+{read_us, {:ok, results}} =
+  :timer.tc(fn ->
+    Client.history_read_raw(hd(c_pids), node_ids, start_time: start_time, end_time: DateTime.utc_now())
+  end)
+
+read = Enum.reduce(results, 0, fn {:ok, history}, acc -> acc + div(byte_size(history.timestamps), 8) end)
+IO.puts("read: #{read} samples in #{div(read_us, 1000)} ms (#{round(read / (read_us / 1_000_000))} samples/s)")
+
+size = path |> File.ls!() |> Enum.map(&File.stat!(Path.join(path, &1)).size) |> Enum.sum()
+IO.puts("store: #{size} bytes (#{Float.round(size / max(read, 1), 1)} bytes/sample)")
+
+File.rm_rf!(path)
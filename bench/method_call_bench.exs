@@ -0,0 +1,101 @@
+# Read latency of a client session while other sessions have method calls pending in Elixir.
+#
+#   mix run bench/method_call_bench.exs [pending_calls] [reads] [answer_delay_ms]
+#
+# Method calls are answered `answer_delay_ms` after they reach the controlling process, so up to
+# `pending_calls` calls are always pending while another session reads a node `reads` times.
+alias OpcUA.{Client, NodeId, QualifiedName, Server}
+
+{pending, reads, delay} =
+  case System.argv() do
+    [pending, reads, delay] -> {String.to_integer(pending), String.to_integer(reads), String.to_integer(delay)}
+    [pending, reads] -> {String.to_integer(pending), String.to_integer(reads), 500}
+    [pending] -> {String.to_integer(pending), 2_000, 500}
+    [] -> {32, 2_000, 500}
+  end
+
+objects_folder = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+method_id = NodeId.new(ns_index: 1, identifier_type: "string", identifier: "SlowAdd")
+current_time = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2258)
+parent = self()
+
+# The server controlling process answers every call after `delay` ms.
+spawn_link(fn ->
+  {:ok, s_pid} = Server.start_link()
+  :ok = Server.set_default_config(s_pid)
+  :ok = Server.set_port(s_pid, 4090)
+  {:ok, 1} = Server.add_namespace(s_pid, "Bench")
+  :ok = Server.set_method_call_config(s_pid, timeout: 10 * delay + 1000, max_calls: max(pending, 1))
+
+  :ok =
+    Server.add_method_node(s_pid,
+      requested_new_node_id: method_id,
+      parent_node_id: objects_folder,
+      reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+      browse_name: QualifiedName.new(ns_index: 1, name: "SlowAdd"),
+      input_arguments: [{"a", 10}, {"b", 10}],
+      output_arguments: [{"sum", 10}]
+    )
+
+  :ok = Server.start(s_pid)
+  send(parent, :ready)
+
+  answer = fn answer ->
+    receive do
+      {:method_call, call_id, _object_id, _method_id, [a, b]} ->
+        Process.send_after(self(), {:answer, call_id, a + b}, delay)
+
+      {:answer, call_id, sum} ->
+        Server.set_method_result(s_pid, call_id, {:ok, [{10, sum}]})
+    end
+
+    answer.(answer)
+  end
+
+  answer.(answer)
+end)
+
+receive do
+  :ready -> :ok
+end
+
+connect = fn ->
+  {:ok, c_pid} = Client.start_link()
+  :ok = Client.set_config(c_pid)
+  :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4090/")
+  c_pid
+end
+
+reader = connect.()
+
+measure = fn ->
+  latencies =
+    for _ <- 1..reads do
+      {us, {:ok, _time}} = :timer.tc(fn -> Client.read_node_value(reader, current_time) end)
+      us
+    end
+    |> Enum.sort()
+
+  {Enum.at(latencies, div(reads, 2)), Enum.at(latencies, div(reads * 99, 100)), List.last(latencies)}
+end
+
+report = fn label, {p50, p99, max} -> IO.puts("#{label}: p50 #{p50} us, p99 #{p99} us, max #{max} us") end
+
+report.("idle server       ", measure.())
+
+# One session per pending call, each calling the method in a loop.
+callers =
+  for _ <- 1..pending do
+    c_pid = connect.()
+
+    spawn_link(fn ->
+      Stream.repeatedly(fn -> Client.call_methods(c_pid, [{objects_folder, method_id, [{10, 1.0}, {10, 2.0}]}], timeout: :infinity) end)
+      |> Stream.run()
+    end)
+  end
+
+# Let every session have its call pending.
+Process.sleep(delay)
+report.("#{pending} calls pending", measure.())
+
+Enum.each(callers, &Process.unlink/1)
@@ -0,0 +1,58 @@
+# Concurrent read throughput: OpcUA.TagTable (ETS) vs. GenServer.call to the port owner.
+#
+#   mix run bench/tag_table_bench.exs [readers] [reads_per_reader]
+#
+alias OpcUA.{Client, NodeId, QualifiedName, Server, TagTable}
+
+{readers, reads} =
+  case System.argv() do
+    [readers, reads] -> {String.to_integer(readers), String.to_integer(reads)}
+    [readers] -> {String.to_integer(readers), 1_000}
+    [] -> {100, 1_000}
+  end
+
+{:ok, s_pid} = Server.start_link(tag_table: :bench_tags)
+:ok = Server.set_default_config(s_pid)
+:ok = Server.set_port(s_pid, 4090)
+{:ok, ns_index} = Server.add_namespace(s_pid, "Bench")
+
+node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "BenchTag")
+
+:ok =
+  Server.add_variable_node(s_pid,
+    requested_new_node_id: node_id,
+    parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+    reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+    browse_name: QualifiedName.new(ns_index: ns_index, name: "BenchTag"),
+    type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+  )
+
+:ok = Server.write_node_access_level(s_pid, node_id, 3)
+:ok = Server.start(s_pid)
+
+# The tag table is populated by client writes.
+{:ok, c_pid} = Client.start_link()
+:ok = Client.set_config(c_pid)
+:ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4090/")
+:ok = Client.write_node_value(c_pid, node_id, 10, 42.0)
+Process.sleep(100)
+{:ok, 42.0} = TagTable.read(:bench_tags, node_id)
+
+run = fn label, read_fun ->
+  {time_us, _} =
+    :timer.tc(fn ->
+      1..readers
+      |> Task.async_stream(fn _ -> for _ <- 1..reads, do: {:ok, 42.0} = read_fun.() end,
+        max_concurrency: readers,
+        timeout: :infinity
+      )
+      |> Stream.run()
+    end)
+
+  total = readers * reads
+  IO.puts("#{label}: #{total} reads in #{div(time_us, 1000)} ms (#{round(total / (time_us / 1_000_000))} reads/s)")
+end
+
+IO.puts("#{readers} concurrent readers x #{reads} reads")
+run.("GenServer.call (read_node_value)", fn -> Server.read_node_value(s_pid, node_id) end)
+run.("OpcUA.TagTable.read", fn -> TagTable.read(:bench_tags, node_id) end)
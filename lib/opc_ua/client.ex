@@ -3,7 +3,44 @@ defmodule OpcUA.Client do
 
   @config_keys ["requestedSessionTimeout", "secureChannelLifeTime", "timeout"]
 
-  alias OpcUA.NodeId
+  @browse_directions %{forward: 0, inverse: 1, both: 2}
+
+  # OPC UA FilterOperator of the event where clause expressions.
+  @event_binary_operators %{
+    eq: 0,
+    gt: 2,
+    lt: 3,
+    gte: 4,
+    lte: 5,
+    like: 6,
+    and: 10,
+    or: 11,
+    bitwise_and: 16,
+    bitwise_or: 17
+  }
+
+  # OPC UA BrowseResultMask bits, in the order the C port encodes them.
+  @browse_result_fields [
+    reference_type: 1,
+    is_forward: 2,
+    node_class: 4,
+    browse_name: 8,
+    display_name: 16,
+    type_definition: 32
+  ]
+
+  @node_classes [
+    {:object, 1, "Object"},
+    {:variable, 2, "Variable"},
+    {:method, 4, "Method"},
+    {:object_type, 8, "ObjectType"},
+    {:variable_type, 16, "VariableType"},
+    {:reference_type, 32, "ReferenceType"},
+    {:data_type, 64, "DataType"},
+    {:view, 128, "View"}
+  ]
+
+  alias OpcUA.{NodeId, QualifiedName, TagTable}
 
   @moduledoc """
 
@@ -124,6 +161,58 @@ defmodule OpcUA.Client do
   """
   @callback handle_deleted_subscription(integer(), term()) :: term()
 
+  @doc """
+  Optional callback that handles the notification messages of a subscription lost during an outage
+  (see `get_subscription_stats/1`).
+
+  It's first argument is the `subscription_id` of the subscription, the second one the list of
+  sequence numbers of the lost messages.
+
+  The third argument it's the GenServer state (Parent process).
+  """
+  @callback handle_subscription_gap(integer(), list(), term()) :: term()
+
+  @doc """
+  Optional callback that handles the changed values of a poll group (see `add_poll_group/3`).
+
+  It's first argument is a tuple, in which its first element is the `group_id` and the
+  second element is a list of `{%NodeId{}, {:ok, value} | {:error, reason}}` with the
+  values that changed since the previous report.
+
+  The second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_polled_data({integer(), list()}, term()) :: term()
+
+  @doc """
+  Optional callback that handles the events notified by event monitored items (see
+  `add_event_monitored_item/2`).
+
+  It's first argument is the list of events of a publish response, every event is a tuple
+  `{subscription_id, monitored_item_id, fields}` with the selected fields in select order.
+
+  The second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_events(list(), term()) :: term()
+
+  @doc """
+  Optional callback that handles the connection events of the client (see `connect_async/2` and
+  `set_reconnect/2`).
+
+  It's first argument is the event, a tuple `{event, value}`.
+
+  The second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_connection({atom(), term()}, term()) :: term()
+
+  @doc """
+  Optional callback that handles the state changes of the client (see `set_state_notifications/2`).
+
+  It's first argument is a tuple `{channel_state, session_state, status}`.
+
+  The second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_client_state({atom(), atom(), binary()}, term()) :: term()
+
   defmacro __using__(opts) do
     quote location: :keep, bind_quoted: [opts: opts] do
       use GenServer, Keyword.drop(opts, [:configuration])
@@ -175,6 +264,11 @@ defmodule OpcUA.Client do
         {:noreply, state}
       end
 
+      def handle_info({:gap, subscription_id, sequence_numbers}, state) do
+        state = apply(__MODULE__, :handle_subscription_gap, [subscription_id, sequence_numbers, state])
+        {:noreply, state}
+      end
+
       def handle_info({:data, subscription_id, monitored_id, value}, state) do
         state =
           apply(__MODULE__, :handle_monitored_data, [
@@ -192,6 +286,26 @@ defmodule OpcUA.Client do
         {:noreply, state}
       end
 
+      def handle_info({:poll, group_id, changes}, state) do
+        state = apply(__MODULE__, :handle_polled_data, [{group_id, changes}, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:events, events}, state) do
+        state = apply(__MODULE__, :handle_events, [events, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:connection, event}, state) do
+        state = apply(__MODULE__, :handle_connection, [event, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:state, channel_state, session_state, status}, state) do
+        state = apply(__MODULE__, :handle_client_state, [{channel_state, session_state, status}, state])
+        {:noreply, state}
+      end
+
       @impl true
       def handle_subscription_timeout(subscription_id, state) do
         require Logger
@@ -218,6 +332,19 @@ defmodule OpcUA.Client do
         state
       end
 
+      @impl true
+      def handle_subscription_gap(subscription_id, sequence_numbers, state) do
+        require Logger
+
+        Logger.warning(
+          "No handle_subscription_gap/3 clause in #{__MODULE__} provided for #{
+            inspect({subscription_id, sequence_numbers})
+          }"
+        )
+
+        state
+      end
+
       @impl true
       def handle_monitored_data(changed_data_event, state) do
         require Logger
@@ -244,6 +371,58 @@ defmodule OpcUA.Client do
         state
       end
 
+      @impl true
+      def handle_polled_data(polled_data_event, state) do
+        require Logger
+
+        Logger.warning(
+          "No handle_polled_data/2 clause in #{__MODULE__} provided for #{
+            inspect(polled_data_event)
+          }"
+        )
+
+        state
+      end
+
+      @impl true
+      def handle_events(events, state) do
+        require Logger
+
+        Logger.warning(
+          "No handle_events/2 clause in #{__MODULE__} provided for #{
+            inspect(events)
+          }"
+        )
+
+        state
+      end
+
+      @impl true
+      def handle_connection(event, state) do
+        require Logger
+
+        Logger.warning(
+          "No handle_connection/2 clause in #{__MODULE__} provided for #{
+            inspect(event)
+          }"
+        )
+
+        state
+      end
+
+      @impl true
+      def handle_client_state(client_state, state) do
+        require Logger
+
+        Logger.warning(
+          "No handle_client_state/2 clause in #{__MODULE__} provided for #{
+            inspect(client_state)
+          }"
+        )
+
+        state
+      end
+
       @impl true
       def configuration(_user_init_state), do: []
 
@@ -282,8 +461,13 @@ defmodule OpcUA.Client do
                      monitored_items: 1,
                      handle_subscription_timeout: 2,
                      handle_deleted_subscription: 2,
+                     handle_subscription_gap: 3,
                      handle_monitored_data: 2,
-                     handle_deleted_monitored_item: 3
+                     handle_deleted_monitored_item: 3,
+                     handle_polled_data: 2,
+                     handle_events: 2,
+                     handle_connection: 2,
+                     handle_client_state: 2
     end
   end
 
@@ -291,6 +475,10 @@ defmodule OpcUA.Client do
 
   @doc """
     Starts up a OPC UA Client GenServer.
+    The following options are supported:
+    * `:tag_table` -> atom(). Name of an `OpcUA.TagTable` to populate with monitored items notifications.
+    * `:host` -> GenServer.server(). `OpcUA.ClientHost` whose port runs this client as one of its sessions,
+      instead of a port of its own.
   """
   @spec start_link(term(), list()) :: {:ok, pid} | {:error, term} | {:error, :einval}
   def start_link(args \\ [], opts \\ []) do
@@ -408,6 +596,56 @@ defmodule OpcUA.Client do
     GenServer.call(pid, {:conn, {:disconnect, nil}})
   end
 
+  @doc """
+    Starts connecting the OPC UA Client by a url and returns once the attempt started, the
+    outcome is sent to the controlling process as `{:connection, event}` messages:
+    * `{:connecting, attempt}` -> an attempt started.
+    * `{:connected, outage_ms}` -> the session is activated, `outage_ms` is the time it was down
+      (0 on the first connection).
+    * `{:failed, status}` -> the attempt failed and the reconnection is disabled.
+    * `{:backoff, delay_ms}` -> the attempt failed, the next one starts after `delay_ms`.
+    * `{:disconnected, status}` -> the connection dropped (only with the reconnection enabled).
+    * `{:recovered, {previous_subscription_id, subscription_id | status, [{previous_monitored_id, monitored_id | status}]}}`
+      -> a subscription restored after an outage. Transferred subscriptions keep their ids (and
+      report no monitored items), recreated ones report the new id of every monitored item.
+    The following must be filled:
+    * `:url` -> binary().
+  """
+  @spec connect_async(GenServer.server(), list()) :: :ok | {:error, term} | {:error, :einval}
+  def connect_async(pid, args) when is_list(args) do
+    GenServer.call(pid, {:conn, {:async, args}})
+  end
+
+  @doc """
+    Keeps the OPC UA Client connected: when its connection drops (or an attempt of `connect_async/2`
+    fails) it reconnects to the same url with an exponential backoff with jitter, and its
+    subscriptions and monitored items are transferred to the new session, or recreated if the
+    server lost them. The progress is reported as in `connect_async/2`. `disconnect/1` and `reset/1`
+    stop reconnecting. The client reconnects with the identity of its last connection (the user of
+    `connect_by_username/2`), and the cached data types and browse paths are dropped.
+    The following options are supported:
+    * `:enabled` -> boolean(). Defaults to true.
+    * `:min_backoff` -> integer(). Delay (ms) before the second attempt, doubled with every failure. Defaults to 500.
+    * `:max_backoff` -> integer(). Maximum delay (ms) between attempts. Defaults to 30000.
+  """
+  @spec set_reconnect(GenServer.server(), list()) :: :ok | {:error, term} | {:error, :einval}
+  def set_reconnect(pid, opts \\ []) when is_list(opts) do
+    GenServer.call(pid, {:conn, {:reconnect, opts}})
+  end
+
+  @doc """
+    Enables or disables the state notifications of the OPC UA Client: every change of its state is
+    sent to the controlling process as `{:state, channel_state, session_state, status}`, starting
+    with the current state, so it doesn't have to be polled with `get_state/1`.
+    * `channel_state` -> `:closed`, `:connecting`, `:open` or `:closing`.
+    * `session_state` -> `:closed`, `:create_requested`, `:created`, `:activate_requested`, `:activated` or `:closing`.
+    * `status` -> binary(). Connection status, e.g. "Good" or "BadConnectionClosed".
+  """
+  @spec set_state_notifications(GenServer.server(), boolean()) :: :ok | {:error, term} | {:error, :einval}
+  def set_state_notifications(pid, enabled) when is_boolean(enabled) do
+    GenServer.call(pid, {:conn, {:state_notifications, enabled}})
+  end
+
   # Discovery functions
 
   @doc """
@@ -461,6 +699,27 @@ defmodule OpcUA.Client do
     GenServer.call(pid, {:subscription, {:delete, subscription_id}})
   end
 
+  @doc """
+    Gets the delivery counters of the subscriptions of the OPC UA Client:
+    * `:gaps` -> recoveries (see `set_reconnect/2`) that found notification messages that were
+      not received.
+    * `:republished` -> messages recovered with the Republish service, their notifications are
+      delivered as usual. Retained messages that were received before the outage (recognized by
+      their notifications) are skipped.
+    * `:lost` -> messages not received and no longer retained by the server, also sent to the
+      controlling process as `{:gap, subscription_id, [sequence_number]}`. The messages discarded
+      before the first retained one are only known while nothing was received since the
+      subscription was created or last recovered: the port does not see the sequence numbers of the
+      messages it receives.
+    * `:late` -> data changes received more than twice the publishing interval after their server
+      timestamp.
+    * `:max_lateness` -> the largest of those delays (ms).
+  """
+  @spec get_subscription_stats(GenServer.server()) :: {:ok, list()} | {:error, term} | {:error, :einval}
+  def get_subscription_stats(pid) do
+    GenServer.call(pid, {:subscription, {:stats, nil}})
+  end
+
   @doc """
     Adds a monitored item used to request a server for notifications of each change of value in a specific node.
     The following option must be filled:
@@ -485,6 +744,324 @@ defmodule OpcUA.Client do
     GenServer.call(pid, {:subscription, {:delete_monitored_item, args}})
   end
 
+  @doc """
+    Adds a monitored item for the events emitted by a node. The server filters the events with
+    the where clause and only notifies the selected fields; the events of every publish response
+    are sent to the controlling process as a single `{:events, [{subscription_id, monitored_item_id, fields}]}`
+    message, `fields` being the selected values in `:select` order (`nil` for missing fields).
+    Deleted with `delete_monitored_item/2`.
+
+    The following options can be filled:
+    * `:subscription_id` -> integer() (required).
+    * `:select` -> list of event fields (required). A field is a browse path relative to
+      BaseEventType (e.g. `"Message"`, `"0:EnabledState/0:Id"`), `{type_definition_id, path}` or
+      `{type_definition_id, path, attribute_id}` (e.g. `{condition_type_id, "", 1}` for the ConditionId).
+    * `:where` -> filter expression (default none):
+      - `{:and | :or, expression, expression}`, `{:not, expression}`, `{:of_type, %NodeId{}}`,
+      - `{:eq | :gt | :lt | :gte | :lte | :like | :bitwise_and | :bitwise_or, operand, operand}`,
+      - `{:is_null, operand}`, `{:between, operand, low, high}`, `{:in_list, operand, [operand]}`,
+      where an operand is an expression, an event field `{:field, field}` or a literal `{data_type, value}`.
+    * `:monitored_item` -> %NodeId{} emitting the events (default the Server object).
+    * `:sampling_time` -> float() (default 0.0).
+    * `:queue_size` -> integer(), events queued in the server between publish responses (default 100).
+
+        Client.add_event_monitored_item(pid,
+          subscription_id: subscription_id,
+          select: ["EventId", "SourceName", "Message", "Severity"],
+          where: {:and, {:of_type, alarm_type_id}, {:gte, {:field, "Severity"}, {4, 500}}}
+        )
+  """
+  @spec add_event_monitored_item(GenServer.server(), list()) ::
+          {:ok, integer()} | {:error, term} | {:error, :einval}
+  def add_event_monitored_item(pid, args) when is_list(args) do
+    GenServer.call(pid, {:subscription, {:event_monitored_item, args}})
+  end
+
+  # Last Value Cache functions.
+
+  @doc """
+    Enables (or disables) the last value cache. While enabled, the client port keeps the
+    last value notified for every monitored item, so `read_cached/2` and `read_cached_many/2`
+    answer from memory without any OPC UA traffic. Disabling it drops the cached values.
+  """
+  @spec set_value_cache(GenServer.server(), boolean()) :: :ok | {:error, term} | {:error, :einval}
+  def set_value_cache(pid, enabled) when is_boolean(enabled) do
+    GenServer.call(pid, {:cache, {:set, enabled}})
+  end
+
+  @doc """
+    Reads the last notified value of a monitored node from the last value cache.
+    Returns `{:ok, %{value: term(), server_timestamp: integer(), age: integer()}}`, where
+    `server_timestamp` is the OPC UA DateTime of the notification (0 if unknown) and `age`
+    is the time in milliseconds since it was received.
+    Returns `{:error, :not_cached}` for nodes without a monitored item (or a first notification).
+  """
+  @spec read_cached(GenServer.server(), %NodeId{}) ::
+          {:ok, map()} | {:error, binary()} | {:error, :not_cached} | {:error, :einval}
+  def read_cached(pid, %NodeId{} = node_id) do
+    GenServer.call(pid, {:cache, {:read, node_id}})
+  end
+
+  @doc """
+    Reads the last notified values of many monitored nodes (1 to 1000) from the last value cache.
+    Returns {:ok, [{:ok, map()} | {:error, reason}]} or {:error, reason}, see `read_cached/2`.
+  """
+  @spec read_cached_many(GenServer.server(), [%NodeId{}]) ::
+          {:ok, list()} | {:error, binary() | atom()}
+  def read_cached_many(pid, node_ids) when is_list(node_ids) do
+    GenServer.call(pid, {:cache, {:read_many, node_ids}})
+  end
+
+  # Browse functions.
+
+  @doc """
+    Browses the references of many nodes (1 to 1000) in a single request.
+    The following options can be filled:
+    * `:direction` -> `:forward` (default), `:inverse` or `:both`.
+    * `:reference_type` -> %NodeId{} of the references to follow (default HierarchicalReferences, i=33).
+    * `:include_subtypes` -> boolean() (default true).
+    * `:node_classes` -> list of node classes to return (`:object`, `:variable`, `:method`, `:object_type`,
+      `:variable_type`, `:reference_type`, `:data_type`, `:view`), default `[]` (all).
+    * `:result_fields` -> fields of every reference besides its `:node_id` (`:reference_type`, `:is_forward`,
+      `:node_class`, `:browse_name`, `:display_name`, `:type_definition`), default all. Requesting only
+      what is needed shrinks both the OPC UA responses and the port frames.
+    * `:max_references` -> integer(), references per node and response (default 0, the server limit).
+    * `:follow` -> boolean(), follows continuation points in the port until every node is complete,
+      requesting all the pending nodes in a single BrowseNext per round trip (default true).
+
+    References are streamed from the port as they arrive.
+    Returns {:ok, [{:ok, %{references: [map()], continuation_point: binary() | nil}} | {:error, reason}]}
+    (in the order of `node_ids`) or {:error, reason}.
+  """
+  @spec browse(GenServer.server(), [%NodeId{}], keyword()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def browse(pid, node_ids, opts \\ []) when is_list(node_ids) and is_list(opts) do
+    if(@mix_env != :test) do
+      GenServer.call(pid, {:browse, {:browse, node_ids, opts}})
+    else
+      # Valgrind
+      GenServer.call(pid, {:browse, {:browse, node_ids, opts}}, :infinity)
+    end
+  end
+
+  @doc """
+    Continues the results of `browse/3` (with `follow: false`) from their continuation points (1 to 1000).
+    The following options can be filled:
+    * `:release` -> boolean(), releases the continuation points instead (default false).
+    * `:result_fields` -> must match the ones of the `browse/3` call (default all).
+    * `:follow` -> boolean() (default false).
+
+    Returns the same as `browse/3`, in the order of `continuation_points` (an empty list when released).
+  """
+  @spec browse_next(GenServer.server(), [binary()], keyword()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def browse_next(pid, continuation_points, opts \\ [])
+      when is_list(continuation_points) and is_list(opts) do
+    if(@mix_env != :test) do
+      GenServer.call(pid, {:browse, {:browse_next, continuation_points, opts}})
+    else
+      # Valgrind
+      GenServer.call(pid, {:browse, {:browse_next, continuation_points, opts}}, :infinity)
+    end
+  end
+
+  # Browse Path Resolution functions.
+
+  @doc """
+    Resolves browse paths to NodeIds (following HierarchicalReferences) in a single
+    TranslateBrowsePathsToNodeIds request, split in chunks of the server limit when needed.
+    Resolved paths are cached in the client port, so repeated resolutions do not reach the server.
+    The cache is dropped on connect, disconnect and reset, and when the server NamespaceArray changes
+    (it is read along with every resolution that misses the cache, and before answering from the
+    cache when it was last read more than a second ago).
+
+    Every path (1 to 1000) is one of:
+    * binary() -> browse names separated by "/", from the Root folder (or `:start_node`),
+      e.g. `"0:Objects/2:Line1/2:Press/2:Temp"`. Names without a "ns:" prefix use `:ns_index`.
+    * `{%NodeId{}, binary()}` -> the same, from the given node.
+    * `{%NodeId{}, [%QualifiedName{} | binary()]}` -> browse names from the given node.
+
+    The following options can be filled:
+    * `:start_node` -> %NodeId{} where binary paths start (default Root, i=84).
+    * `:ns_index` -> namespace of the browse names without prefix (default 0).
+    * `:cached` -> boolean(), false resolves every path in the server and refreshes the cache (default true).
+
+    Returns {:ok, [{:ok, %NodeId{}} | {:error, reason}]} (in the order of `paths`) or {:error, reason}.
+  """
+  @spec translate_browse_paths(GenServer.server(), list(), keyword()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def translate_browse_paths(pid, paths, opts \\ []) when is_list(paths) and is_list(opts) do
+    GenServer.call(pid, {:browse_path, {:translate, paths, opts}})
+  end
+
+  # Method Call functions.
+
+  @doc """
+    Calls several methods in the server with a single Call request (split in smaller requests when
+    the server answers BadTooManyOperations).
+
+    Every call (1 to 1000) is a `{object_id, method_id, input_arguments}` tuple, where `object_id` and
+    `method_id` are %NodeId{} and every input argument is a `{data_type, value}` tuple (as in
+    `write_node_value/4`); a list `value` is sent as an array of `data_type`.
+    Only builtin data types are supported for input arguments.
+
+    The following options can be filled:
+    * `:timeout` -> timeout of the call (default 5_000).
+
+    Returns {:ok, [{:ok, output_arguments} | {:error, reason}]} (in the order of `calls`) or {:error, reason}.
+    When a split request fails after others went through, the calls that ran keep their results and
+    the failed ones get the status of that request.
+  """
+  @spec call_methods(GenServer.server(), list(), keyword()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def call_methods(pid, calls, opts \\ []) when is_list(calls) and is_list(opts) do
+    if(@mix_env != :test) do
+      GenServer.call(pid, {:call_methods, calls}, Keyword.get(opts, :timeout, 5_000))
+    else
+      # Valgrind
+      GenServer.call(pid, {:call_methods, calls}, :infinity)
+    end
+  end
+
+  # History Read functions.
+
+  @doc """
+    Reads the raw (or modified) history of many nodes in a single HistoryRead request. Continuation
+    points are followed in the port (one HistoryRead for all the pending nodes per round trip) and the
+    values are streamed back in multiple frames.
+
+    The following options can be filled:
+    * `:start_time` -> %DateTime{} or OPC UA DateTime (integer, 100 ns since 1601) (default 0).
+    * `:end_time` -> %DateTime{} or OPC UA DateTime (default 0). At least one of both times is required.
+    * `:num_values` -> integer(), values per node and request, 0 for the server limit (default 0).
+    * `:return_bounds` -> boolean() (default false).
+    * `:modified` -> boolean(), reads modified values instead of raw values (modification infos
+      are not returned) (default false).
+    * `:timeout` -> timeout of the call (default 60_000).
+
+    Returns {:ok, [{:ok, history} | {:error, reason}]} (in the order of `node_ids`) or {:error, reason}.
+    Every `history` is a map with parallel arrays:
+    * `:timestamps` -> binary of native signed 64 bit OPC UA DateTimes (source timestamps).
+    * `:data_type` -> the data type of the values when they are packed, `nil` otherwise.
+    * `:values` -> binary of native `:data_type` values (e.g. `float-64` for Double, 8 bit for
+      Boolean) or a list of values when the node has no single numeric data type.
+    * `:statuses` -> binary of native unsigned 32 bit status codes, `nil` when every value is Good.
+
+        for <<timestamp::signed-64-native <- history.timestamps>>, do: timestamp
+        for <<value::float-64-native <- history.values>>, do: value
+  """
+  @spec history_read_raw(GenServer.server(), [%NodeId{}], keyword()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def history_read_raw(pid, node_ids, opts \\ []) when is_list(node_ids) and is_list(opts) do
+    if(@mix_env != :test) do
+      GenServer.call(pid, {:history_read, {:raw, node_ids, opts}}, Keyword.get(opts, :timeout, 60_000))
+    else
+      # Valgrind
+      GenServer.call(pid, {:history_read, {:raw, node_ids, opts}}, :infinity)
+    end
+  end
+
+  # Address Space Crawler functions.
+
+  @doc """
+    Crawls the address space below `root` (forward HierarchicalReferences and subtypes) in the port:
+    every level is browsed with batched Browse requests, several of them in flight, and the
+    DataType, ValueRank, ArrayDimensions and AccessLevel of variables are read the same way.
+
+    The following options can be filled:
+    * `:cache_path` -> binary(), file where the result is cached (default `nil`, no cache). The cache
+      is keyed by the server NamespaceArray, `root` and the `:model_version` value; when they match,
+      the nodes are loaded from the file without crawling.
+    * `:model_version` -> %NodeId{} of a server variable that changes with the information model
+      (default `nil`).
+    * `:validate` -> boolean(), crawls the hierarchy again even if the cache matches, reading metadata
+      only for the nodes that are not in the cache (default false). Added and removed nodes are
+      found, but a cached node keeps its metadata: a changed DataType, ValueRank, ArrayDimensions or
+      AccessLevel of an existing node is only seen with a new `:model_version` value or without cache.
+    * `:max_depth` -> integer(), levels below `root` (default 0, unlimited).
+    * `:max_nodes` -> integer(), 1 to 1_000_000 (default 100_000). Truncated crawls are not cached.
+    * `:timeout` -> timeout of the call (default 60_000).
+
+    Returns {:ok, %{source: :cache | :validated | :crawled, truncated: boolean(), nodes: [map()]}}
+    or {:error, reason}, where every node is a map with `:node_id`, `:parent` (%NodeId{}, `nil` for the
+    root), `:node_class`, `:browse_name`, `:data_type`, `:value_rank`, `:array_dimensions` and
+    `:access_level`, ordered by level. `truncated` is true when `:max_nodes` stopped the crawl or the
+    children of some node are missing because its Browse (or BrowseNext) failed.
+  """
+  @spec crawl(GenServer.server(), %NodeId{}, keyword()) ::
+          {:ok, map()} | {:error, binary()} | {:error, :einval}
+  def crawl(pid, %NodeId{} = root, opts \\ []) when is_list(opts) do
+    if(@mix_env != :test) do
+      GenServer.call(pid, {:crawl, {root, opts}}, Keyword.get(opts, :timeout, 60_000))
+    else
+      # Valgrind
+      GenServer.call(pid, {:crawl, {root, opts}}, :infinity)
+    end
+  end
+
+  # Polling Engine functions.
+
+  @doc """
+    Registers a poll group, a fixed set of nodes that the client port reads at a fixed rate,
+    for servers with poor (or no) subscription support.
+    Every cycle is a single Read request, the first one is delayed by a random offset within
+    the interval so groups do not hit the server at the same time. Only the values that changed
+    since the previous report are sent to the controlling process as
+    `{:poll, group_id, [{%NodeId{}, {:ok, value} | {:error, reason}}]}`.
+    Cycles are skipped while there is no active session or the previous Read is still pending.
+
+    Input: list of %NodeId{} (1 to 1000 nodes), and the following options:
+    * `:interval` -> float(), milliseconds between cycles (at least 10.0, default 1000.0).
+    * `:deadband` -> float(), absolute change that numeric values must exceed to be reported
+      (default 0.0, any change).
+
+    Returns {:ok, group_id} or {:error, reason}.
+  """
+  @spec add_poll_group(GenServer.server(), [%NodeId{}], keyword()) ::
+          {:ok, integer()} | {:error, term} | {:error, :einval}
+  def add_poll_group(pid, node_ids, opts \\ []) when is_list(node_ids) and is_list(opts) do
+    GenServer.call(pid, {:poll, {:add, node_ids, opts}})
+  end
+
+  @doc """
+    Deletes a poll group.
+  """
+  @spec delete_poll_group(GenServer.server(), integer()) :: :ok | {:error, term} | {:error, :einval}
+  def delete_poll_group(pid, group_id) when is_integer(group_id) do
+    GenServer.call(pid, {:poll, {:delete, group_id}})
+  end
+
+  # Custom Data Types functions.
+
+  @doc """
+    Discovers server-defined data types (structures and enumerations) through their
+    DataTypeDefinition attribute and caches them for the rest of the session, so their values
+    are read as maps of `field_name => value`.
+    Unknown types are also discovered on the first read that returns them, this function
+    only moves that cost ahead of time. The cache is dropped on connect, disconnect and reset,
+    and when the server NamespaceArray changes.
+    Input: list of data type %NodeId{} (1 to 100 types).
+    Returns {:ok, [:ok | {:error, reason}]} or {:error, reason}.
+  """
+  @spec load_data_types(GenServer.server(), [%NodeId{}]) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def load_data_types(pid, data_type_ids) when is_list(data_type_ids) do
+    if(@mix_env != :test) do
+      GenServer.call(pid, {:data_types, {:load, data_type_ids}})
+    else
+      # Valgrind
+      GenServer.call(pid, {:data_types, {:load, data_type_ids}}, :infinity)
+    end
+  end
+
+  @doc """
+    Drops every cached data type (e.g. after the server information model changed).
+  """
+  @spec clear_data_types(GenServer.server()) :: :ok | {:error, term} | {:error, :einval}
+  def clear_data_types(pid) do
+    GenServer.call(pid, {:data_types, {:clear, nil}})
+  end
+
   # Read nodes Attributes
 
   @doc """
@@ -600,19 +1177,33 @@ defmodule OpcUA.Client do
   end
 
   # Handlers
-  def init({_args, controlling_process}) do
-    lib_dir =
-      :opex62541
-      |> :code.priv_dir()
-      |> to_string()
-      |> set_ld_library_path()
+  def init({args, controlling_process}) do
+    tag_table = if is_list(args), do: args |> Keyword.get(:tag_table) |> TagTable.new()
+    state = %State{controlling_process: controlling_process, tag_table: tag_table}
+    host = if is_list(args), do: Keyword.get(args, :host)
 
-    executable = lib_dir <> "/opc_ua_client"
+    if is_nil(host) do
+      lib_dir =
+        :opex62541
+        |> :code.priv_dir()
+        |> to_string()
+        |> set_ld_library_path()
 
-    port = open_port(executable, use_valgrind?())
+      executable = lib_dir <> "/opc_ua_client"
 
-    state = %State{port: port, controlling_process: controlling_process}
-    {:ok, state}
+      port = open_port(executable, use_valgrind?())
+
+      {:ok, %{state | port: port}}
+    else
+      case OpcUA.ClientHost.open_session(host) do
+        {:ok, {host_pid, port, session_id}} ->
+          Process.monitor(host_pid)
+          {:ok, %{state | port: port, session: {host_pid, session_id}}}
+
+        error ->
+          {:stop, error}
+      end
+    end
   end
 
   # Lifecycle Handlers
@@ -695,6 +1286,30 @@ defmodule OpcUA.Client do
     {:noreply, state}
   end
 
+  def handle_call({:conn, {:async, args}}, caller_info, state) do
+    url = Keyword.fetch!(args, :url)
+    call_port(state, :connect_client_async, caller_info, url)
+    {:noreply, state}
+  end
+
+  def handle_call({:conn, {:state_notifications, enabled}}, caller_info, state) do
+    call_port(state, :set_state_notifications, caller_info, enabled)
+    {:noreply, state}
+  end
+
+  def handle_call({:conn, {:reconnect, opts}}, caller_info, state) do
+    with enabled when is_boolean(enabled) <- Keyword.get(opts, :enabled, true),
+         min_backoff when is_integer(min_backoff) and min_backoff > 0 <- Keyword.get(opts, :min_backoff, 500),
+         max_backoff when is_integer(max_backoff) and max_backoff >= min_backoff <-
+           Keyword.get(opts, :max_backoff, 30000) do
+      call_port(state, :set_reconnect, caller_info, {enabled, min_backoff, max_backoff})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
   # Discovery Handlers.
 
   def handle_call({:discovery, {:find_servers_on_network, url}}, caller_info, state) do
@@ -724,6 +1339,11 @@ defmodule OpcUA.Client do
     {:noreply, state}
   end
 
+  def handle_call({:subscription, {:stats, nil}}, caller_info, state) do
+    call_port(state, :get_subscription_stats, caller_info, nil)
+    {:noreply, state}
+  end
+
   def handle_call({:subscription, {:monitored_item, args}}, caller_info, state) do
     with monitored_item <- Keyword.fetch!(args, :monitored_item) |> to_c(),
          subscription_id <- Keyword.fetch!(args, :subscription_id),
@@ -732,6 +1352,24 @@ defmodule OpcUA.Client do
          true <- is_float(sampling_time) do
       c_args = {monitored_item, subscription_id, sampling_time}
       call_port(state, :add_monitored_item, caller_info, c_args)
+      {:noreply, track_monitored_item(state, caller_info, subscription_id, Keyword.fetch!(args, :monitored_item))}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:subscription, {:event_monitored_item, args}}, caller_info, state) do
+    with subscription_id <- Keyword.get(args, :subscription_id),
+         %NodeId{} = node_id <- Keyword.get(args, :monitored_item, server_object()),
+         sampling_time <- Keyword.get(args, :sampling_time, 0.0),
+         queue_size <- Keyword.get(args, :queue_size, 100),
+         true <- is_integer(subscription_id) and is_float(sampling_time),
+         true <- is_integer(queue_size) and queue_size >= 0,
+         {:ok, c_select} <- event_select_to_c(Keyword.get(args, :select)),
+         {:ok, c_where} <- event_where_to_c(Keyword.get(args, :where)) do
+      c_args = {to_c(node_id), subscription_id, sampling_time, queue_size, c_select, c_where}
+      call_port(state, :add_event_monitored_item, caller_info, c_args)
       {:noreply, state}
     else
       _ ->
@@ -753,35 +1391,191 @@ defmodule OpcUA.Client do
     end
   end
 
-  # Write nodes Attributes
+  # Last Value Cache Handlers
 
-  def handle_call({:read, {:user_write_mask, node_id}}, caller_info, state) do
-    c_args = to_c(node_id)
-    call_port(state, :read_node_user_write_mask, caller_info, c_args)
+  def handle_call({:cache, {:set, enabled}}, caller_info, state) do
+    call_port(state, :set_value_cache, caller_info, enabled)
     {:noreply, state}
   end
 
-  def handle_call({:read, {:user_access_level, node_id}}, caller_info, state) do
+  def handle_call({:cache, {:read, node_id}}, caller_info, state) do
     c_args = to_c(node_id)
-    call_port(state, :read_node_user_access_level, caller_info, c_args)
+    call_port(state, :read_cached, caller_info, c_args)
     {:noreply, state}
   end
 
-  def handle_call({:read, {:user_executable, node_id}}, caller_info, state) do
-    c_args = to_c(node_id)
-    call_port(state, :read_node_user_executable, caller_info, c_args)
+  def handle_call({:cache, {:read_many, node_ids}}, caller_info, state) do
+    c_args = Enum.map(node_ids, &to_c/1)
+    call_port(state, :read_cached_many, caller_info, c_args)
     {:noreply, state}
   end
 
-  # Write nodes Attributes
-
-  def handle_call({:write, {:node_id, node_id, new_node_id}}, caller_info, state) do
-    c_args = {to_c(node_id), to_c(new_node_id)}
-    call_port(state, :write_node_node_id, caller_info, c_args)
-    {:noreply, state}
+  # Browse Handlers
+
+  def handle_call({:browse, {:browse, node_ids, opts}}, caller_info, state) do
+    with {:ok, direction} <- Map.fetch(@browse_directions, Keyword.get(opts, :direction, :forward)),
+         %NodeId{} = reference_type <-
+           Keyword.get(opts, :reference_type, NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 33)),
+         include_subtypes when is_boolean(include_subtypes) <- Keyword.get(opts, :include_subtypes, true),
+         {:ok, node_class_mask} <- node_class_mask(Keyword.get(opts, :node_classes, [])),
+         {:ok, fields, result_mask} <- browse_result_mask(opts),
+         max_references when is_integer(max_references) and max_references >= 0 <-
+           Keyword.get(opts, :max_references, 0),
+         follow when is_boolean(follow) <- Keyword.get(opts, :follow, true) do
+      c_args =
+        {Enum.map(node_ids, &to_c/1), direction, to_c(reference_type), include_subtypes,
+         node_class_mask, result_mask, max_references, follow}
+
+      call_port(state, :browse, caller_info, c_args)
+      {:noreply, %{state | browse_parts: Map.put(state.browse_parts, caller_info, {fields, []})}}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
   end
 
-  def handle_call({:write, {:node_class, node_id, node_class}}, caller_info, state) do
+  def handle_call({:browse, {:browse_next, continuation_points, opts}}, caller_info, state) do
+    with true <- Enum.all?(continuation_points, &is_binary/1),
+         release when is_boolean(release) <- Keyword.get(opts, :release, false),
+         {:ok, fields, result_mask} <- browse_result_mask(opts),
+         follow when is_boolean(follow) <- Keyword.get(opts, :follow, false) do
+      c_args = {continuation_points, release, result_mask, follow}
+      call_port(state, :browse_next, caller_info, c_args)
+      {:noreply, %{state | browse_parts: Map.put(state.browse_parts, caller_info, {fields, []})}}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # Browse Path Resolution Handlers
+
+  def handle_call({:browse_path, {:translate, paths, opts}}, caller_info, state) do
+    with %NodeId{} = start_node <-
+           Keyword.get(opts, :start_node, NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 84)),
+         ns_index when ns_index in 0..65_535 <- Keyword.get(opts, :ns_index, 0),
+         cached when is_boolean(cached) <- Keyword.get(opts, :cached, true),
+         {:ok, c_paths} <- browse_paths_to_c(paths, start_node, ns_index) do
+      call_port(state, :translate_browse_paths, caller_info, {c_paths, cached})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # Method Call Handlers
+
+  def handle_call({:call_methods, calls}, caller_info, state) do
+    case method_calls_to_c(calls) do
+      {:ok, c_calls} ->
+        call_port(state, :call_methods, caller_info, c_calls)
+        {:noreply, state}
+
+      :error ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # History Read Handlers
+
+  def handle_call({:history_read, {:raw, node_ids, opts}}, caller_info, state) do
+    with true <- node_ids != [] and Enum.all?(node_ids, &match?(%NodeId{}, &1)),
+         {:ok, start_time} <- opc_ua_date_time(Keyword.get(opts, :start_time, 0)),
+         {:ok, end_time} <- opc_ua_date_time(Keyword.get(opts, :end_time, 0)),
+         true <- start_time != 0 or end_time != 0,
+         num_values when is_integer(num_values) and num_values >= 0 <- Keyword.get(opts, :num_values, 0),
+         return_bounds when is_boolean(return_bounds) <- Keyword.get(opts, :return_bounds, false),
+         modified when is_boolean(modified) <- Keyword.get(opts, :modified, false) do
+      c_args = {Enum.map(node_ids, &to_c/1), start_time, end_time, num_values, return_bounds, modified}
+      call_port(state, :history_read_raw, caller_info, c_args)
+      {:noreply, %{state | browse_parts: Map.put(state.browse_parts, caller_info, {[], []})}}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # Address Space Crawler Handlers
+
+  def handle_call({:crawl, {root, opts}}, caller_info, state) do
+    with cache_path when is_binary(cache_path) <- Keyword.get(opts, :cache_path) || "",
+         %NodeId{} = model_version <-
+           Keyword.get(opts, :model_version) ||
+             NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 0),
+         validate when is_boolean(validate) <- Keyword.get(opts, :validate, false),
+         max_depth when is_integer(max_depth) and max_depth >= 0 <- Keyword.get(opts, :max_depth, 0),
+         max_nodes when is_integer(max_nodes) and max_nodes > 0 <- Keyword.get(opts, :max_nodes, 100_000) do
+      c_args = {to_c(root), cache_path, to_c(model_version), validate, max_depth, max_nodes}
+      call_port(state, :crawl, caller_info, c_args)
+      {:noreply, %{state | browse_parts: Map.put(state.browse_parts, caller_info, {[], []})}}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # Polling Engine Handlers
+
+  def handle_call({:poll, {:add, node_ids, opts}}, caller_info, state) do
+    with interval when is_number(interval) <- Keyword.get(opts, :interval, 1000.0),
+         deadband when is_number(deadband) <- Keyword.get(opts, :deadband, 0.0) do
+      c_args = {interval / 1, deadband / 1, Enum.map(node_ids, &to_c/1)}
+      call_port(state, :add_poll_group, caller_info, c_args)
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:poll, {:delete, group_id}}, caller_info, state) do
+    call_port(state, :delete_poll_group, caller_info, group_id)
+    {:noreply, state}
+  end
+
+  # Custom Data Types Handlers
+
+  def handle_call({:data_types, {:load, data_type_ids}}, caller_info, state) do
+    c_args = Enum.map(data_type_ids, &to_c/1)
+    call_port(state, :load_data_types, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  def handle_call({:data_types, {:clear, nil}}, caller_info, state) do
+    call_port(state, :clear_data_types, caller_info, nil)
+    {:noreply, state}
+  end
+
+  # Write nodes Attributes
+
+  def handle_call({:read, {:user_write_mask, node_id}}, caller_info, state) do
+    c_args = to_c(node_id)
+    call_port(state, :read_node_user_write_mask, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  def handle_call({:read, {:user_access_level, node_id}}, caller_info, state) do
+    c_args = to_c(node_id)
+    call_port(state, :read_node_user_access_level, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  def handle_call({:read, {:user_executable, node_id}}, caller_info, state) do
+    c_args = to_c(node_id)
+    call_port(state, :read_node_user_executable, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  # Write nodes Attributes
+
+  def handle_call({:write, {:node_id, node_id, new_node_id}}, caller_info, state) do
+    c_args = {to_c(node_id), to_c(new_node_id)}
+    call_port(state, :write_node_node_id, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  def handle_call({:write, {:node_class, node_id, node_class}}, caller_info, state) do
     c_args = {to_c(node_id), node_class}
     call_port(state, :write_node_node_class, caller_info, c_args)
     {:noreply, state}
@@ -826,6 +1620,7 @@ defmodule OpcUA.Client do
 
   def handle_info({_port, {:exit_status, code}}, state) do
     Logger.warning("(#{__MODULE__}) Error code: #{inspect(code)}.")
+    command_spans_fail({:exit_status, code})
     # retrying delay
     Process.sleep(@c_timeout)
     {:stop, :restart, state}
@@ -833,11 +1628,18 @@ defmodule OpcUA.Client do
 
   def handle_info({:EXIT, _port, reason}, state) do
     Logger.debug("(#{__MODULE__}) Exit reason: #{inspect(reason)}")
+    command_spans_fail(reason)
     # retrying delay
     Process.sleep(@c_timeout)
     {:stop, :restart, state}
   end
 
+  def handle_info({:DOWN, _ref, :process, host, reason}, %{session: {host, _session_id}} = state) do
+    Logger.debug("(#{__MODULE__}) Client host exit reason: #{inspect(reason)}")
+    command_spans_fail(reason)
+    {:stop, :restart, state}
+  end
+
   def handle_info(msg, state) do
     Logger.warning("(#{__MODULE__}) Unhandled message: #{inspect(msg)}.")
     {:noreply, state}
@@ -850,10 +1652,49 @@ defmodule OpcUA.Client do
          %{controlling_process: c_pid} = state
        ) do
     value = parse_c_value(c_value)
+
+    case Map.fetch(state.monitored_nodes, {subscription_id, monitored_id}) do
+      {:ok, node_id} -> TagTable.put(state.tag_table, node_id, value)
+      :error -> nil
+    end
+
     send(c_pid, {:data, subscription_id, monitored_id, value})
     state
   end
 
+  defp handle_c_response(
+         {:subscription, {:delete, subscription_id, monitored_id} = message},
+         %{controlling_process: c_pid} = state
+       ) do
+    send(c_pid, message)
+    untrack_monitored_items(state, fn {sub_id, mon_id} -> sub_id == subscription_id and mon_id == monitored_id end)
+  end
+
+  defp handle_c_response(
+         {:subscription, {:delete, subscription_id} = message},
+         %{controlling_process: c_pid} = state
+       ) do
+    send(c_pid, message)
+    untrack_monitored_items(state, fn {sub_id, _mon_id} -> sub_id == subscription_id end)
+  end
+
+  defp handle_c_response(
+         {:subscription, {:events, c_events}},
+         %{controlling_process: c_pid} = state
+       ) do
+    events =
+      Enum.map(c_events, fn
+        {subscription_id, monitored_id, fields} when is_list(fields) ->
+          {subscription_id, monitored_id, Enum.map(fields, &parse_c_value/1)}
+
+        event ->
+          event
+      end)
+
+    send(c_pid, {:events, events})
+    state
+  end
+
   defp handle_c_response(
          {:subscription, message},
          %{controlling_process: c_pid} = state
@@ -862,6 +1703,118 @@ defmodule OpcUA.Client do
     state
   end
 
+  # Connection C message handlers
+
+  defp handle_c_response(
+         {:connection, {:recovered, {subscription_id, new_subscription_id, monitored_ids}}} = message,
+         %{controlling_process: c_pid} = state
+       ) do
+    send(c_pid, message)
+    remap_monitored_items(state, subscription_id, new_subscription_id, monitored_ids)
+  end
+
+  defp handle_c_response({:connection, _event} = message, %{controlling_process: c_pid} = state) do
+    send(c_pid, message)
+    state
+  end
+
+  defp handle_c_response(
+         {:state, _channel_state, _session_state, _status} = message,
+         %{controlling_process: c_pid} = state
+       ) do
+    send(c_pid, message)
+    state
+  end
+
+  # Browse C Handlers
+
+  defp handle_c_response({browse, caller_metadata, {:partial, references}}, state)
+       when browse in [:browse, :browse_next, :crawl, :history_read_raw] do
+    browse_parts =
+      Map.update(state.browse_parts, caller_metadata, {[], [references]}, fn {fields, parts} ->
+        {fields, [references | parts]}
+      end)
+
+    %{state | browse_parts: browse_parts}
+  end
+
+  defp handle_c_response({browse, caller_metadata, c_response}, state)
+       when browse in [:browse, :browse_next] do
+    {{fields, parts}, browse_parts} = Map.pop(state.browse_parts, caller_metadata, {[], []})
+    GenServer.reply(caller_metadata, parse_browse_response(c_response, fields, parts))
+    %{state | browse_parts: browse_parts}
+  end
+
+  # Browse Path Resolution C Handlers
+
+  defp handle_c_response({:translate_browse_paths, caller_metadata, {:ok, results}}, state) do
+    GenServer.reply(caller_metadata, {:ok, Enum.map(results, &parse_node_id/1)})
+    state
+  end
+
+  defp handle_c_response({:translate_browse_paths, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  # Method Call C Handlers
+
+  defp handle_c_response({:call_methods, caller_metadata, {:ok, results}}, state) do
+    GenServer.reply(caller_metadata, {:ok, Enum.map(results, &parse_method_result/1)})
+    state
+  end
+
+  defp handle_c_response({:call_methods, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  # History Read C Handlers
+
+  defp handle_c_response({:history_read_raw, caller_metadata, c_response}, state) do
+    {{_fields, parts}, browse_parts} = Map.pop(state.browse_parts, caller_metadata, {[], []})
+    GenServer.reply(caller_metadata, parse_history_response(c_response, parts))
+    %{state | browse_parts: browse_parts}
+  end
+
+  # Address Space Crawler C Handlers
+
+  defp handle_c_response({:crawl, caller_metadata, c_response}, state) do
+    {{_fields, parts}, browse_parts} = Map.pop(state.browse_parts, caller_metadata, {[], []})
+    GenServer.reply(caller_metadata, parse_crawl_response(c_response, parts))
+    %{state | browse_parts: browse_parts}
+  end
+
+  # Polling Engine C message handlers
+
+  defp handle_c_response(
+         {:poll, {:data, group_id, c_changes}},
+         %{controlling_process: c_pid} = state
+       ) do
+    changes =
+      Enum.map(c_changes, fn {c_node_id, c_value} ->
+        node_id = parse_c_value(c_node_id)
+        value = parse_value(c_value)
+
+        with {:ok, data} <- value, do: TagTable.put(state.tag_table, node_id, data)
+
+        {node_id, value}
+      end)
+
+    send(c_pid, {:poll, group_id, changes})
+    state
+  end
+
+  defp handle_c_response({:add_poll_group, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  defp handle_c_response({:delete_poll_group, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
   # Lifecycle C Handlers
 
   defp handle_c_response({:get_client_state, caller_metadata, client_state}, state) do
@@ -914,6 +1867,21 @@ defmodule OpcUA.Client do
     state
   end
 
+  defp handle_c_response({:connect_client_async, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  defp handle_c_response({:set_reconnect, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  defp handle_c_response({:set_state_notifications, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
   # Discovery functions C Handlers
 
   defp handle_c_response({:find_servers_on_network, caller_metadata, c_response}, state) do
@@ -943,8 +1911,46 @@ defmodule OpcUA.Client do
     state
   end
 
+  defp handle_c_response({:get_subscription_stats, caller_metadata, {:ok, c_stats}}, state) do
+    stats =
+      Enum.map(c_stats, fn {subscription_id, gaps, republished, lost, late, max_lateness} ->
+        %{
+          subscription_id: subscription_id,
+          gaps: gaps,
+          republished: republished,
+          lost: lost,
+          late: late,
+          max_lateness: max_lateness
+        }
+      end)
+
+    GenServer.reply(caller_metadata, {:ok, stats})
+    state
+  end
+
+  defp handle_c_response({:get_subscription_stats, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
   defp handle_c_response({:add_monitored_item, caller_metadata, c_response}, state) do
     GenServer.reply(caller_metadata, c_response)
+
+    {request, pending} = Map.pop(state.pending_monitored_items, caller_metadata)
+    state = %{state | pending_monitored_items: pending}
+
+    case {request, c_response} do
+      {{subscription_id, node_id}, {:ok, monitored_id}} ->
+        monitored_nodes = Map.put(state.monitored_nodes, {subscription_id, monitored_id}, node_id)
+        %{state | monitored_nodes: monitored_nodes}
+
+      _ ->
+        state
+    end
+  end
+
+  defp handle_c_response({:add_event_monitored_item, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
     state
   end
 
@@ -953,6 +1959,40 @@ defmodule OpcUA.Client do
     state
   end
 
+  # Last Value Cache C Handlers
+
+  defp handle_c_response({:set_value_cache, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  defp handle_c_response({:read_cached, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, parse_cached_value(c_response))
+    state
+  end
+
+  defp handle_c_response({:read_cached_many, caller_metadata, {:ok, results}}, state) do
+    GenServer.reply(caller_metadata, {:ok, Enum.map(results, &parse_cached_value/1)})
+    state
+  end
+
+  defp handle_c_response({:read_cached_many, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  # Custom Data Types C Handlers
+
+  defp handle_c_response({:load_data_types, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
+  defp handle_c_response({:clear_data_types, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
   # Read nodes Attributes
 
   defp handle_c_response({:read_node_user_write_mask, caller_metadata, data}, state) do
@@ -1007,4 +2047,407 @@ defmodule OpcUA.Client do
     GenServer.reply(caller_metadata, data)
     state
   end
+
+  defp node_class_mask(node_classes) when is_list(node_classes) do
+    Enum.reduce_while(node_classes, {:ok, 0}, fn node_class, {:ok, mask} ->
+      case List.keyfind(@node_classes, node_class, 0) do
+        {_node_class, bit, _name} -> {:cont, {:ok, Bitwise.bor(mask, bit)}}
+        nil -> {:halt, :error}
+      end
+    end)
+  end
+
+  defp node_class_mask(_node_classes), do: :error
+
+  defp browse_result_mask(opts) do
+    requested = Keyword.get(opts, :result_fields, Keyword.keys(@browse_result_fields))
+
+    if is_list(requested) and Enum.all?(requested, &Keyword.has_key?(@browse_result_fields, &1)) do
+      fields = for {field, _bit} <- @browse_result_fields, field in requested, do: field
+      mask = Enum.reduce(fields, 0, &Bitwise.bor(Keyword.fetch!(@browse_result_fields, &1), &2))
+      {:ok, fields, mask}
+    else
+      :error
+    end
+  end
+
+  defp parse_browse_response({:ok, statuses}, fields, parts) do
+    references =
+      parts
+      |> Enum.reverse()
+      |> Enum.concat()
+      |> Enum.group_by(fn {index, _reference} -> index end, fn {_index, reference} ->
+        parse_browse_reference(reference, fields)
+      end)
+
+    results =
+      statuses
+      |> Enum.with_index()
+      |> Enum.map(fn
+        {{:ok, continuation_point}, index} ->
+          {:ok, %{references: Map.get(references, index, []), continuation_point: continuation_point}}
+
+        {error, _index} ->
+          error
+      end)
+
+    {:ok, results}
+  end
+
+  defp parse_browse_response(c_response, _fields, _parts), do: c_response
+
+  defp parse_browse_reference(reference, fields) do
+    [node_id | values] = Tuple.to_list(reference)
+
+    fields
+    |> Enum.zip(values)
+    |> Map.new(fn
+      {:node_class, node_class} ->
+        {:node_class, node_class_name(node_class)}
+
+      {field, value} when field in [:reference_type, :browse_name, :type_definition] ->
+        {field, parse_c_value(value)}
+
+      {field, value} ->
+        {field, value}
+    end)
+    |> Map.put(:node_id, parse_c_value(node_id))
+  end
+
+  defp browse_paths_to_c(paths, start_node, ns_index) do
+    paths
+    |> Enum.reduce_while([], fn path, c_paths ->
+      case browse_path_to_c(path, start_node, ns_index) do
+        {:ok, c_path} -> {:cont, [c_path | c_paths]}
+        :error -> {:halt, :error}
+      end
+    end)
+    |> case do
+      :error -> :error
+      c_paths -> {:ok, Enum.reverse(c_paths)}
+    end
+  end
+
+  defp browse_path_to_c(path, start_node, ns_index) when is_binary(path),
+    do: browse_path_to_c({start_node, path}, start_node, ns_index)
+
+  defp browse_path_to_c({%NodeId{} = start_node, path}, _start_node, ns_index) when is_binary(path),
+    do: browse_path_to_c({start_node, String.split(path, "/", trim: true)}, start_node, ns_index)
+
+  defp browse_path_to_c({%NodeId{} = start_node, [_ | _] = browse_names}, _start_node, ns_index) do
+    c_browse_names = Enum.map(browse_names, &browse_name_to_c(&1, ns_index))
+
+    if Enum.member?(c_browse_names, :error),
+      do: :error,
+      else: {:ok, {to_c(start_node), c_browse_names}}
+  end
+
+  defp browse_path_to_c(_path, _start_node, _ns_index), do: :error
+
+  defp browse_name_to_c(%QualifiedName{ns_index: ns_index, name: name}, _ns_index)
+       when ns_index in 0..65_535 and is_binary(name),
+       do: {ns_index, name}
+
+  defp browse_name_to_c(name, ns_index) when is_binary(name) do
+    case Integer.parse(name) do
+      {prefix, ":" <> browse_name} when prefix in 0..65_535 -> {prefix, browse_name}
+      _ -> {ns_index, name}
+    end
+  end
+
+  defp browse_name_to_c(_name, _ns_index), do: :error
+
+  defp server_object(), do: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2253)
+
+  defp base_event_type(), do: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2041)
+
+  defp event_select_to_c([_ | _] = fields) do
+    c_fields = Enum.map(fields, &event_field_to_c/1)
+    if Enum.member?(c_fields, :error), do: :error, else: {:ok, c_fields}
+  end
+
+  defp event_select_to_c(_fields), do: :error
+
+  # Fields are SimpleAttributeOperands, the Value attribute (13) unless told otherwise.
+  defp event_field_to_c(path) when is_binary(path), do: event_field_to_c({base_event_type(), path, 13})
+
+  defp event_field_to_c({%NodeId{} = type_id, path}), do: event_field_to_c({type_id, path, 13})
+
+  defp event_field_to_c({%NodeId{} = type_id, path, attribute_id})
+       when is_binary(path) and attribute_id in 1..27 do
+    c_browse_names = path |> String.split("/", trim: true) |> Enum.map(&browse_name_to_c(&1, 0))
+
+    if Enum.member?(c_browse_names, :error),
+      do: :error,
+      else: {to_c(type_id), c_browse_names, attribute_id}
+  end
+
+  defp event_field_to_c(_field), do: :error
+
+  # The where clause is flattened into ContentFilterElements, the root expression first and the
+  # nested ones referenced by their index.
+  defp event_where_to_c(nil), do: {:ok, []}
+
+  defp event_where_to_c(expression) do
+    case event_element_to_c(expression, %{}) do
+      {:ok, _index, elements} -> {:ok, Enum.map(0..(map_size(elements) - 1), &Map.fetch!(elements, &1))}
+      :error -> :error
+    end
+  end
+
+  defp event_element_to_c(expression, elements) do
+    index = map_size(elements)
+    elements = Map.put(elements, index, nil)
+
+    with {:ok, operator, operands} <- event_expression(expression),
+         {:ok, c_operands, elements} <- event_operands_to_c(operands, elements) do
+      {:ok, index, Map.put(elements, index, {operator, c_operands})}
+    else
+      _ -> :error
+    end
+  end
+
+  defp event_expression({operator, left, right}) when is_map_key(@event_binary_operators, operator),
+    do: {:ok, Map.fetch!(@event_binary_operators, operator), [left, right]}
+
+  defp event_expression({:is_null, operand}), do: {:ok, 1, [operand]}
+  defp event_expression({:not, operand}), do: {:ok, 7, [operand]}
+  defp event_expression({:between, operand, low, high}), do: {:ok, 8, [operand, low, high]}
+  defp event_expression({:in_list, operand, [_ | _] = list}), do: {:ok, 9, [operand | list]}
+  defp event_expression({:of_type, %NodeId{} = type_id}), do: {:ok, 14, [{16, type_id}]}
+  defp event_expression(_expression), do: :error
+
+  defp event_operands_to_c(operands, elements) do
+    Enum.reduce_while(operands, {:ok, [], elements}, fn operand, {:ok, c_operands, elements} ->
+      case event_operand_to_c(operand, elements) do
+        {:ok, c_operand, elements} -> {:cont, {:ok, [c_operand | c_operands], elements}}
+        :error -> {:halt, :error}
+      end
+    end)
+    |> case do
+      {:ok, c_operands, elements} -> {:ok, Enum.reverse(c_operands), elements}
+      :error -> :error
+    end
+  end
+
+  defp event_operand_to_c({:field, field}, elements) do
+    case event_field_to_c(field) do
+      :error -> :error
+      c_field -> {:ok, {:attribute, c_field}, elements}
+    end
+  end
+
+  defp event_operand_to_c({data_type, _value} = literal, elements) when is_integer(data_type),
+    do: {:ok, {:literal, method_argument_to_c(literal)}, elements}
+
+  defp event_operand_to_c(expression, elements) when is_tuple(expression) do
+    case event_element_to_c(expression, elements) do
+      {:ok, index, elements} -> {:ok, {:element, index}, elements}
+      :error -> :error
+    end
+  end
+
+  defp event_operand_to_c(_operand, _elements), do: :error
+
+  defp method_calls_to_c([_ | _] = calls) do
+    c_calls = Enum.map(calls, &method_call_to_c/1)
+    if Enum.member?(c_calls, :error), do: :error, else: {:ok, c_calls}
+  end
+
+  defp method_calls_to_c(_calls), do: :error
+
+  defp method_call_to_c({%NodeId{} = object_id, %NodeId{} = method_id, arguments}) when is_list(arguments) do
+    c_arguments = Enum.map(arguments, &method_argument_to_c/1)
+
+    if Enum.member?(c_arguments, :error),
+      do: :error,
+      else: {to_c(object_id), to_c(method_id), c_arguments}
+  end
+
+  defp method_call_to_c(_call), do: :error
+
+  # Arrays go as tuples, lists of small integers would reach the port as strings.
+  defp method_argument_to_c({data_type, values}) when is_integer(data_type) and is_list(values),
+    do: {data_type, true, values |> Enum.map(&value_to_c(data_type, &1)) |> List.to_tuple()}
+
+  defp method_argument_to_c({data_type, value}) when is_integer(data_type),
+    do: {data_type, false, value_to_c(data_type, value)}
+
+  defp method_argument_to_c(_argument), do: :error
+
+  defp parse_method_result({:ok, output_arguments}),
+    do: {:ok, Enum.map(output_arguments, &parse_c_value/1)}
+
+  defp parse_method_result(result), do: result
+
+  # OPC UA DateTime: 100 ns intervals since 1601-01-01.
+  defp opc_ua_date_time(%DateTime{} = date_time),
+    do: {:ok, DateTime.to_unix(date_time, :microsecond) * 10 + 116_444_736_000_000_000}
+
+  defp opc_ua_date_time(date_time) when is_integer(date_time) and date_time >= 0, do: {:ok, date_time}
+  defp opc_ua_date_time(_date_time), do: :error
+
+  defp parse_history_response({:ok, statuses}, parts) do
+    entries = parts |> Enum.reverse() |> Enum.concat() |> Enum.group_by(&elem(&1, 0))
+
+    results =
+      statuses
+      |> Enum.with_index()
+      |> Enum.map(fn
+        {:ok, index} -> {:ok, merge_history_entries(Map.get(entries, index, []))}
+        {error, _index} -> error
+      end)
+
+    {:ok, results}
+  end
+
+  defp parse_history_response(c_response, _parts), do: c_response
+
+  # Entries of a node are only kept packed when all of them share the packed data type.
+  defp merge_history_entries(entries) do
+    data_types = entries |> Enum.map(&elem(&1, 1)) |> Enum.uniq()
+
+    {data_type, values} =
+      case data_types do
+        [data_type] when is_integer(data_type) ->
+          {data_type, entries |> Enum.map(&elem(&1, 3)) |> IO.iodata_to_binary()}
+
+        _ ->
+          {nil, Enum.flat_map(entries, fn entry -> unpack_history_values(elem(entry, 1), elem(entry, 3)) end)}
+      end
+
+    statuses =
+      if Enum.all?(entries, &is_nil(elem(&1, 4))),
+        do: nil,
+        else:
+          entries
+          |> Enum.map(fn
+            {_index, _data_type, timestamps, _values, nil} -> :binary.copy(<<0::32>>, div(byte_size(timestamps), 8))
+            {_index, _data_type, _timestamps, _values, statuses} -> statuses
+          end)
+          |> IO.iodata_to_binary()
+
+    %{
+      timestamps: entries |> Enum.map(&elem(&1, 2)) |> IO.iodata_to_binary(),
+      data_type: data_type,
+      values: values,
+      statuses: statuses
+    }
+  end
+
+  defp unpack_history_values(nil, values), do: Enum.map(values, &parse_c_value/1)
+  defp unpack_history_values(0, values), do: for(<<v::8 <- values>>, do: v != 0)
+  defp unpack_history_values(1, values), do: for(<<v::signed-8 <- values>>, do: v)
+  defp unpack_history_values(2, values), do: for(<<v::8 <- values>>, do: v)
+  defp unpack_history_values(3, values), do: for(<<v::signed-16-native <- values>>, do: v)
+  defp unpack_history_values(4, values), do: for(<<v::16-native <- values>>, do: v)
+  defp unpack_history_values(5, values), do: for(<<v::signed-32-native <- values>>, do: v)
+  defp unpack_history_values(6, values), do: for(<<v::32-native <- values>>, do: v)
+  defp unpack_history_values(data_type, values) when data_type in [7, 12], do: for(<<v::signed-64-native <- values>>, do: v)
+  defp unpack_history_values(8, values), do: for(<<v::64-native <- values>>, do: v)
+  # NaN and infinity do not match a float segment.
+  defp unpack_history_values(9, values), do: for(<<v::binary-4 <- values>>, do: unpack_float(v))
+  defp unpack_history_values(10, values), do: for(<<v::binary-8 <- values>>, do: unpack_float(v))
+
+  defp unpack_float(<<v::float-32-native>>), do: v
+  defp unpack_float(<<v::float-64-native>>), do: v
+  defp unpack_float(_nan_or_infinity), do: nil
+
+  defp parse_crawl_response({:ok, {source, truncated}}, parts) do
+    c_nodes = parts |> Enum.reverse() |> Enum.concat()
+    node_ids = c_nodes |> Enum.map(&parse_c_value(elem(&1, 0))) |> List.to_tuple()
+
+    nodes =
+      c_nodes
+      |> Enum.with_index()
+      |> Enum.map(fn {{_node_id, parent, node_class, browse_name, data_type, value_rank,
+                       array_dimensions, access_level}, index} ->
+        %{
+          node_id: elem(node_ids, index),
+          parent: if(index == 0, do: nil, else: elem(node_ids, parent)),
+          node_class: node_class_name(node_class),
+          browse_name: parse_c_value(browse_name),
+          data_type: parse_c_value(data_type),
+          value_rank: value_rank,
+          array_dimensions: array_dimensions,
+          access_level: access_level
+        }
+      end)
+
+    {:ok, %{source: source, truncated: truncated, nodes: nodes}}
+  end
+
+  defp parse_crawl_response(c_response, _parts), do: c_response
+
+  defp node_class_name(node_class) do
+    case List.keyfind(@node_classes, node_class, 1) do
+      {_node_class, _bit, name} -> name
+      nil -> "Unspecified"
+    end
+  end
+
+  defp parse_cached_value({:ok, {c_value, server_timestamp, age}}),
+    do: {:ok, %{value: parse_c_value(c_value), server_timestamp: server_timestamp, age: age}}
+
+  defp parse_cached_value(response), do: response
+
+  # Tag table: monitored items are mapped to their node, so notifications can be stored by NodeId.
+
+  defp track_monitored_item(%{tag_table: nil} = state, _caller_info, _subscription_id, _node_id),
+    do: state
+
+  defp track_monitored_item(state, caller_info, subscription_id, node_id) do
+    pending = Map.put(state.pending_monitored_items, caller_info, {subscription_id, node_id})
+    %{state | pending_monitored_items: pending}
+  end
+
+  # Recovered subscriptions: recreated monitored items are tracked by their new ids.
+  defp remap_monitored_items(%{tag_table: nil} = state, _sub_id, _new_sub_id, _mon_ids), do: state
+
+  defp remap_monitored_items(state, subscription_id, new_subscription_id, _monitored_ids)
+       when not is_integer(new_subscription_id) do
+    untrack_monitored_items(state, fn {sub_id, _mon_id} -> sub_id == subscription_id end)
+  end
+
+  defp remap_monitored_items(state, subscription_id, new_subscription_id, monitored_ids) do
+    {moved, monitored_nodes} =
+      Map.split(state.monitored_nodes, Enum.map(monitored_ids, fn {mon_id, _} -> {subscription_id, mon_id} end))
+
+    monitored_nodes =
+      Enum.reduce(monitored_ids, monitored_nodes, fn
+        {mon_id, new_mon_id}, acc when is_integer(new_mon_id) ->
+          case Map.fetch(moved, {subscription_id, mon_id}) do
+            {:ok, node_id} -> Map.put(acc, {new_subscription_id, new_mon_id}, node_id)
+            :error -> acc
+          end
+
+        _failed, acc ->
+          acc
+      end)
+
+    # Values of the items that could not be recreated are dropped like deleted items.
+    failed = for {mon_id, status} <- monitored_ids, not is_integer(status), do: {subscription_id, mon_id}
+
+    %{state | monitored_nodes: Map.merge(monitored_nodes, Map.take(moved, failed))}
+    |> untrack_monitored_items(&(&1 in failed))
+  end
+
+  defp untrack_monitored_items(%{tag_table: nil} = state, _filter), do: state
+
+  defp untrack_monitored_items(state, filter) do
+    {removed, monitored_nodes} =
+      Enum.split_with(state.monitored_nodes, fn {monitored_item, _node_id} -> filter.(monitored_item) end)
+
+    monitored_nodes = Map.new(monitored_nodes)
+
+    # Values are only dropped when no other monitored item keeps them up to date.
+    remaining_nodes = monitored_nodes |> Map.values() |> MapSet.new()
+
+    removed
+    |> Enum.map(fn {_monitored_item, node_id} -> node_id end)
+    |> Enum.reject(&MapSet.member?(remaining_nodes, &1))
+    |> Enum.each(&TagTable.delete(state.tag_table, &1))
+
+    %{state | monitored_nodes: monitored_nodes}
+  end
 end
@@ -0,0 +1,156 @@
+defmodule OpcUA.ClientHost do
+  @moduledoc """
+  One `opc_ua_client` port shared by many `OpcUA.Client` processes.
+
+  Every client started with the `:host` option gets its own session (a `UA_Client` with its own
+  connection, event loop, subscriptions and caches) in the host port instead of a port of its own,
+  so hundreds of connections run in one OS process. The sessions are not lighter than standalone
+  clients: the host saves the OS processes (and their open62541 runtime), not the memory of each
+  connection. See `bench/client_host_bench.exs`. The clients keep their whole API; their requests
+  are tagged with the session id and the host routes the responses and notifications back to them.
+
+  ```elixir
+  {:ok, host} = OpcUA.ClientHost.start_link()
+  {:ok, c_pid} = OpcUA.Client.start_link(host: host)
+  ```
+
+  The session is deleted when its client exits. If the host (or its port) exits, so do its clients.
+  """
+  use GenServer
+  require Logger
+
+  alias OpcUA.Client
+
+  @c_timeout 5000
+
+  @doc """
+    Starts up an OPC UA Client host GenServer.
+  """
+  @spec start_link(list()) :: {:ok, pid} | {:error, term}
+  def start_link(opts \\ []) do
+    GenServer.start_link(__MODULE__, nil, opts)
+  end
+
+  @doc """
+    Stops an OPC UA Client host GenServer.
+  """
+  @spec stop(GenServer.server()) :: :ok
+  def stop(pid) do
+    GenServer.stop(pid)
+  end
+
+  @doc """
+    Returns the number of open sessions.
+  """
+  @spec sessions(GenServer.server()) :: non_neg_integer()
+  def sessions(pid) do
+    GenServer.call(pid, :sessions)
+  end
+
+  @doc false
+  def open_session(pid) do
+    GenServer.call(pid, :open_session)
+  end
+
+  # Handlers
+
+  def init(nil) do
+    lib_dir =
+      :opex62541
+      |> :code.priv_dir()
+      |> to_string()
+      |> Client.set_ld_library_path()
+
+    port =
+      Port.open({:spawn_executable, to_charlist(lib_dir <> "/opc_ua_client")}, [
+        {:args, []},
+        {:packet, 2},
+        :use_stdio,
+        :binary,
+        :exit_status
+      ])
+
+    # sessions: session id => client pid, monitors: monitor reference => session id
+    {:ok, %{port: port, sessions: %{}, monitors: %{}}}
+  end
+
+  def handle_call(:open_session, {pid, _tag} = caller_info, state) do
+    call_port(state, :new_session, {caller_info, pid}, nil)
+    {:noreply, state}
+  end
+
+  def handle_call(:sessions, _caller_info, state) do
+    {:reply, map_size(state.sessions), state}
+  end
+
+  def handle_info({port, {:data, <<?s, session_id::32, frame::binary>>}}, state) do
+    case Map.fetch(state.sessions, session_id) do
+      {:ok, pid} -> send(pid, {port, {:data, frame}})
+      # Late notifications of a deleted session
+      :error -> :ok
+    end
+
+    {:noreply, state}
+  end
+
+  def handle_info({_port, {:data, <<?r, c_response::binary>>}}, state) do
+    state =
+      c_response
+      |> :erlang.binary_to_term()
+      |> handle_c_response(state)
+
+    {:noreply, state}
+  end
+
+  def handle_info({:DOWN, ref, :process, _pid, _reason}, state) do
+    {session_id, monitors} = Map.pop(state.monitors, ref)
+
+    if session_id != nil do
+      call_port(state, :delete_session, nil, session_id)
+    end
+
+    {:noreply, %{state | monitors: monitors, sessions: Map.delete(state.sessions, session_id)}}
+  end
+
+  def handle_info({_port, {:exit_status, code}}, state) do
+    Logger.warning("(#{__MODULE__}) Error code: #{inspect(code)}.")
+    # retrying delay
+    Process.sleep(@c_timeout)
+    {:stop, :restart, state}
+  end
+
+  def handle_info(msg, state) do
+    Logger.warning("(#{__MODULE__}) Unhandled message: #{inspect(msg)}.")
+    {:noreply, state}
+  end
+
+  # C Handlers
+
+  defp handle_c_response({:new_session, {caller_info, pid}, {:ok, session_id}}, state) do
+    ref = Process.monitor(pid)
+    GenServer.reply(caller_info, {:ok, {self(), state.port, session_id}})
+
+    %{
+      state
+      | sessions: Map.put(state.sessions, session_id, pid),
+        monitors: Map.put(state.monitors, ref, session_id)
+    }
+  end
+
+  defp handle_c_response({:new_session, {caller_info, _pid}, error}, state) do
+    GenServer.reply(caller_info, error)
+    state
+  end
+
+  defp handle_c_response({:delete_session, nil, :ok}, state), do: state
+
+  defp handle_c_response({:delete_session, nil, error}, state) do
+    Logger.warning("(#{__MODULE__}) Session delete error: #{inspect(error)}.")
+    state
+  end
+
+  defp call_port(state, command, caller, arguments) do
+    msg = {command, caller, arguments}
+    send(state.port, {self(), {:command, :erlang.term_to_binary(msg)}})
+  end
+end
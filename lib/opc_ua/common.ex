@@ -21,9 +21,24 @@ defmodule OpcUA.Common do
 
         # port: C port process
         # controlling_process: parent process
+        # tag_table: optional OpcUA.TagTable name
+        # monitored_nodes: {subscription_id, monitored_item_id} => %NodeId{} (tag table only)
+        # pending_monitored_items: caller_info => {subscription_id, %NodeId{}} (tag table only)
+        # browse_parts: caller_info => {result fields, streamed frames} (client browse and crawl)
+        # batch_writes: sends the server write notifications as {:writes, list} (server)
+        # port_stats_interval, port_stats_timer: periodic port statistics telemetry
+        # session: {host pid, session id} of a client multiplexed in an OpcUA.ClientHost port
 
         defstruct port: nil,
-                  controlling_process: nil
+                  controlling_process: nil,
+                  tag_table: nil,
+                  monitored_nodes: %{},
+                  pending_monitored_items: %{},
+                  browse_parts: %{},
+                  batch_writes: false,
+                  port_stats_interval: 0,
+                  port_stats_timer: nil,
+                  session: nil
       end
 
       # Write nodes Attributes functions
@@ -405,6 +420,63 @@ defmodule OpcUA.Common do
         GenServer.call(pid, {:read, {:value_by_data_type, {node_id, data_type}}})
       end
 
+      # Port statistics functions
+
+      @doc """
+      Returns the statistics of the C port as a map:
+        * `:frames_in`, `:bytes_in`, `:frames_out`, `:bytes_out` -> port traffic.
+        * `:notifications` -> subscription, event and poll notifications sent (Client).
+        * `:commands` -> `%{command => %{count: count, decode: latency, call: latency, send: latency,
+          total: latency}}`, where every latency is `%{p50: us, p90: us, p99: us, max: us}`. `decode` is
+          the time from the port reading the request to its handler (including the server command
+          queue), `call` the OPC UA service call, and `send` the time writing the response frames. Only
+          `read_node_value`, `read_node_values` and `write_node_value` time their service call, `call`
+          is `nil` for the other commands (their service call is part of `total`).
+
+      Every call also emits the `[:opex62541, :port, :stats]` telemetry event, with the traffic and
+      notification counters as measurements and `%{module: module, pid: pid, commands: commands}` as
+      metadata.
+
+      The following option can be filled:
+        * `:reset` -> boolean(), the command latencies start over (default: false).
+      """
+      @spec get_port_stats(GenServer.server(), keyword()) :: {:ok, map()} | {:error, binary()} | {:error, :einval}
+      def get_port_stats(pid, opts \\ []) when is_list(opts) do
+        GenServer.call(pid, {:port_stats, {:get, opts}})
+      end
+
+      @doc """
+      Emits the `[:opex62541, :port, :stats]` telemetry event every `interval` ms (see
+      `get_port_stats/2`), resetting the command latencies every time. 0 stops it.
+
+      The `[:opex62541, :process, :stats]` event is emitted along, with the GenServer
+      `:message_queue_len`, the bytes queued to the port (`:port_queue_size`, `:port_busy` when
+      any) and the `:pending_commands` waiting for a response as measurements.
+      """
+      @spec set_port_stats_interval(GenServer.server(), non_neg_integer()) :: :ok | {:error, :einval}
+      def set_port_stats_interval(pid, interval) when is_integer(interval) and interval >= 0 do
+        GenServer.call(pid, {:port_stats, {:interval, interval}})
+      end
+
+      # Port statistics handlers
+
+      def handle_call({:port_stats, {:get, opts}}, caller_info, state) do
+        reset = Keyword.get(opts, :reset, false)
+
+        if is_boolean(reset) do
+          call_port(state, :get_port_stats, caller_info, reset)
+          {:noreply, state}
+        else
+          {:reply, {:error, :einval}, state}
+        end
+      end
+
+      def handle_call({:port_stats, {:interval, interval}}, _caller_info, state) do
+        if state.port_stats_timer, do: Process.cancel_timer(state.port_stats_timer)
+        timer = if interval > 0, do: Process.send_after(self(), :port_stats, interval)
+        {:reply, :ok, %{state | port_stats_interval: interval, port_stats_timer: timer}}
+      end
+
       # Write nodes Attributes handlers
       def handle_call({:write, {:display_name, node_id, {locale, name}}}, caller_info, state)
           when is_binary(locale) and is_binary(name) do
@@ -676,14 +748,53 @@ defmodule OpcUA.Common do
       # Catch all handlers
 
       def handle_info({_port, {:data, <<?r, c_response::binary>>}}, state) do
-        state =
-          c_response
-          |> :erlang.binary_to_term()
-          |> handle_c_response(state)
+        c_response = :erlang.binary_to_term(c_response)
+        span = command_span_take(c_response)
 
+        state =
+          try do
+            handle_c_response(c_response, state)
+          catch
+            kind, reason ->
+              command_span_exception(span, kind, reason, __STACKTRACE__)
+              :erlang.raise(kind, reason, __STACKTRACE__)
+          end
+
+        command_span_stop(span, c_response)
         {:noreply, state}
       end
 
+      def handle_info(:port_stats, %{port_stats_interval: interval} = state) when interval > 0 do
+        emit_process_stats(state)
+        call_port(state, :get_port_stats, :telemetry, true)
+        timer = Process.send_after(self(), :port_stats, interval)
+        {:noreply, %{state | port_stats_timer: timer}}
+      end
+
+      def handle_info(:port_stats, state), do: {:noreply, %{state | port_stats_timer: nil}}
+
+      # Port statistics C handlers
+
+      defp handle_c_response({:get_port_stats, caller_metadata, {:ok, c_stats}}, state) do
+        stats = parse_port_stats(c_stats)
+
+        :telemetry.execute(
+          [:opex62541, :port, :stats],
+          Map.delete(stats, :commands),
+          %{module: __MODULE__, pid: self(), commands: stats.commands}
+        )
+
+        if caller_metadata != :telemetry, do: GenServer.reply(caller_metadata, {:ok, stats})
+        state
+      end
+
+      defp handle_c_response({:get_port_stats, :telemetry, _error}, state), do: state
+
+      defp handle_c_response({:get_port_stats, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
       # Write nodes Attributes C handlers
 
       defp handle_c_response({:write_node_browse_name, caller_metadata, data}, state) do
@@ -933,9 +1044,142 @@ defmodule OpcUA.Common do
 
       defp call_port(state, command, caller, arguments) do
         msg = {command, caller, arguments}
-        send(state.port, {self(), {:command, :erlang.term_to_binary(msg)}})
+        payload = :erlang.term_to_binary(msg)
+        command_span_start(command, caller, arguments, byte_size(payload))
+        port_command(state, payload)
+      end
+
+      # A multiplexed session doesn't own the port, its requests go on behalf of the host.
+      defp port_command(%{session: nil} = state, payload) do
+        send(state.port, {self(), {:command, payload}})
       end
 
+      defp port_command(%{session: {host, session_id}} = state, payload) do
+        send(state.port, {host, {:command, [<<?s, session_id::32>>, payload]}})
+      end
+
+      # Telemetry spans of the port commands, from the call to its (last) response frame. The spans
+      # in flight live in the process dictionary, keyed by caller, since call_port doesn't return
+      # the state.
+
+      defp command_span_start(command, {pid, _tag} = caller, arguments, payload_size) when is_pid(pid) do
+        metadata = %{
+          module: __MODULE__,
+          pid: self(),
+          command: command,
+          node_count: command_node_count(arguments),
+          payload_size: payload_size
+        }
+
+        start_time = System.monotonic_time()
+
+        :telemetry.execute(
+          [:opex62541, :command, :start],
+          %{monotonic_time: start_time, system_time: System.system_time()},
+          metadata
+        )
+
+        Process.put({:opex62541_span, caller}, {start_time, metadata})
+      end
+
+      defp command_span_start(_command, _caller, _arguments, _payload_size), do: nil
+
+      # Streamed responses end with their last frame.
+      defp command_span_take({_command, _caller, {:partial, _part}}), do: nil
+      defp command_span_take({_command, {pid, _tag} = caller, _data}) when is_pid(pid),
+        do: Process.delete({:opex62541_span, caller})
+
+      defp command_span_take(_c_response), do: nil
+
+      defp command_span_stop(nil, _c_response), do: nil
+
+      defp command_span_stop({start_time, metadata}, {_command, _caller, data}) do
+        stop_time = System.monotonic_time()
+
+        :telemetry.execute(
+          [:opex62541, :command, :stop],
+          %{duration: stop_time - start_time, monotonic_time: stop_time},
+          Map.put(metadata, :result, command_result(data))
+        )
+      end
+
+      defp command_span_exception(nil, _kind, _reason, _stacktrace), do: nil
+
+      defp command_span_exception({start_time, metadata}, kind, reason, stacktrace) do
+        stop_time = System.monotonic_time()
+
+        :telemetry.execute(
+          [:opex62541, :command, :exception],
+          %{duration: stop_time - start_time, monotonic_time: stop_time},
+          Map.merge(metadata, %{kind: kind, reason: reason, stacktrace: stacktrace})
+        )
+      end
+
+      # The commands in flight when the port exits won't get a response.
+      defp command_spans_fail(reason) do
+        for {{:opex62541_span, caller}, _span} <- Process.get() do
+          command_span_exception(Process.delete({:opex62541_span, caller}), :exit, reason, [])
+        end
+      end
+
+      defp command_node_count(nil), do: 0
+      defp command_node_count(arguments) when is_list(arguments), do: length(arguments)
+      defp command_node_count(_arguments), do: 1
+
+      defp command_result(:ok), do: :ok
+      defp command_result({:ok, _data}), do: :ok
+      defp command_result({:error, _reason}), do: :error
+      defp command_result(_data), do: :ok
+
+      # GenServer mailbox and port load, emitted with the port statistics.
+      defp emit_process_stats(state) do
+        {:message_queue_len, message_queue_len} = Process.info(self(), :message_queue_len)
+
+        port_queue_size =
+          case :erlang.port_info(state.port, :queue_size) do
+            {:queue_size, queue_size} -> queue_size
+            nil -> 0
+          end
+
+        pending_commands = Enum.count(Process.get(), &match?({{:opex62541_span, _caller}, _span}, &1))
+
+        :telemetry.execute(
+          [:opex62541, :process, :stats],
+          %{
+            message_queue_len: message_queue_len,
+            port_queue_size: port_queue_size,
+            port_busy: port_queue_size > 0,
+            pending_commands: pending_commands
+          },
+          %{module: __MODULE__, pid: self()}
+        )
+      end
+
+      defp parse_port_stats({frames_in, bytes_in, frames_out, bytes_out, notifications, commands}) do
+        %{
+          frames_in: frames_in,
+          bytes_in: bytes_in,
+          frames_out: frames_out,
+          bytes_out: bytes_out,
+          notifications: notifications,
+          commands: Map.new(commands, &parse_command_stats/1)
+        }
+      end
+
+      defp parse_command_stats({name, count, decode, call, send, total}) do
+        {name,
+         %{
+           count: count,
+           decode: parse_latency(decode),
+           call: parse_latency(call),
+           send: parse_latency(send),
+           total: parse_latency(total)
+         }}
+      end
+
+      defp parse_latency({p50, p90, p99, max}), do: %{p50: p50, p90: p90, p99: p99, max: max}
+      defp parse_latency(nil), do: nil
+
       defp charlist_to_string({:ok, charlist}), do: {:ok, to_string(charlist)}
       defp charlist_to_string(error_response), do: error_response
 
@@ -955,6 +1199,8 @@ defmodule OpcUA.Common do
       defp value_to_c(data_type, value) when data_type in [16, 17, 19], do: to_c(value)
       # SEMANTICCHANGESTRUCTUREDATATYPE (v1.4.x: value changed from 25 to 350)
       defp value_to_c(data_type, {arg1, arg2}) when data_type == 350, do: {to_c(arg1), to_c(arg2)}
+      # EXTENSIONOBJECT: an encoded structure, {encoding_node_id, body}
+      defp value_to_c(21, {%NodeId{} = encoding_id, body}) when is_binary(body), do: {to_c(encoding_id), body}
       defp value_to_c(_data_type, value), do: value
 
       defp parse_browse_name({:ok, {ns_index, name}}),
@@ -999,6 +1245,9 @@ defmodule OpcUA.Common do
       defp parse_value({:ok, array}) when is_list(array),
         do: {:ok, Enum.map(array, fn(data) -> parse_c_value(data) end)}
 
+      defp parse_value({:ok, structure}) when is_map(structure),
+        do: {:ok, parse_c_value(structure)}
+
       defp parse_value(response), do: response
 
       defp parse_c_value({ns_index, type, name, name_space_uri, server_index}),
@@ -1024,6 +1273,9 @@ defmodule OpcUA.Common do
       defp parse_c_value(array) when is_list(array),
         do: Enum.map(array, fn(data) -> parse_c_value(data) end)
 
+      defp parse_c_value(structure) when is_map(structure),
+        do: Map.new(structure, fn({field, data}) -> {field, parse_c_value(data)} end)
+
       defp parse_c_value(response), do: response
 
       @doc false
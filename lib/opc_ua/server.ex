@@ -1,7 +1,7 @@
 defmodule OpcUA.Server do
   use OpcUA.Common
 
-  alias OpcUA.{NodeId, QualifiedName}
+  alias OpcUA.{NodeId, QualifiedName, TagTable}
 
   @moduledoc """
 
@@ -57,6 +57,45 @@ defmodule OpcUA.Server do
   """
   @callback handle_write(key :: {%NodeId{}, any}, term()) :: term()
 
+  @doc """
+  Optional callback that handles the calls to the method nodes added with `add_method_node/2`.
+
+  It's first argument is a tuple `{call_id, object_id, method_id, input_arguments}`, the call is
+  answered with `set_method_result/3` (from this or any other process) before the method call timeout.
+
+  the second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_method_call(key :: {integer(), %NodeId{}, %NodeId{}, list()}, term()) :: term()
+
+  @doc """
+  Optional callback that handles the value requests of the lazy variables (see `set_node_lazy_read/3`).
+
+  It's first argument is the `node_id` of the variable, its value is answered with `set_lazy_value/4`
+  (from this or any other process).
+
+  the second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_lazy_read(key :: %NodeId{}, term()) :: term()
+
+  @doc """
+  Optional callback that handles the batched write notifications (see `set_write_notifications/2`).
+
+  It's first argument is a list of `{node_id, value}` in the order they were written, by default
+  every write is passed to `handle_write/2`.
+
+  the second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_writes(key :: [{%NodeId{}, any}], term()) :: term()
+
+  @doc """
+  Optional callback that handles the statistics pushed every `set_server_stats_interval/2` ms.
+
+  It's first argument is the statistics map (see `get_server_stats/1`).
+
+  the second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_server_stats(key :: map(), term()) :: term()
+
   @type config_params ::
           {:hostname, binary()}
           | {:port, non_neg_integer()}
@@ -138,6 +177,26 @@ defmodule OpcUA.Server do
         {:noreply, state}
       end
 
+      def handle_info({:writes, writes}, state) do
+        state = apply(__MODULE__, :handle_writes, [writes, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:server_stats, stats}, state) do
+        state = apply(__MODULE__, :handle_server_stats, [stats, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:lazy_read, node_id}, state) do
+        state = apply(__MODULE__, :handle_lazy_read, [node_id, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:method_call, call_id, object_id, method_id, arguments}, state) do
+        state = apply(__MODULE__, :handle_method_call, [{call_id, object_id, method_id, arguments}, state])
+        {:noreply, state}
+      end
+
       @impl true
       def handle_write(write_event, state) do
         require Logger
@@ -145,6 +204,32 @@ defmodule OpcUA.Server do
         state
       end
 
+      @impl true
+      def handle_writes(writes, state) do
+        Enum.reduce(writes, state, &apply(__MODULE__, :handle_write, [&1, &2]))
+      end
+
+      @impl true
+      def handle_server_stats(stats, state) do
+        require Logger
+        Logger.warning("No handle_server_stats/2 clause in #{__MODULE__} provided for #{inspect(stats)}")
+        state
+      end
+
+      @impl true
+      def handle_method_call(method_call, state) do
+        require Logger
+        Logger.warning("No handle_method_call/2 clause in #{__MODULE__} provided for #{inspect(method_call)}")
+        state
+      end
+
+      @impl true
+      def handle_lazy_read(node_id, state) do
+        require Logger
+        Logger.warning("No handle_lazy_read/2 clause in #{__MODULE__} provided for #{inspect(node_id)}")
+        state
+      end
+
       @impl true
       def address_space(_user_init_state), do: []
 
@@ -213,12 +298,18 @@ defmodule OpcUA.Server do
                       start_link: 1,
                       configuration: 1,
                       address_space: 1,
-                      handle_write: 2
+                      handle_write: 2,
+                      handle_writes: 2,
+                      handle_server_stats: 2,
+                      handle_method_call: 2,
+                      handle_lazy_read: 2
     end
   end
 
   @doc """
   Starts up a OPC UA Server GenServer.
+  The following options are supported:
+  * `:tag_table` -> atom(). Name of an `OpcUA.TagTable` to populate with the values written by clients.
   """
   @spec start_link(term(), list()) :: {:ok, pid} | {:error, term} | {:error, :einval}
   def start_link(args \\ [], opts \\ []) do
@@ -295,6 +386,16 @@ defmodule OpcUA.Server do
     end
   end
 
+  @doc """
+  Sets the notification messages every subscription keeps for the Republish service until the
+  client acknowledges them (0, the default, for no limit). The oldest are discarded beyond it.
+  """
+  @spec set_retransmission_queue_size(GenServer.server(), non_neg_integer()) ::
+          :ok | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def set_retransmission_queue_size(pid, size) when is_integer(size) and size >= 0 do
+    GenServer.call(pid, {:config, {:retransmission_queue_size, size}})
+  end
+
   @doc """
   Adds users (and passwords) to the Server with optional port configuration.
 
@@ -340,7 +441,8 @@ defmodule OpcUA.Server do
   end
 
   @doc """
-  Stop OPC UA Server.
+  Stop OPC UA Server. Returns once the server stopped (after the requests sent before), so it can be
+  started again right away.
   """
   @spec stop_server(GenServer.server()) :: :ok | {:error, binary()} | {:error, :einval}
   def stop_server(pid) do
@@ -613,6 +715,22 @@ defmodule OpcUA.Server do
     GenServer.call(pid, {:add, {:data_type_node, args}})
   end
 
+  @doc """
+  Add a structure data type with builtin scalar fields: its data type node (a Structure subtype),
+  its "Default Binary" encoding node and its definition, so clients can discover and decode its
+  values. Its values are written as `{21, {encoding_node_id, body}}` with the binary encoded body.
+  The following must be filled:
+    * `:requested_new_node_id` -> %NodeID{}.
+    * `:encoding_node_id` -> %NodeID{}.
+    * `:browse_name` -> %QualifiedName{}.
+    * `:fields` -> list(), `{name, data_type}` with the UA_TYPES index of the field (1 to 32 fields).
+  """
+  @spec add_structure_type(GenServer.server(), list()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def add_structure_type(pid, args) when is_list(args) do
+    GenServer.call(pid, {:add, {:structure_type, args}})
+  end
+
   @doc """
   Add a new reference in the server.
   The following must be filled:
@@ -675,6 +793,250 @@ defmodule OpcUA.Server do
     GenServer.call(pid, {:delete_monitored_item, monitored_item_id})
   end
 
+  # History functions
+
+  @doc """
+  Keeps the last `capacity` values of a variable node in an in-memory history, so that clients
+  can read it with HistoryRead (e.g. `OpcUA.Client.history_read_raw/3`).
+  Every value written to the node is recorded with its source timestamp; once `capacity`
+  values are stored the oldest one is overwritten. The `Historizing` attribute and the
+  `HistoryRead` access level bit of the node are set accordingly.
+  Calling it again resizes the history, a `capacity` of 0 deletes it.
+  Requires open62541 to be built with `UA_ENABLE_HISTORIZING`.
+
+  The following options can be filled:
+    * `:store` -> `:memory` (default) or `:disk`, appends the values to the on-disk store (see
+      `set_history_store/3`), `capacity` values are buffered in memory between appends.
+  """
+  @spec set_node_history(GenServer.server(), %NodeId{}, non_neg_integer(), keyword()) ::
+          :ok | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def set_node_history(pid, %NodeId{} = node_id, capacity, opts \\ []) when is_list(opts) do
+    GenServer.call(pid, {:history, {:node, node_id, capacity, Keyword.get(opts, :store, :memory)}})
+  end
+
+  @doc """
+  Opens the on-disk history store in `path` (created if needed). Values of the nodes configured
+  with `set_node_history(pid, node_id, capacity, store: :disk)` are appended in blocks to
+  memory-mapped segment files, which are dropped whole by the retention policy. The history
+  already stored in `path` is readable again once the store is opened.
+  The store can only be opened once per server.
+
+  The following options can be filled:
+    * `:segment_size` -> integer(), bytes of each segment file (default 64 MiB).
+    * `:retention` -> integer(), seconds a segment is kept after its newest value, 0 keeps every
+      segment (default 0).
+    * `:max_size` -> integer(), bytes of all the segments, 0 for no limit (default 0).
+    * `:flush_interval` -> integer(), ms between appends of the buffered values (default 1000).
+  """
+  @spec set_history_store(GenServer.server(), binary(), keyword()) ::
+          :ok | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def set_history_store(pid, path, opts \\ []) when is_binary(path) and is_list(opts) do
+    GenServer.call(pid, {:history, {:store, path, opts}})
+  end
+
+  # Method functions
+
+  @doc """
+  Add a new method node to the server. Its calls are not run on the server thread: they are sent to
+  the controlling process as `{:method_call, call_id, object_id, method_id, input_arguments}`
+  messages (see `handle_method_call/2`) and answered with `set_method_result/3`, while the server
+  keeps serving other requests.
+  The following must be filled:
+    * `:requested_new_node_id` -> %NodeID{}.
+    * `:parent_node_id` -> %NodeID{}.
+    * `:reference_type_node_id` -> %NodeID{}.
+    * `:browse_name` -> %QualifiedName{}.
+
+  The following options can be filled:
+    * `:input_arguments` -> list(), `{name, data_type}` or `{name, data_type, value_rank}` with the
+      UA_TYPES index of the argument (default: []).
+    * `:output_arguments` -> list(), as `:input_arguments` (default: []).
+  """
+  @spec add_method_node(GenServer.server(), list()) ::
+          :ok | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def add_method_node(pid, args) when is_list(args) do
+    GenServer.call(pid, {:add, {:method_node, args}})
+  end
+
+  @doc """
+  Configures the method calls of the nodes added with `add_method_node/2`.
+
+  The following options can be filled:
+    * `:timeout` -> integer(), ms a call waits for its result before the server answers it with
+      BadTimeout (default: 10_000).
+    * `:max_calls` -> integer(), calls dispatched at a time (up to 4096), further calls wait in the
+      server queue and are rejected once the queue holds as many (default: 64). It can't change
+      while calls are pending.
+  """
+  @spec set_method_call_config(GenServer.server(), keyword()) ::
+          :ok | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def set_method_call_config(pid, opts) when is_list(opts) do
+    GenServer.call(pid, {:method, {:config, opts}})
+  end
+
+  @doc """
+  Answers a method call with `{:ok, output_arguments}`, where every output argument is
+  `{data_type, value}` (a list of values for arrays), or `{:error, status_code}` with an integer
+  (bad) status code.
+  """
+  @spec set_method_result(GenServer.server(), integer(), {:ok, list()} | {:error, integer()}) ::
+          :ok | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def set_method_result(pid, call_id, result) when is_integer(call_id) do
+    GenServer.call(pid, {:method, {:result, call_id, result}})
+  end
+
+  # Lazy value functions
+
+  @doc """
+  Makes a variable lazy: its value is computed by the controlling process on demand instead of
+  being written every cycle. A read of the variable when its value is older than `ttl` ms sends
+  `{:lazy_read, node_id}` to the controlling process (see `handle_lazy_read/2`) and is served the
+  cached value; the fresh value, set with `set_lazy_value/4`, is served until `ttl` expires again.
+  Only one request is sent per expiration (it is sent again if not answered within 1 s), so a
+  burst of reads costs a single round trip. A `ttl` of 0 makes it a plain variable again.
+  """
+  @spec set_node_lazy_read(GenServer.server(), %NodeId{}, non_neg_integer()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_node_lazy_read(pid, %NodeId{} = node_id, ttl) when is_integer(ttl) and ttl >= 0 do
+    GenServer.call(pid, {:lazy, {:node, node_id, ttl}})
+  end
+
+  @doc """
+  Sets the value of a lazy variable (`{data_type, value}` as in `write_node_value/4`, a list of
+  values for arrays), it is cached for the variable TTL.
+  """
+  @spec set_lazy_value(GenServer.server(), %NodeId{}, integer(), term()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_lazy_value(pid, %NodeId{} = node_id, data_type, value) when is_integer(data_type) do
+    GenServer.call(pid, {:lazy, {:value, node_id, {data_type, value}}})
+  end
+
+  # Write notification functions
+
+  @doc """
+  Configures the notifications of the values written by clients. By default every write is sent to
+  the controlling process as `{node_id, value}` (see `handle_write/2`) once the server iteration that
+  served it ends.
+
+  The following options can be filled:
+    * `:default` -> boolean(), notifies the nodes without a setting of their own or of their
+      namespace (see `set_write_notification/3`) (default: true).
+    * `:window` -> integer(), ms (up to 60_000) the writes are collected before they are sent, only
+      the last value written to a node within the window is sent; 0 sends them every server
+      iteration (default: 0).
+    * `:batch` -> boolean(), sends the writes sent together as a single `{:writes, [{node_id, value}]}`
+      message (see `handle_writes/2`) (default: false).
+
+  A value that can't be encoded within the port frame limit is notified as
+  `{:error, "BadEncodingLimitsExceeded"}`.
+  """
+  @spec set_write_notifications(GenServer.server(), keyword()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_write_notifications(pid, opts) when is_list(opts) do
+    GenServer.call(pid, {:write_notifications, {:config, opts}})
+  end
+
+  @doc """
+  Enables (`true`) or disables (`false`) the write notifications of a node or of every node of a
+  namespace (`ns_index`), `:default` removes the setting. A node setting takes precedence over its
+  namespace setting, which takes precedence over the `:default` option of `set_write_notifications/2`.
+  """
+  @spec set_write_notification(GenServer.server(), %NodeId{} | non_neg_integer(), boolean() | :default) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_write_notification(pid, target, mode) do
+    GenServer.call(pid, {:write_notifications, {:filter, target, mode}})
+  end
+
+  # Statistics functions
+
+  @doc """
+  Returns the load statistics of the server as a map:
+    * `:sessions`, `:secure_channels` -> current count, with the `:cumulated_*`, `:rejected_*`,
+      `*_timeouts` and `*_aborts` counts since the server started.
+    * `:subscriptions`, `:monitored_items` -> current count.
+    * `:retransmission_queue` -> notifications waiting for an acknowledgement, `:late_publish_requests`,
+      `:discarded_messages` and `:queue_overflows` (monitored item queues) of the current subscriptions.
+    * `:services` -> `%{service => %{total: count, errors: count}}` requests of the current sessions
+      (e.g. `"read"`, `"write"`, `"publish"`, `"total"`).
+    * `:commands` -> `%{command => %{count: count, p50: us, p90: us, p99: us, max: us}}` latency of the
+      commands of this server, from the port reading them to their response.
+    * `:nodes` -> nodes in the nodestore.
+    * `:process_read_bytes`, `:process_write_bytes` -> bytes passed to read and write system calls by
+      the whole server process (`rchar`/`wchar` of `/proc/self/io`): OPC UA sockets, but also the port
+      pipes and files, so they are not the network traffic of the server (Linux).
+    * `:rss` -> resident memory of the server process (Linux).
+
+  Subscription and service numbers require open62541 to be built with `UA_ENABLE_DIAGNOSTICS`.
+  """
+  @spec get_server_stats(GenServer.server()) :: {:ok, map()} | {:error, binary()} | {:error, :einval}
+  def get_server_stats(pid) do
+    GenServer.call(pid, {:stats, :get})
+  end
+
+  @doc """
+  Sends the statistics (see `get_server_stats/1`) to the controlling process as
+  `{:server_stats, stats}` every `interval` ms (see `handle_server_stats/2`), 0 stops them.
+  """
+  @spec set_server_stats_interval(GenServer.server(), non_neg_integer()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_server_stats_interval(pid, interval) when is_integer(interval) and interval >= 0 do
+    GenServer.call(pid, {:stats, {:interval, interval}})
+  end
+
+  # Event functions
+
+  @doc """
+  Creates an instance of `event_type` (`BaseEventType` or one of its subtypes), returns its node id.
+  Its fields are written with `set_event_fields/3` and it is emitted with `trigger_event/3`.
+  Requires open62541 to be built with `UA_ENABLE_SUBSCRIPTIONS_EVENTS`.
+  """
+  @spec create_event(GenServer.server(), %NodeId{}) ::
+          {:ok, %NodeId{}} | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def create_event(pid, %NodeId{} = event_type) do
+    GenServer.call(pid, {:event, {:create, event_type}})
+  end
+
+  @doc """
+  Writes fields of an event instance. `fields` is a list of `{field, {data_type, value}}`, where
+  `field` is the browse name of the field (a string for namespace 0, e.g. `"Message"`, or a
+  `%QualifiedName{}`) and `data_type` the UA_TYPES index of the value (a list of values for arrays),
+  e.g. `[{"Message", {20, {"en-US", "Line 1 trip"}}}, {"Severity", {4, 800}}]`.
+  """
+  @spec set_event_fields(GenServer.server(), %NodeId{}, list()) ::
+          :ok | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def set_event_fields(pid, %NodeId{} = event_node, fields) when is_list(fields) do
+    GenServer.call(pid, {:event, {:fields, event_node, fields}})
+  end
+
+  @doc """
+  Triggers an event instance, the event monitored items of the origin node (and its ancestors up to
+  the Server object) get a snapshot of its fields. Returns the EventId.
+
+  The following options can be filled:
+    * `:origin` -> %NodeId{}, node emitting the event (default: the Server object).
+    * `:keep` -> boolean(), keeps the instance to trigger it again, otherwise it is deleted (default: false).
+  """
+  @spec trigger_event(GenServer.server(), %NodeId{}, keyword()) ::
+          {:ok, binary()} | {:error, binary()} | {:error, :einval} | {:error, :not_supported}
+  def trigger_event(pid, %NodeId{} = event_node, opts \\ []) when is_list(opts) do
+    GenServer.call(pid, {:event, {:trigger, event_node, opts}})
+  end
+
+  @doc """
+  Triggers many events with a single port message, e.g. an alarm burst.
+  Each event is `{event_type, fields}` or `{event_type, origin, fields}`, with the `fields` of
+  `set_event_fields/3`; `Time` is set to the current time unless given.
+  One instance per event type is reused for all its events: the fields written by the previous event
+  are restored to their original value, and `SourceNode` and `SourceName` are set from the origin
+  (its browse name) before the given fields are written.
+  Returns `:ok` or `{:error, [{index, reason}]}` with the events that failed (up to 256).
+  """
+  @spec trigger_events(GenServer.server(), list()) ::
+          :ok | {:error, list()} | {:error, :einval} | {:error, :not_supported}
+  def trigger_events(pid, events) when is_list(events) do
+    GenServer.call(pid, {:event, {:trigger_many, events}})
+  end
+
 
   @doc """
   Change the browse name of a node.
@@ -692,7 +1054,7 @@ defmodule OpcUA.Server do
   end
 
   # Handlers
-  def init({_args, controlling_process}) do
+  def init({args, controlling_process}) do
 
     lib_dir =
       :opex62541
@@ -704,7 +1066,9 @@ defmodule OpcUA.Server do
 
     port = open_port(executable, use_valgrind?())
 
-    state = %State{port: port, controlling_process: controlling_process}
+    tag_table = if is_list(args), do: args |> Keyword.get(:tag_table) |> TagTable.new()
+
+    state = %State{port: port, controlling_process: controlling_process, tag_table: tag_table}
     {:ok, state}
   end
 
@@ -737,6 +1101,11 @@ defmodule OpcUA.Server do
     {:noreply, state}
   end
 
+  def handle_call({:config, {:retransmission_queue_size, size}}, caller_info, state) do
+    call_port(state, :set_retransmission_queue_size, caller_info, size)
+    {:noreply, state}
+  end
+
   # v1.4.x: Always send {users_list, port} tuple to C
   # Elixir handles the default port value (4840)
   def handle_call({:config, {:users, {users, port}}}, caller_info, state) when is_list(users) and is_integer(port) do
@@ -966,6 +1335,21 @@ defmodule OpcUA.Server do
     {:noreply, state}
   end
 
+  def handle_call({:add, {:structure_type, args}}, caller_info, state) do
+    requested_new_node_id = Keyword.fetch!(args, :requested_new_node_id) |> to_c()
+    encoding_node_id = Keyword.fetch!(args, :encoding_node_id) |> to_c()
+    browse_name = Keyword.fetch!(args, :browse_name) |> to_c()
+    fields = Keyword.fetch!(args, :fields)
+
+    if Enum.all?(fields, &match?({name, data_type} when is_binary(name) and is_integer(data_type), &1)) do
+      c_args = {requested_new_node_id, encoding_node_id, browse_name, fields}
+      call_port(state, :add_structure_type, caller_info, c_args)
+      {:noreply, state}
+    else
+      {:reply, {:error, :einval}, state}
+    end
+  end
+
   def handle_call({:add, {:data_type_node, args}}, caller_info, state) do
     requested_new_node_id = Keyword.fetch!(args, :requested_new_node_id) |> to_c()
     parent_node_id = Keyword.fetch!(args, :parent_node_id) |> to_c()
@@ -1029,6 +1413,184 @@ defmodule OpcUA.Server do
     {:noreply, state}
   end
 
+  # History functions
+
+  def handle_call({:history, {:node, node_id, capacity, store}}, caller_info, state)
+      when is_integer(capacity) and capacity >= 0 and store in [:memory, :disk] do
+    c_args = {to_c(node_id), capacity, store == :disk}
+    call_port(state, :set_node_history, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  def handle_call({:history, {:store, path, opts}}, caller_info, state) do
+    segment_size = Keyword.get(opts, :segment_size, 64 * 1024 * 1024)
+    retention = Keyword.get(opts, :retention, 0)
+    max_size = Keyword.get(opts, :max_size, 0)
+    flush_interval = Keyword.get(opts, :flush_interval, 1000)
+
+    if Enum.all?([segment_size, retention, max_size, flush_interval], &(is_integer(&1) and &1 >= 0)) do
+      c_args = {path, segment_size, retention, max_size, flush_interval}
+      call_port(state, :set_history_store, caller_info, c_args)
+      {:noreply, state}
+    else
+      {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:history, _args}, _caller_info, state) do
+    {:reply, {:error, :einval}, state}
+  end
+
+  # Method functions
+
+  def handle_call({:add, {:method_node, args}}, caller_info, state) do
+    with  requested_new_node_id <- Keyword.fetch!(args, :requested_new_node_id) |> to_c(),
+          parent_node_id <- Keyword.fetch!(args, :parent_node_id) |> to_c(),
+          reference_type_node_id <- Keyword.fetch!(args, :reference_type_node_id) |> to_c(),
+          browse_name <- Keyword.fetch!(args, :browse_name) |> to_c(),
+          {:ok, inputs} <- method_arguments_to_c(Keyword.get(args, :input_arguments, [])),
+          {:ok, outputs} <- method_arguments_to_c(Keyword.get(args, :output_arguments, [])) do
+      c_args = {requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, inputs, outputs}
+      call_port(state, :add_method_node, caller_info, c_args)
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:method, {:config, opts}}, caller_info, state) do
+    with  timeout <- Keyword.get(opts, :timeout, 10_000),
+          max_calls <- Keyword.get(opts, :max_calls, 64),
+          true <- is_integer(timeout) and timeout > 0,
+          true <- is_integer(max_calls) and max_calls > 0 do
+      call_port(state, :set_method_call_config, caller_info, {timeout, max_calls})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:method, {:result, call_id, {:ok, outputs}}}, caller_info, state) when is_list(outputs) do
+    c_outputs = Enum.map(outputs, &variant_to_c/1)
+
+    if Enum.all?(c_outputs, &is_tuple/1) do
+      call_port(state, :set_method_result, caller_info, {call_id, 0, c_outputs})
+      {:noreply, state}
+    else
+      {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:method, {:result, call_id, {:error, status_code}}}, caller_info, state)
+      when is_integer(status_code) and status_code > 0 do
+    call_port(state, :set_method_result, caller_info, {call_id, status_code, []})
+    {:noreply, state}
+  end
+
+  def handle_call({:method, _args}, _caller_info, state) do
+    {:reply, {:error, :einval}, state}
+  end
+
+  # Lazy value functions
+
+  def handle_call({:lazy, {:node, node_id, ttl}}, caller_info, state) do
+    call_port(state, :set_node_lazy_read, caller_info, {to_c(node_id), ttl})
+    {:noreply, state}
+  end
+
+  def handle_call({:lazy, {:value, node_id, value}}, caller_info, state) do
+    with  c_value when is_tuple(c_value) <- variant_to_c(value) do
+      call_port(state, :set_lazy_value, caller_info, {to_c(node_id), c_value})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # Write notification functions
+
+  def handle_call({:write_notifications, {:config, opts}}, caller_info, state) do
+    notify_default = Keyword.get(opts, :default, true)
+    window = Keyword.get(opts, :window, 0)
+    batch = Keyword.get(opts, :batch, false)
+
+    if is_boolean(notify_default) and is_integer(window) and window >= 0 and is_boolean(batch) do
+      call_port(state, :set_write_notifications, caller_info, {notify_default, window})
+      {:noreply, %{state | batch_writes: batch}}
+    else
+      {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:write_notifications, {:filter, target, mode}}, caller_info, state) do
+    with  c_target when is_tuple(c_target) <- write_target_to_c(target),
+          c_mode when is_integer(c_mode) <- write_mode_to_c(mode) do
+      call_port(state, :set_write_notification, caller_info, {c_target, c_mode})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # Statistics functions
+
+  def handle_call({:stats, :get}, caller_info, state) do
+    call_port(state, :get_server_stats, caller_info, nil)
+    {:noreply, state}
+  end
+
+  def handle_call({:stats, {:interval, interval}}, caller_info, state) do
+    call_port(state, :set_server_stats_interval, caller_info, interval)
+    {:noreply, state}
+  end
+
+  # Event functions
+
+  def handle_call({:event, {:create, event_type}}, caller_info, state) do
+    call_port(state, :create_event, caller_info, to_c(event_type))
+    {:noreply, state}
+  end
+
+  def handle_call({:event, {:fields, event_node, fields}}, caller_info, state) do
+    with  c_fields when is_list(c_fields) <- event_fields_to_c(fields) do
+      call_port(state, :set_event_fields, caller_info, {to_c(event_node), c_fields})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:event, {:trigger, event_node, opts}}, caller_info, state) do
+    with  %NodeId{} = origin <- Keyword.get(opts, :origin, server_object()),
+          keep when is_boolean(keep) <- Keyword.get(opts, :keep, false) do
+      call_port(state, :trigger_event, caller_info, {to_c(event_node), to_c(origin), keep})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:event, {:trigger_many, [_ | _] = events}}, caller_info, state) do
+    c_events = Enum.map(events, &event_to_c/1)
+
+    if Enum.all?(c_events, &is_tuple/1) do
+      call_port(state, :trigger_events, caller_info, c_events)
+      {:noreply, state}
+    else
+      {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:event, _args}, _caller_info, state) do
+    {:reply, {:error, :einval}, state}
+  end
+
   def handle_call({:write, {:browse_name, node_id, browse_name}}, caller_info, state) do
     c_args = {to_c(node_id), to_c(browse_name)}
     call_port(state, :write_node_browse_name, caller_info, c_args)
@@ -1049,6 +1611,7 @@ defmodule OpcUA.Server do
 
   def handle_info({_port, {:exit_status, code}}, state) do
     Logger.warning("(#{__MODULE__}) Error code: #{inspect(code)}.")
+    command_spans_fail({:exit_status, code})
     # retrying delay
     Process.sleep(@c_timeout)
     {:stop, :restart, state}
@@ -1056,6 +1619,7 @@ defmodule OpcUA.Server do
 
   def handle_info({:EXIT, _port, reason}, state) do
     Logger.debug("(#{__MODULE__}) Exit reason: #{inspect(reason)}")
+    command_spans_fail(reason)
     # retrying delay
     Process.sleep(@c_timeout)
     {:stop, :restart, state}
@@ -1072,10 +1636,57 @@ defmodule OpcUA.Server do
        ) do
     variable_node = NodeId.new(ns_index: ns_index, identifier_type: type, identifier: name)
     value = parse_c_value(c_value)
+    TagTable.put(state.tag_table, variable_node, value)
     send(c_pid, {variable_node, value})
     state
   end
 
+  defp handle_c_response({:writes, c_writes}, %{controlling_process: c_pid} = state) do
+    writes =
+      Enum.map(c_writes, fn {{ns_index, type, name}, c_value} ->
+        variable_node = NodeId.new(ns_index: ns_index, identifier_type: type, identifier: name)
+        value = parse_write_value(c_value)
+        TagTable.put(state.tag_table, variable_node, value)
+        {variable_node, value}
+      end)
+
+    if state.batch_writes,
+      do: send(c_pid, {:writes, writes}),
+      else: Enum.each(writes, &send(c_pid, &1))
+
+    state
+  end
+
+  defp handle_c_response({:server_stats, c_stats}, %{controlling_process: c_pid} = state) do
+    send(c_pid, {:server_stats, parse_server_stats(c_stats)})
+    state
+  end
+
+  defp handle_c_response({:get_server_stats, caller_metadata, {:ok, c_stats}}, state) do
+    GenServer.reply(caller_metadata, {:ok, parse_server_stats(c_stats)})
+    state
+  end
+
+  defp handle_c_response({:get_server_stats, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_server_stats_interval, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_write_notifications, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_write_notification, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
   defp handle_c_response({:test, caller_metadata, data}, state) do
     GenServer.reply(caller_metadata, data)
     state
@@ -1110,6 +1721,11 @@ defmodule OpcUA.Server do
     state
   end
 
+  defp handle_c_response({:set_retransmission_queue_size, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
   defp handle_c_response({:set_users, caller_metadata, data}, state) do
     GenServer.reply(caller_metadata, data)
     state
@@ -1204,6 +1820,11 @@ defmodule OpcUA.Server do
     state
   end
 
+  defp handle_c_response({:add_structure_type, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
   defp handle_c_response({:add_reference, caller_metadata, data}, state) do
     GenServer.reply(caller_metadata, data)
     state
@@ -1247,4 +1868,153 @@ defmodule OpcUA.Server do
     GenServer.reply(caller_metadata, data)
     state
   end
+
+  defp handle_c_response({:set_history_store, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_node_history, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response(
+         {:method_call, call_id, {c_object_id, c_method_id, c_arguments}},
+         %{controlling_process: c_pid} = state
+       ) do
+    arguments = Enum.map(c_arguments, &parse_c_value/1)
+    send(c_pid, {:method_call, call_id, parse_c_value(c_object_id), parse_c_value(c_method_id), arguments})
+    state
+  end
+
+  defp handle_c_response({:lazy_read, c_node_id}, %{controlling_process: c_pid} = state) do
+    send(c_pid, {:lazy_read, parse_c_value(c_node_id)})
+    state
+  end
+
+  defp handle_c_response({:set_node_lazy_read, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_lazy_value, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:add_method_node, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_method_call_config, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_method_result, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:create_event, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, parse_node_id(data))
+    state
+  end
+
+  defp handle_c_response({:set_event_fields, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:trigger_event, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:trigger_events, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp parse_server_stats(c_stats) do
+    Map.new(c_stats, fn
+      {:services, services} ->
+        {:services, Map.new(services, fn {name, total, errors} -> {name, %{total: total, errors: errors}} end)}
+
+      {:commands, commands} ->
+        {:commands,
+         Map.new(commands, fn {name, count, p50, p90, p99, max} ->
+           {name, %{count: count, p50: p50, p90: p90, p99: p99, max: max}}
+         end)}
+
+      stat ->
+        stat
+    end)
+  end
+
+  defp parse_write_value({:error, status}) when is_binary(status), do: {:error, status}
+  defp parse_write_value(c_value), do: parse_c_value(c_value)
+
+  defp write_target_to_c(%NodeId{} = node_id), do: {:node, to_c(node_id)}
+  defp write_target_to_c(ns_index) when is_integer(ns_index) and ns_index >= 0, do: {:namespace, ns_index}
+  defp write_target_to_c(_target), do: :error
+
+  defp write_mode_to_c(false), do: 0
+  defp write_mode_to_c(true), do: 1
+  defp write_mode_to_c(:default), do: 2
+  defp write_mode_to_c(_mode), do: :error
+
+  defp server_object(), do: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2253)
+
+  defp event_to_c({%NodeId{} = event_type, fields}), do: event_to_c({event_type, server_object(), fields})
+
+  defp event_to_c({%NodeId{} = event_type, %NodeId{} = origin, fields}) do
+    with  c_fields when is_list(c_fields) <- event_fields_to_c(fields),
+          do: {to_c(event_type), to_c(origin), c_fields}
+  end
+
+  defp event_to_c(_event), do: :error
+
+  defp event_fields_to_c(fields) when is_list(fields) do
+    c_fields = Enum.map(fields, &event_field_to_c/1)
+    if Enum.all?(c_fields, &is_tuple/1), do: c_fields, else: :error
+  end
+
+  defp event_fields_to_c(_fields), do: :error
+
+  defp event_field_to_c({name, value}) when is_binary(name),
+    do: event_field_to_c({QualifiedName.new(ns_index: 0, name: name), value})
+
+  defp event_field_to_c({%QualifiedName{} = name, value}) do
+    with  c_value when is_tuple(c_value) <- variant_to_c(value),
+          do: {to_c(name), c_value}
+  end
+
+  defp event_field_to_c(_field), do: :error
+
+  defp method_arguments_to_c(arguments) when is_list(arguments) do
+    c_arguments = Enum.map(arguments, &method_argument_to_c/1)
+    if Enum.all?(c_arguments, &is_tuple/1), do: {:ok, c_arguments}, else: :error
+  end
+
+  defp method_arguments_to_c(_arguments), do: :error
+
+  defp method_argument_to_c({name, data_type}), do: method_argument_to_c({name, data_type, -1})
+
+  defp method_argument_to_c({name, data_type, value_rank})
+       when is_binary(name) and is_integer(data_type) and data_type >= 0 and is_integer(value_rank),
+       do: {name, data_type, value_rank}
+
+  defp method_argument_to_c(_argument), do: :error
+
+  # Arrays go as tuples, lists of small integers would reach the port as strings.
+  defp variant_to_c({data_type, values}) when is_integer(data_type) and is_list(values),
+    do: {data_type, true, values |> Enum.map(&value_to_c(data_type, &1)) |> List.to_tuple()}
+
+  defp variant_to_c({data_type, value}) when is_integer(data_type),
+    do: {data_type, false, value_to_c(data_type, value)}
+
+  defp variant_to_c(_value), do: :error
 end
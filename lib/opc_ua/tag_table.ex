@@ -0,0 +1,69 @@
+defmodule OpcUA.TagTable do
+  @moduledoc """
+  Opt-in ETS table with the latest value of every tag seen by an `OpcUA.Client`
+  (monitored items notifications) or an `OpcUA.Server` (values written by clients).
+
+  The table is owned (and only written) by the process that owns the port, but it is
+  created with `read_concurrency: true` and readers access it directly, so reads never
+  message the Client/Server GenServer and scale with the number of reader processes.
+
+  Enable it with the `:tag_table` option, its value is the name of the table:
+
+  ```elixir
+  {:ok, c_pid} = OpcUA.Client.start_link(tag_table: :plc_tags)
+  # ... subscription & monitored items ...
+  {:ok, value} = OpcUA.TagTable.read(:plc_tags, node_id)
+  ```
+  """
+
+  alias OpcUA.NodeId
+
+  @doc false
+  @spec new(atom() | nil) :: atom() | nil
+  def new(nil), do: nil
+
+  def new(name) when is_atom(name),
+    do: :ets.new(name, [:set, :protected, :named_table, read_concurrency: true])
+
+  @doc false
+  @spec put(atom() | nil, %NodeId{}, term()) :: true | nil
+  def put(nil, _node_id, _value), do: nil
+
+  def put(table, %NodeId{} = node_id, value),
+    do: :ets.insert(table, {node_id, value, System.system_time(:millisecond)})
+
+  @doc false
+  @spec delete(atom() | nil, %NodeId{}) :: true | nil
+  def delete(nil, _node_id), do: nil
+  def delete(table, %NodeId{} = node_id), do: :ets.delete(table, node_id)
+
+  @doc """
+  Reads the latest value of a tag.
+  """
+  @spec read(atom(), %NodeId{}) :: {:ok, term()} | {:error, :not_found}
+  def read(table, %NodeId{} = node_id) do
+    case :ets.lookup(table, node_id) do
+      [{_node_id, value, _updated_at}] -> {:ok, value}
+      [] -> {:error, :not_found}
+    end
+  end
+
+  @doc """
+  Reads the latest value of many tags.
+  """
+  @spec read_many(atom(), [%NodeId{}]) :: [{:ok, term()} | {:error, :not_found}]
+  def read_many(table, node_ids) when is_list(node_ids),
+    do: Enum.map(node_ids, &read(table, &1))
+
+  @doc """
+  Reads the latest value of a tag along with the system time (in milliseconds) it was updated.
+  """
+  @spec read_with_timestamp(atom(), %NodeId{}) ::
+          {:ok, {term(), integer()}} | {:error, :not_found}
+  def read_with_timestamp(table, %NodeId{} = node_id) do
+    case :ets.lookup(table, node_id) do
+      [{_node_id, value, updated_at}] -> {:ok, {value, updated_at}}
+      [] -> {:error, :not_found}
+    end
+  end
+end
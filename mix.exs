@@ -59,6 +59,7 @@ defmodule Opex62541.MixProject do
           OpcUA.Client,
           OpcUA.Server,
           OpcUA.Common,
+          OpcUA.TagTable,
         ],
         "Information Modeling": [
           OpcUA.BaseNodeAttrs,
@@ -128,6 +129,7 @@ defmodule Opex62541.MixProject do
   defp deps do
     [
       {:elixir_cmake, "~> 0.8"},
+      {:telemetry, "~> 1.0"},
       {:ex_doc, "~> 0.28", only: :dev, runtime: false},
       {:credo, "~> 1.7", only: [:dev, :test], runtime: false}
     ]
@@ -13,6 +13,11 @@ FILE *log_location;
 
 const char response_id = 'r';
 bool server_is_writing = false;
+// Optional hook used by the client to decode ExtensionObjects of not yet known (server-defined) types.
+// It receives every value of a response at once, so the type cache is validated once per response.
+void (*decode_extension_objects)(void *entity, UA_Variant **values, size_t values_size) = NULL;
+// Optional hook used by the server to filter and batch the write notifications sent to Elixir.
+void (*notify_write)(const UA_NodeId *node_id, const UA_Variant *value) = NULL;
 
 /**
  * @return a monotonic timestamp in milliseconds
@@ -364,6 +369,212 @@ UA_LocalizedText assemble_localized_text(const char *req, int *req_index)
     return localized_text;
 }
 
+static UA_StatusCode assemble_variant_element(const char *req, int *req_index, const UA_DataType *type, void *data)
+{
+    int term_size;
+    int term_type;
+    long integer;
+    unsigned long uinteger;
+    long long integer64;
+    double number;
+
+    switch (type->typeKind)
+    {
+        case UA_DATATYPEKIND_BOOLEAN:
+            {
+                int boolean;
+                if (ei_decode_boolean(req, req_index, &boolean) < 0)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+                *(UA_Boolean *)data = boolean;
+            }
+        break;
+
+        case UA_DATATYPEKIND_SBYTE:
+        case UA_DATATYPEKIND_INT16:
+        case UA_DATATYPEKIND_INT32:
+        case UA_DATATYPEKIND_ENUM:
+            if (ei_decode_long(req, req_index, &integer) < 0)
+                return UA_STATUSCODE_BADTYPEMISMATCH;
+
+            if (type->typeKind == UA_DATATYPEKIND_SBYTE)
+                *(UA_SByte *)data = (UA_SByte)integer;
+            else if (type->typeKind == UA_DATATYPEKIND_INT16)
+                *(UA_Int16 *)data = (UA_Int16)integer;
+            else
+                *(UA_Int32 *)data = (UA_Int32)integer;
+        break;
+
+        case UA_DATATYPEKIND_BYTE:
+        case UA_DATATYPEKIND_UINT16:
+        case UA_DATATYPEKIND_UINT32:
+        case UA_DATATYPEKIND_STATUSCODE:
+            if (ei_decode_ulong(req, req_index, &uinteger) < 0)
+                return UA_STATUSCODE_BADTYPEMISMATCH;
+
+            if (type->typeKind == UA_DATATYPEKIND_BYTE)
+                *(UA_Byte *)data = (UA_Byte)uinteger;
+            else if (type->typeKind == UA_DATATYPEKIND_UINT16)
+                *(UA_UInt16 *)data = (UA_UInt16)uinteger;
+            else
+                *(UA_UInt32 *)data = (UA_UInt32)uinteger;
+        break;
+
+        case UA_DATATYPEKIND_INT64:
+        case UA_DATATYPEKIND_DATETIME:
+            if (ei_decode_longlong(req, req_index, &integer64) < 0)
+                return UA_STATUSCODE_BADTYPEMISMATCH;
+            *(UA_Int64 *)data = (UA_Int64)integer64;
+        break;
+
+        case UA_DATATYPEKIND_UINT64:
+            {
+                unsigned long long uinteger64;
+                if (ei_decode_ulonglong(req, req_index, &uinteger64) < 0)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+                *(UA_UInt64 *)data = (UA_UInt64)uinteger64;
+            }
+        break;
+
+        case UA_DATATYPEKIND_FLOAT:
+        case UA_DATATYPEKIND_DOUBLE:
+            // Integers are accepted as well (e.g. 5 for a Double argument)
+            if (ei_decode_double(req, req_index, &number) < 0) {
+                if (ei_decode_longlong(req, req_index, &integer64) < 0)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+                number = (double)integer64;
+            }
+
+            if (type->typeKind == UA_DATATYPEKIND_FLOAT)
+                *(UA_Float *)data = (UA_Float)number;
+            else
+                *(UA_Double *)data = number;
+        break;
+
+        case UA_DATATYPEKIND_STRING:
+        case UA_DATATYPEKIND_BYTESTRING:
+        case UA_DATATYPEKIND_XMLELEMENT:
+            {
+                if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+
+                UA_ByteString *string = (UA_ByteString *)data;
+                if (term_size > 0 && UA_ByteString_allocBuffer(string, term_size) != UA_STATUSCODE_GOOD)
+                    return UA_STATUSCODE_BADOUTOFMEMORY;
+
+                long binary_len;
+                if (ei_decode_binary(req, req_index, string->data, &binary_len) < 0)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+            }
+        break;
+
+        case UA_DATATYPEKIND_NODEID:
+            *(UA_NodeId *)data = assemble_node_id(req, req_index);
+        break;
+
+        case UA_DATATYPEKIND_EXPANDEDNODEID:
+            *(UA_ExpandedNodeId *)data = assemble_expanded_node_id(req, req_index);
+        break;
+
+        case UA_DATATYPEKIND_QUALIFIEDNAME:
+            *(UA_QualifiedName *)data = assemble_qualified_name(req, req_index);
+        break;
+
+        case UA_DATATYPEKIND_LOCALIZEDTEXT:
+            *(UA_LocalizedText *)data = assemble_localized_text(req, req_index);
+        break;
+
+        case UA_DATATYPEKIND_EXTENSIONOBJECT:
+            // {encoding_id, body}: an already encoded structure, e.g. of a server-defined type
+            {
+                UA_ExtensionObject *object = (UA_ExtensionObject *)data;
+
+                if (ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 2)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+
+                object->encoding = UA_EXTENSIONOBJECT_ENCODED_BYTESTRING;
+                object->content.encoded.typeId = assemble_node_id(req, req_index);
+
+                if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+
+                UA_ByteString *body = &object->content.encoded.body;
+                if (term_size > 0 && UA_ByteString_allocBuffer(body, term_size) != UA_STATUSCODE_GOOD)
+                    return UA_STATUSCODE_BADOUTOFMEMORY;
+
+                long binary_len;
+                if (ei_decode_binary(req, req_index, body->data, &binary_len) < 0)
+                    return UA_STATUSCODE_BADTYPEMISMATCH;
+            }
+        break;
+
+        default:
+            return UA_STATUSCODE_BADNOTSUPPORTED;
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  Assembles a Variant from a {data_type, is_array, value} tuple, where data_type is the UA_TYPES index
+ *  and arrays come as tuples (lists of small integers would be encoded as strings).
+ *  Only builtin types are supported, ExtensionObjects as {encoding_id, body}; a failed Variant is
+ *  left empty.
+ */
+UA_StatusCode assemble_variant(const char *req, int *req_index, UA_Variant *value)
+{
+    int term_size;
+    int is_array;
+    unsigned long data_type;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    UA_Variant_init(value);
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, "assemble_variant requires a 3-tuple, term_size = %d", term_size);
+
+    if (ei_decode_ulong(req, req_index, &data_type) < 0 || data_type >= UA_TYPES_COUNT)
+        return UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+
+    if (ei_decode_boolean(req, req_index, &is_array) < 0)
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    const UA_DataType *type = &UA_TYPES[data_type];
+
+    if (!is_array) {
+        void *data = UA_new(type);
+        if (data == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+
+        retval = assemble_variant_element(req, req_index, type, data);
+        if (retval != UA_STATUSCODE_GOOD) {
+            UA_delete(data, type);
+            return retval;
+        }
+
+        UA_Variant_setScalar(value, data, type);
+        return UA_STATUSCODE_GOOD;
+    }
+
+    if (ei_decode_tuple_header(req, req_index, &term_size) < 0)
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    void *array = UA_Array_new(term_size, type);
+    if (array == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    for (int i = 0; i < term_size && retval == UA_STATUSCODE_GOOD; i++)
+        retval = assemble_variant_element(req, req_index, type, (char *)array + i * type->memSize);
+
+    if (retval != UA_STATUSCODE_GOOD) {
+        UA_Array_delete(array, term_size, type);
+        return retval;
+    }
+
+    UA_Variant_setArray(value, array, term_size, type);
+    return UA_STATUSCODE_GOOD;
+}
+
 /***************************/
 /* Elixir Message encoders */
 /***************************/
@@ -818,6 +1029,74 @@ void encode_array_dimensions_struct(char *resp, int *resp_index, void *data, int
         ei_encode_empty_list(resp, resp_index);
 }
 
+/*
+ *  Encodes a structure (including server-defined types registered in customDataTypes) as a map
+ *  of member name => value. Members are walked with the same layout rules the generated types use.
+ *  %{"field" => value}
+ */
+void encode_structure(char *resp, int *resp_index, void *data, const UA_DataType *type)
+{
+    uintptr_t ptr = (uintptr_t)data;
+    UA_Variant member_value;
+
+    ei_encode_map_header(resp, resp_index, type->membersSize);
+
+    for(size_t i = 0; i < type->membersSize; i++) {
+        const UA_DataTypeMember *member = &type->members[i];
+        ptr += member->padding;
+
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+        const char *member_name = member->memberName ? member->memberName : "";
+        ei_encode_binary(resp, resp_index, member_name, strlen(member_name));
+#else
+        ei_encode_ulong(resp, resp_index, i);
+#endif
+
+        UA_Variant_init(&member_value);
+
+        if(member->isArray) {
+            size_t array_size = *(size_t *)ptr;
+            ptr += sizeof(size_t);
+            UA_Variant_setArray(&member_value, *(void **)ptr, array_size, member->memberType);
+            ptr += sizeof(void *);
+            encode_variant_array_struct(resp, resp_index, &member_value);
+        }
+        else if(member->isOptional) {
+            void *field = *(void **)ptr;
+            ptr += sizeof(void *);
+            if(field == NULL) {
+                ei_encode_atom(resp, resp_index, "nil");
+                continue;
+            }
+            UA_Variant_setScalar(&member_value, field, member->memberType);
+            encode_variant_scalar_struct(resp, resp_index, &member_value, 0);
+        }
+        else {
+            UA_Variant_setScalar(&member_value, (void *)ptr, member->memberType);
+            encode_variant_scalar_struct(resp, resp_index, &member_value, 0);
+            ptr += member->memberType->memSize;
+        }
+    }
+}
+
+/*
+ *  Only decoded ExtensionObjects can be encoded, undecoded bodies (unknown types) stay as :error.
+ */
+void encode_extension_object(char *resp, int *resp_index, void *data)
+{
+    UA_ExtensionObject *object = (UA_ExtensionObject *)data;
+    UA_Variant content;
+
+    if(object->encoding < UA_EXTENSIONOBJECT_DECODED || object->content.decoded.type == NULL) {
+        ei_encode_atom(resp, resp_index, "error");
+        return;
+    }
+
+    UA_Variant_init(&content);
+    UA_Variant_setScalar(&content, object->content.decoded.data, object->content.decoded.type);
+    encode_variant_scalar_struct(resp, resp_index, &content, 0);
+}
+
 void encode_variant_scalar_struct(char *resp, int *resp_index, void *data, size_t index)
 {
     UA_Variant value = *(UA_Variant *) data;
@@ -930,12 +1209,21 @@ void encode_variant_scalar_struct(char *resp, int *resp_index, void *data, size_
             encode_localized_text(resp, resp_index, ((UA_LocalizedText *)value.data + index));
         break;
 
-        // // TODO: UA_TYPES_EXTENSIONOBJECT
+        case UA_DATATYPEKIND_STRUCTURE:
+        case UA_DATATYPEKIND_OPTSTRUCT:
+            encode_structure(resp, resp_index, (UA_Byte *)value.data + index * value.type->memSize, value.type);
+        break;
+
+        case UA_DATATYPEKIND_EXTENSIONOBJECT:
+            encode_extension_object(resp, resp_index, ((UA_ExtensionObject *)value.data + index));
+        break;
+
+        case UA_DATATYPEKIND_VARIANT:
+            encode_variant_struct(resp, resp_index, ((UA_Variant *)value.data + index));
+        break;
     
         // // TODO: UA_TYPES_DATAVALUE
 
-        // // TODO: UA_TYPES_VARIANT
-
         // // TODO: UA_TYPES_DIAGNOSTICINFO
     
         default:
@@ -1136,6 +1424,30 @@ void free_caller_metadata()
     free(caller_metadata_ptr);
 }
 
+/*
+ *  Moves the metadata of the current request to caller, so the request can be answered later.
+ */
+void take_caller_metadata(Caller_metadata *caller)
+{
+    caller->function = caller_function;
+    caller->metadata = caller_metadata_ptr;
+    caller->size = caller_metadata_size;
+
+    caller_function = NULL;
+    caller_metadata_ptr = NULL;
+    caller_metadata_size = 0;
+}
+
+/*
+ *  Makes a taken caller metadata the current one again (freed by free_caller_metadata).
+ */
+void restore_caller_metadata(const Caller_metadata *caller)
+{
+    caller_function = caller->function;
+    caller_metadata_ptr = caller->metadata;
+    caller_metadata_size = caller->size;
+}
+
 /***************************/
 /* Elixir Message senders */
 /***************************/
@@ -1197,6 +1509,7 @@ void send_monitored_item_response(void *subscription_id, void *monitored_id, voi
     encode_data_response(resp, &resp_index, data, data_type, 0);
 
     erlcmd_send(resp, resp_index);
+    notifications_sent++;
 }
 
 /**
@@ -1325,9 +1638,12 @@ void send_write_response(UA_Server *server,
                const UA_NodeId *nodeId, void *nodeContext,
                const UA_NumericRange *range, const UA_DataValue *data) {
 
-    if(server_is_writing) 
-    {
-        server_is_writing = false;
+    // Echo of a write from Elixir (same thread, see handle_write_node_value)
+    if(server_is_writing)
+        return;
+
+    if(notify_write != NULL) {
+        notify_write(nodeId, &data->value);
         return;
     }
 
@@ -1335,6 +1651,235 @@ void send_write_response(UA_Server *server,
     send_write_data_response(nodeId, &variant, 29);
 }
 
+/*******************/
+/* Port statistics */
+/*******************/
+
+/*
+ *  Latency of the port commands, in HDR-style histograms (4 buckets per power of two of us, up to
+ *  ~16 s) split in phases:
+ *   - decode: from reading the request to its handler (including the server command queue),
+ *   - call: the OPC UA service calls of the handler, only for the handlers that time them
+ *     (port_stats_service_begin/end), the others have no call histogram,
+ *   - send: writing the response frames.
+ *  Recording a command costs a few clock reads and counter increments. Commands are recorded by the
+ *  thread executing them, which is also the one encoding and sending them: the service and send
+ *  times are per-thread counters.
+ */
+uint64_t notifications_sent = 0;
+static Command_stats *command_stats = NULL;     // per request handler
+static size_t command_stats_size = 0;
+static __thread uint64_t service_us = 0;
+static __thread bool service_timed = false;
+
+static size_t histogram_bucket(uint64_t us)
+{
+    if(us < 4)
+        return (size_t)us;
+
+    int exponent = 63 - __builtin_clzll(us);
+    size_t bucket = (size_t)(exponent - 1) * 4 + (size_t)((us >> (exponent - 2)) & 3);
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+// Upper bound of a bucket.
+static uint64_t histogram_bucket_value(size_t bucket)
+{
+    if(bucket < 4)
+        return bucket;
+
+    size_t exponent = bucket / 4 + 1;
+    return ((uint64_t)(4 + bucket % 4 + 1) << (exponent - 2)) - 1;
+}
+
+void histogram_record(Histogram *histogram, uint64_t us)
+{
+    histogram->count++;
+    histogram->buckets[histogram_bucket(us)]++;
+    if(us > histogram->max_us)
+        histogram->max_us = us;
+}
+
+uint64_t histogram_percentile(const Histogram *histogram, uint64_t per_mille)
+{
+    uint64_t rank = (histogram->count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if(seen >= rank && seen > 0) {
+            uint64_t value = histogram_bucket_value(i);
+            return value < histogram->max_us ? value : histogram->max_us;
+        }
+    }
+
+    return histogram->max_us;
+}
+
+void port_stats_init(size_t handlers)
+{
+    command_stats = (Command_stats *)calloc(handlers, sizeof(Command_stats));
+    command_stats_size = command_stats != NULL ? handlers : 0;
+}
+
+void port_stats_clear()
+{
+    free(command_stats);
+    command_stats = NULL;
+    command_stats_size = 0;
+}
+
+static uint64_t elapsed_us(UA_DateTime from, UA_DateTime to)
+{
+    return to > from ? (uint64_t)((to - from) / UA_DATETIME_USEC) : 0;
+}
+
+/*
+ *  Times the OPC UA service call of the running handler, the calls of a handler add up.
+ */
+UA_DateTime port_stats_service_begin()
+{
+    return UA_DateTime_nowMonotonic();
+}
+
+void port_stats_service_end(UA_DateTime start)
+{
+    service_us += elapsed_us(start, UA_DateTime_nowMonotonic());
+    service_timed = true;
+}
+
+/*
+ *  Records a command executed by `handler`, `send_ns` is the time spent writing its frames.
+ */
+void port_stats_record(size_t handler, const char *name, UA_DateTime received, UA_DateTime decoded,
+                       UA_DateTime done, uint64_t send_ns)
+{
+    uint64_t call_us = service_us;
+    bool timed = service_timed;
+    service_us = 0;
+    service_timed = false;
+
+    if(handler >= command_stats_size)
+        return;
+
+    Command_stats *stats = &command_stats[handler];
+    stats->name = name;
+    histogram_record(&stats->decode, elapsed_us(received, decoded));
+    if(timed)
+        histogram_record(&stats->call, call_us);
+    histogram_record(&stats->send, send_ns / 1000);
+    histogram_record(&stats->total, elapsed_us(received, done));
+}
+
+static void encode_histogram(char *resp, int *resp_index, const Histogram *histogram)
+{
+    ei_encode_tuple_header(resp, resp_index, 4);
+    ei_encode_ulonglong(resp, resp_index, histogram_percentile(histogram, 500));
+    ei_encode_ulonglong(resp, resp_index, histogram_percentile(histogram, 900));
+    ei_encode_ulonglong(resp, resp_index, histogram_percentile(histogram, 990));
+    ei_encode_ulonglong(resp, resp_index, histogram->max_us);
+}
+
+/*
+ *  Output: [{name, count, p50_us, p90_us, p99_us, max_us}], total latency of the executed commands
+ */
+void encode_command_latencies(char *resp, int *resp_index)
+{
+    for(size_t i = 0; i < command_stats_size; i++) {
+        const Command_stats *stats = &command_stats[i];
+        if(stats->total.count == 0)
+            continue;
+
+        ei_encode_list_header(resp, resp_index, 1);
+        ei_encode_tuple_header(resp, resp_index, 6);
+        ei_encode_binary(resp, resp_index, stats->name, strlen(stats->name));
+        ei_encode_ulonglong(resp, resp_index, stats->total.count);
+        ei_encode_ulonglong(resp, resp_index, histogram_percentile(&stats->total, 500));
+        ei_encode_ulonglong(resp, resp_index, histogram_percentile(&stats->total, 900));
+        ei_encode_ulonglong(resp, resp_index, histogram_percentile(&stats->total, 990));
+        ei_encode_ulonglong(resp, resp_index, stats->total.max_us);
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
+
+/*
+ *  Output: {frames_in, bytes_in, frames_out, bytes_out, notifications,
+ *           [{name, count, decode, call | nil, send, total}]}, every phase as {p50_us, p90_us, p99_us, max_us}
+ */
+static void encode_port_stats_response(char *resp, int *resp_index)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
+
+    ei_encode_tuple_header(resp, resp_index, 6);
+    ei_encode_ulonglong(resp, resp_index, erlcmd_stats.frames_in);
+    ei_encode_ulonglong(resp, resp_index, erlcmd_stats.bytes_in);
+    ei_encode_ulonglong(resp, resp_index, erlcmd_stats.frames_out);
+    ei_encode_ulonglong(resp, resp_index, erlcmd_stats.bytes_out);
+    ei_encode_ulonglong(resp, resp_index, notifications_sent);
+
+    for(size_t i = 0; i < command_stats_size; i++) {
+        const Command_stats *stats = &command_stats[i];
+        if(stats->total.count == 0)
+            continue;
+
+        ei_encode_list_header(resp, resp_index, 1);
+        ei_encode_tuple_header(resp, resp_index, 6);
+        ei_encode_binary(resp, resp_index, stats->name, strlen(stats->name));
+        ei_encode_ulonglong(resp, resp_index, stats->total.count);
+        encode_histogram(resp, resp_index, &stats->decode);
+        if(stats->call.count > 0)
+            encode_histogram(resp, resp_index, &stats->call);
+        else
+            ei_encode_atom(resp, resp_index, "nil");
+        encode_histogram(resp, resp_index, &stats->send);
+        encode_histogram(resp, resp_index, &stats->total);
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
+
+/*
+ *  Input: reset (the command histograms start over once sent)
+ */
+void handle_get_port_stats(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int reset;
+
+    if(ei_decode_boolean(req, req_index, &reset) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    // Size pass first: the response must fit the {:packet, 2} port frame.
+    int resp_size = sizeof(uint16_t);
+    encode_port_stats_response(NULL, &resp_size);
+
+    if(resp_size > erlcmd_frame_limit()) {
+        send_error_response("overflow");
+        return;
+    }
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    int resp_index = sizeof(uint16_t);
+    encode_port_stats_response(resp, &resp_index);
+    erlcmd_send(resp, resp_index);
+    free(resp);
+
+    if(reset && command_stats != NULL)
+        memset(command_stats, 0, command_stats_size * sizeof(Command_stats));
+}
+
 /******************************/
 /* Node Addition and Deletion */
 /******************************/
@@ -2345,10 +2890,12 @@ void handle_write_node_value(void *entity, bool entity_type, const char *req, in
         return;
     }
 
+    UA_DateTime service = port_stats_service_begin();
     if(entity_type)
         retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, &value);
     else
         retval = UA_Server_readValue((UA_Server *)entity, node_id, &value); 
+    port_stats_service_end(service);
 
     if(retval != UA_STATUSCODE_GOOD) {
         UA_NodeId_clear(&node_id);
@@ -2895,6 +3442,7 @@ void handle_write_node_value(void *entity, bool entity_type, const char *req, in
         break;
     }
     
+    service = port_stats_service_begin();
     if(entity_type)
     {
         retval = UA_Client_writeValueAttribute((UA_Client *)entity, node_id, &value);
@@ -2903,7 +3451,9 @@ void handle_write_node_value(void *entity, bool entity_type, const char *req, in
     {
         server_is_writing = true;
         retval = UA_Server_writeValue((UA_Server *)entity, node_id, value);
+        server_is_writing = false;
     }
+    port_stats_service_end(service);
 
     UA_NodeId_clear(&node_id);
     
@@ -3347,6 +3897,7 @@ void handle_write_node_blank_array(void *entity, bool entity_type, const char *r
     {
         server_is_writing = true;
         retval = UA_Server_writeValue((UA_Server *)entity, node_id, value);
+        server_is_writing = false;
     }
     
     UA_Variant_clear(&value);
@@ -3917,10 +4468,12 @@ void handle_read_node_value(void *entity, bool entity_type, const char *req, int
         return;
     }
    
+    UA_DateTime service = port_stats_service_begin();
     if(entity_type)
         retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, value);
     else
         retval = UA_Server_readValue((UA_Server *)entity, node_id, value);
+    port_stats_service_end(service);
 
     UA_NodeId_clear(&node_id);
 
@@ -3931,6 +4484,9 @@ void handle_read_node_value(void *entity, bool entity_type, const char *req, int
         return;
     }
 
+    if(entity_type && decode_extension_objects != NULL)
+        decode_extension_objects(entity, &value, 1);
+
     send_data_response(value, 29, 0);
     
     UA_Variant_clear(value);
@@ -4026,14 +4582,23 @@ void handle_read_node_values(void *entity, bool entity_type, const char *req, in
     readRequest.nodesToRead = nodesToRead;
     readRequest.nodesToReadSize = node_count;
 
+    UA_DateTime service = port_stats_service_begin();
     UA_ReadResponse readResponse = UA_Client_Service_read((UA_Client *)entity, readRequest);
+    port_stats_service_end(service);
+
+    if(decode_extension_objects != NULL && readResponse.resultsSize <= (size_t)node_count) {
+        UA_Variant *values[100];
+        for(size_t i = 0; i < readResponse.resultsSize; i++)
+            values[i] = &readResponse.results[i].value;
+        decode_extension_objects(entity, values, readResponse.resultsSize);
+    }
 
     // Size pass first: the response must fit the {:packet, 2} port frame
     // (uint16_t length), so it is bounds-checked before any byte is written.
     int resp_size = sizeof(uint16_t);
     encode_read_node_values_response(NULL, &resp_size, &readResponse);
 
-    if(resp_size > ERLCMD_BUF_SIZE * 2) {
+    if(resp_size > erlcmd_frame_limit()) {
         UA_ReadResponse_clear(&readResponse);
         UA_Array_delete(nodesToRead, node_count, &UA_TYPES[UA_TYPES_READVALUEID]);
         send_error_response("overflow");
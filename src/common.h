@@ -51,6 +51,42 @@ uint64_t current_time();
 
 static char *caller_function;
 
+extern const char response_id;
+extern bool server_is_writing;
+extern void (*decode_extension_objects)(void *entity, UA_Variant **values, size_t values_size);
+extern void (*notify_write)(const UA_NodeId *node_id, const UA_Variant *value);
+
+/*
+ * Port statistics: latency histograms, 4 buckets per power of two of us
+ */
+#define HISTOGRAM_BUCKETS 96
+
+typedef struct {
+    uint64_t count;
+    uint64_t max_us;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+typedef struct {
+    const char *name;
+    Histogram decode;
+    Histogram call;
+    Histogram send;
+    Histogram total;
+} Command_stats;
+
+extern uint64_t notifications_sent;
+
+void histogram_record(Histogram *histogram, uint64_t us);
+uint64_t histogram_percentile(const Histogram *histogram, uint64_t per_mille);
+void port_stats_init(size_t handlers);
+void port_stats_clear();
+void port_stats_record(size_t handler, const char *name, UA_DateTime received, UA_DateTime decoded,
+                       UA_DateTime done, uint64_t send_ns);
+UA_DateTime port_stats_service_begin();
+void port_stats_service_end(UA_DateTime start);
+void encode_command_latencies(char *resp, int *resp_index);
+
 static char *caller_metadata_ptr;
 static size_t caller_metadata_size = 0;
 
@@ -59,6 +95,7 @@ UA_NodeId assemble_node_id(const char *req, int *req_index);
 UA_ExpandedNodeId assemble_expanded_node_id(const char *req, int *req_index);
 UA_QualifiedName assemble_qualified_name(const char *req, int *req_index);
 UA_LocalizedText assemble_localized_text(const char *req, int *req_index);
+UA_StatusCode assemble_variant(const char *req, int *req_index, UA_Variant *value);
 
 // Elixir Message assemblers
 void encode_client_config(char *resp, int *resp_index, void *data);
@@ -67,6 +104,16 @@ void encode_application_description_struct(char *resp, int *resp_index, void *da
 void encode_endpoint_description_struct(char *resp, int *resp_index, void *data, int data_len);
 void encode_array_dimensions_struct(char *resp, int *resp_index, void *data, int data_len);
 void encode_server_config(char *resp, int *resp_index, void *data);
+void encode_node_id(char *resp, int *resp_index, void *data);
+void encode_expanded_node_id(char *resp, int *resp_index, void *data);
+void encode_qualified_name(char *resp, int *resp_index, void *data);
+void encode_localized_text(char *resp, int *resp_index, void *data);
+void encode_structure(char *resp, int *resp_index, void *data, const UA_DataType *type);
+void encode_extension_object(char *resp, int *resp_index, void *data);
+void encode_variant_scalar_struct(char *resp, int *resp_index, void *data, size_t index);
+void encode_variant_array_struct(char *resp, int *resp_index, void *data);
+void encode_variant_struct(char *resp, int *resp_index, void *data);
+void encode_caller_metadata(char *req, int *req_index);
 void send_subscription_timeout_response(void *data, int data_type, int data_len);
 void send_subscription_deleted_response(void *data, int data_type, int data_len);
 void send_monitored_item_response(void *subscription_id, void *monitored_id, void *data, int data_type);
@@ -75,13 +122,28 @@ void send_data_response(void *data, int data_type, int data_len);
 void send_error_response(const char *reason);
 void send_ok_response();
 void send_opex_response(uint32_t reason);
+void send_write_response(UA_Server *server,
+               const UA_NodeId *sessionId, void *sessionContext,
+               const UA_NodeId *nodeId, void *nodeContext,
+               const UA_NumericRange *range, const UA_DataValue *data);
 
 //Elixir message decoders
 void handle_caller_metadata(const char *req, int *req_index, const char* cmd);
 void free_caller_metadata();
 
+// Caller metadata of a request answered after its handler returned
+typedef struct {
+    char *function;
+    char *metadata;
+    size_t size;
+} Caller_metadata;
+
+void take_caller_metadata(Caller_metadata *caller);
+void restore_caller_metadata(const Caller_metadata *caller);
+
 //Client and Server common handlers
 void handle_test(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_get_port_stats(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_variable_node(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_variable_type_node(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_object_node(void *entity, bool entity_type, const char *req, int *req_index);
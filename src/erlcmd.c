@@ -23,6 +23,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifndef __WIN32__
+#include <pthread.h>
+#include <time.h>
+#endif
 
 #ifdef __WIN32__
 // Assume that all windows platforms are little endian
@@ -187,24 +191,59 @@ void erlcmd_init(struct erlcmd *handler,
 #endif
 }
 
+struct erlcmd_stats erlcmd_stats = {0};
+__thread uint64_t erlcmd_send_ns = 0;
+
+#ifndef __WIN32__
+// Responses may be sent from several threads (e.g. the server thread callbacks), frames must not interleave.
+static pthread_mutex_t erlcmd_send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t erlcmd_now_ns()
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return ((uint64_t) tp.tv_sec) * 1000000000 + tp.tv_nsec;
+}
+#endif
+
+#define ERLCMD_MAX_PREFIX 8
+
+// Per thread, so frames sent by worker threads carry their own prefix
+static __thread char erlcmd_prefix[ERLCMD_MAX_PREFIX];
+static __thread size_t erlcmd_prefix_len = 0;
+
 /**
- * @brief Synchronously send a response back to Erlang
+ * @brief Set the bytes written at the start of every following frame of the calling thread
  *
- * @param response what to send back
+ * @param prefix the bytes, NULL to send frames as they are
+ * @param len the number of bytes, at most ERLCMD_MAX_PREFIX
  */
-void erlcmd_send(char *response, size_t len)
+void erlcmd_set_prefix(const char *prefix, size_t len)
 {
-    uint16_t be_len = TO_BIGENDIAN16(len - sizeof(uint16_t));
-    memcpy(response, &be_len, sizeof(be_len));
+    if (len > ERLCMD_MAX_PREFIX)
+        errx(EXIT_FAILURE, "Frame prefix too long: %d bytes", (int) len);
 
-#ifdef __WIN32__
-    BOOL rc = WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), response, len, NULL, NULL);
-    if (!rc)
-        errx(EXIT_FAILURE, "WriteFile to stdout failed (Erlang exit?)");
-#else
+    if (prefix != NULL)
+        memcpy(erlcmd_prefix, prefix, len);
+    erlcmd_prefix_len = prefix != NULL ? len : 0;
+}
+
+/**
+ * @brief The largest frame (length header included) erlcmd_send takes from the calling thread
+ *
+ * The prefix is part of the {packet, 2} payload, so it is taken out of the frame.
+ */
+int erlcmd_frame_limit()
+{
+    return ERLCMD_BUF_SIZE * 2 - (int) erlcmd_prefix_len;
+}
+
+#ifndef __WIN32__
+static void erlcmd_write_all(const char *buffer, size_t len)
+{
     size_t wrote = 0;
-    do {        
-        ssize_t amount_written = write(STDOUT_FILENO, response + wrote, len - wrote);
+    do {
+        ssize_t amount_written = write(STDOUT_FILENO, buffer + wrote, len - wrote);
         if (amount_written < 0) {
             if (errno == EINTR)
                 continue;
@@ -213,6 +252,51 @@ void erlcmd_send(char *response, size_t len)
         }
         wrote += amount_written;
     } while (wrote < len);
+}
+#endif
+
+/**
+ * @brief Synchronously send a response back to Erlang
+ *
+ * @param response what to send back
+ */
+void erlcmd_send(char *response, size_t len)
+{
+    // A wrong length header would desync the port (and every session it hosts)
+    if (len - sizeof(uint16_t) + erlcmd_prefix_len > UINT16_MAX)
+        errx(EXIT_FAILURE, "Frame too large: %d bytes", (int) len);
+
+    uint16_t be_len = TO_BIGENDIAN16(len - sizeof(uint16_t) + erlcmd_prefix_len);
+
+#ifdef __WIN32__
+    char header[sizeof(uint16_t) + ERLCMD_MAX_PREFIX];
+    memcpy(header, &be_len, sizeof(be_len));
+    memcpy(header + sizeof(be_len), erlcmd_prefix, erlcmd_prefix_len);
+
+    BOOL rc = WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), header, sizeof(be_len) + erlcmd_prefix_len, NULL, NULL) &&
+              WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), response + sizeof(uint16_t), len - sizeof(uint16_t), NULL, NULL);
+    if (!rc)
+        errx(EXIT_FAILURE, "WriteFile to stdout failed (Erlang exit?)");
+    erlcmd_stats.frames_out++;
+    erlcmd_stats.bytes_out += len - sizeof(uint16_t) + erlcmd_prefix_len;
+#else
+    pthread_mutex_lock(&erlcmd_send_lock);
+    uint64_t start = erlcmd_now_ns();
+    if (erlcmd_prefix_len == 0) {
+        memcpy(response, &be_len, sizeof(be_len));
+        erlcmd_write_all(response, len);
+    } else {
+        // The prefix goes between the length and the frame, the frame itself is left untouched
+        char header[sizeof(uint16_t) + ERLCMD_MAX_PREFIX];
+        memcpy(header, &be_len, sizeof(be_len));
+        memcpy(header + sizeof(be_len), erlcmd_prefix, erlcmd_prefix_len);
+        erlcmd_write_all(header, sizeof(be_len) + erlcmd_prefix_len);
+        erlcmd_write_all(response + sizeof(uint16_t), len - sizeof(uint16_t));
+    }
+    erlcmd_stats.frames_out++;
+    erlcmd_stats.bytes_out += len - sizeof(uint16_t) + erlcmd_prefix_len;
+    pthread_mutex_unlock(&erlcmd_send_lock);
+    erlcmd_send_ns += erlcmd_now_ns() - start;
 #endif
 }
 
@@ -237,6 +321,8 @@ static size_t erlcmd_try_dispatch(struct erlcmd *handler)
     if (msglen + sizeof(uint16_t) > handler->index)
         return 0;
 
+    erlcmd_stats.frames_in++;
+    erlcmd_stats.bytes_in += msglen;
     handler->request_handler(handler->buffer, handler->cookie);
 
     return msglen + sizeof(uint16_t);
@@ -18,6 +18,7 @@
 #define ERLCMD_H
 
 #include <ei.h>
+#include <stdint.h>
 
 #ifdef __WIN32__
 #include <windows.h>
@@ -46,10 +47,27 @@ struct erlcmd
 #endif
 };
 
+/*
+ * Port traffic, frames are counted without their length header
+ */
+struct erlcmd_stats
+{
+    uint64_t frames_in;
+    uint64_t bytes_in;
+    uint64_t frames_out;
+    uint64_t bytes_out;
+};
+
+extern struct erlcmd_stats erlcmd_stats;
+// Time spent writing frames by the calling thread
+extern __thread uint64_t erlcmd_send_ns;
+
 void erlcmd_init(struct erlcmd *handler,
 		 void (*request_handler)(const char *req, void *cookie),
 		 void *cookie);
 void erlcmd_send(char *response, size_t len);
+void erlcmd_set_prefix(const char *prefix, size_t len);
+int erlcmd_frame_limit();
 int erlcmd_process(struct erlcmd *handler);
 
 #ifdef __WIN32__
@@ -0,0 +1,142 @@
+/*
+ *  Ingestion throughput of the server on-disk history store, without the port nor the network: the
+ *  samples go through the history database hook (lock, node lookup, append, flush of the full write
+ *  buffers) and the store is then reopened to time the rebuild of the indexes.
+ *
+ *    priv/history_store_bench [nodes] [samples_per_node] [buffered_values]
+ *
+ *  Exits with 1 when the ingestion is below HISTORY_BENCH_TARGET samples/s.
+ */
+#define main opc_ua_server_main
+#include "opc_ua_server.c"
+#undef main
+
+#define HISTORY_BENCH_TARGET 50000          // samples/s
+#define HISTORY_BENCH_SEGMENT_SIZE (16 * 1024 * 1024)
+
+#ifdef UA_ENABLE_HISTORIZING
+
+static double elapsed_seconds(UA_DateTime start)
+{
+    return (double)(UA_DateTime_nowMonotonic() - start) / UA_DATETIME_SEC;
+}
+
+static void remove_store(const char *path)
+{
+    DIR *dir = opendir(path);
+    if(dir == NULL)
+        return;
+
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL) {
+        size_t size = strlen(path) + strlen(entry->d_name) + 2;
+        char *file = (char *)malloc(size);
+        if(file == NULL)
+            continue;
+        snprintf(file, size, "%s/%s", path, entry->d_name);
+        if(entry->d_name[0] != '.')
+            unlink(file);
+        free(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+static UA_StatusCode open_store(const char *path, unsigned long nodes, unsigned long buffered)
+{
+    pthread_mutex_lock(&history_lock);
+    UA_StatusCode retval = history_store_open(path, HISTORY_BENCH_SEGMENT_SIZE, 0, 0);
+    for(unsigned long i = 0; retval == UA_STATUSCODE_GOOD && i < nodes; i++) {
+        UA_NodeId node_id = UA_NODEID_NUMERIC(1, (UA_UInt32)(i + 1));
+        retval = history_add(&node_id, buffered, true);
+    }
+    pthread_mutex_unlock(&history_lock);
+
+    return retval;
+}
+
+static void close_store()
+{
+    pthread_mutex_lock(&history_lock);
+    history_store_close();
+    history_clear();
+    pthread_mutex_unlock(&history_lock);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long nodes = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+    unsigned long samples = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+    unsigned long buffered = argc > 3 ? strtoul(argv[3], NULL, 10) : 1024;
+    if(nodes == 0 || samples == 0 || buffered == 0 || buffered > HISTORY_MAX_CAPACITY)
+        errx(EXIT_FAILURE, "usage: %s [nodes] [samples_per_node] [buffered_values]", argv[0]);
+
+    char path[] = "/tmp/opex_history_bench_XXXXXX";
+    if(mkdtemp(path) == NULL)
+        err(EXIT_FAILURE, "mkdtemp");
+
+    if(open_store(path, nodes, buffered) != UA_STATUSCODE_GOOD)
+        errx(EXIT_FAILURE, "can not open the history store in %s", path);
+
+    UA_DataValue value;
+    UA_DataValue_init(&value);
+    UA_Double sample = 0.0;
+    UA_Variant_setScalar(&value.value, &sample, &UA_TYPES[UA_TYPES_DOUBLE]);
+    value.hasValue = true;
+    value.hasSourceTimestamp = true;
+    UA_DateTime time = UA_DateTime_now();
+
+    UA_DateTime start = UA_DateTime_nowMonotonic();
+
+    for(unsigned long i = 0; i < samples; i++) {
+        value.sourceTimestamp = time + (UA_DateTime)i * UA_DATETIME_MSEC;
+        sample = (UA_Double)i;
+        for(unsigned long n = 0; n < nodes; n++) {
+            UA_NodeId node_id = UA_NODEID_NUMERIC(1, (UA_UInt32)(n + 1));
+            history_set_value(NULL, NULL, NULL, NULL, &node_id, true, &value);
+        }
+    }
+
+    pthread_mutex_lock(&history_lock);
+    history_flush_all();
+    size_t size = history_store.size;
+    pthread_mutex_unlock(&history_lock);
+
+    double ingest = elapsed_seconds(start);
+    double total = (double)nodes * (double)samples;
+    close_store();
+
+    start = UA_DateTime_nowMonotonic();
+    UA_StatusCode retval = open_store(path, nodes, buffered);
+    double reopen = elapsed_seconds(start);
+
+    size_t stored = 0;
+    for(unsigned long n = 0; retval == UA_STATUSCODE_GOOD && n < nodes; n++) {
+        UA_NodeId node_id = UA_NODEID_NUMERIC(1, (UA_UInt32)(n + 1));
+        History_node *node = history_find(&node_id);
+        if(node != NULL)
+            stored += node->stored;
+    }
+    close_store();
+    remove_store(path);
+
+    printf("%lu nodes x %lu samples, %lu values buffered per node\n", nodes, samples, buffered);
+    printf("ingest: %.0f samples in %.0f ms (%.0f samples/s, target %d)\n", total, ingest * 1000, total / ingest,
+           HISTORY_BENCH_TARGET);
+    printf("reopen: %zu samples indexed in %.0f ms\n", stored, reopen * 1000);
+    printf("store: %zu bytes (%.1f bytes/sample)\n", size, (double)size / total);
+
+    if(stored != (size_t)total)
+        errx(EXIT_FAILURE, "%zu samples stored, %.0f expected", stored, total);
+
+    return total / ingest >= HISTORY_BENCH_TARGET ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#else
+
+int main()
+{
+    errx(EXIT_FAILURE, "open62541 was built without UA_ENABLE_HISTORIZING");
+}
+
+#endif
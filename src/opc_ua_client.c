@@ -7,1007 +7,7557 @@
 #include <poll.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "erlcmd.h"
 #include "common.h"
 
 UA_Client *client;
 
-/************************************/
-/* Default Client backend callbacks */
-/************************************/
+static void data_type_cache_clear();
+static void path_cache_clear();
+static void poll_groups_clear(bool client_deleted);
+static void poll_groups_drop_types(const UA_DataTypeArray *chain);
 
-static void subscriptionInactivityCallback (UA_Client *client, UA_UInt32 subscription_id, void *subContext) 
-{
-    send_subscription_timeout_response(&subscription_id, 27, 0);
-}
+/*********************/
+/* Last Value Cache  */
+/*********************/
 
-static void deleteSubscriptionCallback(UA_Client *client, UA_UInt32 subscription_id, void *subscriptionContext) 
+/*
+ *  Optional cache of the last value notified for every monitored node, keyed by NodeId.
+ *  Entries are reference counted by the monitored items watching the node, so they live exactly
+ *  as long as some subscription keeps them fresh; values are only stored while the cache is enabled.
+ */
+#define VALUE_CACHE_MIN_BUCKETS 256
+
+typedef struct Value_cache_entry {
+    UA_NodeId node_id;
+    UA_DataValue value;
+    uint64_t received;                  // current_time() of the last notification
+    UA_UInt32 monitored_items;
+    struct Value_cache_entry *next;
+} Value_cache_entry;
+
+// Context of every data change monitored item.
+typedef struct {
+    UA_NodeId node_id;
+    bool cached;                        // counted by a value cache entry
+} Monitored_item_context;
+
+static Value_cache_entry **value_cache = NULL;
+static size_t value_cache_buckets = 0;
+static size_t value_cache_size = 0;
+static bool value_cache_enabled = false;
+
+static Value_cache_entry *value_cache_find(const UA_NodeId *node_id)
 {
-    send_subscription_deleted_response(&subscription_id, 27, 0);
+    if(value_cache == NULL)
+        return NULL;
+
+    Value_cache_entry *entry = value_cache[UA_NodeId_hash(node_id) & (value_cache_buckets - 1)];
+    while(entry != NULL && !UA_NodeId_equal(&entry->node_id, node_id))
+        entry = entry->next;
+
+    return entry;
 }
 
-static void dataChangeNotificationCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id, void *monContext, UA_DataValue *data) 
+static void value_cache_resize(size_t buckets)
 {
-    UA_Variant variant = data->value;
-    send_monitored_item_response(&subscription_id, &monitored_id, &variant, 29);
+    Value_cache_entry **resized = (Value_cache_entry **)calloc(buckets, sizeof(Value_cache_entry *));
+    if(resized == NULL)
+        return;
+
+    for(size_t i = 0; i < value_cache_buckets; i++) {
+        Value_cache_entry *entry = value_cache[i];
+        while(entry != NULL) {
+            Value_cache_entry *next = entry->next;
+            size_t bucket = UA_NodeId_hash(&entry->node_id) & (buckets - 1);
+            entry->next = resized[bucket];
+            resized[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(value_cache);
+    value_cache = resized;
+    value_cache_buckets = buckets;
 }
 
-static void deleteMonitoredItemCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id, void *monContext)
+/*
+ *  Registers a monitored item watching node_id.
+ */
+static void value_cache_retain(const UA_NodeId *node_id)
 {
-    send_monitored_item_delete_response(&subscription_id, &monitored_id);
+    Value_cache_entry *entry = value_cache_find(node_id);
+    if(entry != NULL) {
+        entry->monitored_items++;
+        return;
+    }
+
+    if(value_cache_size >= value_cache_buckets)
+        value_cache_resize(value_cache_buckets ? value_cache_buckets * 2 : VALUE_CACHE_MIN_BUCKETS);
+
+    if(value_cache == NULL)
+        return;
+
+    entry = (Value_cache_entry *)calloc(1, sizeof(Value_cache_entry));
+    if(entry == NULL)
+        return;
+
+    UA_NodeId_copy(node_id, &entry->node_id);
+    UA_DataValue_init(&entry->value);
+    entry->monitored_items = 1;
+
+    size_t bucket = UA_NodeId_hash(node_id) & (value_cache_buckets - 1);
+    entry->next = value_cache[bucket];
+    value_cache[bucket] = entry;
+    value_cache_size++;
 }
-/***************************************/
-/* Configuration & Lifecycle Functions */
-/***************************************/
 
-/**
- *  This is function allows to configure the client. 
-*/
-static void handle_set_client_config(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  Unregisters a monitored item watching node_id, the entry is dropped with the last one.
+ */
+static void value_cache_release(const UA_NodeId *node_id)
 {
-    int i_key;
-    int map_size;
+    if(value_cache == NULL)
+        return;
 
-    int term_size;
-    int term_type;
-    unsigned long value;
+    Value_cache_entry **link = &value_cache[UA_NodeId_hash(node_id) & (value_cache_buckets - 1)];
+    while(*link != NULL && !UA_NodeId_equal(&(*link)->node_id, node_id))
+        link = &(*link)->next;
 
-    UA_ClientConfig *config = UA_Client_getConfig(client);
-    UA_ClientConfig_setDefault(config);
+    Value_cache_entry *entry = *link;
+    if(entry == NULL || --entry->monitored_items > 0)
+        return;
 
-    if(ei_decode_map_header(req, req_index, &map_size) < 0)
-        errx(EXIT_FAILURE, ":set_client_config inconsistent argument arity = %d", term_size);    
-    for(i_key = 0; i_key < map_size; i_key++)
-    {
-        if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-            errx(EXIT_FAILURE, "Invalid bytestring (size) %d", term_size);
+    *link = entry->next;
+    UA_NodeId_clear(&entry->node_id);
+    UA_DataValue_clear(&entry->value);
+    free(entry);
+    value_cache_size--;
+}
 
-        char key[term_size + 1];
-        long binary_len;
-        if (ei_decode_binary(req, req_index, key, &binary_len) < 0) 
-            errx(EXIT_FAILURE, "Invalid bytestring");
-        key[binary_len] = '\0';
+static void value_cache_update(const UA_NodeId *node_id, const UA_DataValue *value)
+{
+    Value_cache_entry *entry = value_cache_find(node_id);
+    if(entry == NULL)
+        return;
 
-        if(!strcmp(key, "timeout"))
-        {
-            if (ei_decode_ulong(req, req_index, &value) < 0) {
-                send_error_response("einval_2");
-                return;
-            }
-            config->timeout = (int)value;
-        }
-        else if(!strcmp(key, "requestedSessionTimeout"))
-        {
-            if (ei_decode_ulong(req, req_index, &value) < 0) {
-                send_error_response("einval_2");
-                return;
-            }
-            config->requestedSessionTimeout = (int)value;
-        }
-        else if(!strcmp(key, "secureChannelLifeTime")) 
-        {
-            if (ei_decode_ulong(req, req_index, &value) < 0) {
-                send_error_response("einval_2");
-                return;
-            }
-            config->secureChannelLifeTime = (int)value;
+    UA_DataValue_clear(&entry->value);
+    UA_DataValue_copy(value, &entry->value);
+    entry->received = current_time();
+}
+
+static void value_cache_clear_values()
+{
+    for(size_t i = 0; i < value_cache_buckets; i++) {
+        for(Value_cache_entry *entry = value_cache[i]; entry != NULL; entry = entry->next) {
+            UA_DataValue_clear(&entry->value);
+            entry->received = 0;
         }
-        else
-        {
-            errx(EXIT_FAILURE, ":set_client_config inconsistent argument arity = %s", key);    
-            send_error_response("einval");
-            return;
+    }
+}
+
+/*
+ *  Drops every entry, used when the client (and all its monitored items) is recreated.
+ */
+static void value_cache_reset()
+{
+    for(size_t i = 0; i < value_cache_buckets; i++) {
+        Value_cache_entry *entry = value_cache[i];
+        while(entry != NULL) {
+            Value_cache_entry *next = entry->next;
+            UA_NodeId_clear(&entry->node_id);
+            UA_DataValue_clear(&entry->value);
+            free(entry);
+            entry = next;
         }
+        value_cache[i] = NULL;
     }
 
-    send_ok_response();
+    value_cache_size = 0;
 }
 
-/* 
-*   Get the client configuration. 
-*/
-static void handle_get_client_config(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  {:ok, {value, server_timestamp, age_ms}} | {:error, :not_cached} | {:error, status}
+ */
+static void encode_cached_value(char *resp, int *resp_index, const UA_NodeId *node_id, uint64_t now)
 {
-    UA_ClientConfig *config = UA_Client_getConfig(client);
-    send_data_response(config, 7, 0);
+    Value_cache_entry *entry = value_cache_enabled ? value_cache_find(node_id) : NULL;
+
+    ei_encode_tuple_header(resp, resp_index, 2);
+
+    if(entry == NULL || entry->received == 0) {
+        ei_encode_atom(resp, resp_index, "error");
+        ei_encode_atom(resp, resp_index, "not_cached");
+        return;
+    }
+
+    if(entry->value.hasStatus && entry->value.status != UA_STATUSCODE_GOOD) {
+        const char *status = UA_StatusCode_name(entry->value.status);
+        ei_encode_atom(resp, resp_index, "error");
+        ei_encode_binary(resp, resp_index, status, strlen(status));
+        return;
+    }
+
+    ei_encode_atom(resp, resp_index, "ok");
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_variant_struct(resp, resp_index, &entry->value.value);
+    ei_encode_longlong(resp, resp_index, entry->value.hasServerTimestamp ? entry->value.serverTimestamp : 0);
+    ei_encode_ulonglong(resp, resp_index, now - entry->received);
 }
 
 /*
- * Gets the current client connection state.
- * 
- * TODO: v1.4.x - Return all 3 states (channelState, sessionState, connectStatus) as a tuple
- * instead of a single global state string. This would match the UA_Client_getState API better
- * and provide more detailed information to the Elixir layer.
- * Current: returns single string like "Session", "Secure Channel", "Disconnected"
- * Proposed: return {channelState, sessionState, connectStatus} tuple
-*/
-static void handle_get_client_state(void *entity, bool entity_type, const char *req, int *req_index)
+ *  Encodes the cached reads response. Following the ei convention, a NULL resp buffer only
+ *  computes the encoded size into resp_index.
+ */
+static void encode_read_cached_response(char *resp, int *resp_index, const UA_NodeId *node_ids, int node_count, bool many)
 {
-    // v1.4.x: UA_Client_getState signature changed
-    UA_SecureChannelState channelState;
-    UA_SessionState sessionState;
-    UA_StatusCode connectStatus;
-    UA_Client_getState(client, &channelState, &sessionState, &connectStatus);
+    uint64_t now = current_time();
 
-    // Special case: If session is closed but channel is open, return channel state (for no-session connections)
-    if(sessionState == UA_SESSIONSTATE_CLOSED && channelState == UA_SECURECHANNELSTATE_OPEN) {
-        send_data_response("Secure Channel", 3, 0);
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+
+    if(!many) {
+        encode_cached_value(resp, resp_index, &node_ids[0], now);
         return;
     }
 
-    // Return session state for all other cases
-    switch(sessionState)
-    {
-        case UA_SESSIONSTATE_CLOSED:
-            send_data_response("Disconnected", 3, 0);
-        break;
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
 
-        case UA_SESSIONSTATE_CREATE_REQUESTED:
-            send_data_response("Create Requested", 3, 0);
-        break;
+    ei_encode_list_header(resp, resp_index, node_count);
+    for(int i = 0; i < node_count; i++)
+        encode_cached_value(resp, resp_index, &node_ids[i], now);
+    ei_encode_empty_list(resp, resp_index);
+}
 
-        case UA_SESSIONSTATE_CREATED:
-            send_data_response("Created", 3, 0);
-        break;
+static void send_read_cached_response(const UA_NodeId *node_ids, int node_count, bool many)
+{
+    // Size pass first: the response must fit the {:packet, 2} port frame.
+    int resp_size = sizeof(uint16_t);
+    encode_read_cached_response(NULL, &resp_size, node_ids, node_count, many);
 
-        case UA_SESSIONSTATE_ACTIVATE_REQUESTED:
-            send_data_response("Activate Requested", 3, 0);
-        break;
+    if(resp_size > erlcmd_frame_limit()) {
+        send_error_response("overflow");
+        return;
+    }
 
-        case UA_SESSIONSTATE_ACTIVATED:
-            send_data_response("Session", 3, 0);
-        break;
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
+        return;
+    }
 
-        case UA_SESSIONSTATE_CLOSING:
-            send_data_response("Closing", 3, 0);
-        break;
+    int resp_index = sizeof(uint16_t);
+    encode_read_cached_response(resp, &resp_index, node_ids, node_count, many);
+    erlcmd_send(resp, resp_index);
 
-        default:
-            send_data_response("Unknown", 3, 0);
-        break;
-    }
+    free(resp);
 }
 
-/* 
-*   Resets a client. 
-*/
-static void handle_reset_client(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  Enables or disables the last value cache. Disabling it drops the cached values.
+ */
+static void handle_set_value_cache(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    // v1.4.x: UA_Client_reset removed, disconnect and recreate client
-    UA_Client_disconnect(client);
-    UA_Client_delete(client);
-    client = UA_Client_new();
-    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    int enabled;
+    if(ei_decode_boolean(req, req_index, &enabled) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    value_cache_enabled = enabled;
+    if(!value_cache_enabled)
+        value_cache_clear_values();
+
     send_ok_response();
 }
 
-/************************/
-/* Connection Functions */
-/************************/
+/*
+ *  Reads the last notified value of a monitored node without a network round trip.
+ */
+static void handle_read_cached(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-/* Connect to the server by passing only the url.
- *
- * @return Indicates whether the operation succeeded or returns an error code */
-static void handle_connect_client_by_url(void *entity, bool entity_type, const char *req, int *req_index)
+    send_read_cached_response(&node_id, 1, false);
+
+    UA_NodeId_clear(&node_id);
+}
+
+/*
+ *  Reads the last notified values of many monitored nodes without a network round trip.
+ *  Input: list of node_id tuples (1 to 1000)
+ *  Output: {:ok, [{:ok, {value, server_timestamp, age_ms}} | {:error, reason}]} | {:error, reason}
+ */
+static void handle_read_cached_many(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    int term_size;
-    int term_type;
-    
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid url (size)");
+    int list_count;
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_read_cached_many requires a list");
 
-    char url[term_size + 1];
-    long binary_len;
-    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid url");
-    url[binary_len] = '\0';
+    int node_count = list_count;
 
+    if(node_count == 0 || node_count > 1000) {
+        send_error_response("einval");
+        return;
+    }
 
-    UA_StatusCode retval = UA_Client_connect(client, url);
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    UA_NodeId *node_ids = (UA_NodeId *)UA_Array_new(node_count, &UA_TYPES[UA_TYPES_NODEID]);
+    if(node_ids == NULL) {
+        send_error_response("enomem");
         return;
     }
-    
-    send_ok_response();
+
+    for(int i = 0; i < node_count; i++)
+        node_ids[i] = assemble_node_id(req, req_index);
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    send_read_cached_response(node_ids, node_count, true);
+
+    UA_Array_delete(node_ids, node_count, &UA_TYPES[UA_TYPES_NODEID]);
 }
 
-/* Connect to the server by passing a url, username and password.
- *
- * @return Indicates whether the operation succeeded or returns an error code */
-static void handle_connect_client_by_username(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    int term_size;
-    int term_type;
-    unsigned long str_len;
-    unsigned long binary_len;
+/****************/
+/* Reconnection */
+/****************/
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 3)
-        errx(EXIT_FAILURE, ":connect_client_by_username requires a 3-tuple, term_size = %d", term_size);
-    
-    // URL
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid url (size)");
+/*
+ *  Optional automatic reconnection (set_reconnect). A session whose connection drops is
+ *  reconnected from the main loop with asynchronous connects spaced by an exponential backoff
+ *  with jitter, so other sessions and requests are never blocked. The subscriptions and
+ *  monitored items created through the port are mirrored here to survive a lost session: once
+ *  connected, the subscriptions the stack still knows are transferred to the new session
+ *  (TransferSubscriptions) and the others are recreated in batches.
+ *  Progress is pushed as {:connection, event} frames.
+ */
+#define RECONNECT_MIN_BACKOFF_MS 500
+#define RECONNECT_MAX_BACKOFF_MS 30000
+#define RECOVERY_BATCH_SIZE 100
+
+typedef enum {
+    RECONNECT_IDLE,                     // not connected by the port, or disconnected on request
+    RECONNECT_CONNECTED,
+    RECONNECT_CONNECTING,               // asynchronous connect in progress
+    RECONNECT_BACKOFF                   // waiting for the next attempt
+} Reconnect_phase;
+
+// The 1.4 client never shows the sequence numbers of the messages it receives, so the
+// notifications are fingerprinted to recognize the retained messages already received.
+#define MIRROR_FINGERPRINTS 64
+
+typedef struct Mirrored_item {
+    UA_UInt32 id;
+    bool event;                         // event item, else data change item
+    UA_MonitoredItemCreateRequest request;
+    UA_UInt32 previous_id;              // id before the last recovery
+    UA_StatusCode status;               // of the last recovery
+    struct Mirrored_item *next;
+} Mirrored_item;
+
+typedef struct Mirrored_subscription {
+    UA_UInt32 id;
+    UA_Double publishing_interval;
+    bool dropped;                       // deleted by the stack with the lost session
+    bool recreated;                     // by the last recovery, else transferred or kept
+    UA_UInt32 previous_id;
+    UA_StatusCode status;
+    UA_UInt32 last_sequence;            // newest sequence number known to be received (or republished)
+    bool sequence_current;              // nothing was received after last_sequence
+    uint64_t received;                  // notifications received
+    UA_UInt32 fingerprints[MIRROR_FINGERPRINTS]; // of the last notifications received
+    uint64_t gaps;                      // recoveries that found messages not received
+    uint64_t republished;               // messages recovered with Republish
+    uint64_t lost;                      // messages the server no longer retained
+    uint64_t late;                      // data changes older than twice the publishing interval
+    uint64_t max_lateness;              // ms
+    Mirrored_item *items;
+    struct Mirrored_subscription *next;
+} Mirrored_subscription;
+
+typedef struct {
+    bool enabled;
+    UA_UInt32 min_backoff;              // ms
+    UA_UInt32 max_backoff;              // ms
+    Reconnect_phase phase;
+    char *url;
+    UA_UInt32 attempt;
+    uint64_t next_attempt;              // current_time()
+    uint64_t attempt_deadline;          // current_time(), an attempt still in progress is abandoned
+    uint64_t outage_start;              // current_time()
+    bool outage;                        // the connection dropped, the subscriptions are recovered when connected
+    bool session_lost;                  // the session was closed during the outage
+    Mirrored_subscription *subscriptions;
+} Reconnect;
+
+static const Reconnect reconnect_defaults = {
+    .min_backoff = RECONNECT_MIN_BACKOFF_MS,
+    .max_backoff = RECONNECT_MAX_BACKOFF_MS,
+    .phase = RECONNECT_IDLE
+};
 
-    char url[term_size + 1];
-    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid url");
-    url[binary_len] = '\0';
+static Reconnect reconnect = {
+    .min_backoff = RECONNECT_MIN_BACKOFF_MS,
+    .max_backoff = RECONNECT_MAX_BACKOFF_MS,
+    .phase = RECONNECT_IDLE
+};
 
-    //USER
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid username (size)");
+static pthread_t main_thread;
 
-    char username[term_size + 1];
-    if (ei_decode_binary(req, req_index, username, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid username");
-    username[binary_len] = '\0';
+static Mirrored_subscription *mirror_find_subscription(UA_UInt32 subscription_id)
+{
+    Mirrored_subscription *subscription = reconnect.subscriptions;
+    while(subscription != NULL && subscription->id != subscription_id)
+        subscription = subscription->next;
 
-    //PASSWORD
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid password (size)");
+    return subscription;
+}
+
+static void mirror_add_subscription(UA_UInt32 subscription_id, UA_Double publishing_interval)
+{
+    Mirrored_subscription *subscription = (Mirrored_subscription *)calloc(1, sizeof(Mirrored_subscription));
+    if(subscription == NULL)
+        return;
+
+    subscription->id = subscription_id;
+    subscription->publishing_interval = publishing_interval;
+    // A new subscription numbers its messages from 1
+    subscription->sequence_current = true;
+    subscription->next = reconnect.subscriptions;
+    reconnect.subscriptions = subscription;
+}
+
+static Mirrored_item *mirror_find_item(Mirrored_subscription *subscription, UA_UInt32 monitored_id)
+{
+    Mirrored_item *item = subscription->items;
+    while(item != NULL && item->id != monitored_id)
+        item = item->next;
+
+    return item;
+}
+
+// FNV-1a
+static UA_UInt32 fingerprint_bytes(UA_UInt32 hash, const void *data, size_t size)
+{
+    const UA_Byte *bytes = (const UA_Byte *)data;
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+
+    return hash;
+}
+
+/*
+ *  Type, length and, for pointer free types and strings, the first bytes of a value.
+ */
+static UA_UInt32 fingerprint_variant(UA_UInt32 hash, const UA_Variant *value)
+{
+    hash = fingerprint_bytes(hash, &value->type, sizeof(value->type));
+    if(value->type == NULL || value->data <= UA_EMPTY_ARRAY_SENTINEL)
+        return hash;
+
+    size_t length = UA_Variant_isScalar(value) ? 1 : value->arrayLength;
+    hash = fingerprint_bytes(hash, &length, sizeof(length));
+
+    if(value->type->pointerFree) {
+        size_t size = length * value->type->memSize;
+        return fingerprint_bytes(hash, value->data, size < 64 ? size : 64);
+    }
+
+    if(length == 1 && (value->type == &UA_TYPES[UA_TYPES_STRING] || value->type == &UA_TYPES[UA_TYPES_BYTESTRING])) {
+        const UA_String *string = (const UA_String *)value->data;
+        return fingerprint_bytes(hash, string->data, string->length < 64 ? string->length : 64);
+    }
+
+    return hash;
+}
+
+static UA_UInt32 fingerprint_data_change(UA_UInt32 monitored_id, const UA_DataValue *data)
+{
+    UA_UInt32 hash = fingerprint_bytes(2166136261u, &monitored_id, sizeof(monitored_id));
+    hash = fingerprint_bytes(hash, &data->status, sizeof(data->status));
+    if(data->hasSourceTimestamp)
+        hash = fingerprint_bytes(hash, &data->sourceTimestamp, sizeof(data->sourceTimestamp));
+    if(data->hasServerTimestamp)
+        hash = fingerprint_bytes(hash, &data->serverTimestamp, sizeof(data->serverTimestamp));
+
+    return fingerprint_variant(hash, &data->value);
+}
+
+static UA_UInt32 fingerprint_event(UA_UInt32 monitored_id, size_t fields_size, const UA_Variant *fields)
+{
+    UA_UInt32 hash = fingerprint_bytes(2166136261u, &monitored_id, sizeof(monitored_id));
+    for(size_t i = 0; i < fields_size; i++)
+        hash = fingerprint_variant(hash, &fields[i]);
+
+    return hash;
+}
+
+static bool mirror_fingerprint_seen(const Mirrored_subscription *subscription, UA_UInt32 fingerprint)
+{
+    size_t size = subscription->received < MIRROR_FINGERPRINTS ? subscription->received : MIRROR_FINGERPRINTS;
+    for(size_t i = 0; i < size; i++) {
+        if(subscription->fingerprints[i] == fingerprint)
+            return true;
+    }
+
+    return false;
+}
+
+static void mirror_received(Mirrored_subscription *subscription, UA_UInt32 fingerprint)
+{
+    subscription->fingerprints[subscription->received % MIRROR_FINGERPRINTS] = fingerprint;
+    subscription->received++;
+    subscription->sequence_current = false;
+}
+
+static void mirror_event_notified(UA_UInt32 subscription_id, UA_UInt32 monitored_id, size_t fields_size,
+                                  const UA_Variant *fields)
+{
+    Mirrored_subscription *subscription = mirror_find_subscription(subscription_id);
+    if(subscription != NULL)
+        mirror_received(subscription, fingerprint_event(monitored_id, fields_size, fields));
+}
+
+/*
+ *  Remembers a data change and measures its lateness, from its server timestamp (so it includes
+ *  the clock skew).
+ */
+static void mirror_notified(UA_UInt32 subscription_id, UA_UInt32 monitored_id, const UA_DataValue *data)
+{
+    Mirrored_subscription *subscription = mirror_find_subscription(subscription_id);
+    if(subscription == NULL)
+        return;
+
+    mirror_received(subscription, fingerprint_data_change(monitored_id, data));
+
+    UA_DateTime timestamp = data->hasServerTimestamp ? data->serverTimestamp :
+                            data->hasSourceTimestamp ? data->sourceTimestamp : 0;
+    if(timestamp == 0)
+        return;
+
+    UA_DateTime lateness = UA_DateTime_now() - timestamp;
+    if(lateness <= (UA_DateTime)(2 * subscription->publishing_interval * UA_DATETIME_MSEC))
+        return;
+
+    subscription->late++;
+    if((uint64_t)(lateness / UA_DATETIME_MSEC) > subscription->max_lateness)
+        subscription->max_lateness = lateness / UA_DATETIME_MSEC;
+}
+
+static void mirror_add_item(UA_UInt32 subscription_id, UA_UInt32 monitored_id, bool event,
+                            const UA_MonitoredItemCreateRequest *request)
+{
+    Mirrored_subscription *subscription = mirror_find_subscription(subscription_id);
+    if(subscription == NULL)
+        return;
+
+    Mirrored_item *item = (Mirrored_item *)calloc(1, sizeof(Mirrored_item));
+    if(item == NULL)
+        return;
+
+    if(UA_MonitoredItemCreateRequest_copy(request, &item->request) != UA_STATUSCODE_GOOD) {
+        free(item);
+        return;
+    }
+
+    item->id = monitored_id;
+    item->event = event;
+    item->next = subscription->items;
+    subscription->items = item;
+}
+
+static void mirror_free_item(Mirrored_item *item)
+{
+    UA_MonitoredItemCreateRequest_clear(&item->request);
+    free(item);
+}
+
+static void mirror_remove_item(UA_UInt32 subscription_id, UA_UInt32 monitored_id)
+{
+    Mirrored_subscription *subscription = mirror_find_subscription(subscription_id);
+    if(subscription == NULL)
+        return;
+
+    Mirrored_item **link = &subscription->items;
+    while(*link != NULL && (*link)->id != monitored_id)
+        link = &(*link)->next;
+
+    if(*link != NULL) {
+        Mirrored_item *item = *link;
+        *link = item->next;
+        mirror_free_item(item);
+    }
+}
+
+static void mirror_remove_subscription(UA_UInt32 subscription_id)
+{
+    Mirrored_subscription **link = &reconnect.subscriptions;
+    while(*link != NULL && (*link)->id != subscription_id)
+        link = &(*link)->next;
+
+    if(*link == NULL)
+        return;
+
+    Mirrored_subscription *subscription = *link;
+    *link = subscription->next;
+
+    while(subscription->items != NULL) {
+        Mirrored_item *next = subscription->items->next;
+        mirror_free_item(subscription->items);
+        subscription->items = next;
+    }
+    free(subscription);
+}
+
+/*
+ *  Deletions done by the stack while the connection is down are not reported: the subscription
+ *  (and its items) is recreated once connected.
+ *  @return true if the deletion is part of an outage
+ */
+static bool mirror_subscription_dropped(UA_UInt32 subscription_id)
+{
+    Mirrored_subscription *subscription = mirror_find_subscription(subscription_id);
+    if(subscription == NULL)
+        return false;
+
+    if(reconnect.outage) {
+        subscription->dropped = true;
+        return true;
+    }
+
+    mirror_remove_subscription(subscription_id);
+    return false;
+}
+
+static bool mirror_item_dropped(UA_UInt32 subscription_id, UA_UInt32 monitored_id)
+{
+    if(reconnect.outage && mirror_find_subscription(subscription_id) != NULL)
+        return true;
+
+    mirror_remove_item(subscription_id, monitored_id);
+    return false;
+}
+
+/*
+ *  Stops reconnecting (disconnected on request), later deletions are reported again.
+ */
+static void reconnect_stop()
+{
+    free(reconnect.url);
+    reconnect.url = NULL;
+    reconnect.phase = RECONNECT_IDLE;
+    reconnect.outage = false;
+    reconnect.session_lost = false;
+    reconnect.attempt = 0;
+}
+
+/*
+ *  Frees the mirror and stops reconnecting, the settings are kept.
+ */
+static void reconnect_clear()
+{
+    while(reconnect.subscriptions != NULL)
+        mirror_remove_subscription(reconnect.subscriptions->id);
+
+    reconnect_stop();
+}
+
+/*
+ *  {:connection, {event, value}}
+ */
+static void send_connection_event(const char *event, uint64_t value, UA_StatusCode status)
+{
+    char resp[256];
+    int resp_index = sizeof(uint16_t); // Space for payload size
+    resp[resp_index++] = response_id;
+    ei_encode_version(resp, &resp_index);
+    ei_encode_tuple_header(resp, &resp_index, 2);
+    ei_encode_atom(resp, &resp_index, "connection");
+    ei_encode_tuple_header(resp, &resp_index, 2);
+    ei_encode_atom(resp, &resp_index, event);
+
+    if(status != UA_STATUSCODE_GOOD) {
+        const char *status_code = UA_StatusCode_name(status);
+        ei_encode_binary(resp, &resp_index, status_code, strlen(status_code));
+    } else {
+        ei_encode_ulonglong(resp, &resp_index, value);
+    }
+
+    erlcmd_send(resp, resp_index);
+}
+
+static void clientStateCallback(UA_Client *client, UA_SecureChannelState channelState,
+                                UA_SessionState sessionState, UA_StatusCode connectStatus)
+{
+    // Blocking connects run on the workers, the reconnection state belongs to the main loop
+    if(!pthread_equal(pthread_self(), main_thread))
+        return;
+
+    if(reconnect.outage && sessionState == UA_SESSIONSTATE_CLOSED)
+        reconnect.session_lost = true;
+}
+
+/*
+ *  A connection made through the port, reconnected while enabled.
+ */
+static void reconnect_connected(const char *url)
+{
+    if(reconnect.url != url) {
+        free(reconnect.url);
+        reconnect.url = strdup(url);
+    }
+
+    reconnect.phase = RECONNECT_CONNECTED;
+    reconnect.attempt = 0;
+}
+
+/************************************/
+/* Default Client backend callbacks */
+/************************************/
+
+/*
+ *  The stack can run these callbacks while a worker connects the client (it cleans or restores
+ *  the subscriptions of the previous session). They touch the state of the session, which
+ *  belongs to the main loop, so the worker queues them in its job and the main loop replays them
+ *  when the job completes (see the worker pool).
+ */
+typedef enum {
+    CALLBACK_SUBSCRIPTION_INACTIVE,
+    CALLBACK_SUBSCRIPTION_DELETED,
+    CALLBACK_DATA_CHANGE,
+    CALLBACK_MONITORED_ITEM_DELETED,
+    CALLBACK_EVENT,
+    CALLBACK_EVENT_ITEM_DELETED
+} Callback_kind;
+
+// true if called on a worker, the callback is queued
+static bool callback_defer(Callback_kind kind, UA_UInt32 subscription_id, UA_UInt32 monitored_id, void *context,
+                           const UA_DataValue *value, size_t fields_size, const UA_Variant *fields);
+
+static void subscriptionInactivityCallback (UA_Client *client, UA_UInt32 subscription_id, void *subContext) 
+{
+    if(callback_defer(CALLBACK_SUBSCRIPTION_INACTIVE, subscription_id, 0, NULL, NULL, 0, NULL))
+        return;
+
+    send_subscription_timeout_response(&subscription_id, 27, 0);
+}
+
+static void deleteSubscriptionCallback(UA_Client *client, UA_UInt32 subscription_id, void *subscriptionContext) 
+{
+    if(callback_defer(CALLBACK_SUBSCRIPTION_DELETED, subscription_id, 0, NULL, NULL, 0, NULL))
+        return;
+
+    if(mirror_subscription_dropped(subscription_id))
+        return;
+
+    send_subscription_deleted_response(&subscription_id, 27, 0);
+}
+
+static void dataChangeNotificationCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id, void *monContext, UA_DataValue *data) 
+{
+    if(callback_defer(CALLBACK_DATA_CHANGE, subscription_id, monitored_id, monContext, data, 0, NULL))
+        return;
+
+    if(value_cache_enabled && monContext != NULL)
+        value_cache_update(&((Monitored_item_context *)monContext)->node_id, data);
+
+    mirror_notified(subscription_id, monitored_id, data);
+
+    UA_Variant variant = data->value;
+    send_monitored_item_response(&subscription_id, &monitored_id, &variant, 29);
+}
+
+static void deleteMonitoredItemCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id, void *monContext)
+{
+    if(callback_defer(CALLBACK_MONITORED_ITEM_DELETED, subscription_id, monitored_id, monContext, NULL, 0, NULL))
+        return;
+
+    Monitored_item_context *context = (Monitored_item_context *)monContext;
+    if(context != NULL) {
+        if(context->cached)
+            value_cache_release(&context->node_id);
+        UA_NodeId_clear(&context->node_id);
+        free(context);
+    }
+
+    if(mirror_item_dropped(subscription_id, monitored_id))
+        return;
+
+    send_monitored_item_delete_response(&subscription_id, &monitored_id);
+}
+/***************************************/
+/* Configuration & Lifecycle Functions */
+/***************************************/
+
+/**
+ *  This is function allows to configure the client. 
+*/
+static void handle_set_client_config(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int i_key;
+    int map_size;
+
+    int term_size;
+    int term_type;
+    unsigned long value;
+
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+    UA_ClientConfig_setDefault(config);
+
+    if(ei_decode_map_header(req, req_index, &map_size) < 0)
+        errx(EXIT_FAILURE, ":set_client_config inconsistent argument arity = %d", term_size);    
+    for(i_key = 0; i_key < map_size; i_key++)
+    {
+        if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            errx(EXIT_FAILURE, "Invalid bytestring (size) %d", term_size);
+
+        char key[term_size + 1];
+        long binary_len;
+        if (ei_decode_binary(req, req_index, key, &binary_len) < 0) 
+            errx(EXIT_FAILURE, "Invalid bytestring");
+        key[binary_len] = '\0';
+
+        if(!strcmp(key, "timeout"))
+        {
+            if (ei_decode_ulong(req, req_index, &value) < 0) {
+                send_error_response("einval_2");
+                return;
+            }
+            config->timeout = (int)value;
+        }
+        else if(!strcmp(key, "requestedSessionTimeout"))
+        {
+            if (ei_decode_ulong(req, req_index, &value) < 0) {
+                send_error_response("einval_2");
+                return;
+            }
+            config->requestedSessionTimeout = (int)value;
+        }
+        else if(!strcmp(key, "secureChannelLifeTime")) 
+        {
+            if (ei_decode_ulong(req, req_index, &value) < 0) {
+                send_error_response("einval_2");
+                return;
+            }
+            config->secureChannelLifeTime = (int)value;
+        }
+        else
+        {
+            errx(EXIT_FAILURE, ":set_client_config inconsistent argument arity = %s", key);    
+            send_error_response("einval");
+            return;
+        }
+    }
+
+    send_ok_response();
+}
+
+/* 
+*   Get the client configuration. 
+*/
+static void handle_get_client_config(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+    send_data_response(config, 7, 0);
+}
+
+/*
+ * Gets the current client connection state.
+ * 
+ * TODO: v1.4.x - Return all 3 states (channelState, sessionState, connectStatus) as a tuple
+ * instead of a single global state string. This would match the UA_Client_getState API better
+ * and provide more detailed information to the Elixir layer.
+ * Current: returns single string like "Session", "Secure Channel", "Disconnected"
+ * Proposed: return {channelState, sessionState, connectStatus} tuple
+*/
+static void handle_get_client_state(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    // v1.4.x: UA_Client_getState signature changed
+    UA_SecureChannelState channelState;
+    UA_SessionState sessionState;
+    UA_StatusCode connectStatus;
+    UA_Client_getState(client, &channelState, &sessionState, &connectStatus);
+
+    // Special case: If session is closed but channel is open, return channel state (for no-session connections)
+    if(sessionState == UA_SESSIONSTATE_CLOSED && channelState == UA_SECURECHANNELSTATE_OPEN) {
+        send_data_response("Secure Channel", 3, 0);
+        return;
+    }
+
+    // Return session state for all other cases
+    switch(sessionState)
+    {
+        case UA_SESSIONSTATE_CLOSED:
+            send_data_response("Disconnected", 3, 0);
+        break;
+
+        case UA_SESSIONSTATE_CREATE_REQUESTED:
+            send_data_response("Create Requested", 3, 0);
+        break;
+
+        case UA_SESSIONSTATE_CREATED:
+            send_data_response("Created", 3, 0);
+        break;
+
+        case UA_SESSIONSTATE_ACTIVATE_REQUESTED:
+            send_data_response("Activate Requested", 3, 0);
+        break;
+
+        case UA_SESSIONSTATE_ACTIVATED:
+            send_data_response("Session", 3, 0);
+        break;
+
+        case UA_SESSIONSTATE_CLOSING:
+            send_data_response("Closing", 3, 0);
+        break;
+
+        default:
+            send_data_response("Unknown", 3, 0);
+        break;
+    }
+}
+
+/* 
+*   Resets a client. 
+*/
+static void handle_reset_client(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    // v1.4.x: UA_Client_reset removed, disconnect and recreate client
+    reconnect_stop();
+    UA_Client_disconnect(client);
+    // The cached values go before the data types they were decoded with.
+    value_cache_reset();
+    poll_groups_clear(true);
+    data_type_cache_clear();
+    path_cache_clear();
+    UA_Client_delete(client);
+    reconnect_clear();
+    client = UA_Client_new();
+    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    send_ok_response();
+}
+
+/***************/
+/* Worker pool */
+/***************/
+
+/*
+ *  Connecting (secure channel and session setup, maybe with encryption) and discovery block for
+ *  seconds, so they run in a pool of worker threads and post their completion back to the main
+ *  loop, which keeps serving requests and notifications meanwhile. A UA_Client is owned by one
+ *  thread at a time: connections take the client of their session, which is neither iterated nor
+ *  given requests (they wait in order) until the job completes, and discovery uses a temporary
+ *  client of its own. Workers never encode responses, the main loop does when the job completes.
+ */
+#define WORKER_THREADS 4
+
+typedef enum {
+    JOB_CONNECT,
+    JOB_CONNECT_USERNAME,
+    JOB_CONNECT_SECURE_CHANNEL,
+    JOB_FIND_SERVERS_ON_NETWORK,
+    JOB_FIND_SERVERS,
+    JOB_GET_ENDPOINTS
+} Job_kind;
+
+// Client callback run on a worker, replayed by the main loop
+typedef struct Deferred_callback {
+    Callback_kind kind;
+    UA_UInt32 subscription_id;
+    UA_UInt32 monitored_id;
+    void *context;                      // monitored item context
+    UA_DataValue value;
+    UA_Variant *fields;
+    size_t fields_size;
+    struct Deferred_callback *next;
+} Deferred_callback;
+
+typedef struct Job {
+    Job_kind kind;
+    struct Session *session;
+    UA_Client *client;                  // owned by the worker while the job runs
+    char *url;
+    char *username;
+    char *password;
+    UA_StatusCode retval;
+    void *results;
+    size_t results_size;
+    Caller_metadata caller;
+    char prefix[8];                     // frame prefix of the session
+    size_t prefix_size;
+    Deferred_callback *callbacks;
+    Deferred_callback **callbacks_tail;
+    struct Job *next;
+} Job;
+
+// The job of the worker running on this thread
+static __thread Job *worker_job = NULL;
+
+static pthread_t workers[WORKER_THREADS];
+static size_t workers_started = 0;
+static bool workers_stopping = false;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_ready = PTHREAD_COND_INITIALIZER;
+static Job *jobs_pending = NULL;
+static Job *jobs_done = NULL;
+static int jobs_wake[2] = {-1, -1};     // pipe, written by the workers when a job is done
+
+static void job_submit(Job *job);
+
+static bool job_is_discovery(const Job *job)
+{
+    return job->kind >= JOB_FIND_SERVERS_ON_NETWORK;
+}
+
+static const UA_DataType *job_results_type(const Job *job)
+{
+    switch(job->kind) {
+        case JOB_FIND_SERVERS_ON_NETWORK: return &UA_TYPES[UA_TYPES_SERVERONNETWORK];
+        case JOB_FIND_SERVERS: return &UA_TYPES[UA_TYPES_APPLICATIONDESCRIPTION];
+        case JOB_GET_ENDPOINTS: return &UA_TYPES[UA_TYPES_ENDPOINTDESCRIPTION];
+        default: return NULL;
+    }
+}
+
+/*
+ *  Takes url (and username and password), allocated with malloc.
+ */
+static Job *job_new(Job_kind kind, char *url, char *username, char *password)
+{
+    Job *job = (Job *)calloc(1, sizeof(Job));
+    if(job == NULL)
+        errx(EXIT_FAILURE, "Out of memory (job)");
+
+    job->kind = kind;
+    job->url = url;
+    job->username = username;
+    job->password = password;
+
+    // Discovery doesn't need (nor block) the client of the session
+    if(job_is_discovery(job)) {
+        job->client = UA_Client_new();
+        UA_ClientConfig *config = UA_Client_getConfig(job->client);
+        UA_ClientConfig_setDefault(config);
+        config->timeout = UA_Client_getConfig(client)->timeout;
+    }
+
+    return job;
+}
+
+static bool callback_defer(Callback_kind kind, UA_UInt32 subscription_id, UA_UInt32 monitored_id, void *context,
+                           const UA_DataValue *value, size_t fields_size, const UA_Variant *fields)
+{
+    if(worker_job == NULL)
+        return false;
+
+    Deferred_callback *callback = (Deferred_callback *)calloc(1, sizeof(Deferred_callback));
+    if(callback == NULL)
+        errx(EXIT_FAILURE, "Out of memory (callback)");
+
+    callback->kind = kind;
+    callback->subscription_id = subscription_id;
+    callback->monitored_id = monitored_id;
+    callback->context = context;
+
+    if((value != NULL && UA_DataValue_copy(value, &callback->value) != UA_STATUSCODE_GOOD) ||
+       (fields != NULL && UA_Array_copy(fields, fields_size, (void **)&callback->fields,
+                                        &UA_TYPES[UA_TYPES_VARIANT]) != UA_STATUSCODE_GOOD))
+        errx(EXIT_FAILURE, "Out of memory (callback)");
+    callback->fields_size = fields != NULL ? fields_size : 0;
+
+    if(worker_job->callbacks_tail == NULL)
+        worker_job->callbacks_tail = &worker_job->callbacks;
+    *worker_job->callbacks_tail = callback;
+    worker_job->callbacks_tail = &callback->next;
+    return true;
+}
+
+static void callback_free(Deferred_callback *callback)
+{
+    UA_DataValue_clear(&callback->value);
+    if(callback->fields != NULL)
+        UA_Array_delete(callback->fields, callback->fields_size, &UA_TYPES[UA_TYPES_VARIANT]);
+    free(callback);
+}
+
+static void job_free(Job *job)
+{
+    // Not replayed: only the monitored item contexts are released, the session goes away
+    while(job->callbacks != NULL) {
+        Deferred_callback *callback = job->callbacks;
+        job->callbacks = callback->next;
+
+        Monitored_item_context *context = (Monitored_item_context *)callback->context;
+        if(callback->kind == CALLBACK_MONITORED_ITEM_DELETED && context != NULL) {
+            UA_NodeId_clear(&context->node_id);
+            free(context);
+        }
+        callback_free(callback);
+    }
+
+    if(job->results != NULL)
+        UA_Array_delete(job->results, job->results_size, job_results_type(job));
+
+    if(job_is_discovery(job))
+        UA_Client_delete(job->client);
+
+    free(job->url);
+    free(job->username);
+    free(job->password);
+    free(job);
+}
+
+// Frees a job that won't be answered
+static void job_drop(Job *job)
+{
+    free(job->caller.function);
+    free(job->caller.metadata);
+    job_free(job);
+}
+
+// On a worker thread
+static void job_run(Job *job)
+{
+    switch(job->kind) {
+        case JOB_CONNECT:
+            job->retval = UA_Client_connect(job->client, job->url);
+            break;
+
+        case JOB_CONNECT_USERNAME:
+            // v1.4.x: Function renamed to camelCase
+            job->retval = UA_Client_connectUsername(job->client, job->url, job->username, job->password);
+            break;
+
+        case JOB_CONNECT_SECURE_CHANNEL:
+            // v1.4.x: Use UA_Client_connectSecureChannel to connect only the secure channel without creating a session
+            job->retval = UA_Client_connectSecureChannel(job->client, job->url);
+            break;
+
+        case JOB_FIND_SERVERS_ON_NETWORK:
+            job->retval = UA_Client_findServersOnNetwork(job->client, job->url, 0, 0, 0, NULL, &job->results_size,
+                                                         (UA_ServerOnNetwork **)&job->results);
+            break;
+
+        case JOB_FIND_SERVERS:
+            job->retval = UA_Client_findServers(job->client, job->url, 0, NULL, 0, NULL, &job->results_size,
+                                                (UA_ApplicationDescription **)&job->results);
+            break;
+
+        case JOB_GET_ENDPOINTS:
+            job->retval = UA_Client_getEndpoints(job->client, job->url, &job->results_size,
+                                                 (UA_EndpointDescription **)&job->results);
+            break;
+    }
+}
+
+// On the main loop, with the caller metadata of the job restored
+static void job_respond(Job *job)
+{
+    if(job->retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(job->retval);
+        return;
+    }
+
+    switch(job->kind) {
+        case JOB_FIND_SERVERS_ON_NETWORK:
+            send_data_response(job->results, 8, job->results_size);
+            break;
+
+        case JOB_FIND_SERVERS:
+            send_data_response(job->results, 9, job->results_size);
+            break;
+
+        case JOB_GET_ENDPOINTS:
+            send_data_response(job->results, 10, job->results_size);
+            break;
+
+        case JOB_CONNECT_SECURE_CHANNEL:
+            send_ok_response();
+            break;
+
+        default:
+            // The session keeps the identity token of connect_by_username for the reconnections
+            reconnect_connected(job->url);
+            send_ok_response();
+            break;
+    }
+}
+
+static void jobs_append(Job **list, Job *job)
+{
+    job->next = NULL;
+    while(*list != NULL)
+        list = &(*list)->next;
+    *list = job;
+}
+
+static void *worker_run(void *arg)
+{
+    (void) arg;
+
+    for(;;) {
+        pthread_mutex_lock(&jobs_lock);
+        while(jobs_pending == NULL && !workers_stopping)
+            pthread_cond_wait(&jobs_ready, &jobs_lock);
+
+        if(workers_stopping) {
+            pthread_mutex_unlock(&jobs_lock);
+            return NULL;
+        }
+
+        Job *job = jobs_pending;
+        jobs_pending = job->next;
+        pthread_mutex_unlock(&jobs_lock);
+
+        // The client callbacks are queued, anything else sent during the job goes to its session
+        erlcmd_set_prefix(job->prefix_size > 0 ? job->prefix : NULL, job->prefix_size);
+        worker_job = job;
+        job_run(job);
+        worker_job = NULL;
+
+        pthread_mutex_lock(&jobs_lock);
+        jobs_append(&jobs_done, job);
+        pthread_mutex_unlock(&jobs_lock);
+
+        // A full pipe already wakes the main loop
+        ssize_t rc;
+        do {
+            rc = write(jobs_wake[1], "j", 1);
+        } while(rc < 0 && errno == EINTR);
+    }
+}
+
+static void workers_start()
+{
+    if(pipe(jobs_wake) < 0)
+        err(EXIT_FAILURE, "pipe");
+
+    fcntl(jobs_wake[0], F_SETFL, fcntl(jobs_wake[0], F_GETFL) | O_NONBLOCK);
+    fcntl(jobs_wake[1], F_SETFL, fcntl(jobs_wake[1], F_GETFL) | O_NONBLOCK);
+
+    for(; workers_started < WORKER_THREADS; workers_started++) {
+        if(pthread_create(&workers[workers_started], NULL, worker_run, NULL) != 0)
+            errx(EXIT_FAILURE, "Failed to start the worker threads");
+    }
+}
+
+/*
+ *  Waits for the jobs running (pending jobs are dropped) and frees every job not completed.
+ */
+static void workers_stop()
+{
+    pthread_mutex_lock(&jobs_lock);
+    workers_stopping = true;
+    pthread_cond_broadcast(&jobs_ready);
+    pthread_mutex_unlock(&jobs_lock);
+
+    for(size_t i = 0; i < workers_started; i++)
+        pthread_join(workers[i], NULL);
+
+    Job *lists[] = {jobs_pending, jobs_done};
+    for(size_t i = 0; i < 2; i++) {
+        while(lists[i] != NULL) {
+            Job *next = lists[i]->next;
+            job_drop(lists[i]);
+            lists[i] = next;
+        }
+    }
+    jobs_pending = NULL;
+    jobs_done = NULL;
+
+    close(jobs_wake[0]);
+    close(jobs_wake[1]);
+}
+
+static Job *jobs_take_done()
+{
+    char drain[64];
+    while(read(jobs_wake[0], drain, sizeof(drain)) > 0);
+
+    pthread_mutex_lock(&jobs_lock);
+    Job *done = jobs_done;
+    jobs_done = NULL;
+    pthread_mutex_unlock(&jobs_lock);
+
+    return done;
+}
+
+/************************/
+/* Connection Functions */
+/************************/
+
+/* Connect to the server by passing only the url.
+ *
+ * @return Indicates whether the operation succeeded or returns an error code */
+static void handle_connect_client_by_url(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid url (size)");
+
+    char *url = (char *)malloc(term_size + 1);
+    long binary_len;
+    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid url");
+    url[binary_len] = '\0';
+
+
+    // Custom data types and browse paths are resolved once per session.
+    data_type_cache_clear();
+    path_cache_clear();
+
+    UA_Client_getConfig(client)->stateCallback = clientStateCallback;
+    job_submit(job_new(JOB_CONNECT, url, NULL, NULL));
+}
+
+/* Connect to the server by passing a url, username and password.
+ *
+ * @return Indicates whether the operation succeeded or returns an error code */
+static void handle_connect_client_by_username(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    unsigned long str_len;
+    unsigned long binary_len;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 3)
+        errx(EXIT_FAILURE, ":connect_client_by_username requires a 3-tuple, term_size = %d", term_size);
+    
+    // URL
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid url (size)");
+
+    char *url = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid url");
+    url[binary_len] = '\0';
+
+    //USER
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid username (size)");
+
+    char *username = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, username, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid username");
+    username[binary_len] = '\0';
+
+    //PASSWORD
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid password (size)");
+
+    char *password = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, password, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid password");
+    password[binary_len] = '\0';
+
+    data_type_cache_clear();
+    path_cache_clear();
+
+    UA_Client_getConfig(client)->stateCallback = clientStateCallback;
+    job_submit(job_new(JOB_CONNECT_USERNAME, url, username, password));
+}
+
+/* Connect to the server secure channel without creating a session.
+ *
+ * @return Indicates whether the operation succeeded or returns an error code */
+static void handle_connect_client_secure_channel(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    long binary_len = 0; 
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid url (size)");
+
+    char *url = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid url");
+    url[binary_len] = '\0';
+    
+    job_submit(job_new(JOB_CONNECT_SECURE_CHANNEL, url, NULL, NULL));
+}
+
+/* Disconnect and close a connection to the selected server.
+ *
+ * @return Indicates whether the operation succeeded or returns an error code */
+static void handle_disconnect_client(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    reconnect_stop();
+    UA_StatusCode retval = UA_Client_disconnect(client);
+    data_type_cache_clear();
+    path_cache_clear();
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+    
+    send_ok_response();
+}
+
+/**************/
+/* Encryption */
+/**************/
+
+/* 
+ *   Creates a client configuration with all security policies for the given certificates.
+ */
+static void handle_set_config_with_security_policies(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    char *arg1;
+    char *arg2;
+    long binary_len;
+    unsigned long security_mode = 1;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 3)
+        errx(EXIT_FAILURE, ":handle_set_config_with_security_policies requires a 3-tuple, term_size = %d", term_size);
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_ATOM_EXT)
+    {
+        if (ei_decode_ulong(req, req_index, &security_mode) < 0) {
+            send_error_response("einval");
+            return;
+        }
+    }
+    else
+    {
+        char nil[4];
+        if (ei_decode_atom(req, req_index, nil) < 0)
+            errx(EXIT_FAILURE, "expecting command atom");
+    }
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid certificate (size)");
+
+    arg1 = (char *)malloc(term_size + 1);
+
+    if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid certificate");
+
+    arg1[binary_len] = '\0';
+
+    UA_ByteString certificate;
+    certificate.data = arg1;
+    certificate.length = binary_len;
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid private_key (size)");
+
+    arg2 = (char *)malloc(term_size + 1);
+
+    if (ei_decode_binary(req, req_index, arg2, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid private_key");
+
+    arg2[binary_len] = '\0';
+
+    UA_ByteString private_key;
+    private_key.data = arg2;
+    private_key.length = binary_len;
+
+    /* Load the trustlist */
+    size_t trust_list_size = 0;
+    UA_ByteString *trust_list = NULL;
+
+    /* Loading of a revocation list currently unsupported */
+    size_t revocation_list_size = 0;
+    UA_ByteString *revocation_list = NULL;
+
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+
+    config->securityMode = (UA_MessageSecurityMode) security_mode;
+
+    UA_StatusCode retval =
+        UA_ClientConfig_setDefaultEncryption(config, certificate, private_key,
+                                             trust_list, trust_list_size,
+                                             revocation_list, revocation_list_size);
+
+    /* v1.4.x: For testing, accept all certificates */
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_CertificateVerification_AcceptAll(&config->certificateVerification);
+    }
+
+    UA_ByteString_clear(&certificate);
+    UA_ByteString_clear(&private_key);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }    
+
+    send_ok_response();
+}
+
+/***********************/
+/* Discovery Functions */
+/***********************/
+
+/* Get a list of all known server in the network. Only supported by LDS servers.
+ *
+ * @param url to connect (for example "opc.tcp://localhost:4840")
+ * @return Indicates whether the operation succeeded or returns an error code */
+static void handle_find_servers_on_network(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    long binary_len = 0; 
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid url (size)");
+
+    char *url = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid url");
+    url[binary_len] = '\0';
+
+    job_submit(job_new(JOB_FIND_SERVERS_ON_NETWORK, url, NULL, NULL));
+}
+
+/* Gets a list of all registered servers at the given server.
+ *
+ * @param serverUrl url to connect (for example "opc.tcp://localhost:4840")
+ * @return Indicates whether the operation succeeded or returns an error code */
+static void handle_find_servers(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    long binary_len = 0; 
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid url (size)");
+
+    char *url = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid url");
+    url[binary_len] = '\0';
+
+    job_submit(job_new(JOB_FIND_SERVERS, url, NULL, NULL));
+}
+
+/* Gets a list of endpoints of a server
+ *
+ * @param url to connect (for example "opc.tcp://localhost:4840")
+ * @return Indicates whether the operation succeeded or returns an error code */
+static void handle_get_endpoints(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    long binary_len = 0; 
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid url (size)");
+
+    char *url = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid url");
+    url[binary_len] = '\0';
+
+    job_submit(job_new(JOB_GET_ENDPOINTS, url, NULL, NULL));
+}
+
+/******************************/
+/* Node Addition and Deletion */
+/******************************/
+
+/* 
+ *  Add a new reference to the server. 
+ */
+void handle_add_reference(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    long binary_len;
+    unsigned long target_node_class;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 6)
+        errx(EXIT_FAILURE, ":handle_add_reference requires a 6-tuple, term_size = %d", term_size);
+    
+    UA_NodeId source_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_id = assemble_node_id(req, req_index);
+    UA_ExpandedNodeId target_id = assemble_expanded_node_id(req, req_index);
+
+    int is_forward;
+    ei_decode_boolean(req, req_index, &is_forward);
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid target_server_uri (size)");
+
+    char target_server_uri_str[term_size + 1];
+    if (ei_decode_binary(req, req_index, target_server_uri_str, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid target_server_uri_str");
+    target_server_uri_str[binary_len] = '\0';
+
+    UA_String target_server_uri = UA_STRING(target_server_uri_str);
+
+    if (ei_decode_ulong(req, req_index, &target_node_class) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_StatusCode retval = UA_Client_addReference(client, source_id, reference_type_id, (UA_Boolean)is_forward, target_server_uri, target_id, target_node_class);
+
+    UA_NodeId_clear(&source_id);
+    UA_NodeId_clear(&reference_type_id);
+    UA_ExpandedNodeId_clear(&target_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/***************************************/
+/* Reading and Writing Node Attributes */
+/***************************************/
+
+/* 
+ *  Change 'data type' of a node in the server. 
+ */
+void handle_write_node_node_id(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_node_id requires a 3-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+    UA_NodeId new_node_id = assemble_node_id(req, req_index);
+
+    retval = UA_Client_writeNodeIdAttribute(client, node_id, &new_node_id);
+
+    UA_NodeId_clear(&node_id);
+    UA_NodeId_clear(&new_node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'node class' attribute of a node in the server. 
+ */
+void handle_write_node_node_class(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_node_class requires a 3-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+    unsigned long node_class;
+    
+    if (ei_decode_ulong(req, req_index, &node_class) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    retval = UA_Client_writeNodeClassAttribute(client, node_id, (UA_NodeClass *) &node_class);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'user_write_mask' attribute of a node in the server. 
+ */
+void handle_write_node_user_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_user_write_mask requires a 3-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+    unsigned long user_write_mask;
+    
+    if (ei_decode_ulong(req, req_index, &user_write_mask) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_UInt32 ua_user_write_mask = (UA_UInt32) user_write_mask;
+
+    retval = UA_Client_writeUserWriteMaskAttribute(client, node_id, &ua_user_write_mask);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'symmetric' of a node in the server. 
+ */
+void handle_write_node_symmetric(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_symmetric requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // write_mask
+    int symmetric;
+    if (ei_decode_boolean(req, req_index, &symmetric) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_Boolean symmetric_bool = symmetric;
+    
+    retval = UA_Client_writeSymmetricAttribute(client, node_id, &symmetric_bool);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'contains_no_loops' of a node in the server. 
+ */
+void handle_write_node_contains_no_loops(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_contains_no_loops requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    int contains_no_loops;
+    if (ei_decode_boolean(req, req_index, &contains_no_loops) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_Boolean contains_no_loops_bool = contains_no_loops;
+    
+    retval = UA_Client_writeContainsNoLoopsAttribute(client, node_id, &contains_no_loops_bool);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'user_access_level' of a node in the server. 
+ */
+void handle_write_node_user_access_level(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_user_access_level requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    unsigned long user_access_level;
+    if (ei_decode_ulong(req, req_index, &user_access_level) < 0) {
+        send_error_response("einval");
+        return;
+    }
+    
+    UA_Byte ua_user_access_level = (UA_Byte) user_access_level;
+
+    retval = UA_Client_writeAccessLevelAttribute(client, node_id, &ua_user_access_level);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'user_executable' of a node in the server. 
+ */
+void handle_write_node_user_executable(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_user_executable requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    int user_executable;
+    if (ei_decode_boolean(req, req_index, &user_executable) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_Boolean user_executable_bool = user_executable;
+    
+    retval = UA_Client_writeUserExecutableAttribute(client, node_id, &user_executable_bool);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Reads 'user_write_mask' attribute of a node in the server. 
+ */
+void handle_read_node_user_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+    UA_UInt32 user_write_mask;
+
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    retval = UA_Client_readUserWriteMaskAttribute(client, node_id, &user_write_mask);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_data_response(&user_write_mask, 27, 0);
+}
+
+/* 
+ *  Reads 'user_access_level' Attribute from a node. 
+ */
+void handle_read_node_user_access_level(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_Byte user_access_level;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    retval = UA_Client_readUserAccessLevelAttribute(client, node_id, &user_access_level);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_data_response(&user_access_level, 24, 0);
+}
+
+/* 
+ *  Reads 'user_executable' Attribute from a node. 
+ */
+void handle_read_node_user_executable(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_Boolean user_executable;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    retval = UA_Client_readUserExecutableAttribute(client, node_id, &user_executable);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_data_response(&user_executable, 0, 0);
+}
+
+
+/*********************/
+/* Custom Data Types */
+/*********************/
+
+/*
+ *  Server-defined structures are discovered through their DataTypeDefinition attribute and
+ *  registered in UA_ClientConfig.customDataTypes, so later reads are decoded by the stack itself.
+ *  Every discovery appends one UA_DataTypeArray to the chain. The whole chain is dropped when
+ *  the session changes or when the server NamespaceArray no longer matches the cached one. While
+ *  types are cached, the NamespaceArray is read again before decoding a response if the last read is
+ *  DATA_TYPE_CHECK_INTERVAL old; the values of that response the stack decoded with the dropped
+ *  types are encoded back and decoded with the types discovered again.
+ */
+#define MAX_DISCOVERED_DATA_TYPES 256
+#define MAX_DISCOVERY_DEPTH 8
+#define DATA_TYPE_CHECK_INTERVAL 1000       // ms
+
+static UA_DataTypeArray *custom_types = NULL;
+static UA_DataTypeArray *retired_types = NULL;
+static UA_Variant custom_types_namespaces;
+static uint64_t custom_types_checked = 0;      // current_time() of the last NamespaceArray read
+static UA_NodeId *unknown_encodings = NULL;
+static size_t unknown_encodings_size = 0;
+
+static char *ua_string_to_cstr(const UA_String *string)
+{
+    char *cstr = (char *)malloc(string->length + 1);
+    if(cstr == NULL)
+        return NULL;
+
+    if(string->length > 0)
+        memcpy(cstr, string->data, string->length);
+    cstr[string->length] = '\0';
+
+    return cstr;
+}
+
+static void free_custom_data_type(UA_DataType *type)
+{
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+    free((char *)type->typeName);
+    for(size_t i = 0; i < type->membersSize; i++)
+        free((char *)type->members[i].memberName);
+#endif
+    free(type->members);
+    UA_NodeId_clear(&type->typeId);
+    UA_NodeId_clear(&type->binaryEncodingId);
+    memset(type, 0, sizeof(UA_DataType));
+}
+
+static bool data_type_in_chain(const UA_DataType *type, const UA_DataTypeArray *chain)
+{
+    for(; chain != NULL; chain = chain->next) {
+        if(type >= chain->types && type < chain->types + chain->typesSize)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ *  True if the value (or an ExtensionObject or Variant in it) was decoded with a type of the chain.
+ */
+static bool variant_uses_types(const UA_Variant *value, const UA_DataTypeArray *chain)
+{
+    if(value->type == NULL || value->data == NULL)
+        return false;
+
+    if(data_type_in_chain(value->type, chain))
+        return true;
+
+    size_t size = UA_Variant_isScalar(value) ? 1 : value->arrayLength;
+
+    if(value->type == &UA_TYPES[UA_TYPES_EXTENSIONOBJECT]) {
+        const UA_ExtensionObject *objects = (const UA_ExtensionObject *)value->data;
+        for(size_t i = 0; i < size; i++) {
+            if(objects[i].encoding >= UA_EXTENSIONOBJECT_DECODED &&
+               data_type_in_chain(objects[i].content.decoded.type, chain))
+                return true;
+        }
+    } else if(value->type == &UA_TYPES[UA_TYPES_VARIANT]) {
+        const UA_Variant *variants = (const UA_Variant *)value->data;
+        for(size_t i = 0; i < size; i++) {
+            if(variant_uses_types(&variants[i], chain))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ *  Cached values keep pointers to the types they were decoded with, so the values decoded with a
+ *  chain are dropped before it is freed: value cache entries wait for the next notification and
+ *  poll groups report the node again on their next read.
+ */
+static void data_type_values_release(const UA_DataTypeArray *chain)
+{
+    if(chain == NULL)
+        return;
+
+    for(size_t i = 0; i < value_cache_buckets; i++) {
+        for(Value_cache_entry *entry = value_cache[i]; entry != NULL; entry = entry->next) {
+            if(variant_uses_types(&entry->value.value, chain)) {
+                UA_DataValue_clear(&entry->value);
+                entry->received = 0;
+            }
+        }
+    }
+
+    poll_groups_drop_types(chain);
+}
+
+static void free_data_type_chain(UA_DataTypeArray *chain)
+{
+    data_type_values_release(chain);
+
+    while(chain != NULL) {
+        UA_DataTypeArray *next = (UA_DataTypeArray *)chain->next;
+        UA_DataType *types = (UA_DataType *)chain->types;
+
+        for(size_t i = 0; i < chain->typesSize; i++)
+            free_custom_data_type(&types[i]);
+
+        free(types);
+        free(chain);
+        chain = next;
+    }
+}
+
+/*
+ *  Values of the response being decoded may already use the cached types (the stack decodes
+ *  registered types itself), so a chain invalidated while decoding is only detached here and
+ *  freed before the next response is decoded.
+ */
+static void data_type_cache_retire()
+{
+    if(custom_types != NULL) {
+        UA_DataTypeArray *last = custom_types;
+        while(last->next != NULL)
+            last = (UA_DataTypeArray *)last->next;
+
+        last->next = retired_types;
+        retired_types = custom_types;
+        custom_types = NULL;
+    }
+
+    if(client != NULL)
+        UA_Client_getConfig(client)->customDataTypes = NULL;
+
+    UA_Variant_clear(&custom_types_namespaces);
+    custom_types_checked = 0;
+    UA_Array_delete(unknown_encodings, unknown_encodings_size, &UA_TYPES[UA_TYPES_NODEID]);
+    unknown_encodings = NULL;
+    unknown_encodings_size = 0;
+}
+
+static void data_type_cache_clear()
+{
+    free_data_type_chain(custom_types);
+    custom_types = NULL;
+    free_data_type_chain(retired_types);
+    retired_types = NULL;
+
+    if(client != NULL)
+        UA_Client_getConfig(client)->customDataTypes = NULL;
+
+    UA_Variant_clear(&custom_types_namespaces);
+    custom_types_checked = 0;
+    UA_Array_delete(unknown_encodings, unknown_encodings_size, &UA_TYPES[UA_TYPES_NODEID]);
+    unknown_encodings = NULL;
+    unknown_encodings_size = 0;
+}
+
+/*
+ *  Looks a type up in the types being built, ns0 and the cache.
+ */
+static const UA_DataType *find_data_type(const UA_NodeId *type_id, const UA_DataType *pending, size_t pending_size)
+{
+    for(size_t i = 0; i < pending_size; i++) {
+        if(UA_NodeId_equal(&pending[i].typeId, type_id))
+            return &pending[i];
+    }
+
+    // Abstract BaseDataType fields are carried as Variants.
+    if(type_id->namespaceIndex == 0 && type_id->identifierType == UA_NODEIDTYPE_NUMERIC &&
+       type_id->identifier.numeric == UA_NS0ID_BASEDATATYPE)
+        return &UA_TYPES[UA_TYPES_VARIANT];
+
+    return UA_findDataTypeWithCustom(type_id, custom_types);
+}
+
+static const UA_DataType *find_data_type_by_encoding(const UA_NodeId *encoding_id)
+{
+    for(const UA_DataTypeArray *array = custom_types; array != NULL; array = array->next) {
+        for(size_t i = 0; i < array->typesSize; i++) {
+            if(UA_NodeId_equal(&array->types[i].binaryEncodingId, encoding_id))
+                return &array->types[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ *  Natural alignment of the in-memory representation of a type, so members are laid out
+ *  exactly like the C compiler lays out the generated types.
+ */
+static size_t data_type_alignment(const UA_DataType *type)
+{
+    size_t alignment = 1;
+
+    switch(type->typeKind) {
+        case UA_DATATYPEKIND_GUID:
+            return sizeof(UA_UInt32);
+
+        case UA_DATATYPEKIND_STRUCTURE:
+        case UA_DATATYPEKIND_OPTSTRUCT:
+        case UA_DATATYPEKIND_UNION:
+            if(type->typeKind == UA_DATATYPEKIND_UNION)
+                alignment = sizeof(UA_UInt32);
+
+            for(size_t i = 0; i < type->membersSize; i++) {
+                const UA_DataTypeMember *member = &type->members[i];
+                size_t member_alignment = (member->isArray || member->isOptional) ?
+                    sizeof(void *) : data_type_alignment(member->memberType);
+
+                if(member_alignment > alignment)
+                    alignment = member_alignment;
+            }
+            return alignment;
+
+        default:
+            if(!type->pointerFree)
+                return sizeof(void *);
+            return type->memSize < sizeof(UA_UInt64) ? type->memSize : sizeof(UA_UInt64);
+    }
+}
+
+/*
+ *  Builds an enumeration type, enumerations are encoded as Int32.
+ */
+static UA_StatusCode build_enumeration_type(UA_DataType *type, const UA_NodeId *type_id, const UA_QualifiedName *browse_name)
+{
+    *type = UA_TYPES[UA_TYPES_INT32];
+    type->typeKind = UA_DATATYPEKIND_ENUM;
+    type->members = NULL;
+    type->membersSize = 0;
+    UA_NodeId_init(&type->binaryEncodingId);
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+    type->typeName = ua_string_to_cstr(&browse_name->name);
+#endif
+
+    return UA_NodeId_copy(type_id, &type->typeId);
+}
+
+/*
+ *  Builds a structure type from its StructureDefinition. Returns UA_STATUSCODE_BADDATATYPEIDUNKNOWN
+ *  while a field type is not known yet, so the caller can retry once its dependencies are built.
+ */
+static UA_StatusCode build_structure_type(UA_DataType *type, const UA_NodeId *type_id, const UA_QualifiedName *browse_name,
+                                          const UA_StructureDefinition *definition, const UA_DataType *pending, size_t pending_size)
+{
+    UA_Byte type_kind;
+    size_t offset = 0;
+    size_t alignment = 1;
+    UA_Boolean pointer_free = true;
+
+    switch(definition->structureType) {
+        case UA_STRUCTURETYPE_STRUCTURE:
+            type_kind = UA_DATATYPEKIND_STRUCTURE;
+        break;
+
+        case UA_STRUCTURETYPE_STRUCTUREWITHOPTIONALFIELDS:
+            type_kind = UA_DATATYPEKIND_OPTSTRUCT;
+        break;
+
+        default:
+            return UA_STATUSCODE_BADNOTSUPPORTED;
+    }
+
+    if(definition->fieldsSize > UA_BYTE_MAX)
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+
+    UA_DataTypeMember *members = (UA_DataTypeMember *)calloc(definition->fieldsSize + 1, sizeof(UA_DataTypeMember));
+    if(members == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    for(size_t i = 0; i < definition->fieldsSize; i++) {
+        const UA_StructureField *field = &definition->fields[i];
+        UA_DataTypeMember *member = &members[i];
+        size_t member_alignment;
+        size_t member_size;
+
+        const UA_DataType *member_type = find_data_type(&field->dataType, pending, pending_size);
+        if(member_type == NULL) {
+            free(members);
+            return UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+        }
+
+        member->memberType = member_type;
+        member->isArray = field->valueRank >= UA_VALUERANK_ONE_DIMENSION;
+        member->isOptional = type_kind == UA_DATATYPEKIND_OPTSTRUCT && field->isOptional;
+
+        if(member->isArray) {
+            // size_t length followed by the array pointer
+            member_alignment = sizeof(size_t);
+            member_size = sizeof(size_t) + sizeof(void *);
+        }
+        else if(member->isOptional) {
+            member_alignment = sizeof(void *);
+            member_size = sizeof(void *);
+        }
+        else {
+            member_alignment = data_type_alignment(member_type);
+            member_size = member_type->memSize;
+        }
+
+        size_t padding = (member_alignment - offset % member_alignment) % member_alignment;
+        member->padding = (UA_Byte)padding;
+        offset += padding + member_size;
+
+        if(member_alignment > alignment)
+            alignment = member_alignment;
+
+        if(member->isArray || member->isOptional || !member_type->pointerFree)
+            pointer_free = false;
+    }
+
+    offset += (alignment - offset % alignment) % alignment;
+    if(offset > UA_UINT16_MAX) {
+        free(members);
+        return UA_STATUSCODE_BADNOTSUPPORTED;
+    }
+
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+    for(size_t i = 0; i < definition->fieldsSize; i++)
+        members[i].memberName = ua_string_to_cstr(&definition->fields[i].name);
+    type->typeName = ua_string_to_cstr(&browse_name->name);
+#endif
+
+    type->memSize = (UA_UInt32)offset;
+    type->typeKind = type_kind;
+    type->pointerFree = pointer_free;
+    type->overlayable = false;
+    type->membersSize = (UA_UInt32)definition->fieldsSize;
+    type->members = members;
+    UA_NodeId_copy(&definition->defaultEncodingId, &type->binaryEncodingId);
+
+    return UA_NodeId_copy(type_id, &type->typeId);
+}
+
+static bool namespaces_equal(const UA_Variant *a, const UA_Variant *b)
+{
+    if(a->type != &UA_TYPES[UA_TYPES_STRING] || b->type != &UA_TYPES[UA_TYPES_STRING] ||
+       a->arrayLength != b->arrayLength)
+        return false;
+
+    for(size_t i = 0; i < a->arrayLength; i++) {
+        if(!UA_String_equal(&((UA_String *)a->data)[i], &((UA_String *)b->data)[i]))
+            return false;
+    }
+
+    return true;
+}
+
+static bool node_id_in_array(const UA_NodeId *node_id, const UA_NodeId *array, size_t array_size)
+{
+    for(size_t i = 0; i < array_size; i++) {
+        if(UA_NodeId_equal(node_id, &array[i]))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ *  Discovers the given data types, and the field types they depend on, with one batched Read per
+ *  dependency level and registers them in the client configuration. Types already known cost no
+ *  round trip. results[i] receives the status of type_ids[i].
+ */
+static UA_StatusCode data_type_cache_load(const UA_NodeId *type_ids, size_t type_ids_size, UA_StatusCode *results)
+{
+    UA_NodeId discovered_ids[MAX_DISCOVERED_DATA_TYPES];
+    UA_QualifiedName discovered_names[MAX_DISCOVERED_DATA_TYPES];
+    UA_Variant discovered_definitions[MAX_DISCOVERED_DATA_TYPES];
+    UA_StatusCode discovered_status[MAX_DISCOVERED_DATA_TYPES];
+    size_t discovered_size = 0;
+    size_t round_start = 0;
+    bool namespaces_checked = false;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    for(size_t i = 0; i < type_ids_size; i++) {
+        if(find_data_type(&type_ids[i], NULL, 0) != NULL ||
+           node_id_in_array(&type_ids[i], discovered_ids, discovered_size))
+            continue;
+
+        if(discovered_size == MAX_DISCOVERED_DATA_TYPES)
+            break;
+
+        UA_NodeId_copy(&type_ids[i], &discovered_ids[discovered_size]);
+        UA_QualifiedName_init(&discovered_names[discovered_size]);
+        UA_Variant_init(&discovered_definitions[discovered_size]);
+        discovered_status[discovered_size] = UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+        discovered_size++;
+    }
+
+    // One Read per dependency level: {DataTypeDefinition, BrowseName} per type, plus the
+    // NamespaceArray on the first level to detect a changed address space.
+    for(size_t depth = 0; depth < MAX_DISCOVERY_DEPTH && round_start < discovered_size; depth++) {
+        size_t round_size = discovered_size - round_start;
+        size_t offset = namespaces_checked ? 0 : 1;
+        size_t read_size = round_size * 2 + offset;
+
+        UA_ReadValueId *nodesToRead = (UA_ReadValueId *)UA_Array_new(read_size, &UA_TYPES[UA_TYPES_READVALUEID]);
+        if(nodesToRead == NULL) {
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            break;
+        }
+
+        if(!namespaces_checked) {
+            nodesToRead[0].nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_NAMESPACEARRAY);
+            nodesToRead[0].attributeId = UA_ATTRIBUTEID_VALUE;
+        }
+
+        for(size_t i = 0; i < round_size; i++) {
+            UA_NodeId_copy(&discovered_ids[round_start + i], &nodesToRead[offset + 2 * i].nodeId);
+            nodesToRead[offset + 2 * i].attributeId = UA_ATTRIBUTEID_DATATYPEDEFINITION;
+            UA_NodeId_copy(&discovered_ids[round_start + i], &nodesToRead[offset + 2 * i + 1].nodeId);
+            nodesToRead[offset + 2 * i + 1].attributeId = UA_ATTRIBUTEID_BROWSENAME;
+        }
+
+        UA_ReadRequest readRequest;
+        UA_ReadRequest_init(&readRequest);
+        readRequest.nodesToRead = nodesToRead;
+        readRequest.nodesToReadSize = read_size;
+
+        UA_ReadResponse readResponse = UA_Client_Service_read(client, readRequest);
+        UA_Array_delete(nodesToRead, read_size, &UA_TYPES[UA_TYPES_READVALUEID]);
+
+        retval = readResponse.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD && readResponse.resultsSize != read_size)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_ReadResponse_clear(&readResponse);
+            break;
+        }
+
+        if(!namespaces_checked) {
+            UA_Variant *namespaces = &readResponse.results[0].value;
+            if(!UA_Variant_isEmpty(&custom_types_namespaces) && !namespaces_equal(namespaces, &custom_types_namespaces))
+                data_type_cache_retire();
+            if(UA_Variant_isEmpty(&custom_types_namespaces))
+                UA_Variant_copy(namespaces, &custom_types_namespaces);
+            custom_types_checked = current_time();
+            namespaces_checked = true;
+        }
+
+        for(size_t i = 0; i < round_size; i++) {
+            size_t index = round_start + i;
+            UA_DataValue *definition = &readResponse.results[offset + 2 * i];
+            UA_DataValue *browse_name = &readResponse.results[offset + 2 * i + 1];
+
+            if(definition->status != UA_STATUSCODE_GOOD) {
+                discovered_status[index] = definition->status;
+                continue;
+            }
+
+            if(browse_name->status == UA_STATUSCODE_GOOD &&
+               UA_Variant_hasScalarType(&browse_name->value, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]))
+                UA_QualifiedName_copy((UA_QualifiedName *)browse_name->value.data, &discovered_names[index]);
+
+            UA_Variant_copy(&definition->value, &discovered_definitions[index]);
+
+            if(!UA_Variant_hasScalarType(&definition->value, &UA_TYPES[UA_TYPES_STRUCTUREDEFINITION]))
+                continue;
+
+            // Queue the field types that are neither known nor discovered for the next level.
+            UA_StructureDefinition *structure = (UA_StructureDefinition *)definition->value.data;
+            for(size_t j = 0; j < structure->fieldsSize; j++) {
+                const UA_NodeId *field_type = &structure->fields[j].dataType;
+                if(find_data_type(field_type, NULL, 0) != NULL ||
+                   node_id_in_array(field_type, discovered_ids, discovered_size) ||
+                   discovered_size == MAX_DISCOVERED_DATA_TYPES)
+                    continue;
+
+                UA_NodeId_copy(field_type, &discovered_ids[discovered_size]);
+                UA_QualifiedName_init(&discovered_names[discovered_size]);
+                UA_Variant_init(&discovered_definitions[discovered_size]);
+                discovered_status[discovered_size] = UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+                discovered_size++;
+            }
+        }
+
+        UA_ReadResponse_clear(&readResponse);
+        round_start += round_size;
+    }
+
+    // Build the types, retrying until no more dependencies can be resolved.
+    UA_DataType *types = NULL;
+    size_t types_size = 0;
+
+    if(retval == UA_STATUSCODE_GOOD && discovered_size > 0)
+        types = (UA_DataType *)calloc(discovered_size, sizeof(UA_DataType));
+
+    if(types != NULL) {
+        bool progress = true;
+        while(progress) {
+            progress = false;
+            for(size_t i = 0; i < discovered_size; i++) {
+                UA_Variant *definition = &discovered_definitions[i];
+                UA_StatusCode status;
+
+                if(discovered_status[i] != UA_STATUSCODE_BADDATATYPEIDUNKNOWN || UA_Variant_isEmpty(definition))
+                    continue;
+
+                if(UA_Variant_hasScalarType(definition, &UA_TYPES[UA_TYPES_STRUCTUREDEFINITION]))
+                    status = build_structure_type(&types[types_size], &discovered_ids[i], &discovered_names[i],
+                                                  (UA_StructureDefinition *)definition->data, types, types_size);
+                else if(UA_Variant_hasScalarType(definition, &UA_TYPES[UA_TYPES_ENUMDEFINITION]))
+                    status = build_enumeration_type(&types[types_size], &discovered_ids[i], &discovered_names[i]);
+                else
+                    status = UA_STATUSCODE_BADNOTSUPPORTED;
+
+                if(status == UA_STATUSCODE_BADDATATYPEIDUNKNOWN)
+                    continue;
+
+                discovered_status[i] = status;
+                if(status == UA_STATUSCODE_GOOD) {
+                    types_size++;
+                    progress = true;
+                }
+                else
+                    free_custom_data_type(&types[types_size]);
+            }
+        }
+
+        if(types_size > 0) {
+            UA_DataTypeArray chain = {.next = custom_types, .typesSize = types_size, .types = types};
+            UA_DataTypeArray *array = (UA_DataTypeArray *)malloc(sizeof(UA_DataTypeArray));
+            if(array != NULL) {
+                memcpy(array, &chain, sizeof(UA_DataTypeArray));
+                custom_types = array;
+                UA_Client_getConfig(client)->customDataTypes = custom_types;
+            }
+            else {
+                for(size_t i = 0; i < types_size; i++)
+                    free_custom_data_type(&types[i]);
+                free(types);
+                retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            }
+        }
+        else
+            free(types);
+    }
+    else if(retval == UA_STATUSCODE_GOOD && discovered_size > 0)
+        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+
+    for(size_t i = 0; results != NULL && i < type_ids_size; i++) {
+        results[i] = retval;
+        if(retval != UA_STATUSCODE_GOOD)
+            continue;
+
+        if(find_data_type(&type_ids[i], NULL, 0) != NULL) {
+            results[i] = UA_STATUSCODE_GOOD;
+            continue;
+        }
+
+        results[i] = UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+        for(size_t j = 0; j < discovered_size; j++) {
+            if(UA_NodeId_equal(&type_ids[i], &discovered_ids[j]))
+                results[i] = discovered_status[j];
+        }
+    }
+
+    for(size_t i = 0; i < discovered_size; i++) {
+        UA_NodeId_clear(&discovered_ids[i]);
+        UA_QualifiedName_clear(&discovered_names[i]);
+        UA_Variant_clear(&discovered_definitions[i]);
+    }
+
+    return retval;
+}
+
+static void decode_extension_object(UA_ExtensionObject *object, const UA_DataType *type)
+{
+    void *data = UA_new(type);
+    if(data == NULL)
+        return;
+
+    if(UA_decodeBinary(&object->content.encoded.body, data, type, NULL) != UA_STATUSCODE_GOOD) {
+        UA_delete(data, type);
+        return;
+    }
+
+    UA_ExtensionObject_clear(object);
+    UA_ExtensionObject_setValue(object, data, type);
+}
+
+/*
+ *  Reads the NamespaceArray if the last read is DATA_TYPE_CHECK_INTERVAL old and retires the cached
+ *  types if it changed. Returns true when they were retired.
+ */
+static bool data_type_cache_check()
+{
+    if(custom_types == NULL || current_time() - custom_types_checked < DATA_TYPE_CHECK_INTERVAL)
+        return false;
+
+    UA_Variant namespaces;
+    UA_Variant_init(&namespaces);
+    if(UA_Client_readValueAttribute(client, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_NAMESPACEARRAY), &namespaces) !=
+       UA_STATUSCODE_GOOD)
+        return false;
+
+    custom_types_checked = current_time();
+    bool changed = !UA_Variant_isEmpty(&custom_types_namespaces) && !namespaces_equal(&namespaces, &custom_types_namespaces);
+    UA_Variant_clear(&namespaces);
+
+    if(changed)
+        data_type_cache_retire();
+
+    return changed;
+}
+
+static UA_StatusCode extension_object_encode(UA_ExtensionObject *object, const void *data, const UA_DataType *type)
+{
+    UA_ExtensionObject_init(object);
+    UA_StatusCode retval = UA_encodeBinary(data, type, &object->content.encoded.body);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_NodeId_copy(&type->binaryEncodingId, &object->content.encoded.typeId);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_ExtensionObject_clear(object);
+        return retval;
+    }
+
+    object->encoding = UA_EXTENSIONOBJECT_ENCODED_BYTESTRING;
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  Turns the values decoded with the types of `chain` back into encoded ExtensionObjects, as they
+ *  were received.
+ */
+static void variant_encode_types(UA_Variant *value, const UA_DataTypeArray *chain)
+{
+    if(value->type == NULL || value->data == NULL)
+        return;
+
+    bool scalar = UA_Variant_isScalar(value);
+    size_t size = scalar ? 1 : value->arrayLength;
+
+    if(data_type_in_chain(value->type, chain)) {
+        const UA_DataType *type = value->type;
+        UA_ExtensionObject *objects = (UA_ExtensionObject *)UA_Array_new(size, &UA_TYPES[UA_TYPES_EXTENSIONOBJECT]);
+        for(size_t i = 0; objects != NULL && i < size; i++)
+            extension_object_encode(&objects[i], (const char *)value->data + i * type->memSize, type);
+
+        UA_Variant_clear(value);
+        if(objects == NULL)
+            return;
+
+        if(scalar)
+            UA_Variant_setScalar(value, objects, &UA_TYPES[UA_TYPES_EXTENSIONOBJECT]);
+        else
+            UA_Variant_setArray(value, objects, size, &UA_TYPES[UA_TYPES_EXTENSIONOBJECT]);
+        return;
+    }
+
+    if(value->type != &UA_TYPES[UA_TYPES_EXTENSIONOBJECT])
+        return;
+
+    UA_ExtensionObject *objects = (UA_ExtensionObject *)value->data;
+    for(size_t i = 0; i < size; i++) {
+        if(objects[i].encoding < UA_EXTENSIONOBJECT_DECODED ||
+           !data_type_in_chain(objects[i].content.decoded.type, chain))
+            continue;
+
+        UA_ExtensionObject encoded;
+        extension_object_encode(&encoded, objects[i].content.decoded.data, objects[i].content.decoded.type);
+        UA_ExtensionObject_clear(&objects[i]);
+        objects[i] = encoded;
+    }
+}
+
+/*
+ *  Decodes the ExtensionObjects of a response whose type is not registered yet. The unknown
+ *  binary encodings of all the values are collected first, so the NamespaceArray is validated and
+ *  the data types behind them are found (one inverse HasEncoding Browse) and discovered once per
+ *  response, before any value is decoded. Encodings that cannot be resolved are remembered so they
+ *  do not cost a round trip on every read.
+ */
+static void decode_client_extension_objects(void *entity, UA_Variant **values, size_t values_size)
+{
+    // No value of the previous response is alive anymore, the cached ones are dropped.
+    free_data_type_chain(retired_types);
+    retired_types = NULL;
+
+    // Known encoding ids may name other types once the namespaces moved.
+    if(data_type_cache_check()) {
+        for(size_t v = 0; v < values_size; v++)
+            variant_encode_types(values[v], retired_types);
+    }
+
+    UA_NodeId encodings[MAX_DISCOVERED_DATA_TYPES];
+    size_t encodings_size = 0;
+
+    for(size_t v = 0; v < values_size; v++) {
+        if(values[v]->type != &UA_TYPES[UA_TYPES_EXTENSIONOBJECT])
+            continue;
+
+        UA_ExtensionObject *objects = (UA_ExtensionObject *)values[v]->data;
+        size_t objects_size = UA_Variant_isScalar(values[v]) ? 1 : values[v]->arrayLength;
+
+        for(size_t i = 0; i < objects_size; i++) {
+            const UA_NodeId *encoding = &objects[i].content.encoded.typeId;
+
+            if(objects[i].encoding != UA_EXTENSIONOBJECT_ENCODED_BYTESTRING ||
+               find_data_type_by_encoding(encoding) != NULL ||
+               node_id_in_array(encoding, unknown_encodings, unknown_encodings_size) ||
+               node_id_in_array(encoding, encodings, encodings_size) ||
+               encodings_size == MAX_DISCOVERED_DATA_TYPES)
+                continue;
+
+            encodings[encodings_size++] = *encoding;
+        }
+    }
+
+    if(encodings_size > 0) {
+        UA_BrowseDescription *nodesToBrowse = (UA_BrowseDescription *)UA_Array_new(
+            encodings_size, &UA_TYPES[UA_TYPES_BROWSEDESCRIPTION]);
+        if(nodesToBrowse == NULL)
+            return;
+
+        for(size_t i = 0; i < encodings_size; i++) {
+            UA_NodeId_copy(&encodings[i], &nodesToBrowse[i].nodeId);
+            nodesToBrowse[i].browseDirection = UA_BROWSEDIRECTION_INVERSE;
+            nodesToBrowse[i].referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASENCODING);
+            nodesToBrowse[i].includeSubtypes = false;
+            nodesToBrowse[i].nodeClassMask = UA_NODECLASS_DATATYPE;
+            nodesToBrowse[i].resultMask = UA_BROWSERESULTMASK_NONE;
+        }
+
+        UA_BrowseRequest browseRequest;
+        UA_BrowseRequest_init(&browseRequest);
+        browseRequest.nodesToBrowse = nodesToBrowse;
+        browseRequest.nodesToBrowseSize = encodings_size;
+        browseRequest.requestedMaxReferencesPerNode = 1;
+
+        UA_BrowseResponse browseResponse = UA_Client_Service_browse(client, browseRequest);
+
+        UA_NodeId type_ids[MAX_DISCOVERED_DATA_TYPES];
+        UA_StatusCode type_status[MAX_DISCOVERED_DATA_TYPES];
+        for(size_t i = 0; i < encodings_size; i++) {
+            UA_NodeId_init(&type_ids[i]);
+            if(browseResponse.responseHeader.serviceResult == UA_STATUSCODE_GOOD &&
+               i < browseResponse.resultsSize && browseResponse.results[i].referencesSize > 0)
+                type_ids[i] = browseResponse.results[i].references[0].nodeId.nodeId;
+        }
+
+        UA_StatusCode retval = browseResponse.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = data_type_cache_load(type_ids, encodings_size, type_status);
+
+        // Only negative-cache definitive answers, transport errors are retried on the next read.
+        for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < encodings_size; i++) {
+            if(find_data_type_by_encoding(&encodings[i]) != NULL)
+                continue;
+
+            UA_Array_appendCopy((void **)&unknown_encodings, &unknown_encodings_size,
+                                &encodings[i], &UA_TYPES[UA_TYPES_NODEID]);
+        }
+
+        UA_BrowseResponse_clear(&browseResponse);
+        UA_Array_delete(nodesToBrowse, encodings_size, &UA_TYPES[UA_TYPES_BROWSEDESCRIPTION]);
+    }
+
+    for(size_t v = 0; v < values_size; v++) {
+        if(values[v]->type != &UA_TYPES[UA_TYPES_EXTENSIONOBJECT])
+            continue;
+
+        UA_ExtensionObject *objects = (UA_ExtensionObject *)values[v]->data;
+        size_t objects_size = UA_Variant_isScalar(values[v]) ? 1 : values[v]->arrayLength;
+
+        for(size_t i = 0; i < objects_size; i++) {
+            if(objects[i].encoding != UA_EXTENSIONOBJECT_ENCODED_BYTESTRING)
+                continue;
+
+            const UA_DataType *type = find_data_type_by_encoding(&objects[i].content.encoded.typeId);
+            if(type != NULL)
+                decode_extension_object(&objects[i], type);
+        }
+    }
+}
+
+/*
+ *  Encodes the load_data_types response. Following the ei convention, a NULL resp buffer only
+ *  computes the encoded size into resp_index.
+ *  {:ok, [:ok | {:error, reason}]}
+ */
+static void encode_load_data_types_response(char *resp, int *resp_index, UA_StatusCode *results, int results_size)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
+
+    ei_encode_list_header(resp, resp_index, results_size);
+    for(int i = 0; i < results_size; i++) {
+        if(results[i] == UA_STATUSCODE_GOOD) {
+            ei_encode_atom(resp, resp_index, "ok");
+            continue;
+        }
+
+        const char *status = UA_StatusCode_name(results[i]);
+        ei_encode_tuple_header(resp, resp_index, 2);
+        ei_encode_atom(resp, resp_index, "error");
+        ei_encode_binary(resp, resp_index, status, strlen(status));
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
+
+/*
+ *  Discovers and caches the given data types ahead of the first read.
+ *  Input: list of data type node_id tuples
+ *  Output: {:ok, [:ok | {:error, reason}]} | {:error, reason}
+ */
+static void handle_load_data_types(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int list_count;
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_load_data_types requires a list");
+
+    int type_count = list_count;
+
+    if(type_count == 0 || type_count > 100) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_NodeId type_ids[100];
+    UA_StatusCode results[100];
+
+    for(int i = 0; i < type_count; i++)
+        type_ids[i] = assemble_node_id(req, req_index);
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    UA_StatusCode retval = data_type_cache_load(type_ids, type_count, results);
+
+    for(int i = 0; i < type_count; i++)
+        UA_NodeId_clear(&type_ids[i]);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    int resp_size = sizeof(uint16_t);
+    encode_load_data_types_response(NULL, &resp_size, results, type_count);
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    int resp_index = sizeof(uint16_t);
+    encode_load_data_types_response(resp, &resp_index, results, type_count);
+    erlcmd_send(resp, resp_index);
+
+    free(resp);
+}
+
+/*
+ *  Drops every cached data type, e.g. after the server model changed.
+ */
+static void handle_clear_data_types(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    data_type_cache_clear();
+    send_ok_response();
+}
+
+/**********/
+/* Browse */
+/**********/
+
+/*
+ *  Browse and BrowseNext for many starting nodes per request. References are streamed back as
+ *  {:partial, [{index, reference}]} frames (index of the starting node in the request) as every
+ *  Browse/BrowseNext response arrives, and the call ends with a {:ok, [{:ok, continuation_point | nil}
+ *  | {:error, status}]} frame. When following, the remaining continuation points of all nodes are
+ *  requested together in a single BrowseNext per round trip.
+ *  A reference is a tuple with the target node_id followed by the fields selected by the result mask
+ *  (reference_type_id, is_forward, node_class, browse_name, display_name, type_definition).
+ */
+#define MAX_BROWSE_NODES 1000
+
+// Local targets are encoded as NodeIds, so they can be browsed again.
+static void encode_browse_target(char *resp, int *resp_index, const UA_ExpandedNodeId *target)
+{
+    if(target->serverIndex == 0 && target->namespaceUri.length == 0)
+        encode_node_id(resp, resp_index, (void *)&target->nodeId);
+    else
+        encode_expanded_node_id(resp, resp_index, (void *)target);
+}
+
+// {index, {node_id, ...}}
+static void encode_browse_reference(char *resp, int *resp_index, size_t index, const UA_ReferenceDescription *reference,
+                                    UA_UInt32 result_mask)
+{
+    int fields = 1;
+    for(UA_UInt32 mask = result_mask & UA_BROWSERESULTMASK_ALL; mask != 0; mask >>= 1)
+        fields += mask & 1;
+
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_ulong(resp, resp_index, (unsigned long)index);
+    ei_encode_tuple_header(resp, resp_index, fields);
+    encode_browse_target(resp, resp_index, &reference->nodeId);
+
+    if(result_mask & UA_BROWSERESULTMASK_REFERENCETYPEID)
+        encode_node_id(resp, resp_index, (void *)&reference->referenceTypeId);
+    if(result_mask & UA_BROWSERESULTMASK_ISFORWARD)
+        ei_encode_boolean(resp, resp_index, reference->isForward);
+    if(result_mask & UA_BROWSERESULTMASK_NODECLASS)
+        ei_encode_ulong(resp, resp_index, (unsigned long)reference->nodeClass);
+    if(result_mask & UA_BROWSERESULTMASK_BROWSENAME)
+        encode_qualified_name(resp, resp_index, (void *)&reference->browseName);
+    if(result_mask & UA_BROWSERESULTMASK_DISPLAYNAME)
+        encode_localized_text(resp, resp_index, (void *)&reference->displayName);
+    if(result_mask & UA_BROWSERESULTMASK_TYPEDEFINITION)
+        encode_browse_target(resp, resp_index, &reference->typeDefinition);
+}
+
+static void encode_browse_partial_header(char *resp, int *resp_index, int entries)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "partial");
+    ei_encode_list_header(resp, resp_index, entries);
+}
+
+/*
+ *  Streams the references of a Browse/BrowseNext response in as few frames as the {:packet, 2} limit
+ *  allows. indices maps every result to its starting node (NULL: same position).
+ *  Returns false when the call was ended with an error response instead (out of memory, or a single
+ *  reference larger than a frame), no status response must follow then.
+ */
+static bool send_browse_references(const UA_BrowseResult *results, size_t results_size, const size_t *indices,
+                                   UA_UInt32 result_mask)
+{
+    const int frame_limit = erlcmd_frame_limit();
+    int header_size = sizeof(uint16_t);
+    encode_browse_partial_header(NULL, &header_size, 1);
+
+    size_t result = 0;
+    size_t reference = 0;
+    for(;;) {
+        while(result < results_size && reference >= results[result].referencesSize) {
+            result++;
+            reference = 0;
+        }
+
+        if(result >= results_size)
+            return true;
+
+        // Size pass
+        int frame_size = header_size + 1;   // + list tail
+        int entries = 0;
+        size_t end_result = result;
+        size_t end_reference = reference;
+        while(end_result < results_size) {
+            if(end_reference >= results[end_result].referencesSize) {
+                end_result++;
+                end_reference = 0;
+                continue;
+            }
+
+            int entry_size = 0;
+            encode_browse_reference(NULL, &entry_size, indices ? indices[end_result] : end_result,
+                                    &results[end_result].references[end_reference], result_mask);
+            if(frame_size + entry_size > frame_limit) {
+                if(entries > 0)
+                    break;
+
+                send_error_response("overflow");
+                return false;
+            }
+
+            frame_size += entry_size;
+            entries++;
+            end_reference++;
+        }
+
+        char *resp = (char *)malloc(frame_size);
+        if(resp == NULL) {
+            send_error_response("enomem");
+            return false;
+        }
+
+        int resp_index = sizeof(uint16_t);
+        encode_browse_partial_header(resp, &resp_index, entries);
+        for(int i = 0; i < entries; i++) {
+            while(reference >= results[result].referencesSize) {
+                result++;
+                reference = 0;
+            }
+
+            encode_browse_reference(resp, &resp_index, indices ? indices[result] : result,
+                                    &results[result].references[reference], result_mask);
+            reference++;
+        }
+        ei_encode_empty_list(resp, &resp_index);
+        erlcmd_send(resp, resp_index);
+
+        free(resp);
+    }
+}
+
+// {:ok, [{:ok, continuation_point | nil} | {:error, status}]}
+static void encode_browse_status_response(char *resp, int *resp_index, const UA_BrowseResult *results, size_t results_size)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
+
+    if(results_size > 0)
+        ei_encode_list_header(resp, resp_index, (int)results_size);
+
+    for(size_t i = 0; i < results_size; i++) {
+        ei_encode_tuple_header(resp, resp_index, 2);
+
+        if(results[i].statusCode != UA_STATUSCODE_GOOD) {
+            const char *status = UA_StatusCode_name(results[i].statusCode);
+            ei_encode_atom(resp, resp_index, "error");
+            ei_encode_binary(resp, resp_index, status, strlen(status));
+            continue;
+        }
+
+        ei_encode_atom(resp, resp_index, "ok");
+        if(results[i].continuationPoint.length > 0)
+            ei_encode_binary(resp, resp_index, results[i].continuationPoint.data, results[i].continuationPoint.length);
+        else
+            ei_encode_atom(resp, resp_index, "nil");
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
+
+// Returns false when an error was sent instead (the continuation points did not reach the caller).
+static bool send_browse_status_response(const UA_BrowseResult *results, size_t results_size)
+{
+    int resp_size = sizeof(uint16_t);
+    encode_browse_status_response(NULL, &resp_size, results, results_size);
+
+    if(resp_size > erlcmd_frame_limit()) {
+        send_error_response("overflow");
+        return false;
+    }
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
+        return false;
+    }
+
+    int resp_index = sizeof(uint16_t);
+    encode_browse_status_response(resp, &resp_index, results, results_size);
+    erlcmd_send(resp, resp_index);
+
+    free(resp);
+    return true;
+}
+
+// Moves the references of source to the end of target.
+static UA_StatusCode browse_result_append_references(UA_BrowseResult *target, UA_BrowseResult *source)
+{
+    if(source->referencesSize == 0)
+        return UA_STATUSCODE_GOOD;
+
+    size_t size = target->referencesSize + source->referencesSize;
+    UA_ReferenceDescription *references =
+        (UA_ReferenceDescription *)UA_Array_new(size, &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
+    if(references == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    if(target->referencesSize > 0) {
+        memcpy(references, target->references, target->referencesSize * sizeof(UA_ReferenceDescription));
+        UA_free(target->references);
+    }
+    memcpy(references + target->referencesSize, source->references, source->referencesSize * sizeof(UA_ReferenceDescription));
+    UA_free(source->references);
+
+    target->references = references;
+    target->referencesSize = size;
+    source->references = NULL;
+    source->referencesSize = 0;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+// Frees continuation points on the server, best effort (they also go away with the session).
+static void browse_release_continuation_points(UA_ByteString *continuation_points, size_t size)
+{
+    UA_BrowseNextRequest request;
+    UA_BrowseNextRequest_init(&request);
+    request.releaseContinuationPoints = true;
+    request.continuationPoints = continuation_points;
+    request.continuationPointsSize = size;
+
+    UA_BrowseNextResponse response = UA_Client_Service_browseNext(client, request);
+    UA_BrowseNextResponse_clear(&response);
+}
+
+// Releases (and drops) the continuation points still held by results, their nodes are not continued.
+static void browse_release_results(UA_BrowseResult *results, size_t results_size)
+{
+    size_t held = 0;
+    for(size_t i = 0; i < results_size; i++)
+        if(results[i].continuationPoint.length > 0)
+            held++;
+
+    if(held == 0)
+        return;
+
+    UA_ByteString *continuation_points = (UA_ByteString *)UA_Array_new(held, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    for(size_t i = 0, k = 0; i < results_size; i++) {
+        if(results[i].continuationPoint.length == 0)
+            continue;
+
+        // Out of memory: one at a time
+        if(continuation_points == NULL) {
+            browse_release_continuation_points(&results[i].continuationPoint, 1);
+            UA_ByteString_clear(&results[i].continuationPoint);
+            continue;
+        }
+
+        continuation_points[k++] = results[i].continuationPoint;
+        UA_ByteString_init(&results[i].continuationPoint);
+    }
+
+    if(continuation_points != NULL) {
+        browse_release_continuation_points(continuation_points, held);
+        UA_Array_delete(continuation_points, held, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    }
+}
+
+/*
+ *  Follows the continuation points of results until every node is complete, with one BrowseNext
+ *  (for all the pending nodes) per round trip. Results keep the final status of every node, and the
+ *  new references are either streamed or appended to the results. The continuation points of the
+ *  nodes that are not continued (failures) are released on the server.
+ *  Returns false when streaming ended the call with an error response.
+ */
+static bool browse_follow_continuation_points(UA_BrowseResult *results, size_t results_size, UA_UInt32 result_mask,
+                                              bool stream)
+{
+    for(;;) {
+        size_t pending = 0;
+        for(size_t i = 0; i < results_size; i++)
+            if(results[i].statusCode == UA_STATUSCODE_GOOD && results[i].continuationPoint.length > 0)
+                pending++;
+
+        if(pending == 0) {
+            // Failed nodes may still hold one (e.g. out of memory while appending)
+            browse_release_results(results, results_size);
+            return true;
+        }
+
+        UA_ByteString *continuation_points = (UA_ByteString *)UA_Array_new(pending, &UA_TYPES[UA_TYPES_BYTESTRING]);
+        size_t *indices = (size_t *)malloc(pending * sizeof(size_t));
+        if(continuation_points == NULL || indices == NULL) {
+            UA_Array_delete(continuation_points, pending, &UA_TYPES[UA_TYPES_BYTESTRING]);
+            free(indices);
+            for(size_t i = 0; i < results_size; i++)
+                if(results[i].continuationPoint.length > 0)
+                    results[i].statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
+            browse_release_results(results, results_size);
+            return true;
+        }
+
+        // Move the continuation points into the request
+        for(size_t i = 0, k = 0; i < results_size; i++) {
+            if(results[i].statusCode != UA_STATUSCODE_GOOD || results[i].continuationPoint.length == 0)
+                continue;
+
+            continuation_points[k] = results[i].continuationPoint;
+            UA_ByteString_init(&results[i].continuationPoint);
+            indices[k++] = i;
+        }
+
+        UA_BrowseNextRequest request;
+        UA_BrowseNextRequest_init(&request);
+        request.releaseContinuationPoints = false;
+        request.continuationPoints = continuation_points;
+        request.continuationPointsSize = pending;
+
+        UA_BrowseNextResponse response = UA_Client_Service_browseNext(client, request);
+
+        bool failed = response.responseHeader.serviceResult != UA_STATUSCODE_GOOD || response.resultsSize != pending;
+        bool sent = true;
+        if(!failed && stream)
+            sent = send_browse_references(response.results, pending, indices, result_mask);
+
+        // The points of the request were not consumed, or were replaced by the ones of the unmatched results
+        if(failed && response.resultsSize > 0)
+            browse_release_results(response.results, response.resultsSize);
+        else if(failed)
+            browse_release_continuation_points(continuation_points, pending);
+
+        for(size_t k = 0; k < pending; k++) {
+            UA_BrowseResult *result = &results[indices[k]];
+
+            if(failed) {
+                result->statusCode = response.responseHeader.serviceResult != UA_STATUSCODE_GOOD ?
+                    response.responseHeader.serviceResult : UA_STATUSCODE_BADUNEXPECTEDERROR;
+                continue;
+            }
+
+            result->statusCode = response.results[k].statusCode;
+            if(!stream && browse_result_append_references(result, &response.results[k]) != UA_STATUSCODE_GOOD)
+                result->statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
+            result->continuationPoint = response.results[k].continuationPoint;
+            UA_ByteString_init(&response.results[k].continuationPoint);
+        }
+
+        UA_BrowseNextResponse_clear(&response);
+        UA_BrowseNextRequest_clear(&request);
+        free(indices);
+
+        if(failed || !sent) {
+            browse_release_results(results, results_size);
+            return sent;
+        }
+    }
+}
+
+static void send_browse_results(UA_BrowseResult *results, size_t results_size, UA_StatusCode service_result,
+                                size_t expected_size, UA_UInt32 result_mask, bool follow)
+{
+    if(service_result != UA_STATUSCODE_GOOD) {
+        send_opex_response(service_result);
+        return;
+    }
+
+    if(results_size != expected_size) {
+        browse_release_results(results, results_size);
+        send_opex_response(UA_STATUSCODE_BADUNEXPECTEDERROR);
+        return;
+    }
+
+    if(!send_browse_references(results, results_size, NULL, result_mask)) {
+        // The caller never gets the continuation points
+        browse_release_results(results, results_size);
+        return;
+    }
+
+    if(follow) {
+        // References already sent are not needed anymore
+        for(size_t i = 0; i < results_size; i++) {
+            UA_Array_delete(results[i].references, results[i].referencesSize, &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
+            results[i].references = NULL;
+            results[i].referencesSize = 0;
+        }
+
+        if(!browse_follow_continuation_points(results, results_size, result_mask, true))
+            return;
+    }
+
+    if(!send_browse_status_response(results, results_size))
+        browse_release_results(results, results_size);
+}
+
+/*
+ *  Browses the references of many nodes in a single request.
+ *  Input: {[node_id] (1 to 1000 nodes), direction (0 forward, 1 inverse, 2 both), reference_type_id,
+ *          include_subtypes, node_class_mask, result_mask, max_references (0 = server limit), follow}
+ *  Output: {:partial, [{index, reference}]} frames, then {:ok, [{:ok, continuation_point | nil} | {:error, status}]}
+ *          or {:error, reason}
+ */
+static void handle_browse(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_count;
+    unsigned long direction;
+    unsigned long node_class_mask;
+    unsigned long result_mask;
+    unsigned long max_references;
+    int include_subtypes;
+    int follow;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 8)
+        errx(EXIT_FAILURE, ":handle_browse requires a 8-tuple, term_size = %d", term_size);
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_browse requires a list of nodes");
+
+    int node_count = list_count;
+    if(node_count == 0 || node_count > MAX_BROWSE_NODES) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_BrowseDescription *nodesToBrowse = (UA_BrowseDescription *)UA_Array_new(node_count, &UA_TYPES[UA_TYPES_BROWSEDESCRIPTION]);
+    if(nodesToBrowse == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    for(int i = 0; i < node_count; i++)
+        nodesToBrowse[i].nodeId = assemble_node_id(req, req_index);
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    if(ei_decode_ulong(req, req_index, &direction) < 0 || direction > UA_BROWSEDIRECTION_BOTH) {
+        UA_Array_delete(nodesToBrowse, node_count, &UA_TYPES[UA_TYPES_BROWSEDESCRIPTION]);
+        send_error_response("einval");
+        return;
+    }
+
+    UA_NodeId reference_type_id = assemble_node_id(req, req_index);
+
+    if(ei_decode_boolean(req, req_index, &include_subtypes) < 0 ||
+       ei_decode_ulong(req, req_index, &node_class_mask) < 0 ||
+       ei_decode_ulong(req, req_index, &result_mask) < 0 ||
+       ei_decode_ulong(req, req_index, &max_references) < 0 ||
+       ei_decode_boolean(req, req_index, &follow) < 0) {
+        UA_NodeId_clear(&reference_type_id);
+        UA_Array_delete(nodesToBrowse, node_count, &UA_TYPES[UA_TYPES_BROWSEDESCRIPTION]);
+        send_error_response("einval");
+        return;
+    }
+
+    for(int i = 0; i < node_count; i++) {
+        nodesToBrowse[i].browseDirection = (UA_BrowseDirection)direction;
+        UA_NodeId_copy(&reference_type_id, &nodesToBrowse[i].referenceTypeId);
+        nodesToBrowse[i].includeSubtypes = include_subtypes;
+        nodesToBrowse[i].nodeClassMask = (UA_UInt32)node_class_mask;
+        nodesToBrowse[i].resultMask = (UA_UInt32)result_mask;
+    }
+    UA_NodeId_clear(&reference_type_id);
+
+    UA_BrowseRequest request;
+    UA_BrowseRequest_init(&request);
+    request.requestedMaxReferencesPerNode = (UA_UInt32)max_references;
+    request.nodesToBrowse = nodesToBrowse;
+    request.nodesToBrowseSize = node_count;
+
+    UA_BrowseResponse response = UA_Client_Service_browse(client, request);
+
+    send_browse_results(response.results, response.resultsSize, response.responseHeader.serviceResult,
+                        node_count, (UA_UInt32)result_mask, follow);
+
+    UA_BrowseResponse_clear(&response);
+    UA_BrowseRequest_clear(&request);
+}
+
+/*
+ *  Continues (or releases) browse results from their continuation points.
+ *  Input: {[continuation_point] (1 to 1000), release, result_mask, follow}
+ *  Output: same as handle_browse (an empty list when released)
+ */
+static void handle_browse_next(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    int list_count;
+    int release;
+    int follow;
+    unsigned long result_mask;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_browse_next requires a 4-tuple, term_size = %d", term_size);
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_browse_next requires a list of continuation points");
+
+    int cp_count = list_count;
+    if(cp_count == 0 || cp_count > MAX_BROWSE_NODES) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_ByteString *continuation_points = (UA_ByteString *)UA_Array_new(cp_count, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    if(continuation_points == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    for(int i = 0; i < cp_count; i++) {
+        if(ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            errx(EXIT_FAILURE, "Invalid continuation point");
+
+        long binary_len;
+        if(UA_ByteString_allocBuffer(&continuation_points[i], term_size) != UA_STATUSCODE_GOOD ||
+           ei_decode_binary(req, req_index, continuation_points[i].data, &binary_len) < 0)
+            errx(EXIT_FAILURE, "Invalid continuation point");
+    }
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    if(ei_decode_boolean(req, req_index, &release) < 0 ||
+       ei_decode_ulong(req, req_index, &result_mask) < 0 ||
+       ei_decode_boolean(req, req_index, &follow) < 0) {
+        UA_Array_delete(continuation_points, cp_count, &UA_TYPES[UA_TYPES_BYTESTRING]);
+        send_error_response("einval");
+        return;
+    }
+
+    UA_BrowseNextRequest request;
+    UA_BrowseNextRequest_init(&request);
+    request.releaseContinuationPoints = release;
+    request.continuationPoints = continuation_points;
+    request.continuationPointsSize = cp_count;
+
+    UA_BrowseNextResponse response = UA_Client_Service_browseNext(client, request);
+
+    if(release && response.responseHeader.serviceResult == UA_STATUSCODE_GOOD)
+        send_browse_status_response(NULL, 0);
+    else
+        send_browse_results(response.results, response.resultsSize, response.responseHeader.serviceResult,
+                            cp_count, (UA_UInt32)result_mask, follow);
+
+    UA_BrowseNextResponse_clear(&response);
+    UA_BrowseNextRequest_clear(&request);
+}
+
+/**************************/
+/* Browse Path Resolution */
+/**************************/
+
+/*
+ *  Browse paths (start node + browse names, following HierarchicalReferences) are resolved with
+ *  TranslateBrowsePathsToNodeIds, in chunks of the server MaxNodesPerTranslateBrowsePathsToNodeIds,
+ *  and the resolved targets are cached by the binary encoding of their path. The cache is dropped on
+ *  connect, disconnect and reset, and when the NamespaceArray changed: it is read along with any
+ *  cache miss, and before answering from the cache when the last read is PATH_CACHE_CHECK_INTERVAL old.
+ */
+#define MAX_TRANSLATE_PATHS 1000
+#define TRANSLATE_DEFAULT_CHUNK 1000
+#define PATH_CACHE_CHECK_INTERVAL 1000      // ms
+
+typedef struct Path_cache_entry {
+    UA_ByteString key;                  // binary encoded UA_BrowsePath
+    UA_UInt32 hash;
+    UA_NodeId target;
+    struct Path_cache_entry *next;
+} Path_cache_entry;
+
+static Path_cache_entry **path_cache = NULL;
+static size_t path_cache_buckets = 0;
+static size_t path_cache_size = 0;
+static UA_String *path_cache_namespaces = NULL;
+static size_t path_cache_namespaces_size = 0;
+static UA_UInt32 translate_chunk_size = 0;      // 0: server limits not read in this session
+static uint64_t path_cache_checked = 0;         // current_time() of the last NamespaceArray read
+
+static void path_cache_clear_entries()
+{
+    for(size_t i = 0; i < path_cache_buckets; i++) {
+        Path_cache_entry *entry = path_cache[i];
+        while(entry != NULL) {
+            Path_cache_entry *next = entry->next;
+            UA_ByteString_clear(&entry->key);
+            UA_NodeId_clear(&entry->target);
+            free(entry);
+            entry = next;
+        }
+    }
+
+    free(path_cache);
+    path_cache = NULL;
+    path_cache_buckets = 0;
+    path_cache_size = 0;
+}
+
+static void path_cache_clear()
+{
+    path_cache_clear_entries();
+    UA_Array_delete(path_cache_namespaces, path_cache_namespaces_size, &UA_TYPES[UA_TYPES_STRING]);
+    path_cache_namespaces = NULL;
+    path_cache_namespaces_size = 0;
+    translate_chunk_size = 0;
+    path_cache_checked = 0;
+}
+
+// An empty key (the path could not be encoded) is never cached.
+static Path_cache_entry *path_cache_find(const UA_ByteString *key, UA_UInt32 hash)
+{
+    if(path_cache_buckets == 0 || key->length == 0)
+        return NULL;
+
+    Path_cache_entry *entry = path_cache[hash & (path_cache_buckets - 1)];
+    while(entry != NULL && (entry->hash != hash || !UA_ByteString_equal(&entry->key, key)))
+        entry = entry->next;
+
+    return entry;
+}
+
+static void path_cache_resize(size_t buckets)
+{
+    Path_cache_entry **resized = (Path_cache_entry **)calloc(buckets, sizeof(Path_cache_entry *));
+    if(resized == NULL)
+        return;
+
+    for(size_t i = 0; i < path_cache_buckets; i++) {
+        Path_cache_entry *entry = path_cache[i];
+        while(entry != NULL) {
+            Path_cache_entry *next = entry->next;
+            size_t bucket = entry->hash & (buckets - 1);
+            entry->next = resized[bucket];
+            resized[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(path_cache);
+    path_cache = resized;
+    path_cache_buckets = buckets;
+}
+
+static void path_cache_put(const UA_ByteString *key, UA_UInt32 hash, const UA_NodeId *target)
+{
+    if(key->length == 0)
+        return;
+
+    Path_cache_entry *entry = path_cache_find(key, hash);
+    if(entry != NULL) {
+        UA_NodeId_clear(&entry->target);
+        UA_NodeId_copy(target, &entry->target);
+        return;
+    }
+
+    if(path_cache_size >= path_cache_buckets)
+        path_cache_resize(path_cache_buckets ? 2 * path_cache_buckets : 256);
+
+    if(path_cache_buckets == 0)
+        return;
+
+    entry = (Path_cache_entry *)calloc(1, sizeof(Path_cache_entry));
+    if(entry == NULL)
+        return;
+
+    if(UA_ByteString_copy(key, &entry->key) != UA_STATUSCODE_GOOD ||
+       UA_NodeId_copy(target, &entry->target) != UA_STATUSCODE_GOOD) {
+        UA_ByteString_clear(&entry->key);
+        free(entry);
+        return;
+    }
+
+    entry->hash = hash;
+    size_t bucket = hash & (path_cache_buckets - 1);
+    entry->next = path_cache[bucket];
+    path_cache[bucket] = entry;
+    path_cache_size++;
+}
+
+static void path_cache_remove(const UA_ByteString *key, UA_UInt32 hash)
+{
+    if(path_cache_buckets == 0)
+        return;
+
+    Path_cache_entry **link = &path_cache[hash & (path_cache_buckets - 1)];
+    while(*link != NULL && ((*link)->hash != hash || !UA_ByteString_equal(&(*link)->key, key)))
+        link = &(*link)->next;
+
+    Path_cache_entry *entry = *link;
+    if(entry == NULL)
+        return;
+
+    *link = entry->next;
+    UA_ByteString_clear(&entry->key);
+    UA_NodeId_clear(&entry->target);
+    free(entry);
+    path_cache_size--;
+}
+
+/*
+ *  Reads the NamespaceArray (dropping the cache if it changed) and, once per session, the server
+ *  MaxNodesPerTranslateBrowsePathsToNodeIds.
+ */
+static UA_StatusCode path_cache_check_server(bool *changed)
+{
+    UA_ReadValueId items[2];
+    UA_ReadValueId_init(&items[0]);
+    UA_ReadValueId_init(&items[1]);
+    items[0].nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_NAMESPACEARRAY);
+    items[0].attributeId = UA_ATTRIBUTEID_VALUE;
+    items[1].nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERCAPABILITIES_OPERATIONLIMITS_MAXNODESPERTRANSLATEBROWSEPATHSTONODEIDS);
+    items[1].attributeId = UA_ATTRIBUTEID_VALUE;
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = items;
+    request.nodesToReadSize = translate_chunk_size == 0 ? 2 : 1;
+
+    UA_ReadResponse response = UA_Client_Service_read(client, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != request.nodesToReadSize)
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    if(retval == UA_STATUSCODE_GOOD && response.results[0].status != UA_STATUSCODE_GOOD)
+        retval = response.results[0].status;
+
+    UA_Variant *namespaces = retval == UA_STATUSCODE_GOOD ? &response.results[0].value : NULL;
+    if(namespaces != NULL && !UA_Variant_hasArrayType(namespaces, &UA_TYPES[UA_TYPES_STRING]))
+        retval = UA_STATUSCODE_BADTYPEMISMATCH;
+
+    *changed = false;
+    if(retval == UA_STATUSCODE_GOOD) {
+        path_cache_checked = current_time();
+        bool equal = namespaces->arrayLength == path_cache_namespaces_size;
+        for(size_t i = 0; equal && i < path_cache_namespaces_size; i++)
+            equal = UA_String_equal(&((UA_String *)namespaces->data)[i], &path_cache_namespaces[i]);
+
+        if(!equal) {
+            *changed = path_cache_size > 0;
+            path_cache_clear_entries();
+            UA_Array_delete(path_cache_namespaces, path_cache_namespaces_size, &UA_TYPES[UA_TYPES_STRING]);
+            path_cache_namespaces = (UA_String *)namespaces->data;
+            path_cache_namespaces_size = namespaces->arrayLength;
+            namespaces->data = NULL;
+            namespaces->arrayLength = 0;
+        }
+
+        if(response.resultsSize == 2) {
+            UA_DataValue *limit = &response.results[1];
+            translate_chunk_size = TRANSLATE_DEFAULT_CHUNK;
+            if(limit->status == UA_STATUSCODE_GOOD && UA_Variant_hasScalarType(&limit->value, &UA_TYPES[UA_TYPES_UINT32]) &&
+               *(UA_UInt32 *)limit->value.data > 0 && *(UA_UInt32 *)limit->value.data < TRANSLATE_DEFAULT_CHUNK)
+                translate_chunk_size = *(UA_UInt32 *)limit->value.data;
+        }
+    }
+
+    UA_ReadResponse_clear(&response);
+    return retval;
+}
+
+// {:ok, [{:ok, node_id} | {:error, status}]}
+static void encode_translate_response(char *resp, int *resp_index, const UA_NodeId *targets, const UA_StatusCode *statuses,
+                                      size_t paths_size)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
+
+    ei_encode_list_header(resp, resp_index, (int)paths_size);
+    for(size_t i = 0; i < paths_size; i++) {
+        ei_encode_tuple_header(resp, resp_index, 2);
+
+        if(statuses[i] != UA_STATUSCODE_GOOD) {
+            const char *status = UA_StatusCode_name(statuses[i]);
+            ei_encode_atom(resp, resp_index, "error");
+            ei_encode_binary(resp, resp_index, status, strlen(status));
+            continue;
+        }
+
+        ei_encode_atom(resp, resp_index, "ok");
+        encode_node_id(resp, resp_index, (void *)&targets[i]);
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
+
+static void send_translate_response(const UA_NodeId *targets, const UA_StatusCode *statuses, size_t paths_size)
+{
+    int resp_size = sizeof(uint16_t);
+    encode_translate_response(NULL, &resp_size, targets, statuses, paths_size);
+
+    if(resp_size > erlcmd_frame_limit()) {
+        send_error_response("overflow");
+        return;
+    }
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    int resp_index = sizeof(uint16_t);
+    encode_translate_response(resp, &resp_index, targets, statuses, paths_size);
+    erlcmd_send(resp, resp_index);
+
+    free(resp);
+}
+
+// Resolves the given paths with as few TranslateBrowsePathsToNodeIds requests as the server allows.
+static UA_StatusCode translate_browse_paths(const UA_BrowsePath *paths, const UA_ByteString *keys, const UA_UInt32 *hashes,
+                                            const size_t *misses, size_t misses_size, UA_NodeId *targets,
+                                            UA_StatusCode *statuses)
+{
+    UA_BrowsePath *chunk = (UA_BrowsePath *)malloc(translate_chunk_size * sizeof(UA_BrowsePath));
+    if(chunk == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t first = 0; retval == UA_STATUSCODE_GOOD && first < misses_size; first += translate_chunk_size) {
+        size_t chunk_size = misses_size - first < translate_chunk_size ? misses_size - first : translate_chunk_size;
+
+        // Shallow copies, the paths are owned by the caller.
+        for(size_t i = 0; i < chunk_size; i++)
+            chunk[i] = paths[misses[first + i]];
+
+        UA_TranslateBrowsePathsToNodeIdsRequest request;
+        UA_TranslateBrowsePathsToNodeIdsRequest_init(&request);
+        request.browsePaths = chunk;
+        request.browsePathsSize = chunk_size;
+
+        UA_TranslateBrowsePathsToNodeIdsResponse response = UA_Client_Service_translateBrowsePathsToNodeIds(client, request);
+        retval = response.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD && response.resultsSize != chunk_size)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+        for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < chunk_size; i++) {
+            size_t index = misses[first + i];
+            UA_BrowsePathResult *result = &response.results[i];
+
+            statuses[index] = result->statusCode;
+            if(result->statusCode != UA_STATUSCODE_GOOD)
+                continue;
+
+            // The first complete, local target
+            statuses[index] = UA_STATUSCODE_BADNOMATCH;
+            for(size_t j = 0; j < result->targetsSize; j++) {
+                UA_BrowsePathTarget *target = &result->targets[j];
+                if(target->remainingPathIndex != UA_UINT32_MAX || target->targetId.serverIndex != 0 ||
+                   target->targetId.namespaceUri.length > 0)
+                    continue;
+
+                statuses[index] = UA_NodeId_copy(&target->targetId.nodeId, &targets[index]);
+                if(statuses[index] == UA_STATUSCODE_GOOD)
+                    path_cache_put(&keys[index], hashes[index], &targets[index]);
+                break;
+            }
+        }
+
+        // Paths that do not resolve anymore
+        for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < chunk_size; i++)
+            if(statuses[misses[first + i]] != UA_STATUSCODE_GOOD)
+                path_cache_remove(&keys[misses[first + i]], hashes[misses[first + i]]);
+
+        UA_TranslateBrowsePathsToNodeIdsResponse_clear(&response);
+    }
+
+    free(chunk);
+    return retval;
+}
+
+// Answers from the cache and resolves the misses (all paths when the NamespaceArray changed).
+static void resolve_browse_paths(const UA_BrowsePath *paths, const UA_ByteString *keys, const UA_UInt32 *hashes,
+                                 size_t paths_size, bool use_cache)
+{
+    UA_NodeId *targets = (UA_NodeId *)UA_Array_new(paths_size, &UA_TYPES[UA_TYPES_NODEID]);
+    UA_StatusCode *statuses = (UA_StatusCode *)calloc(paths_size, sizeof(UA_StatusCode));
+    size_t *misses = (size_t *)calloc(paths_size, sizeof(size_t));
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    if(targets == NULL || statuses == NULL || misses == NULL) {
+        UA_Array_delete(targets, paths_size, &UA_TYPES[UA_TYPES_NODEID]);
+        free(statuses);
+        free(misses);
+        send_error_response("enomem");
+        return;
+    }
+
+    size_t misses_size = 0;
+    for(size_t i = 0; i < paths_size; i++) {
+        Path_cache_entry *entry = use_cache ? path_cache_find(&keys[i], hashes[i]) : NULL;
+        if(entry == NULL || UA_NodeId_copy(&entry->target, &targets[i]) != UA_STATUSCODE_GOOD)
+            misses[misses_size++] = i;
+    }
+
+    // Hits are only served while the NamespaceArray was read recently
+    if(misses_size > 0 || current_time() - path_cache_checked >= PATH_CACHE_CHECK_INTERVAL) {
+        bool changed;
+        retval = path_cache_check_server(&changed);
+
+        // Cached targets of an older NamespaceArray are resolved again.
+        if(retval == UA_STATUSCODE_GOOD && changed) {
+            for(size_t i = 0; i < paths_size; i++) {
+                UA_NodeId_clear(&targets[i]);
+                misses[i] = i;
+            }
+            misses_size = paths_size;
+        }
+
+        if(retval == UA_STATUSCODE_GOOD && misses_size > 0)
+            retval = translate_browse_paths(paths, keys, hashes, misses, misses_size, targets, statuses);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD)
+        send_translate_response(targets, statuses, paths_size);
+    else
+        send_opex_response(retval);
+
+    UA_Array_delete(targets, paths_size, &UA_TYPES[UA_TYPES_NODEID]);
+    free(statuses);
+    free(misses);
+}
+
+/*
+ *  Resolves browse paths to NodeIds, from the cache when possible.
+ *  Input: {[{start_node_id, [{ns_index, browse_name}]}] (1 to 1000 paths), use_cache}
+ *  Output: {:ok, [{:ok, node_id} | {:error, reason}]} | {:error, reason}
+ */
+static void handle_translate_browse_paths(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_count;
+    int use_cache;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_translate_browse_paths requires a 2-tuple, term_size = %d", term_size);
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_translate_browse_paths requires a list of paths");
+
+    int paths_count = list_count;
+    if(paths_count == 0 || paths_count > MAX_TRANSLATE_PATHS) {
+        send_error_response("einval");
+        return;
+    }
+
+    size_t paths_size = (size_t)paths_count;
+    UA_BrowsePath *paths = (UA_BrowsePath *)UA_Array_new(paths_size, &UA_TYPES[UA_TYPES_BROWSEPATH]);
+    UA_ByteString *keys = (UA_ByteString *)UA_Array_new(paths_size, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    UA_UInt32 *hashes = (UA_UInt32 *)calloc(paths_size, sizeof(UA_UInt32));
+    if(paths == NULL || keys == NULL || hashes == NULL) {
+        UA_Array_delete(paths, paths_size, &UA_TYPES[UA_TYPES_BROWSEPATH]);
+        UA_Array_delete(keys, paths_size, &UA_TYPES[UA_TYPES_BYTESTRING]);
+        free(hashes);
+        send_error_response("enomem");
+        return;
+    }
+
+    for(size_t i = 0; i < paths_size; i++) {
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 2)
+            errx(EXIT_FAILURE, ":handle_translate_browse_paths requires 2-tuple paths, term_size = %d", term_size);
+
+        paths[i].startingNode = assemble_node_id(req, req_index);
+
+        if(ei_decode_list_header(req, req_index, &list_count) < 0)
+            errx(EXIT_FAILURE, ":handle_translate_browse_paths requires a list of browse names");
+
+        UA_RelativePath *relative_path = &paths[i].relativePath;
+        if(list_count > 0) {
+            relative_path->elements = (UA_RelativePathElement *)UA_Array_new(list_count, &UA_TYPES[UA_TYPES_RELATIVEPATHELEMENT]);
+            if(relative_path->elements == NULL)
+                errx(EXIT_FAILURE, ":handle_translate_browse_paths out of memory");
+            relative_path->elementsSize = list_count;
+
+            for(int j = 0; j < list_count; j++) {
+                relative_path->elements[j].referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+                relative_path->elements[j].includeSubtypes = true;
+                relative_path->elements[j].targetName = assemble_qualified_name(req, req_index);
+            }
+
+            // Decode list tail
+            ei_decode_list_header(req, req_index, &list_count);
+        }
+
+        // The binary encoding of the path is its cache key, the path misses the cache without it.
+        if(UA_encodeBinary(&paths[i], &UA_TYPES[UA_TYPES_BROWSEPATH], &keys[i]) != UA_STATUSCODE_GOOD)
+            UA_ByteString_clear(&keys[i]);
+        hashes[i] = UA_ByteString_hash(0, keys[i].data, keys[i].length);
+    }
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    if(ei_decode_boolean(req, req_index, &use_cache) < 0)
+        send_error_response("einval");
+    else
+        resolve_browse_paths(paths, keys, hashes, paths_size, use_cache);
+
+    UA_Array_delete(paths, paths_size, &UA_TYPES[UA_TYPES_BROWSEPATH]);
+    UA_Array_delete(keys, paths_size, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    free(hashes);
+}
+
+/****************/
+/* Method Calls */
+/****************/
+
+#define MAX_METHOD_CALLS 1000
+
+// {:ok, [{:ok, [output]} | {:error, status}]}
+static void encode_call_methods_response(char *resp, int *resp_index, const UA_CallMethodResult *results, size_t results_size)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
+
+    ei_encode_list_header(resp, resp_index, (int)results_size);
+    for(size_t i = 0; i < results_size; i++) {
+        const UA_CallMethodResult *result = &results[i];
+        ei_encode_tuple_header(resp, resp_index, 2);
+
+        if(result->statusCode != UA_STATUSCODE_GOOD) {
+            const char *status = UA_StatusCode_name(result->statusCode);
+            ei_encode_atom(resp, resp_index, "error");
+            ei_encode_binary(resp, resp_index, status, strlen(status));
+            continue;
+        }
+
+        ei_encode_atom(resp, resp_index, "ok");
+        ei_encode_list_header(resp, resp_index, (int)result->outputArgumentsSize);
+        for(size_t j = 0; j < result->outputArgumentsSize; j++)
+            encode_variant_struct(resp, resp_index, (void *)&result->outputArguments[j]);
+        ei_encode_empty_list(resp, resp_index);
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
+
+static void send_call_methods_response(const UA_CallMethodResult *results, size_t results_size)
+{
+    int resp_size = sizeof(uint16_t);
+    encode_call_methods_response(NULL, &resp_size, results, results_size);
+
+    if(resp_size > erlcmd_frame_limit()) {
+        send_error_response("overflow");
+        return;
+    }
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    int resp_index = sizeof(uint16_t);
+    encode_call_methods_response(resp, &resp_index, results, results_size);
+    erlcmd_send(resp, resp_index);
+
+    free(resp);
+}
+
+// Calls the methods with a single Call request, servers that limit the calls per request
+// (MaxNodesPerMethodCall) answer BadTooManyOperations and get smaller requests instead.
+// Once a request went through, a failed one only fails its calls and the ones after it, the
+// results of the calls that ran are kept.
+static UA_StatusCode call_methods(UA_CallMethodRequest *requests, size_t requests_size, UA_CallMethodResult *results)
+{
+    size_t chunk_size = requests_size;
+    size_t first = 0;
+
+    while(first < requests_size) {
+        if(chunk_size > requests_size - first)
+            chunk_size = requests_size - first;
+
+        UA_CallRequest request;
+        UA_CallRequest_init(&request);
+        request.methodsToCall = &requests[first];
+        request.methodsToCallSize = chunk_size;
+
+        UA_CallResponse response = UA_Client_Service_call(client, request);
+        UA_StatusCode retval = response.responseHeader.serviceResult;
+
+        if(retval == UA_STATUSCODE_BADTOOMANYOPERATIONS && chunk_size > 1) {
+            UA_CallResponse_clear(&response);
+            chunk_size = (chunk_size + 1) / 2;
+            continue;
+        }
+
+        if(retval == UA_STATUSCODE_GOOD && response.resultsSize != chunk_size)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_CallResponse_clear(&response);
+            if(first == 0)
+                return retval;
+
+            for(size_t i = first; i < requests_size; i++)
+                results[i].statusCode = retval;
+            return UA_STATUSCODE_GOOD;
+        }
+
+        // The results are moved, not copied
+        for(size_t i = 0; i < chunk_size; i++) {
+            results[first + i] = response.results[i];
+            UA_CallMethodResult_init(&response.results[i]);
+        }
+        UA_CallResponse_clear(&response);
+
+        first += chunk_size;
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  Calls several methods with one Call request (or as few as the server allows).
+ *  Input: [{object_id, method_id, [{data_type, is_array, value}]}]
+ *  Output: {:ok, [{:ok, [output]} | {:error, status}]} | {:error, reason}
+ */
+static void handle_call_methods(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_count;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_call_methods requires a list of calls");
+
+    int calls_count = list_count;
+    if(calls_count == 0 || calls_count > MAX_METHOD_CALLS) {
+        send_error_response("einval");
+        return;
+    }
+
+    size_t calls_size = (size_t)calls_count;
+    UA_CallMethodRequest *requests = (UA_CallMethodRequest *)UA_Array_new(calls_size, &UA_TYPES[UA_TYPES_CALLMETHODREQUEST]);
+    if(requests == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    for(size_t i = 0; i < calls_size && retval == UA_STATUSCODE_GOOD; i++) {
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 3)
+            errx(EXIT_FAILURE, ":handle_call_methods requires 3-tuple calls, term_size = %d", term_size);
+
+        requests[i].objectId = assemble_node_id(req, req_index);
+        requests[i].methodId = assemble_node_id(req, req_index);
+
+        if(ei_decode_list_header(req, req_index, &list_count) < 0)
+            errx(EXIT_FAILURE, ":handle_call_methods requires a list of input arguments");
+
+        if(list_count == 0)
+            continue;
+
+        requests[i].inputArguments = (UA_Variant *)UA_Array_new(list_count, &UA_TYPES[UA_TYPES_VARIANT]);
+        if(requests[i].inputArguments == NULL) {
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            break;
+        }
+        requests[i].inputArgumentsSize = list_count;
+
+        for(int j = 0; j < list_count && retval == UA_STATUSCODE_GOOD; j++)
+            retval = assemble_variant(req, req_index, &requests[i].inputArguments[j]);
+
+        // Decode list tail
+        ei_decode_list_header(req, req_index, &list_count);
+    }
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_Array_delete(requests, calls_size, &UA_TYPES[UA_TYPES_CALLMETHODREQUEST]);
+        send_error_response(retval == UA_STATUSCODE_BADOUTOFMEMORY ? "enomem" : "einval");
+        return;
+    }
+
+    UA_CallMethodResult *results = (UA_CallMethodResult *)UA_Array_new(calls_size, &UA_TYPES[UA_TYPES_CALLMETHODRESULT]);
+    if(results == NULL) {
+        UA_Array_delete(requests, calls_size, &UA_TYPES[UA_TYPES_CALLMETHODREQUEST]);
+        send_error_response("enomem");
+        return;
+    }
+
+    retval = call_methods(requests, calls_size, results);
+
+    if(retval == UA_STATUSCODE_GOOD && decode_extension_objects != NULL) {
+        size_t outputs_size = 0;
+        for(size_t i = 0; i < calls_size; i++)
+            outputs_size += results[i].outputArgumentsSize;
+
+        UA_Variant **outputs = outputs_size > 0 ? (UA_Variant **)malloc(outputs_size * sizeof(UA_Variant *)) : NULL;
+        if(outputs != NULL) {
+            size_t k = 0;
+            for(size_t i = 0; i < calls_size; i++)
+                for(size_t j = 0; j < results[i].outputArgumentsSize; j++)
+                    outputs[k++] = &results[i].outputArguments[j];
+
+            decode_extension_objects(client, outputs, outputs_size);
+            free(outputs);
+        }
+    }
+
+    if(retval != UA_STATUSCODE_GOOD)
+        send_opex_response(retval);
+    else
+        send_call_methods_response(results, calls_size);
+
+    UA_Array_delete(results, calls_size, &UA_TYPES[UA_TYPES_CALLMETHODRESULT]);
+    UA_Array_delete(requests, calls_size, &UA_TYPES[UA_TYPES_CALLMETHODREQUEST]);
+}
+
+/****************/
+/* History Read */
+/****************/
+
+/*
+ *  HistoryRead (raw or modified values) of many nodes per request. Continuation points are followed
+ *  in the port, with one HistoryRead for all the pending nodes per round trip, and the values are
+ *  streamed as they arrive. Values of a single numeric type are sent packed: source timestamps
+ *  (int64), values and statuses (uint32) as parallel native binaries.
+ */
+#define MAX_HISTORY_NODES 1000
+#define HISTORY_ENTRY_OVERHEAD 48           // encoded entry without its binaries/values (upper bound)
+
+#ifdef UA_ENABLE_HISTORIZING
+
+// HistoryModifiedData starts with the same dataValues as HistoryData (modification infos are dropped).
+static UA_HistoryData *history_data(UA_HistoryReadResult *result)
+{
+    UA_ExtensionObject *data = &result->historyData;
+    if(data->encoding < UA_EXTENSIONOBJECT_DECODED)
+        return NULL;
+
+    if(data->content.decoded.type == &UA_TYPES[UA_TYPES_HISTORYDATA] ||
+       data->content.decoded.type == &UA_TYPES[UA_TYPES_HISTORYMODIFIEDDATA])
+        return (UA_HistoryData *)data->content.decoded.data;
+
+    return NULL;
+}
+
+// The type of the values if they can be sent as a packed binary, NULL otherwise.
+static const UA_DataType *history_packed_type(const UA_HistoryData *data)
+{
+    const UA_DataType *type = NULL;
+
+    for(size_t i = 0; i < data->dataValuesSize; i++) {
+        const UA_Variant *value = &data->dataValues[i].value;
+        if(UA_Variant_isEmpty(value))
+            continue;
+
+        if(!UA_Variant_isScalar(value) || (type != NULL && value->type != type))
+            return NULL;
+        type = value->type;
+    }
+
+    if(type == NULL)
+        return NULL;
+
+    switch(type->typeKind) {
+        case UA_DATATYPEKIND_BOOLEAN:
+        case UA_DATATYPEKIND_SBYTE:
+        case UA_DATATYPEKIND_BYTE:
+        case UA_DATATYPEKIND_INT16:
+        case UA_DATATYPEKIND_UINT16:
+        case UA_DATATYPEKIND_INT32:
+        case UA_DATATYPEKIND_UINT32:
+        case UA_DATATYPEKIND_INT64:
+        case UA_DATATYPEKIND_UINT64:
+        case UA_DATATYPEKIND_FLOAT:
+        case UA_DATATYPEKIND_DOUBLE:
+        case UA_DATATYPEKIND_DATETIME:
+            // Builtin types share their UA_TYPES index with their kind
+            return type == &UA_TYPES[type->typeKind] ? type : NULL;
+
+        default:
+            return NULL;
+    }
+}
+
+static bool history_has_statuses(const UA_HistoryData *data)
+{
+    for(size_t i = 0; i < data->dataValuesSize; i++)
+        if(data->dataValues[i].hasStatus && data->dataValues[i].status != UA_STATUSCODE_GOOD)
+            return true;
+
+    return false;
+}
+
+static UA_DateTime history_timestamp(const UA_DataValue *value)
+{
+    if(value->hasSourceTimestamp)
+        return value->sourceTimestamp;
+
+    return value->hasServerTimestamp ? value->serverTimestamp : 0;
+}
+
+/*
+ *  {index, data_type | nil, timestamps, values, statuses | nil}
+ *  scratch holds the packed binaries, it is not used when only computing the size (resp == NULL).
+ */
+static void encode_history_entry(char *resp, int *resp_index, size_t index, const UA_DataValue *values, size_t count,
+                                 const UA_DataType *packed, bool statuses, char *scratch)
+{
+    ei_encode_tuple_header(resp, resp_index, 5);
+    ei_encode_ulong(resp, resp_index, index);
+
+    if(packed != NULL)
+        ei_encode_ulong(resp, resp_index, packed->typeKind);
+    else
+        ei_encode_atom(resp, resp_index, "nil");
+
+    if(resp != NULL)
+        for(size_t i = 0; i < count; i++) {
+            UA_DateTime timestamp = history_timestamp(&values[i]);
+            memcpy(scratch + i * sizeof(UA_DateTime), &timestamp, sizeof(UA_DateTime));
+        }
+    ei_encode_binary(resp, resp_index, scratch, count * sizeof(UA_DateTime));
+
+    if(packed != NULL) {
+        if(resp != NULL)
+            for(size_t i = 0; i < count; i++) {
+                // Missing values (e.g. bounds not found) are zeros, their status tells why
+                if(UA_Variant_isEmpty(&values[i].value))
+                    memset(scratch + i * packed->memSize, 0, packed->memSize);
+                else
+                    memcpy(scratch + i * packed->memSize, values[i].value.data, packed->memSize);
+            }
+        ei_encode_binary(resp, resp_index, scratch, count * packed->memSize);
+    } else {
+        ei_encode_list_header(resp, resp_index, (int)count);
+        for(size_t i = 0; i < count; i++)
+            encode_variant_struct(resp, resp_index, (void *)&values[i].value);
+        ei_encode_empty_list(resp, resp_index);
+    }
+
+    if(!statuses) {
+        ei_encode_atom(resp, resp_index, "nil");
+        return;
+    }
+
+    if(resp != NULL)
+        for(size_t i = 0; i < count; i++) {
+            UA_StatusCode status = values[i].hasStatus ? values[i].status : UA_STATUSCODE_GOOD;
+            memcpy(scratch + i * sizeof(UA_StatusCode), &status, sizeof(UA_StatusCode));
+        }
+    ei_encode_binary(resp, resp_index, scratch, count * sizeof(UA_StatusCode));
+}
+
+// Number of values, from first, that fit in budget bytes as one entry.
+static size_t history_entry_fit(const UA_HistoryData *data, size_t first, const UA_DataType *packed, bool statuses,
+                                int budget)
+{
+    size_t available = data->dataValuesSize - first;
+    int value_size = sizeof(UA_DateTime) + (statuses ? sizeof(UA_StatusCode) : 0);
+    int size = HISTORY_ENTRY_OVERHEAD;
+
+    if(budget <= size)
+        return 0;
+
+    if(packed != NULL) {
+        size_t count = (size_t)(budget - size) / (value_size + packed->memSize);
+        return count < available ? count : available;
+    }
+
+    size_t count = 0;
+    while(count < available) {
+        int entry_size = 0;
+        encode_variant_struct(NULL, &entry_size, (void *)&data->dataValues[first + count].value);
+        if(size + value_size + entry_size > budget)
+            break;
+
+        size += value_size + entry_size;
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ *  Streams the values of a HistoryRead response in as few frames as the {:packet, 2} limit allows.
+ *  indices maps every result to its node. A value that does not fit in a frame by itself fails
+ *  its node with BadEncodingLimitsExceeded.
+ */
+static void send_history_data(UA_HistoryReadResult *results, size_t results_size, const size_t *indices)
+{
+    const int frame_limit = erlcmd_frame_limit();
+    int header_size = sizeof(uint16_t);
+    encode_browse_partial_header(NULL, &header_size, 1);
+    header_size += 1;   // list tail
+
+    UA_HistoryData **data = (UA_HistoryData **)calloc(results_size, sizeof(UA_HistoryData *));
+    const UA_DataType **types = (const UA_DataType **)calloc(results_size, sizeof(UA_DataType *));
+    bool *statuses = (bool *)calloc(results_size, sizeof(bool));
+    char *scratch = (char *)malloc(frame_limit);
+    char *resp = (char *)malloc(frame_limit);
+    if(data == NULL || types == NULL || statuses == NULL || scratch == NULL || resp == NULL) {
+        for(size_t i = 0; i < results_size; i++)
+            results[i].statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
+        results_size = 0;
+    }
+
+    for(size_t i = 0; i < results_size; i++) {
+        if(UA_StatusCode_isBad(results[i].statusCode))
+            continue;
+
+        data[i] = history_data(&results[i]);
+        if(data[i] == NULL)
+            continue;
+
+        types[i] = history_packed_type(data[i]);
+        statuses[i] = history_has_statuses(data[i]);
+    }
+
+    size_t result = 0;
+    size_t value = 0;
+    for(;;) {
+        while(result < results_size && (data[result] == NULL || value >= data[result]->dataValuesSize)) {
+            result++;
+            value = 0;
+        }
+
+        if(result >= results_size)
+            break;
+
+        // Size pass: whole results while they fit, the last entry may be a part of its result
+        int frame_size = header_size;
+        int entries = 0;
+        size_t last_count = 0;
+        size_t end_result = result;
+        size_t end_value = value;
+        while(end_result < results_size) {
+            if(data[end_result] == NULL || end_value >= data[end_result]->dataValuesSize) {
+                end_result++;
+                end_value = 0;
+                continue;
+            }
+
+            size_t count = history_entry_fit(data[end_result], end_value, types[end_result], statuses[end_result],
+                                             frame_limit - frame_size);
+            if(count == 0)
+                break;
+
+            int entry_size = 0;
+            encode_history_entry(NULL, &entry_size, indices[end_result], &data[end_result]->dataValues[end_value], count,
+                                 types[end_result], statuses[end_result], scratch);
+            frame_size += entry_size;
+            entries++;
+            last_count = count;
+            end_value += count;
+
+            if(end_value < data[end_result]->dataValuesSize)
+                break;
+        }
+
+        if(entries == 0) {
+            // Not even one value of the current result fits in an empty frame
+            results[result].statusCode = UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+            data[result] = NULL;
+            continue;
+        }
+
+        int resp_index = sizeof(uint16_t);
+        encode_browse_partial_header(resp, &resp_index, entries);
+        for(int i = 0; i < entries; i++) {
+            while(data[result] == NULL || value >= data[result]->dataValuesSize) {
+                result++;
+                value = 0;
+            }
+
+            size_t count = i == entries - 1 ? last_count : data[result]->dataValuesSize - value;
+            encode_history_entry(resp, &resp_index, indices[result], &data[result]->dataValues[value], count,
+                                 types[result], statuses[result], scratch);
+            value += count;
+        }
+        ei_encode_empty_list(resp, &resp_index);
+        erlcmd_send(resp, resp_index);
+    }
+
+    free(data);
+    free(types);
+    free(statuses);
+    free(scratch);
+    free(resp);
+}
+
+// {:ok, [:ok | {:error, status}]}
+static void encode_history_status_response(char *resp, int *resp_index, const UA_StatusCode *statuses, size_t nodes_size)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
+
+    ei_encode_list_header(resp, resp_index, (int)nodes_size);
+    for(size_t i = 0; i < nodes_size; i++) {
+        if(!UA_StatusCode_isBad(statuses[i])) {
+            ei_encode_atom(resp, resp_index, "ok");
+            continue;
+        }
+
+        const char *status = UA_StatusCode_name(statuses[i]);
+        ei_encode_tuple_header(resp, resp_index, 2);
+        ei_encode_atom(resp, resp_index, "error");
+        ei_encode_binary(resp, resp_index, status, strlen(status));
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
+
+static void send_history_status_response(const UA_StatusCode *statuses, size_t nodes_size)
+{
+    int resp_size = sizeof(uint16_t);
+    encode_history_status_response(NULL, &resp_size, statuses, nodes_size);
+
+    if(resp_size > erlcmd_frame_limit()) {
+        send_error_response("overflow");
+        return;
+    }
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    int resp_index = sizeof(uint16_t);
+    encode_history_status_response(resp, &resp_index, statuses, nodes_size);
+    erlcmd_send(resp, resp_index);
+
+    free(resp);
+}
+
+/*
+ *  Reads the history of the nodes, following the continuation points until every node is complete.
+ *  The data is streamed round by round, statuses keeps the final status of every node. Only a failure
+ *  of the first request (nothing streamed yet) is returned, the continuation points left by a later
+ *  failure are released.
+ */
+static UA_StatusCode history_read(UA_ReadRawModifiedDetails *details, UA_HistoryReadValueId *nodes, size_t nodes_size,
+                                  UA_StatusCode *statuses)
+{
+    size_t *indices = (size_t *)malloc(nodes_size * sizeof(size_t));
+    UA_HistoryReadValueId *pending_nodes = (UA_HistoryReadValueId *)malloc(nodes_size * sizeof(UA_HistoryReadValueId));
+    if(indices == NULL || pending_nodes == NULL) {
+        free(indices);
+        free(pending_nodes);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    for(size_t i = 0; i < nodes_size; i++)
+        indices[i] = i;
+
+    UA_HistoryReadRequest request;
+    UA_HistoryReadRequest_init(&request);
+    UA_ExtensionObject_setValue(&request.historyReadDetails, details, &UA_TYPES[UA_TYPES_READRAWMODIFIEDDETAILS]);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_SOURCE;
+    request.releaseContinuationPoints = false;
+
+    UA_StatusCode first_retval = UA_STATUSCODE_GOOD;
+    size_t pending = nodes_size;
+    bool first = true;
+    while(pending > 0) {
+        // Shallow copies, the nodes keep ownership
+        for(size_t k = 0; k < pending; k++)
+            pending_nodes[k] = nodes[indices[k]];
+
+        request.nodesToRead = pending_nodes;
+        request.nodesToReadSize = pending;
+
+        UA_HistoryReadResponse response = UA_Client_Service_historyRead(client, request);
+
+        UA_StatusCode retval = response.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD && response.resultsSize != pending)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+        if(retval != UA_STATUSCODE_GOOD) {
+            if(first)
+                first_retval = retval;
+            for(size_t k = 0; k < pending; k++)
+                statuses[indices[k]] = retval;
+            UA_HistoryReadResponse_clear(&response);
+
+            // The server keeps the continuation points of the pending nodes until they are released
+            if(!first) {
+                request.releaseContinuationPoints = true;
+                response = UA_Client_Service_historyRead(client, request);
+                UA_HistoryReadResponse_clear(&response);
+            }
+            break;
+        }
+
+        send_history_data(response.results, pending, indices);
+
+        size_t next = 0;
+        for(size_t k = 0; k < pending; k++) {
+            size_t i = indices[k];
+            UA_HistoryReadResult *result = &response.results[k];
+
+            UA_ByteString_clear(&nodes[i].continuationPoint);
+            statuses[i] = result->statusCode;
+
+            if(!UA_StatusCode_isBad(result->statusCode) && result->continuationPoint.length > 0) {
+                nodes[i].continuationPoint = result->continuationPoint;
+                UA_ByteString_init(&result->continuationPoint);
+                indices[next++] = i;
+            }
+        }
+
+        UA_HistoryReadResponse_clear(&response);
+        pending = next;
+        first = false;
+    }
+
+    free(indices);
+    free(pending_nodes);
+    return first_retval;
+}
+
+#endif
+
+/*
+ *  Reads the raw (or modified) history of many nodes in a single request.
+ *  Input: {[node_id] (1 to 1000 nodes), start_time, end_time, num_values_per_node (0 = all), return_bounds,
+ *          modified}
+ *  Output: {:partial, [{index, data_type | nil, timestamps, values, statuses | nil}]} frames,
+ *          then {:ok, [:ok | {:error, status}]} or {:error, reason}
+ */
+static void handle_history_read_raw(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_count;
+    long long start_time;
+    long long end_time;
+    unsigned long num_values;
+    int return_bounds;
+    int modified;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 6)
+        errx(EXIT_FAILURE, ":handle_history_read_raw requires a 6-tuple, term_size = %d", term_size);
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_history_read_raw requires a list of nodes");
+
+    int nodes_count = list_count;
+    if(nodes_count == 0 || nodes_count > MAX_HISTORY_NODES) {
+        send_error_response("einval");
+        return;
+    }
+
+    size_t nodes_size = (size_t)nodes_count;
+    UA_HistoryReadValueId *nodes = (UA_HistoryReadValueId *)UA_Array_new(nodes_size, &UA_TYPES[UA_TYPES_HISTORYREADVALUEID]);
+    if(nodes == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    for(size_t i = 0; i < nodes_size; i++)
+        nodes[i].nodeId = assemble_node_id(req, req_index);
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    if(ei_decode_longlong(req, req_index, &start_time) < 0 ||
+       ei_decode_longlong(req, req_index, &end_time) < 0 ||
+       ei_decode_ulong(req, req_index, &num_values) < 0 ||
+       ei_decode_boolean(req, req_index, &return_bounds) < 0 ||
+       ei_decode_boolean(req, req_index, &modified) < 0) {
+        UA_Array_delete(nodes, nodes_size, &UA_TYPES[UA_TYPES_HISTORYREADVALUEID]);
+        send_error_response("einval");
+        return;
+    }
+
+#ifdef UA_ENABLE_HISTORIZING
+    UA_StatusCode *statuses = (UA_StatusCode *)calloc(nodes_size, sizeof(UA_StatusCode));
+    if(statuses == NULL) {
+        UA_Array_delete(nodes, nodes_size, &UA_TYPES[UA_TYPES_HISTORYREADVALUEID]);
+        send_error_response("enomem");
+        return;
+    }
+
+    UA_ReadRawModifiedDetails details;
+    UA_ReadRawModifiedDetails_init(&details);
+    details.isReadModified = modified;
+    details.startTime = start_time;
+    details.endTime = end_time;
+    details.numValuesPerNode = (UA_UInt32)num_values;
+    details.returnBounds = return_bounds;
+
+    UA_StatusCode retval = history_read(&details, nodes, nodes_size, statuses);
+    if(retval != UA_STATUSCODE_GOOD)
+        send_opex_response(retval);
+    else
+        send_history_status_response(statuses, nodes_size);
+
+    free(statuses);
+#else
+    send_error_response("not_supported");
+#endif
+
+    UA_Array_delete(nodes, nodes_size, &UA_TYPES[UA_TYPES_HISTORYREADVALUEID]);
+}
+
+/*************************/
+/* Address Space Crawler */
+/*************************/
+
+/*
+ *  Walks the hierarchy below a root node level by level. Every level is browsed with batched Browse
+ *  requests, several of them in flight, and the metadata of the new variables (DataType, ValueRank,
+ *  ArrayDimensions, AccessLevel) is read with batched Read requests the same way.
+ *  The result can be persisted as a cache file, the binary encoding of a Crawl_cache, keyed by the
+ *  server NamespaceArray and the value of an optional model version node. A matching cache is
+ *  returned without crawling. When it is re-validated, the hierarchy is browsed again but metadata
+ *  is only read for the nodes that are not in the cache: a node that kept its id and NodeClass keeps
+ *  its cached metadata, changing it needs a model version change (or a crawl without the cache).
+ */
+#define CRAWL_CACHE_FORMAT 1
+#define CRAWL_BROWSE_BATCH 500              // nodes per Browse request
+#define CRAWL_READ_BATCH 250                // variables per Read request
+#define CRAWL_PIPELINE 4                    // requests in flight
+#define CRAWL_METADATA_ATTRIBUTES 4
+#define MAX_CRAWL_NODES 1000000
+
+typedef struct {
+    UA_NodeId nodeId;
+    UA_UInt32 parent;                       // position of the parent node (the root is its own parent)
+    UA_UInt32 nodeClass;
+    UA_QualifiedName browseName;
+    UA_NodeId dataType;
+    UA_Int32 valueRank;
+    size_t arrayDimensionsSize;
+    UA_UInt32 *arrayDimensions;
+    UA_Byte accessLevel;
+} Crawl_node;
+
+typedef struct {
+    UA_UInt32 format;
+    size_t namespacesSize;
+    UA_String *namespaces;
+    UA_ByteString modelVersion;             // binary encoded value of the model version node
+    UA_NodeId root;
+    size_t nodesSize;
+    Crawl_node *nodes;
+} Crawl_cache;
+
+static UA_DataTypeMember crawl_node_members[8];
+static UA_DataTypeMember crawl_cache_members[5];
+static UA_DataType crawl_node_type;
+static UA_DataType crawl_cache_type;
+
+#define CRAWL_PADDING(type, member, previous, previous_size) \
+    (offsetof(type, member) - offsetof(type, previous) - (previous_size))
+
+static void crawl_member(UA_DataTypeMember *member, const char *name, const UA_DataType *type, size_t padding, bool is_array)
+{
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+    member->memberName = name;
+#endif
+    member->memberType = type;
+    member->padding = (UA_Byte)padding;
+    member->isArray = is_array;
+    member->isOptional = false;
+}
+
+static void crawl_structure_type(UA_DataType *type, const char *name, size_t mem_size, UA_DataTypeMember *members,
+                                 size_t members_size)
+{
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+    type->typeName = name;
+#endif
+    type->typeId = UA_NODEID_NULL;
+    type->binaryEncodingId = UA_NODEID_NULL;
+    type->memSize = (UA_UInt16)mem_size;
+    type->typeKind = UA_DATATYPEKIND_STRUCTURE;
+    type->pointerFree = false;
+    type->overlayable = false;
+    type->membersSize = (UA_Byte)members_size;
+    type->members = members;
+}
+
+// The cache file layout, described as open62541 structures so the stack encodes it.
+static void crawl_types_init()
+{
+    if(crawl_node_type.members != NULL)
+        return;
+
+    UA_DataTypeMember *node = crawl_node_members;
+    crawl_member(&node[0], "nodeId", &UA_TYPES[UA_TYPES_NODEID], 0, false);
+    crawl_member(&node[1], "parent", &UA_TYPES[UA_TYPES_UINT32],
+                 CRAWL_PADDING(Crawl_node, parent, nodeId, sizeof(UA_NodeId)), false);
+    crawl_member(&node[2], "nodeClass", &UA_TYPES[UA_TYPES_UINT32],
+                 CRAWL_PADDING(Crawl_node, nodeClass, parent, sizeof(UA_UInt32)), false);
+    crawl_member(&node[3], "browseName", &UA_TYPES[UA_TYPES_QUALIFIEDNAME],
+                 CRAWL_PADDING(Crawl_node, browseName, nodeClass, sizeof(UA_UInt32)), false);
+    crawl_member(&node[4], "dataType", &UA_TYPES[UA_TYPES_NODEID],
+                 CRAWL_PADDING(Crawl_node, dataType, browseName, sizeof(UA_QualifiedName)), false);
+    crawl_member(&node[5], "valueRank", &UA_TYPES[UA_TYPES_INT32],
+                 CRAWL_PADDING(Crawl_node, valueRank, dataType, sizeof(UA_NodeId)), false);
+    crawl_member(&node[6], "arrayDimensions", &UA_TYPES[UA_TYPES_UINT32],
+                 CRAWL_PADDING(Crawl_node, arrayDimensionsSize, valueRank, sizeof(UA_Int32)), true);
+    crawl_member(&node[7], "accessLevel", &UA_TYPES[UA_TYPES_BYTE],
+                 CRAWL_PADDING(Crawl_node, accessLevel, arrayDimensions, sizeof(void *)), false);
+    crawl_structure_type(&crawl_node_type, "CrawlNode", sizeof(Crawl_node), node, 8);
+
+    UA_DataTypeMember *cache = crawl_cache_members;
+    crawl_member(&cache[0], "format", &UA_TYPES[UA_TYPES_UINT32], 0, false);
+    crawl_member(&cache[1], "namespaces", &UA_TYPES[UA_TYPES_STRING],
+                 CRAWL_PADDING(Crawl_cache, namespacesSize, format, sizeof(UA_UInt32)), true);
+    crawl_member(&cache[2], "modelVersion", &UA_TYPES[UA_TYPES_BYTESTRING],
+                 CRAWL_PADDING(Crawl_cache, modelVersion, namespaces, sizeof(void *)), false);
+    crawl_member(&cache[3], "root", &UA_TYPES[UA_TYPES_NODEID],
+                 CRAWL_PADDING(Crawl_cache, root, modelVersion, sizeof(UA_ByteString)), false);
+    crawl_member(&cache[4], "nodes", &crawl_node_type,
+                 CRAWL_PADDING(Crawl_cache, nodesSize, root, sizeof(UA_NodeId)), true);
+    crawl_structure_type(&crawl_cache_type, "CrawlCache", sizeof(Crawl_cache), cache, 5);
+}
+
+/*
+ *  Crawled nodes, with an open addressing index (position + 1, 0 is a free slot) by NodeId.
+ */
+typedef struct {
+    Crawl_node *nodes;
+    size_t nodes_size;
+    size_t nodes_capacity;
+    UA_UInt32 *index;
+    size_t index_capacity;
+} Crawl_tree;
+
+static UA_UInt32 crawl_tree_find(const Crawl_tree *tree, const UA_NodeId *node_id)
+{
+    if(tree->index_capacity == 0)
+        return UA_UINT32_MAX;
+
+    size_t slot = UA_NodeId_hash(node_id) & (tree->index_capacity - 1);
+    while(tree->index[slot] != 0) {
+        UA_UInt32 position = tree->index[slot] - 1;
+        if(UA_NodeId_equal(&tree->nodes[position].nodeId, node_id))
+            return position;
+        slot = (slot + 1) & (tree->index_capacity - 1);
+    }
+
+    return UA_UINT32_MAX;
+}
+
+static void crawl_tree_index_insert(Crawl_tree *tree, UA_UInt32 position)
+{
+    size_t slot = UA_NodeId_hash(&tree->nodes[position].nodeId) & (tree->index_capacity - 1);
+    while(tree->index[slot] != 0)
+        slot = (slot + 1) & (tree->index_capacity - 1);
+    tree->index[slot] = position + 1;
+}
+
+// Indexes the node at the end of the tree, the index is kept at most half full.
+static UA_StatusCode crawl_tree_index_last(Crawl_tree *tree)
+{
+    if(2 * tree->nodes_size > tree->index_capacity) {
+        size_t capacity = tree->index_capacity ? 2 * tree->index_capacity : 1024;
+        while(2 * tree->nodes_size > capacity)
+            capacity *= 2;
+
+        UA_UInt32 *index = (UA_UInt32 *)calloc(capacity, sizeof(UA_UInt32));
+        if(index == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+
+        free(tree->index);
+        tree->index = index;
+        tree->index_capacity = capacity;
+
+        for(size_t i = 0; i < tree->nodes_size; i++)
+            crawl_tree_index_insert(tree, (UA_UInt32)i);
+
+        return UA_STATUSCODE_GOOD;
+    }
+
+    crawl_tree_index_insert(tree, (UA_UInt32)(tree->nodes_size - 1));
+    return UA_STATUSCODE_GOOD;
+}
+
+static Crawl_node *crawl_tree_add(Crawl_tree *tree, const UA_NodeId *node_id, UA_UInt32 parent, UA_UInt32 node_class,
+                                  const UA_QualifiedName *browse_name)
+{
+    if(tree->nodes_size == tree->nodes_capacity) {
+        size_t capacity = tree->nodes_capacity ? 2 * tree->nodes_capacity : 256;
+        Crawl_node *nodes = (Crawl_node *)realloc(tree->nodes, capacity * sizeof(Crawl_node));
+        if(nodes == NULL)
+            return NULL;
+
+        tree->nodes = nodes;
+        tree->nodes_capacity = capacity;
+    }
+
+    Crawl_node *node = &tree->nodes[tree->nodes_size];
+    memset(node, 0, sizeof(Crawl_node));
+    UA_NodeId_copy(node_id, &node->nodeId);
+    UA_QualifiedName_copy(browse_name, &node->browseName);
+    node->parent = parent;
+    node->nodeClass = node_class;
+    tree->nodes_size++;
+
+    if(crawl_tree_index_last(tree) != UA_STATUSCODE_GOOD) {
+        tree->nodes_size--;
+        UA_clear(node, &crawl_node_type);
+        return NULL;
+    }
+
+    return node;
+}
+
+// Takes the nodes of a decoded cache.
+static UA_StatusCode crawl_tree_from_cache(Crawl_tree *tree, Crawl_cache *cache)
+{
+    tree->nodes = cache->nodes;
+    tree->nodes_size = cache->nodesSize;
+    tree->nodes_capacity = cache->nodesSize;
+    cache->nodes = NULL;
+    cache->nodesSize = 0;
+
+    size_t capacity = 1024;
+    while(2 * tree->nodes_size > capacity)
+        capacity *= 2;
+
+    tree->index = (UA_UInt32 *)calloc(capacity, sizeof(UA_UInt32));
+    if(tree->index == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    tree->index_capacity = capacity;
+    for(size_t i = 0; i < tree->nodes_size; i++)
+        crawl_tree_index_insert(tree, (UA_UInt32)i);
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static void crawl_tree_clear(Crawl_tree *tree)
+{
+    for(size_t i = 0; i < tree->nodes_size; i++)
+        UA_clear(&tree->nodes[i], &crawl_node_type);
+    free(tree->nodes);
+    free(tree->index);
+    memset(tree, 0, sizeof(Crawl_tree));
+}
+
+/*
+ *  Pipelined requests: items are split in batches, up to CRAWL_PIPELINE of them in flight, and
+ *  the responses are moved to results (item by item).
+ */
+typedef struct Crawl_pipeline {
+    bool browse;
+    void *items;                            // UA_BrowseDescription[] | UA_ReadValueId[]
+    void *results;                          // UA_BrowseResult[] | UA_DataValue[]
+    size_t in_flight;
+    UA_StatusCode status;
+} Crawl_pipeline;
+
+typedef struct {
+    Crawl_pipeline *pipeline;
+    size_t first;
+    size_t count;
+} Crawl_batch;
+
+static void crawl_browse_callback(UA_Client *client, void *userdata, UA_UInt32 requestId, UA_BrowseResponse *response)
+{
+    Crawl_batch *batch = (Crawl_batch *)userdata;
+    Crawl_pipeline *pipeline = batch->pipeline;
+    pipeline->in_flight--;
+
+    if(response->responseHeader.serviceResult != UA_STATUSCODE_GOOD || response->resultsSize != batch->count) {
+        pipeline->status = response->responseHeader.serviceResult != UA_STATUSCODE_GOOD ?
+            response->responseHeader.serviceResult : UA_STATUSCODE_BADUNEXPECTEDERROR;
+        return;
+    }
+
+    UA_BrowseResult *results = (UA_BrowseResult *)pipeline->results + batch->first;
+    for(size_t i = 0; i < batch->count; i++) {
+        results[i] = response->results[i];
+        UA_BrowseResult_init(&response->results[i]);
+    }
+}
+
+static void crawl_read_callback(UA_Client *client, void *userdata, UA_UInt32 requestId, UA_ReadResponse *response)
+{
+    Crawl_batch *batch = (Crawl_batch *)userdata;
+    Crawl_pipeline *pipeline = batch->pipeline;
+    pipeline->in_flight--;
+
+    if(response->responseHeader.serviceResult != UA_STATUSCODE_GOOD || response->resultsSize != batch->count) {
+        pipeline->status = response->responseHeader.serviceResult != UA_STATUSCODE_GOOD ?
+            response->responseHeader.serviceResult : UA_STATUSCODE_BADUNEXPECTEDERROR;
+        return;
+    }
+
+    UA_DataValue *results = (UA_DataValue *)pipeline->results + batch->first;
+    for(size_t i = 0; i < batch->count; i++) {
+        results[i] = response->results[i];
+        UA_DataValue_init(&response->results[i]);
+    }
+}
+
+static UA_StatusCode crawl_send_batch(Crawl_batch *batch)
+{
+    Crawl_pipeline *pipeline = batch->pipeline;
+
+    if(pipeline->browse) {
+        UA_BrowseRequest request;
+        UA_BrowseRequest_init(&request);
+        request.nodesToBrowse = (UA_BrowseDescription *)pipeline->items + batch->first;
+        request.nodesToBrowseSize = batch->count;
+        return UA_Client_sendAsyncBrowseRequest(client, &request, crawl_browse_callback, batch, NULL);
+    }
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = (UA_ReadValueId *)pipeline->items + batch->first;
+    request.nodesToReadSize = batch->count;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    return UA_Client_sendAsyncReadRequest(client, &request, crawl_read_callback, batch, NULL);
+}
+
+static UA_StatusCode crawl_run_pipeline(Crawl_pipeline *pipeline, size_t items_size, size_t batch_size)
+{
+    size_t batches_size = (items_size + batch_size - 1) / batch_size;
+    Crawl_batch *batches = (Crawl_batch *)calloc(batches_size, sizeof(Crawl_batch));
+    if(batches == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    pipeline->in_flight = 0;
+    pipeline->status = UA_STATUSCODE_GOOD;
+
+    size_t next = 0;
+    for(;;) {
+        while(pipeline->status == UA_STATUSCODE_GOOD && next < batches_size && pipeline->in_flight < CRAWL_PIPELINE) {
+            Crawl_batch *batch = &batches[next];
+            batch->pipeline = pipeline;
+            batch->first = next * batch_size;
+            batch->count = items_size - batch->first < batch_size ? items_size - batch->first : batch_size;
+
+            UA_StatusCode retval = crawl_send_batch(batch);
+            if(retval != UA_STATUSCODE_GOOD) {
+                pipeline->status = retval;
+                break;
+            }
+
+            pipeline->in_flight++;
+            next++;
+        }
+
+        // Pending requests always end in their callback (response, timeout or disconnection).
+        if(pipeline->in_flight == 0)
+            break;
+
+        UA_Client_run_iterate(client, 50);
+    }
+
+    free(batches);
+    return pipeline->status;
+}
+
+// Reads DataType, ValueRank, ArrayDimensions and AccessLevel of the given nodes.
+static UA_StatusCode crawl_read_metadata(Crawl_tree *tree, const UA_UInt32 *positions, size_t positions_size)
+{
+    static const UA_UInt32 attributes[CRAWL_METADATA_ATTRIBUTES] = {
+        UA_ATTRIBUTEID_DATATYPE, UA_ATTRIBUTEID_VALUERANK, UA_ATTRIBUTEID_ARRAYDIMENSIONS, UA_ATTRIBUTEID_ACCESSLEVEL
+    };
+
+    if(positions_size == 0)
+        return UA_STATUSCODE_GOOD;
+
+    size_t items_size = positions_size * CRAWL_METADATA_ATTRIBUTES;
+    UA_ReadValueId *items = (UA_ReadValueId *)calloc(items_size, sizeof(UA_ReadValueId));
+    UA_DataValue *results = (UA_DataValue *)calloc(items_size, sizeof(UA_DataValue));
+    if(items == NULL || results == NULL) {
+        free(items);
+        free(results);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    // Shallow copies of the node ids, the tree does not change while reading.
+    for(size_t i = 0; i < items_size; i++) {
+        items[i].nodeId = tree->nodes[positions[i / CRAWL_METADATA_ATTRIBUTES]].nodeId;
+        items[i].attributeId = attributes[i % CRAWL_METADATA_ATTRIBUTES];
+    }
+
+    Crawl_pipeline pipeline = {false, items, results, 0, UA_STATUSCODE_GOOD};
+    UA_StatusCode retval = crawl_run_pipeline(&pipeline, items_size, CRAWL_READ_BATCH * CRAWL_METADATA_ATTRIBUTES);
+
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < positions_size; i++) {
+        Crawl_node *node = &tree->nodes[positions[i]];
+        UA_DataValue *values = &results[i * CRAWL_METADATA_ATTRIBUTES];
+
+        if(UA_Variant_hasScalarType(&values[0].value, &UA_TYPES[UA_TYPES_NODEID]))
+            UA_NodeId_copy((UA_NodeId *)values[0].value.data, &node->dataType);
+        if(UA_Variant_hasScalarType(&values[1].value, &UA_TYPES[UA_TYPES_INT32]))
+            node->valueRank = *(UA_Int32 *)values[1].value.data;
+        if(UA_Variant_hasArrayType(&values[2].value, &UA_TYPES[UA_TYPES_UINT32]) && values[2].value.arrayLength > 0 &&
+           UA_Array_copy(values[2].value.data, values[2].value.arrayLength, (void **)&node->arrayDimensions,
+                         &UA_TYPES[UA_TYPES_UINT32]) == UA_STATUSCODE_GOOD)
+            node->arrayDimensionsSize = values[2].value.arrayLength;
+        if(UA_Variant_hasScalarType(&values[3].value, &UA_TYPES[UA_TYPES_BYTE]))
+            node->accessLevel = *(UA_Byte *)values[3].value.data;
+    }
+
+    for(size_t i = 0; i < items_size; i++)
+        UA_DataValue_clear(&results[i]);
+    free(results);
+    free(items);
+
+    return retval;
+}
+
+static bool crawl_needs_metadata(UA_UInt32 node_class)
+{
+    return node_class == UA_NODECLASS_VARIABLE || node_class == UA_NODECLASS_VARIABLETYPE;
+}
+
+// Takes the metadata of a node from the previous crawl, if the node is there.
+static bool crawl_reuse_metadata(Crawl_node *node, const Crawl_tree *previous)
+{
+    if(previous == NULL)
+        return false;
+
+    UA_UInt32 position = crawl_tree_find(previous, &node->nodeId);
+    if(position == UA_UINT32_MAX || previous->nodes[position].nodeClass != node->nodeClass)
+        return false;
+
+    const Crawl_node *cached = &previous->nodes[position];
+    node->valueRank = cached->valueRank;
+    node->accessLevel = cached->accessLevel;
+    UA_NodeId_copy(&cached->dataType, &node->dataType);
+    if(cached->arrayDimensionsSize > 0 &&
+       UA_Array_copy(cached->arrayDimensions, cached->arrayDimensionsSize, (void **)&node->arrayDimensions,
+                     &UA_TYPES[UA_TYPES_UINT32]) == UA_STATUSCODE_GOOD)
+        node->arrayDimensionsSize = cached->arrayDimensionsSize;
+
+    return true;
+}
+
+// Adds the root node, with its NodeClass and BrowseName.
+static UA_StatusCode crawl_add_root(Crawl_tree *tree, const UA_NodeId *root)
+{
+    UA_ReadValueId items[2];
+    UA_ReadValueId_init(&items[0]);
+    UA_ReadValueId_init(&items[1]);
+    items[0].nodeId = *root;
+    items[0].attributeId = UA_ATTRIBUTEID_NODECLASS;
+    items[1].nodeId = *root;
+    items[1].attributeId = UA_ATTRIBUTEID_BROWSENAME;
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = items;
+    request.nodesToReadSize = 2;
+
+    UA_ReadResponse response = UA_Client_Service_read(client, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != 2)
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    if(retval == UA_STATUSCODE_GOOD && response.results[0].status != UA_STATUSCODE_GOOD)
+        retval = response.results[0].status;
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_QualifiedName browse_name;
+        UA_QualifiedName_init(&browse_name);
+        if(UA_Variant_hasScalarType(&response.results[1].value, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]))
+            browse_name = *(UA_QualifiedName *)response.results[1].value.data;
+
+        UA_UInt32 node_class = UA_Variant_hasScalarType(&response.results[0].value, &UA_TYPES[UA_TYPES_NODECLASS]) ?
+            *(UA_UInt32 *)response.results[0].value.data : UA_NODECLASS_UNSPECIFIED;
+
+        if(crawl_tree_add(tree, root, 0, node_class, &browse_name) == NULL)
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    UA_ReadResponse_clear(&response);
+    return retval;
+}
+
+/*
+ *  Crawls the hierarchy (HierarchicalReferences and subtypes, forward) below root.
+ *  max_depth 0 is unlimited, truncated is set when max_nodes stopped the crawl or the references of
+ *  some node could not be browsed (Browse/BrowseNext failure), the crawl goes on with the other nodes.
+ */
+static UA_StatusCode crawl_address_space(Crawl_tree *tree, const UA_NodeId *root, const Crawl_tree *previous,
+                                         UA_UInt32 max_depth, size_t max_nodes, bool *truncated)
+{
+    UA_StatusCode retval = crawl_add_root(tree, root);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    // Nodes of the current level, and the ones (of the same level) waiting for their metadata.
+    size_t level_first = 0;
+    size_t level_size = 1;
+    UA_UInt32 *to_read = (UA_UInt32 *)malloc(sizeof(UA_UInt32));
+    size_t to_read_size = 0;
+    if(to_read == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    if(crawl_needs_metadata(tree->nodes[0].nodeClass) && !crawl_reuse_metadata(&tree->nodes[0], previous))
+        to_read[to_read_size++] = 0;
+
+    *truncated = false;
+    bool incomplete = false;
+    for(UA_UInt32 depth = 0; retval == UA_STATUSCODE_GOOD; depth++) {
+        retval = crawl_read_metadata(tree, to_read, to_read_size);
+        to_read_size = 0;
+
+        if(retval != UA_STATUSCODE_GOOD || level_size == 0 || *truncated || (max_depth > 0 && depth >= max_depth))
+            break;
+
+        UA_BrowseDescription *items = (UA_BrowseDescription *)calloc(level_size, sizeof(UA_BrowseDescription));
+        UA_BrowseResult *results = (UA_BrowseResult *)calloc(level_size, sizeof(UA_BrowseResult));
+        if(items == NULL || results == NULL) {
+            free(items);
+            free(results);
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            break;
+        }
+
+        // Shallow copies of the node ids, the tree does not change while browsing.
+        for(size_t i = 0; i < level_size; i++) {
+            items[i].nodeId = tree->nodes[level_first + i].nodeId;
+            items[i].browseDirection = UA_BROWSEDIRECTION_FORWARD;
+            items[i].referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+            items[i].includeSubtypes = true;
+            items[i].resultMask = UA_BROWSERESULTMASK_NODECLASS | UA_BROWSERESULTMASK_BROWSENAME;
+        }
+
+        Crawl_pipeline pipeline = {true, items, results, 0, UA_STATUSCODE_GOOD};
+        retval = crawl_run_pipeline(&pipeline, level_size, CRAWL_BROWSE_BATCH);
+        if(retval == UA_STATUSCODE_GOOD)
+            browse_follow_continuation_points(results, level_size, UA_BROWSERESULTMASK_ALL, false);
+        else
+            browse_release_results(results, level_size);
+
+        size_t next_first = tree->nodes_size;
+        for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < level_size && !*truncated; i++) {
+            UA_BrowseResult *result = &results[i];
+            if(result->statusCode != UA_STATUSCODE_GOOD) {
+                incomplete = true;
+                continue;
+            }
+
+            for(size_t j = 0; j < result->referencesSize; j++) {
+                UA_ReferenceDescription *reference = &result->references[j];
+
+                // Remote nodes and nodes already reached through another parent
+                if(reference->nodeId.serverIndex != 0 || reference->nodeId.namespaceUri.length > 0 ||
+                   crawl_tree_find(tree, &reference->nodeId.nodeId) != UA_UINT32_MAX)
+                    continue;
+
+                if(tree->nodes_size >= max_nodes) {
+                    *truncated = true;
+                    break;
+                }
+
+                Crawl_node *node = crawl_tree_add(tree, &reference->nodeId.nodeId, (UA_UInt32)(level_first + i),
+                                                  (UA_UInt32)reference->nodeClass, &reference->browseName);
+                if(node == NULL) {
+                    retval = UA_STATUSCODE_BADOUTOFMEMORY;
+                    break;
+                }
+
+                if(crawl_needs_metadata(node->nodeClass) && !crawl_reuse_metadata(node, previous)) {
+                    UA_UInt32 *grown = (UA_UInt32 *)realloc(to_read, tree->nodes_size * sizeof(UA_UInt32));
+                    if(grown == NULL) {
+                        retval = UA_STATUSCODE_BADOUTOFMEMORY;
+                        break;
+                    }
+                    to_read = grown;
+                    to_read[to_read_size++] = (UA_UInt32)(tree->nodes_size - 1);
+                }
+            }
+        }
+
+        for(size_t i = 0; i < level_size; i++)
+            UA_BrowseResult_clear(&results[i]);
+        free(results);
+        free(items);
+
+        level_first = next_first;
+        level_size = tree->nodes_size - next_first;
+    }
+
+    if(incomplete)
+        *truncated = true;
+
+    free(to_read);
+    return retval;
+}
+
+/*
+ *  Reads the cache key of the server: its NamespaceArray and the (binary encoded) value of the
+ *  model version node, if any.
+ */
+static UA_StatusCode crawl_read_cache_key(Crawl_cache *key, const UA_NodeId *model_version)
+{
+    UA_ReadValueId items[2];
+    UA_ReadValueId_init(&items[0]);
+    UA_ReadValueId_init(&items[1]);
+    items[0].nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_NAMESPACEARRAY);
+    items[0].attributeId = UA_ATTRIBUTEID_VALUE;
+    items[1].nodeId = *model_version;
+    items[1].attributeId = UA_ATTRIBUTEID_VALUE;
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = items;
+    request.nodesToReadSize = UA_NodeId_isNull(model_version) ? 1 : 2;
+
+    UA_ReadResponse response = UA_Client_Service_read(client, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != request.nodesToReadSize)
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < response.resultsSize; i++)
+        if(response.results[i].status != UA_STATUSCODE_GOOD)
+            retval = response.results[i].status;
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_Variant *namespaces = &response.results[0].value;
+        if(UA_Variant_hasArrayType(namespaces, &UA_TYPES[UA_TYPES_STRING])) {
+            key->namespaces = (UA_String *)namespaces->data;
+            key->namespacesSize = namespaces->arrayLength;
+            namespaces->data = NULL;
+            namespaces->arrayLength = 0;
+        }
+
+        if(response.resultsSize == 2)
+            retval = UA_encodeBinary(&response.results[1].value, &UA_TYPES[UA_TYPES_VARIANT], &key->modelVersion);
+    }
+
+    UA_ReadResponse_clear(&response);
+    return retval;
+}
+
+// A cache file may be corrupt: every node must come after its parent (the root is its own parent).
+static bool crawl_cache_matches(const Crawl_cache *cache, const Crawl_cache *key)
+{
+    if(cache->format != CRAWL_CACHE_FORMAT || cache->nodesSize == 0 || cache->nodesSize > MAX_CRAWL_NODES ||
+       cache->namespacesSize != key->namespacesSize ||
+       !UA_ByteString_equal(&cache->modelVersion, &key->modelVersion) || !UA_NodeId_equal(&cache->root, &key->root) ||
+       !UA_NodeId_equal(&cache->nodes[0].nodeId, &key->root) || cache->nodes[0].parent != 0)
+        return false;
+
+    for(size_t i = 0; i < key->namespacesSize; i++)
+        if(!UA_String_equal(&cache->namespaces[i], &key->namespaces[i]))
+            return false;
+
+    for(size_t i = 1; i < cache->nodesSize; i++)
+        if(cache->nodes[i].parent >= i)
+            return false;
+
+    return true;
+}
+
+static bool crawl_cache_load(const char *path, Crawl_cache *cache)
+{
+    FILE *file = fopen(path, "rb");
+    if(file == NULL)
+        return false;
+
+    UA_ByteString buffer = UA_BYTESTRING_NULL;
+    bool loaded = false;
+    long size;
+
+    if(fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0 &&
+       UA_ByteString_allocBuffer(&buffer, (size_t)size) == UA_STATUSCODE_GOOD &&
+       fread(buffer.data, 1, buffer.length, file) == buffer.length)
+        loaded = UA_decodeBinary(&buffer, cache, &crawl_cache_type, NULL) == UA_STATUSCODE_GOOD;
+
+    UA_ByteString_clear(&buffer);
+    fclose(file);
+
+    return loaded;
+}
+
+// Written to a temporary file first, so readers never see a partial cache.
+static bool crawl_cache_save(const char *path, const Crawl_cache *key, const Crawl_tree *tree)
+{
+    Crawl_cache cache = *key;
+    cache.format = CRAWL_CACHE_FORMAT;
+    cache.nodes = tree->nodes;
+    cache.nodesSize = tree->nodes_size;
+
+    UA_ByteString buffer = UA_BYTESTRING_NULL;
+    if(UA_encodeBinary(&cache, &crawl_cache_type, &buffer) != UA_STATUSCODE_GOOD)
+        return false;
+
+    size_t path_size = strlen(path);
+    char *tmp_path = (char *)malloc(path_size + 5);
+    bool saved = false;
+
+    if(tmp_path != NULL) {
+        memcpy(tmp_path, path, path_size);
+        memcpy(tmp_path + path_size, ".tmp", 5);
+
+        FILE *file = fopen(tmp_path, "wb");
+        if(file != NULL) {
+            saved = fwrite(buffer.data, 1, buffer.length, file) == buffer.length;
+            saved = fclose(file) == 0 && saved;
+            saved = saved && rename(tmp_path, path) == 0;
+            if(!saved)
+                remove(tmp_path);
+        }
+
+        free(tmp_path);
+    }
+
+    UA_ByteString_clear(&buffer);
+    return saved;
+}
+
+// {node_id, parent, node_class, browse_name, data_type | nil, value_rank, array_dimensions, access_level}
+static void encode_crawl_node(char *resp, int *resp_index, const Crawl_node *node)
+{
+    ei_encode_tuple_header(resp, resp_index, 8);
+    encode_node_id(resp, resp_index, (void *)&node->nodeId);
+    ei_encode_ulong(resp, resp_index, node->parent);
+    ei_encode_ulong(resp, resp_index, node->nodeClass);
+    encode_qualified_name(resp, resp_index, (void *)&node->browseName);
+
+    if(UA_NodeId_isNull(&node->dataType))
+        ei_encode_atom(resp, resp_index, "nil");
+    else
+        encode_node_id(resp, resp_index, (void *)&node->dataType);
+
+    ei_encode_long(resp, resp_index, node->valueRank);
+
+    if(node->arrayDimensionsSize > 0)
+        ei_encode_list_header(resp, resp_index, (int)node->arrayDimensionsSize);
+    for(size_t i = 0; i < node->arrayDimensionsSize; i++)
+        ei_encode_ulong(resp, resp_index, node->arrayDimensions[i]);
+    ei_encode_empty_list(resp, resp_index);
+
+    ei_encode_ulong(resp, resp_index, node->accessLevel);
+}
+
+// Streams the crawled nodes (in order) as {:partial, [node]} frames, the caller answers the failure.
+static UA_StatusCode send_crawl_nodes(const Crawl_tree *tree)
+{
+    const int frame_limit = erlcmd_frame_limit();
+    int header_size = sizeof(uint16_t);
+    encode_browse_partial_header(NULL, &header_size, 1);
+
+    size_t first = 0;
+    while(first < tree->nodes_size) {
+        int frame_size = header_size + 1;   // + list tail
+        size_t end = first;
+        for(; end < tree->nodes_size; end++) {
+            int entry_size = 0;
+            encode_crawl_node(NULL, &entry_size, &tree->nodes[end]);
+            if(end > first && frame_size + entry_size > frame_limit)
+                break;
+            frame_size += entry_size;
+        }
+
+        char *resp = (char *)malloc(frame_size);
+        if(resp == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+
+        int resp_index = sizeof(uint16_t);
+        encode_browse_partial_header(resp, &resp_index, (int)(end - first));
+        for(size_t i = first; i < end; i++)
+            encode_crawl_node(resp, &resp_index, &tree->nodes[i]);
+        ei_encode_empty_list(resp, &resp_index);
+        erlcmd_send(resp, resp_index);
+
+        free(resp);
+        first = end;
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+// {:ok, {source, truncated}}
+static void send_crawl_response(const char *source, bool truncated)
+{
+    char resp[256];
+    int resp_index = sizeof(uint16_t); // Space for payload size
+    resp[resp_index++] = response_id;
+    ei_encode_version(resp, &resp_index);
+    ei_encode_tuple_header(resp, &resp_index, 3);
+    encode_caller_metadata(resp, &resp_index);
+    ei_encode_tuple_header(resp, &resp_index, 2);
+    ei_encode_atom(resp, &resp_index, "ok");
+    ei_encode_tuple_header(resp, &resp_index, 2);
+    ei_encode_atom(resp, &resp_index, source);
+    ei_encode_boolean(resp, &resp_index, truncated);
+    erlcmd_send(resp, resp_index);
+}
+
+/*
+ *  Crawls the address space below a node, or loads it from a cache file.
+ *  Input: {root_node_id, cache_path ("" = no cache), model_version_node_id (null = none), validate,
+ *          max_depth (0 = unlimited), max_nodes}
+ *  Output: {:partial, [node]} frames, then {:ok, {:cache | :validated | :crawled, truncated}} or {:error, reason}
+ */
+static void handle_crawl(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    int validate;
+    unsigned long max_depth;
+    unsigned long max_nodes;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 6)
+        errx(EXIT_FAILURE, ":handle_crawl requires a 6-tuple, term_size = %d", term_size);
+
+    UA_NodeId root = assemble_node_id(req, req_index);
+
+    if(ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid cache path (size)");
+
+    char *cache_path = (char *)malloc(term_size + 1);
+    long binary_len;
+    if(cache_path == NULL || ei_decode_binary(req, req_index, cache_path, &binary_len) < 0)
+        errx(EXIT_FAILURE, "Invalid cache path");
+    cache_path[binary_len] = '\0';
+
+    UA_NodeId model_version = assemble_node_id(req, req_index);
+
+    if(ei_decode_boolean(req, req_index, &validate) < 0 ||
+       ei_decode_ulong(req, req_index, &max_depth) < 0 ||
+       ei_decode_ulong(req, req_index, &max_nodes) < 0 ||
+       max_nodes == 0 || max_nodes > MAX_CRAWL_NODES) {
+        UA_NodeId_clear(&model_version);
+        UA_NodeId_clear(&root);
+        free(cache_path);
+        send_error_response("einval");
+        return;
+    }
+
+    crawl_types_init();
+
+    Crawl_cache key;
+    Crawl_cache cache;
+    Crawl_tree tree;
+    Crawl_tree previous;
+    memset(&key, 0, sizeof(Crawl_cache));
+    memset(&cache, 0, sizeof(Crawl_cache));
+    memset(&tree, 0, sizeof(Crawl_tree));
+    memset(&previous, 0, sizeof(Crawl_tree));
+
+    const char *source = "crawled";
+    bool truncated = false;
+    bool use_cache = cache_path[0] != '\0';
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    key.root = root;
+    if(use_cache)
+        retval = crawl_read_cache_key(&key, &model_version);
+
+    bool cached = use_cache && retval == UA_STATUSCODE_GOOD && crawl_cache_load(cache_path, &cache) &&
+                  crawl_cache_matches(&cache, &key);
+
+    if(cached && !validate) {
+        source = "cache";
+        retval = crawl_tree_from_cache(&tree, &cache);
+    }
+    else if(retval == UA_STATUSCODE_GOOD) {
+        if(cached) {
+            source = "validated";
+            retval = crawl_tree_from_cache(&previous, &cache);
+        }
+
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = crawl_address_space(&tree, &root, cached ? &previous : NULL, (UA_UInt32)max_depth, max_nodes,
+                                         &truncated);
+
+        // A truncated crawl (max_nodes or nodes that failed to browse) is not complete, so it is not worth caching.
+        if(retval == UA_STATUSCODE_GOOD && use_cache && !truncated)
+            crawl_cache_save(cache_path, &key, &tree);
+    }
+
+    // The nodes streamed before a failure are dropped by the caller
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = send_crawl_nodes(&tree);
+
+    if(retval == UA_STATUSCODE_GOOD)
+        send_crawl_response(source, truncated);
+    else
+        send_opex_response(retval);
+
+    key.root = UA_NODEID_NULL;  // owned by root
+    UA_clear(&key, &crawl_cache_type);
+    UA_clear(&cache, &crawl_cache_type);
+    crawl_tree_clear(&tree);
+    crawl_tree_clear(&previous);
+    UA_NodeId_clear(&model_version);
+    UA_NodeId_clear(&root);
+    free(cache_path);
+}
+
+/******************/
+/* Polling Engine */
+/******************/
+
+/*
+ *  Poll groups read a set of nodes at a fixed rate with one batched (async) Read per cycle and
+ *  report only the values that changed since the last report, as one {:poll, {:data, group_id, changes}}
+ *  frame per cycle. The first cycle of every group is delayed by a random offset within its
+ *  interval, so groups registered together do not hit the server at the same time.
+ */
+#define POLL_ITERATE_TIMEOUT_MS 10
+#define MAX_POLL_GROUP_NODES 1000
+
+typedef struct Poll_group {
+    UA_UInt32 id;
+    UA_UInt64 callback_id;
+    UA_Double interval;                 // ms
+    UA_Double deadband;                 // absolute, numeric scalars only (0 = any change)
+    bool scheduled;                     // repeated callback registered
+    bool in_flight;                     // a Read is pending
+    size_t nodes_size;
+    UA_ReadValueId *nodes;
+    UA_DataValue *last_values;          // last reported values
+    bool *reported;
+    struct Poll_group *next;
+} Poll_group;
+
+static Poll_group *poll_groups = NULL;
+static UA_UInt32 next_poll_group_id = 1;
+
+static Poll_group *find_poll_group(UA_UInt32 group_id)
+{
+    Poll_group *group = poll_groups;
+    while(group != NULL && group->id != group_id)
+        group = group->next;
+
+    return group;
+}
+
+static void free_poll_group(Poll_group *group)
+{
+    UA_Array_delete(group->nodes, group->nodes_size, &UA_TYPES[UA_TYPES_READVALUEID]);
+    UA_Array_delete(group->last_values, group->nodes_size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+    free(group->reported);
+    free(group);
+}
+
+/*
+ *  Drops every poll group, their callbacks are removed with the client when client_deleted.
+ */
+static void poll_groups_clear(bool client_deleted)
+{
+    while(poll_groups != NULL) {
+        Poll_group *next = poll_groups->next;
+        if(!client_deleted)
+            UA_Client_removeCallback(client, poll_groups->callback_id);
+        free_poll_group(poll_groups);
+        poll_groups = next;
+    }
+}
+
+static void poll_groups_drop_types(const UA_DataTypeArray *chain)
+{
+    for(Poll_group *group = poll_groups; group != NULL; group = group->next) {
+        for(size_t i = 0; i < group->nodes_size; i++) {
+            if(variant_uses_types(&group->last_values[i].value, chain)) {
+                UA_DataValue_clear(&group->last_values[i]);
+                group->reported[i] = false;
+            }
+        }
+    }
+}
+
+static bool variant_to_double(const UA_Variant *value, double *number)
+{
+    if(!UA_Variant_isScalar(value))
+        return false;
+
+    switch(value->type->typeKind) {
+        case UA_DATATYPEKIND_SBYTE: *number = *(UA_SByte *)value->data; return true;
+        case UA_DATATYPEKIND_BYTE: *number = *(UA_Byte *)value->data; return true;
+        case UA_DATATYPEKIND_INT16: *number = *(UA_Int16 *)value->data; return true;
+        case UA_DATATYPEKIND_UINT16: *number = *(UA_UInt16 *)value->data; return true;
+        case UA_DATATYPEKIND_INT32: *number = *(UA_Int32 *)value->data; return true;
+        case UA_DATATYPEKIND_UINT32: *number = *(UA_UInt32 *)value->data; return true;
+        case UA_DATATYPEKIND_INT64: *number = (double)*(UA_Int64 *)value->data; return true;
+        case UA_DATATYPEKIND_UINT64: *number = (double)*(UA_UInt64 *)value->data; return true;
+        case UA_DATATYPEKIND_FLOAT: *number = *(UA_Float *)value->data; return true;
+        case UA_DATATYPEKIND_DOUBLE: *number = *(UA_Double *)value->data; return true;
+        default: return false;
+    }
+}
+
+/*
+ *  Values are compared against the last reported one, so slow drifts are reported once they
+ *  accumulate beyond the deadband.
+ */
+static bool poll_value_changed(Poll_group *group, size_t index, const UA_DataValue *value)
+{
+    UA_DataValue *last = &group->last_values[index];
+    double last_number, number;
+
+    if(!group->reported[index] || last->status != value->status)
+        return true;
+
+    if(group->deadband > 0 && variant_to_double(&last->value, &last_number) && variant_to_double(&value->value, &number)) {
+        double delta = number - last_number;
+        return (delta < 0 ? -delta : delta) > group->deadband;
+    }
+
+    return UA_order(&last->value, &value->value, &UA_TYPES[UA_TYPES_VARIANT]) != UA_ORDER_EQ;
+}
+
+// {node_id, {:ok, value} | {:error, reason}}
+static void encode_poll_entry(char *resp, int *resp_index, const UA_NodeId *node_id, const UA_DataValue *value, bool overflow)
+{
+    ei_encode_tuple_header(resp, resp_index, 2);
+    encode_node_id(resp, resp_index, (void *)node_id);
+    ei_encode_tuple_header(resp, resp_index, 2);
+
+    if(overflow || (value->hasStatus && value->status != UA_STATUSCODE_GOOD)) {
+        const char *status = UA_StatusCode_name(overflow ? UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED : value->status);
+        ei_encode_atom(resp, resp_index, "error");
+        ei_encode_binary(resp, resp_index, status, strlen(status));
+        return;
+    }
+
+    ei_encode_atom(resp, resp_index, "ok");
+    encode_variant_struct(resp, resp_index, (void *)&value->value);
+}
+
+// {:poll, {:data, group_id, [entries]}}
+static void encode_poll_header(char *resp, int *resp_index, UA_UInt32 group_id, int entries)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "poll");
+    ei_encode_tuple_header(resp, resp_index, 3);
+    ei_encode_atom(resp, resp_index, "data");
+    ei_encode_ulong(resp, resp_index, group_id);
+    ei_encode_list_header(resp, resp_index, entries);
+}
+
+/*
+ *  Sends the changed values of a cycle, split in as few frames as the {:packet, 2} limit allows.
+ */
+static void send_poll_notifications(Poll_group *group, const size_t *changed, size_t changed_size)
+{
+    const int frame_limit = erlcmd_frame_limit();
+    int header_size = sizeof(uint16_t);
+    encode_poll_header(NULL, &header_size, group->id, 1);
+
+    size_t start = 0;
+    while(start < changed_size) {
+        int frame_size = header_size + 1;   // + list tail
+        size_t end = start;
+
+        for(; end < changed_size; end++) {
+            size_t index = changed[end];
+            int entry_size = 0;
+            encode_poll_entry(NULL, &entry_size, &group->nodes[index].nodeId, &group->last_values[index], false);
+
+            if(frame_size + entry_size > frame_limit) {
+                if(end == start) {
+                    // A single value larger than a frame is reported as an error.
+                    entry_size = 0;
+                    encode_poll_entry(NULL, &entry_size, &group->nodes[index].nodeId, &group->last_values[index], true);
+                    frame_size += entry_size;
+                    end++;
+                }
+                break;
+            }
+
+            frame_size += entry_size;
+        }
+
+        char *resp = (char *)malloc(frame_size);
+        if(resp == NULL)
+            return;
+
+        int resp_index = sizeof(uint16_t);
+        encode_poll_header(resp, &resp_index, group->id, (int)(end - start));
+        for(size_t i = start; i < end; i++) {
+            size_t index = changed[i];
+            int entry_size = 0;
+            encode_poll_entry(NULL, &entry_size, &group->nodes[index].nodeId, &group->last_values[index], false);
+            encode_poll_entry(resp, &resp_index, &group->nodes[index].nodeId, &group->last_values[index],
+                              resp_index + entry_size + 1 > frame_size);
+        }
+        ei_encode_empty_list(resp, &resp_index);
+        erlcmd_send(resp, resp_index);
+        notifications_sent += end - start;
+
+        free(resp);
+        start = end;
+    }
+}
+
+static void poll_group_read_callback(UA_Client *client, void *userdata, UA_UInt32 requestId, UA_ReadResponse *response)
+{
+    // The group may have been deleted while the Read was pending.
+    Poll_group *group = find_poll_group((UA_UInt32)(uintptr_t)userdata);
+    if(group == NULL)
+        return;
+
+    group->in_flight = false;
+
+    if(response->responseHeader.serviceResult != UA_STATUSCODE_GOOD || response->resultsSize != group->nodes_size)
+        return;
+
+    size_t *changed = (size_t *)malloc(group->nodes_size * sizeof(size_t));
+    if(changed == NULL)
+        return;
+
+    size_t changed_size = 0;
+    for(size_t i = 0; i < group->nodes_size; i++) {
+        if(!poll_value_changed(group, i, &response->results[i]))
+            continue;
+
+        UA_DataValue_clear(&group->last_values[i]);
+        UA_DataValue_copy(&response->results[i], &group->last_values[i]);
+        group->reported[i] = true;
+        changed[changed_size++] = i;
+    }
+
+    if(changed_size > 0)
+        send_poll_notifications(group, changed, changed_size);
+
+    free(changed);
+}
+
+static void poll_group_cycle(UA_Client *client, void *data)
+{
+    Poll_group *group = find_poll_group((UA_UInt32)(uintptr_t)data);
+    if(group == NULL)
+        return;
+
+    // The first (jittered) cycle is a timed callback, the fixed rate starts from it.
+    if(!group->scheduled)
+        group->scheduled = UA_Client_addRepeatedCallback(client, poll_group_cycle, data, group->interval,
+                                                         &group->callback_id) == UA_STATUSCODE_GOOD;
+
+    // Skip cycles while a Read is pending (slow server) or there is no session.
+    UA_SessionState sessionState;
+    UA_Client_getState(client, NULL, &sessionState, NULL);
+    if(group->in_flight || sessionState != UA_SESSIONSTATE_ACTIVATED)
+        return;
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = group->nodes;
+    request.nodesToReadSize = group->nodes_size;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+
+    if(UA_Client_sendAsyncReadRequest(client, &request, poll_group_read_callback, data, NULL) == UA_STATUSCODE_GOOD)
+        group->in_flight = true;
+}
+
+/*
+ *  Registers a poll group.
+ *  Input: {interval_ms, deadband, [node_id]} (1 to 1000 nodes)
+ *  Output: {:ok, group_id} | {:error, reason}
+ */
+static void handle_add_poll_group(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    double interval;
+    double deadband;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_add_poll_group requires a 3-tuple, term_size = %d", term_size);
+
+    if(ei_decode_double(req, req_index, &interval) < 0 || interval < POLL_ITERATE_TIMEOUT_MS ||
+       ei_decode_double(req, req_index, &deadband) < 0 || deadband < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    int list_count;
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":handle_add_poll_group requires a list of nodes");
+
+    int node_count = list_count;
+    if(node_count == 0 || node_count > MAX_POLL_GROUP_NODES) {
+        send_error_response("einval");
+        return;
+    }
+
+    Poll_group *group = (Poll_group *)calloc(1, sizeof(Poll_group));
+    if(group == NULL) {
+        send_error_response("enomem");
+        return;
+    }
+
+    group->nodes_size = node_count;
+    group->nodes = (UA_ReadValueId *)UA_Array_new(node_count, &UA_TYPES[UA_TYPES_READVALUEID]);
+    group->last_values = (UA_DataValue *)UA_Array_new(node_count, &UA_TYPES[UA_TYPES_DATAVALUE]);
+    group->reported = (bool *)calloc(node_count, sizeof(bool));
+    if(group->nodes == NULL || group->last_values == NULL || group->reported == NULL) {
+        free_poll_group(group);
+        send_error_response("enomem");
+        return;
+    }
+
+    for(int i = 0; i < node_count; i++) {
+        group->nodes[i].nodeId = assemble_node_id(req, req_index);
+        group->nodes[i].attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    group->id = next_poll_group_id++;
+    group->interval = interval;
+    group->deadband = deadband;
+
+    UA_DateTime first_cycle = UA_DateTime_nowMonotonic() +
+        (UA_DateTime)(rand() % (int)interval) * UA_DATETIME_MSEC;
+
+    UA_StatusCode retval = UA_Client_addTimedCallback(client, poll_group_cycle, (void *)(uintptr_t)group->id,
+                                                      first_cycle, &group->callback_id);
+    if(retval != UA_STATUSCODE_GOOD) {
+        free_poll_group(group);
+        send_opex_response(retval);
+        return;
+    }
+
+    group->next = poll_groups;
+    poll_groups = group;
+
+    send_data_response(&group->id, 27, 0);
+}
+
+static void handle_delete_poll_group(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long group_id;
+    if(ei_decode_ulong(req, req_index, &group_id) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    Poll_group **link = &poll_groups;
+    while(*link != NULL && (*link)->id != group_id)
+        link = &(*link)->next;
+
+    Poll_group *group = *link;
+    if(group == NULL) {
+        send_error_response("einval");
+        return;
+    }
+
+    *link = group->next;
+    UA_Client_removeCallback(client, group->callback_id);
+    free_poll_group(group);
+
+    send_ok_response();
+}
+
+/***********************************************/
+/* Subscriptions and Monitored Items functions */
+/***********************************************/
+
+/*  Subscriptions
+ *
+ *  Subscriptions in OPC UA are asynchronous. That is, the client sends several PublishRequests to the server. 
+ *  The server returns PublishResponses with notifications. But only when a notification has been generated. 
+ *  The client does not wait for the responses and continues normal operations.
+ *  Note the difference between Subscriptions and MonitoredItems. Subscriptions are used to report back notifications. 
+ *  MonitoredItems are used to generate notifications. Every MonitoredItem is attached to exactly one Subscription. 
+ *  And a Subscription can contain many MonitoredItems.
+ */
+
+void handle_add_subscription(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_CreateSubscriptionResponse response;
+
+    double publishing_interval;
+    if (ei_decode_double(req, req_index, &publishing_interval) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_ClientConfig *client_config = UA_Client_getConfig(client);
+    client_config->subscriptionInactivityCallback = subscriptionInactivityCallback;
+
+    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+    request.requestedPublishingInterval = (UA_Double) publishing_interval;
+    response = UA_Client_Subscriptions_create(client, request, NULL, NULL, deleteSubscriptionCallback);
+
+    if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
+        send_opex_response(response.responseHeader.serviceResult);
+        return;
+    }
+
+    mirror_add_subscription(response.subscriptionId, (UA_Double) publishing_interval);
+    send_data_response(&(response.subscriptionId), 27, 0);
+}
+
+void handle_delete_subscription(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long subscription_id;
+    if (ei_decode_ulong(req, req_index, &subscription_id) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    // Reported even during an outage
+    mirror_remove_subscription((UA_UInt32) subscription_id);
+    UA_StatusCode retval = UA_Client_Subscriptions_deleteSingle(client, (UA_UInt32) subscription_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/*  Monitored Items
+ *
+ *  Subscriptions in OPC UA are asynchronous. That is, the client sends several PublishRequests to the server. 
+ *  The server returns PublishResponses with notifications. But only when a notification has been generated. 
+ *  The client does not wait for the responses and continues normal operations.
+ *  Note the difference between Subscriptions and MonitoredItems. Subscriptions are used to report back notifications. 
+ *  MonitoredItems are used to generate notifications. Every MonitoredItem is attached to exactly one Subscription. 
+ *  And a Subscription can contain many MonitoredItems.
+ */
+
+void handle_add_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_MonitoredItemCreateResult monitored_item_response;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_add_monitored_item requires a 3-tuple, term_size = %d", term_size);
+
+    UA_NodeId monitored_node = assemble_node_id(req, req_index);
+
+    unsigned long subscription_id;
+    if (ei_decode_ulong(req, req_index, &subscription_id) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    double sampling_interval;
+    if (ei_decode_double(req, req_index, &sampling_interval) < 0) {
+        send_error_response("einval");
+        return;
+    }
+    
+    UA_MonitoredItemCreateRequest monitored_item_request = UA_MonitoredItemCreateRequest_default(monitored_node);
+
+    monitored_item_request.requestedParameters.samplingInterval = (UA_Double) sampling_interval;
+
+    // The monitored NodeId keys the last value cache. The context is owned by the item and
+    // released in deleteMonitoredItemCallback, which the stack also calls for failed items.
+    Monitored_item_context *monitored_context = (Monitored_item_context *)calloc(1, sizeof(Monitored_item_context));
+    if(monitored_context == NULL) {
+        UA_NodeId_clear(&monitored_node);
+        send_error_response("enomem");
+        return;
+    }
+    UA_NodeId_copy(&monitored_node, &monitored_context->node_id);
+
+    // Registered before the request, so the initial notification is never missed.
+    value_cache_retain(&monitored_context->node_id);
+    monitored_context->cached = true;
+
+    monitored_item_response = UA_Client_MonitoredItems_createDataChange(client, subscription_id,
+                                                                        UA_TIMESTAMPSTORETURN_BOTH, monitored_item_request,
+                                                                        monitored_context, dataChangeNotificationCallback, deleteMonitoredItemCallback);
+
+    if(monitored_item_response.statusCode == UA_STATUSCODE_GOOD)
+        mirror_add_item((UA_UInt32) subscription_id, monitored_item_response.monitoredItemId, false, &monitored_item_request);
+
+    UA_NodeId_clear(&monitored_node);
+
+    if(monitored_item_response.statusCode != UA_STATUSCODE_GOOD) {
+        send_opex_response(monitored_item_response.statusCode);
+        return;
+    }
+
+    send_data_response(&(monitored_item_response.monitoredItemId), 27, 0);
+}
+
+void handle_delete_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_delete_monitored_item requires a 2-tuple, term_size = %d", term_size);
+
+    unsigned long subscription_id;
+    if (ei_decode_ulong(req, req_index, &subscription_id) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    unsigned long monitored_item_id;
+    if (ei_decode_ulong(req, req_index, &monitored_item_id) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    mirror_remove_item((UA_UInt32) subscription_id, (UA_UInt32) monitored_item_id);
+    retval = UA_Client_MonitoredItems_deleteSingle(client, (UA_UInt32) subscription_id, (UA_UInt32) monitored_item_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/**********/
+/* Events */
+/**********/
+
+/*
+ *  Event monitored items. The server filters the events with the where clause and only sends the
+ *  selected fields; notifications are encoded as they arrive into a single frame, which is sent
+ *  once the client iteration (so the whole PublishResponse) has been processed or when it is full.
+ *  Frame: {:subscription, {:events, [{subscription_id, monitored_id, [field]}]}}
+ */
+#define MAX_EVENT_SELECT_CLAUSES 64
+#define MAX_EVENT_WHERE_ELEMENTS 64
+
+static char event_frame[ERLCMD_BUF_SIZE * 2];
+static int event_frame_index = 0;       // end of the encoded events, 0: no events
+static int event_frame_count = 0;
+static size_t event_items = 0;          // the client iterates on its own while there are event items
+
+static void encode_events_header(char *resp, int *resp_index, int count)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "subscription");
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "events");
+    ei_encode_list_header(resp, resp_index, count);
+}
+
+// Size of the header of a frame with events, the list header does not depend on the count.
+static int events_header_size()
+{
+    int header_size = sizeof(uint16_t);
+    encode_events_header(NULL, &header_size, 1);
+
+    return header_size;
+}
+
+static void encode_event(char *resp, int *resp_index, UA_UInt32 subscription_id, UA_UInt32 monitored_id,
+                         size_t fields_size, UA_Variant *fields)
+{
+    ei_encode_tuple_header(resp, resp_index, 3);
+    ei_encode_ulong(resp, resp_index, subscription_id);
+    ei_encode_ulong(resp, resp_index, monitored_id);
+
+    if(fields == NULL) {
+        const char *status = UA_StatusCode_name(UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED);
+        ei_encode_tuple_header(resp, resp_index, 2);
+        ei_encode_atom(resp, resp_index, "error");
+        ei_encode_binary(resp, resp_index, status, strlen(status));
+        return;
+    }
+
+    ei_encode_list_header(resp, resp_index, (int)fields_size);
+    for(size_t i = 0; i < fields_size; i++)
+        encode_variant_struct(resp, resp_index, &fields[i]);
+    ei_encode_empty_list(resp, resp_index);
+}
+
+static void events_flush()
+{
+    if(event_frame_count == 0)
+        return;
+
+    int resp_index = sizeof(uint16_t);
+    encode_events_header(event_frame, &resp_index, event_frame_count);
+    ei_encode_empty_list(event_frame, &event_frame_index);
+    erlcmd_send(event_frame, event_frame_index);
+    notifications_sent += event_frame_count;
+
+    event_frame_index = 0;
+    event_frame_count = 0;
+}
+
+static void eventNotificationCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id,
+                                      void *monContext, size_t nEventFields, UA_Variant *eventFields)
+{
+    if(callback_defer(CALLBACK_EVENT, subscription_id, monitored_id, NULL, NULL, nEventFields, eventFields))
+        return;
+
+    mirror_event_notified(subscription_id, monitored_id, nEventFields, eventFields);
+
+    // One byte is left for the list tail
+    int frame_limit = erlcmd_frame_limit() - 1;
+    int header_size = events_header_size();
+
+    int event_size = 0;
+    encode_event(NULL, &event_size, subscription_id, monitored_id, nEventFields, eventFields);
+
+    if(event_frame_count > 0 && event_frame_index + event_size > frame_limit)
+        events_flush();
+
+    // An event too large for a frame is reported without its fields
+    if(header_size + event_size > frame_limit)
+        eventFields = NULL;
+
+    if(event_frame_count == 0)
+        event_frame_index = header_size;
+
+    encode_event(event_frame, &event_frame_index, subscription_id, monitored_id, nEventFields, eventFields);
+    event_frame_count++;
+}
+
+static void deleteEventItemCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id, void *monContext)
+{
+    if(callback_defer(CALLBACK_EVENT_ITEM_DELETED, subscription_id, monitored_id, NULL, NULL, 0, NULL))
+        return;
+
+    event_items--;
+
+    if(mirror_item_dropped(subscription_id, monitored_id))
+        return;
+
+    send_monitored_item_delete_response(&subscription_id, &monitored_id);
+}
+
+/*
+ *  Input: {type_definition_id, [browse_name], attribute_id}
+ */
+static UA_StatusCode assemble_event_attribute(const char *req, int *req_index, UA_SimpleAttributeOperand *attribute)
+{
+    int term_size;
+    int list_count;
+    unsigned long attribute_id;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":assemble_event_attribute requires a 3-tuple, term_size = %d", term_size);
+
+    attribute->typeDefinitionId = assemble_node_id(req, req_index);
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        errx(EXIT_FAILURE, ":assemble_event_attribute requires a list of browse names");
+
+    if(list_count > 0) {
+        attribute->browsePath = (UA_QualifiedName *)UA_Array_new(list_count, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]);
+        if(attribute->browsePath == NULL)
+            errx(EXIT_FAILURE, ":assemble_event_attribute out of memory");
+        attribute->browsePathSize = list_count;
+
+        for(int i = 0; i < list_count; i++)
+            attribute->browsePath[i] = assemble_qualified_name(req, req_index);
+
+        // Decode list tail
+        ei_decode_list_header(req, req_index, &list_count);
+    }
+
+    if(ei_decode_ulong(req, req_index, &attribute_id) < 0 || attribute_id == 0 ||
+       attribute_id > UA_ATTRIBUTEID_ACCESSLEVELEX)
+        return UA_STATUSCODE_BADATTRIBUTEIDINVALID;
+
+    attribute->attributeId = (UA_UInt32)attribute_id;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  Input: {:element, index} | {:literal, {data_type, is_array, value}} | {:attribute, attribute}
+ */
+static UA_StatusCode assemble_event_operand(const char *req, int *req_index, UA_ExtensionObject *operand)
+{
+    int term_size;
+    char kind[MAXATOMLEN];
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2 ||
+        ei_decode_atom(req, req_index, kind) < 0)
+        errx(EXIT_FAILURE, ":assemble_event_operand requires a 2-tuple with a kind");
+
+    if(!strcmp(kind, "element")) {
+        unsigned long index;
+        if(ei_decode_ulong(req, req_index, &index) < 0 || index >= MAX_EVENT_WHERE_ELEMENTS)
+            return UA_STATUSCODE_BADFILTEROPERANDINVALID;
+
+        UA_ElementOperand *element = UA_ElementOperand_new();
+        if(element == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        element->index = (UA_UInt32)index;
+        UA_ExtensionObject_setValue(operand, element, &UA_TYPES[UA_TYPES_ELEMENTOPERAND]);
+    } else if(!strcmp(kind, "literal")) {
+        UA_LiteralOperand *literal = UA_LiteralOperand_new();
+        if(literal == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        retval = assemble_variant(req, req_index, &literal->value);
+        UA_ExtensionObject_setValue(operand, literal, &UA_TYPES[UA_TYPES_LITERALOPERAND]);
+    } else if(!strcmp(kind, "attribute")) {
+        UA_SimpleAttributeOperand *attribute = UA_SimpleAttributeOperand_new();
+        if(attribute == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        retval = assemble_event_attribute(req, req_index, attribute);
+        UA_ExtensionObject_setValue(operand, attribute, &UA_TYPES[UA_TYPES_SIMPLEATTRIBUTEOPERAND]);
+    } else {
+        retval = UA_STATUSCODE_BADFILTEROPERANDINVALID;
+    }
+
+    return retval;
+}
+
+/*
+ *  Decodes the select and where clauses of an EventFilter, stopping at the first invalid one.
+ *  Input: [attribute], [{operator, [operand]}]
+ */
+static UA_StatusCode assemble_event_filter(const char *req, int *req_index, UA_EventFilter *filter)
+{
+    int list_count;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0 ||
+       list_count == 0 || list_count > MAX_EVENT_SELECT_CLAUSES)
+        return UA_STATUSCODE_BADEVENTFILTERINVALID;
+
+    filter->selectClauses = (UA_SimpleAttributeOperand *)UA_Array_new(list_count, &UA_TYPES[UA_TYPES_SIMPLEATTRIBUTEOPERAND]);
+    if(filter->selectClauses == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    filter->selectClausesSize = list_count;
+
+    for(int i = 0; i < list_count && retval == UA_STATUSCODE_GOOD; i++)
+        retval = assemble_event_attribute(req, req_index, &filter->selectClauses[i]);
+
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0 || list_count > MAX_EVENT_WHERE_ELEMENTS)
+        return UA_STATUSCODE_BADCONTENTFILTERINVALID;
+
+    if(list_count == 0)
+        return UA_STATUSCODE_GOOD;
+
+    UA_ContentFilter *where = &filter->whereClause;
+    where->elements = (UA_ContentFilterElement *)UA_Array_new(list_count, &UA_TYPES[UA_TYPES_CONTENTFILTERELEMENT]);
+    if(where->elements == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    where->elementsSize = list_count;
+
+    for(int i = 0; i < list_count && retval == UA_STATUSCODE_GOOD; i++) {
+        int term_size;
+        int operands_count;
+        unsigned long filter_operator;
+
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 2)
+            errx(EXIT_FAILURE, ":assemble_event_filter requires 2-tuple elements, term_size = %d", term_size);
+
+        if(ei_decode_ulong(req, req_index, &filter_operator) < 0 || filter_operator > UA_FILTEROPERATOR_BITWISEOR ||
+           ei_decode_list_header(req, req_index, &operands_count) < 0 || operands_count == 0)
+            return UA_STATUSCODE_BADFILTEROPERATORINVALID;
+
+        UA_ContentFilterElement *element = &where->elements[i];
+        element->filterOperator = (UA_FilterOperator)filter_operator;
+        element->filterOperands = (UA_ExtensionObject *)UA_Array_new(operands_count, &UA_TYPES[UA_TYPES_EXTENSIONOBJECT]);
+        if(element->filterOperands == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        element->filterOperandsSize = operands_count;
+
+        for(int j = 0; j < operands_count && retval == UA_STATUSCODE_GOOD; j++)
+            retval = assemble_event_operand(req, req_index, &element->filterOperands[j]);
+
+        // Decode list tail
+        if(retval == UA_STATUSCODE_GOOD)
+            ei_decode_list_header(req, req_index, &operands_count);
+    }
+
+    return retval;
+}
+
+/*
+ *  Adds a monitored item for the events emitted by a node (usually the Server object). Its
+ *  notifications carry the selected fields of the events matching the where clause.
+ *  Input: {node_id, subscription_id, sampling_interval, queue_size, [select_attribute], [where_element]}
+ */
+void handle_add_event_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    unsigned long subscription_id;
+    unsigned long queue_size;
+    double sampling_interval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 6)
+        errx(EXIT_FAILURE, ":handle_add_event_monitored_item requires a 6-tuple, term_size = %d", term_size);
+
+    UA_NodeId monitored_node = assemble_node_id(req, req_index);
+
+    if(ei_decode_ulong(req, req_index, &subscription_id) < 0 ||
+       ei_decode_double(req, req_index, &sampling_interval) < 0 ||
+       ei_decode_ulong(req, req_index, &queue_size) < 0 || queue_size > UA_UINT32_MAX) {
+        UA_NodeId_clear(&monitored_node);
+        send_error_response("einval");
+        return;
+    }
+
+    UA_EventFilter *filter = UA_EventFilter_new();
+    if(filter == NULL) {
+        UA_NodeId_clear(&monitored_node);
+        send_error_response("enomem");
+        return;
+    }
 
-    char password[term_size + 1];
-    if (ei_decode_binary(req, req_index, password, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid password");
-    password[binary_len] = '\0';
+    // The request owns the node id and the filter
+    UA_MonitoredItemCreateRequest item = UA_MonitoredItemCreateRequest_default(monitored_node);
+    item.itemToMonitor.attributeId = UA_ATTRIBUTEID_EVENTNOTIFIER;
+    item.requestedParameters.samplingInterval = (UA_Double)sampling_interval;
+    item.requestedParameters.queueSize = (UA_UInt32)queue_size;
+    item.requestedParameters.discardOldest = true;
+    UA_ExtensionObject_setValue(&item.requestedParameters.filter, filter, &UA_TYPES[UA_TYPES_EVENTFILTER]);
 
-    // v1.4.x: Function renamed to camelCase
-    UA_StatusCode retval = UA_Client_connectUsername(client, url, username, password);
+    UA_StatusCode retval = assemble_event_filter(req, req_index, filter);
     if(retval != UA_STATUSCODE_GOOD) {
+        UA_MonitoredItemCreateRequest_clear(&item);
         send_opex_response(retval);
         return;
     }
-    
-    send_ok_response();
-}
 
-/* Connect to the server secure channel without creating a session.
- *
- * @return Indicates whether the operation succeeded or returns an error code */
-static void handle_connect_client_secure_channel(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    int term_size;
-    int term_type;
-    long binary_len = 0; 
+    // Released in deleteEventItemCallback, which the stack also calls for failed items.
+    event_items++;
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid url (size)");
+    UA_MonitoredItemCreateResult result = UA_Client_MonitoredItems_createEvent(client, (UA_UInt32)subscription_id,
+                                                                              UA_TIMESTAMPSTORETURN_BOTH, item, NULL,
+                                                                              eventNotificationCallback, deleteEventItemCallback);
+    if(result.statusCode == UA_STATUSCODE_GOOD)
+        mirror_add_item((UA_UInt32)subscription_id, result.monitoredItemId, true, &item);
+    UA_MonitoredItemCreateRequest_clear(&item);
+
+    retval = result.statusCode;
+    UA_UInt32 monitored_item_id = result.monitoredItemId;
+    UA_MonitoredItemCreateResult_clear(&result);
 
-    char url[term_size + 1];
-    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid url");
-    url[binary_len] = '\0';
-    
-    // v1.4.x: Use UA_Client_connectSecureChannel to connect only the secure channel without creating a session
-    UA_StatusCode retval = UA_Client_connectSecureChannel(client, url);
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
         return;
     }
 
-    send_ok_response();
+    send_data_response(&monitored_item_id, 27, 0);
 }
 
-/* Disconnect and close a connection to the selected server.
- *
- * @return Indicates whether the operation succeeded or returns an error code */
-static void handle_disconnect_client(void *entity, bool entity_type, const char *req, int *req_index)
+/***********************/
+/* Connection recovery */
+/***********************/
+
+#define RECOVERY_REPORT_ITEMS 1000
+
+static bool reconnect_active(const Reconnect *state)
 {
-    
-    UA_StatusCode retval = UA_Client_disconnect(client);
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
-    
-    send_ok_response();
+    return state->phase == RECONNECT_CONNECTING || state->phase == RECONNECT_BACKOFF ||
+           (state->enabled && state->phase == RECONNECT_CONNECTED);
 }
 
-/**************/
-/* Encryption */
-/**************/
+// Sequence numbers wrap around after UA_UINT32_MAX (to 1), so they are compared in serial
+// number arithmetic.
+static bool sequence_after(UA_UInt32 a, UA_UInt32 b)
+{
+    return (UA_Int32)(a - b) > 0;
+}
 
-/* 
- *   Creates a client configuration with all security policies for the given certificates.
+static UA_UInt32 sequence_next(UA_UInt32 sequence_number)
+{
+    return sequence_number == UA_UINT32_MAX ? 1 : sequence_number + 1;
+}
+
+static int compare_sequence_numbers(const void *a, const void *b)
+{
+    UA_UInt32 x = *(const UA_UInt32 *)a;
+    UA_UInt32 y = *(const UA_UInt32 *)b;
+    return sequence_after(x, y) - sequence_after(y, x);
+}
+
+/*
+ *  GetMonitoredItems: {serverHandles, clientHandles} of a subscription, the notifications of
+ *  republished messages only carry client handles.
  */
-static void handle_set_config_with_security_policies(void *entity, bool entity_type, const char *req, int *req_index)
+static UA_Variant *recovery_get_handles(UA_UInt32 subscription_id, size_t *output_size)
 {
-    int term_size;
-    int term_type;
-    char *arg1;
-    char *arg2;
-    long binary_len;
-    unsigned long security_mode = 1;
+    UA_Variant input;
+    UA_Variant_setScalar(&input, &subscription_id, &UA_TYPES[UA_TYPES_UINT32]);
+
+    UA_Variant *output = NULL;
+    UA_StatusCode retval = UA_Client_call(client, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER),
+                                          UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_GETMONITOREDITEMS),
+                                          1, &input, output_size, &output);
+
+    if(retval == UA_STATUSCODE_GOOD && *output_size >= 2 &&
+       UA_Variant_hasArrayType(&output[0], &UA_TYPES[UA_TYPES_UINT32]) &&
+       UA_Variant_hasArrayType(&output[1], &UA_TYPES[UA_TYPES_UINT32]) &&
+       output[0].arrayLength == output[1].arrayLength)
+        return output;
+
+    if(output != NULL)
+        UA_Array_delete(output, *output_size, &UA_TYPES[UA_TYPES_VARIANT]);
+    *output_size = 0;
+    return NULL;
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 3)
-        errx(EXIT_FAILURE, ":handle_set_config_with_security_policies requires a 3-tuple, term_size = %d", term_size);
+static bool recovery_monitored_id(const UA_Variant *handles, UA_UInt32 client_handle, UA_UInt32 *monitored_id)
+{
+    const UA_UInt32 *server_handles = (const UA_UInt32 *)handles[0].data;
+    const UA_UInt32 *client_handles = (const UA_UInt32 *)handles[1].data;
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_ATOM_EXT)
-    {
-        if (ei_decode_ulong(req, req_index, &security_mode) < 0) {
-            send_error_response("einval");
-            return;
+    for(size_t i = 0; i < handles[1].arrayLength; i++) {
+        if(client_handles[i] == client_handle) {
+            *monitored_id = server_handles[i];
+            return true;
         }
     }
-    else
-    {
-        char nil[4];
-        if (ei_decode_atom(req, req_index, nil) < 0)
-            errx(EXIT_FAILURE, "expecting command atom");
-    }
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid certificate (size)");
+    return false;
+}
 
-    arg1 = (char *)malloc(term_size + 1);
+/*
+ *  Notifies the data changes and events of a republished message as if the stack had received it.
+ */
+static void recovery_dispatch(Mirrored_subscription *subscription, UA_NotificationMessage *message, const UA_Variant *handles)
+{
+    UA_UInt32 monitored_id;
 
-    if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid certificate");
+    for(size_t i = 0; i < message->notificationDataSize; i++) {
+        UA_ExtensionObject *notification = &message->notificationData[i];
+        if(notification->encoding < UA_EXTENSIONOBJECT_DECODED)
+            continue;
 
-    arg1[binary_len] = '\0';
+        if(notification->content.decoded.type == &UA_TYPES[UA_TYPES_DATACHANGENOTIFICATION]) {
+            UA_DataChangeNotification *data_changes = (UA_DataChangeNotification *)notification->content.decoded.data;
 
-    UA_ByteString certificate;
-    certificate.data = arg1;
-    certificate.length = binary_len;
+            for(size_t j = 0; j < data_changes->monitoredItemsSize; j++) {
+                UA_MonitoredItemNotification *data_change = &data_changes->monitoredItems[j];
+                if(!recovery_monitored_id(handles, data_change->clientHandle, &monitored_id))
+                    continue;
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid private_key (size)");
+                // Only the node id of the context is used
+                Mirrored_item *item = mirror_find_item(subscription, monitored_id);
+                Monitored_item_context context = {0};
+                if(item != NULL)
+                    context.node_id = item->request.itemToMonitor.nodeId;
 
-    arg2 = (char *)malloc(term_size + 1);
+                dataChangeNotificationCallback(client, subscription->id, NULL, monitored_id,
+                                               item != NULL ? &context : NULL, &data_change->value);
+            }
+        } else if(notification->content.decoded.type == &UA_TYPES[UA_TYPES_EVENTNOTIFICATIONLIST]) {
+            UA_EventNotificationList *events = (UA_EventNotificationList *)notification->content.decoded.data;
 
-    if (ei_decode_binary(req, req_index, arg2, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid private_key");
+            for(size_t j = 0; j < events->eventsSize; j++) {
+                UA_EventFieldList *event = &events->events[j];
+                if(!recovery_monitored_id(handles, event->clientHandle, &monitored_id))
+                    continue;
 
-    arg2[binary_len] = '\0';
+                eventNotificationCallback(client, subscription->id, NULL, monitored_id, NULL,
+                                          event->eventFieldsSize, event->eventFields);
+            }
+        }
+    }
+}
 
-    UA_ByteString private_key;
-    private_key.data = arg2;
-    private_key.length = binary_len;
+/*
+ *  {:subscription, {:gap, subscription_id, [sequence_number]}}
+ *  Messages lost during an outage: no longer retained by the server, or not deliverable.
+ */
+static void encode_gap(char *resp, int *resp_index, UA_UInt32 subscription_id, const UA_UInt32 *sequence_numbers,
+                       size_t count)
+{
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "subscription");
+    ei_encode_tuple_header(resp, resp_index, 3);
+    ei_encode_atom(resp, resp_index, "gap");
+    ei_encode_ulong(resp, resp_index, subscription_id);
+    ei_encode_list_header(resp, resp_index, count);
+    for(size_t i = 0; i < count; i++)
+        ei_encode_ulong(resp, resp_index, sequence_numbers[i]);
+    ei_encode_empty_list(resp, resp_index);
+}
 
-    /* Load the trustlist */
-    size_t trust_list_size = 0;
-    UA_ByteString *trust_list = NULL;
+static void send_gap(UA_UInt32 subscription_id, const UA_UInt32 *sequence_numbers, size_t count)
+{
+    while(count > 0) {
+        size_t chunk = count > RECOVERY_REPORT_ITEMS ? RECOVERY_REPORT_ITEMS : count;
+
+        int resp_size = sizeof(uint16_t) + 1;
+        ei_encode_version(NULL, &resp_size);
+        encode_gap(NULL, &resp_size, subscription_id, sequence_numbers, chunk);
+
+        char *resp = (char *)malloc(resp_size);
+        if(resp == NULL)
+            errx(EXIT_FAILURE, "Out of memory (gap)");
+
+        int resp_index = sizeof(uint16_t); // Space for payload size
+        resp[resp_index++] = response_id;
+        ei_encode_version(resp, &resp_index);
+        encode_gap(resp, &resp_index, subscription_id, sequence_numbers, chunk);
+        erlcmd_send(resp, resp_index);
+        free(resp);
+
+        sequence_numbers += chunk;
+        count -= chunk;
+    }
+}
 
-    /* Loading of a revocation list currently unsupported */
-    size_t revocation_list_size = 0;
-    UA_ByteString *revocation_list = NULL;
+/*
+ *  A retained message was received already when its last notification was.
+ */
+static bool recovery_message_seen(const Mirrored_subscription *subscription, const UA_NotificationMessage *message,
+                                  const UA_Variant *handles)
+{
+    UA_UInt32 monitored_id;
+    bool found = false;
+    UA_UInt32 fingerprint = 0;
+
+    for(size_t i = 0; i < message->notificationDataSize; i++) {
+        const UA_ExtensionObject *notification = &message->notificationData[i];
+        if(notification->encoding < UA_EXTENSIONOBJECT_DECODED)
+            continue;
+
+        if(notification->content.decoded.type == &UA_TYPES[UA_TYPES_DATACHANGENOTIFICATION]) {
+            const UA_DataChangeNotification *data_changes = (const UA_DataChangeNotification *)notification->content.decoded.data;
+            for(size_t j = 0; j < data_changes->monitoredItemsSize; j++) {
+                if(!recovery_monitored_id(handles, data_changes->monitoredItems[j].clientHandle, &monitored_id))
+                    continue;
+                fingerprint = fingerprint_data_change(monitored_id, &data_changes->monitoredItems[j].value);
+                found = true;
+            }
+        } else if(notification->content.decoded.type == &UA_TYPES[UA_TYPES_EVENTNOTIFICATIONLIST]) {
+            const UA_EventNotificationList *events = (const UA_EventNotificationList *)notification->content.decoded.data;
+            for(size_t j = 0; j < events->eventsSize; j++) {
+                if(!recovery_monitored_id(handles, events->events[j].clientHandle, &monitored_id))
+                    continue;
+                fingerprint = fingerprint_event(monitored_id, events->events[j].eventFieldsSize, events->events[j].eventFields);
+                found = true;
+            }
+        }
+    }
 
-    UA_ClientConfig *config = UA_Client_getConfig(client);
+    return found && mirror_fingerprint_seen(subscription, fingerprint);
+}
 
-    config->securityMode = (UA_MessageSecurityMode) security_mode;
+/*
+ *  Republishes the messages the server still retains unacknowledged after an outage, in order.
+ *  The ones received just before the outage (their acknowledgement was lost) are recognized by
+ *  their notifications and skipped. The numbers between the last received message and the first
+ *  retained one are reported as lost when they are known: the 1.4 client does not expose the
+ *  sequence numbers of the messages it receives, so that is only the case while nothing was
+ *  received since a new subscription was created or since the last recovery.
+ */
+#define RECOVERY_MAX_MISSING 10000
 
-    UA_StatusCode retval =
-        UA_ClientConfig_setDefaultEncryption(config, certificate, private_key,
-                                             trust_list, trust_list_size,
-                                             revocation_list, revocation_list_size);
+static void recovery_republish(Mirrored_subscription *subscription, UA_TransferResult *result)
+{
+    UA_UInt32 *sequence_numbers = result->availableSequenceNumbers;
+    size_t count = result->availableSequenceNumbersSize;
+    if(count == 0)
+        return;
 
-    /* v1.4.x: For testing, accept all certificates */
-    if(retval == UA_STATUSCODE_GOOD) {
-        UA_CertificateVerification_AcceptAll(&config->certificateVerification);
-    }
+    qsort(sequence_numbers, count, sizeof(UA_UInt32), compare_sequence_numbers);
 
-    UA_ByteString_clear(&certificate);
-    UA_ByteString_clear(&private_key);
+    UA_UInt32 *lost = (UA_UInt32 *)malloc((count + RECOVERY_MAX_MISSING) * sizeof(UA_UInt32));
+    size_t lost_count = 0;
+    UA_Variant *handles = NULL;
+    size_t handles_size = 0;
+    bool handles_fetched = false;
+    bool gap = false;
+    bool first = true;
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }    
+    for(size_t i = 0; i < count; i++) {
+        UA_UInt32 sequence_number = sequence_numbers[i];
 
-    send_ok_response();
-}
+        // Republished by an earlier recovery, the stack never acknowledges republished messages
+        if(subscription->last_sequence != 0 && !sequence_after(sequence_number, subscription->last_sequence))
+            continue;
 
-/***********************/
-/* Discovery Functions */
-/***********************/
+        UA_RepublishRequest request;
+        UA_RepublishRequest_init(&request);
+        request.subscriptionId = subscription->id;
+        request.retransmitSequenceNumber = sequence_number;
 
-/* Get a list of all known server in the network. Only supported by LDS servers.
- *
- * @param url to connect (for example "opc.tcp://localhost:4840")
- * @return Indicates whether the operation succeeded or returns an error code */
-static void handle_find_servers_on_network(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    int term_size;
-    int term_type;
-    UA_ServerOnNetwork *serverOnNetwork = NULL;
-    size_t serverOnNetworkSize = 0;
+        UA_RepublishResponse response;
+        __UA_Client_Service(client, &request, &UA_TYPES[UA_TYPES_REPUBLISHREQUEST],
+                            &response, &UA_TYPES[UA_TYPES_REPUBLISHRESPONSE]);
 
-    long binary_len = 0; 
+        bool republished = response.responseHeader.serviceResult == UA_STATUSCODE_GOOD;
+        if(republished && !handles_fetched) {
+            handles = recovery_get_handles(subscription->id, &handles_size);
+            handles_fetched = true;
+        }
+        republished = republished && handles != NULL;
+
+        if(republished && recovery_message_seen(subscription, &response.notificationMessage, handles)) {
+            subscription->last_sequence = sequence_number;
+            subscription->sequence_current = true;
+            first = false;
+            UA_RepublishResponse_clear(&response);
+            continue;
+        }
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid url (size)");
+        // Never received nor retained
+        UA_UInt32 missing = sequence_next(subscription->last_sequence);
+        if(first && subscription->sequence_current && sequence_after(sequence_number, missing)) {
+            subscription->lost += (UA_UInt32)(sequence_number - missing);
+            for(; missing != sequence_number && lost != NULL && lost_count < RECOVERY_MAX_MISSING;
+                missing = sequence_next(missing))
+                lost[lost_count++] = missing;
+        }
 
-    char url[term_size + 1];
-    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid url");
-    url[binary_len] = '\0';
+        gap = true;
+        first = false;
 
-    UA_StatusCode retval = UA_Client_findServersOnNetwork(client, url, 0, 0, 0, NULL, &serverOnNetworkSize, &serverOnNetwork);
-    
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        UA_Array_delete(serverOnNetwork, serverOnNetworkSize, &UA_TYPES[UA_TYPES_SERVERONNETWORK]);
-        return;
+        if(republished) {
+            recovery_dispatch(subscription, &response.notificationMessage, handles);
+            subscription->republished++;
+        } else {
+            subscription->lost++;
+            if(lost != NULL)
+                lost[lost_count++] = sequence_number;
+        }
+
+        // Dispatched notifications are received too
+        subscription->last_sequence = sequence_number;
+        subscription->sequence_current = true;
+
+        UA_RepublishResponse_clear(&response);
     }
-    
-    send_data_response(serverOnNetwork, 8, serverOnNetworkSize);
 
-    UA_Array_delete(serverOnNetwork, serverOnNetworkSize, &UA_TYPES[UA_TYPES_SERVERONNETWORK]);
+    if(gap)
+        subscription->gaps++;
+
+    if(lost_count > 0)
+        send_gap(subscription->id, lost, lost_count);
+
+    free(lost);
+    if(handles != NULL)
+        UA_Array_delete(handles, handles_size, &UA_TYPES[UA_TYPES_VARIANT]);
 }
 
-/* Gets a list of all registered servers at the given server.
- *
- * @param serverUrl url to connect (for example "opc.tcp://localhost:4840")
- * @return Indicates whether the operation succeeded or returns an error code */
-static void handle_find_servers(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  Transfers the subscriptions the stack still knows to the session connected after an outage
+ *  (the same one if it survived), which reports the messages retained unacknowledged. The
+ *  subscriptions of a lost session that the server lost too are deleted locally, so they are
+ *  recreated.
+ */
+static void recovery_transfer()
 {
-    int term_size;
-    int term_type;
+    size_t count = 0;
+    for(Mirrored_subscription *subscription = reconnect.subscriptions; subscription != NULL; subscription = subscription->next) {
+        if(!subscription->dropped)
+            count++;
+    }
 
-    UA_ApplicationDescription *applicationDescriptionArray = NULL;
-    size_t applicationDescriptionArraySize = 0;
+    if(count == 0)
+        return;
 
-    long binary_len = 0; 
+    UA_TransferSubscriptionsRequest request;
+    UA_TransferSubscriptionsRequest_init(&request);
+    request.subscriptionIds = (UA_UInt32 *)UA_Array_new(count, &UA_TYPES[UA_TYPES_UINT32]);
+    if(request.subscriptionIds == NULL)
+        return;
+    request.subscriptionIdsSize = count;
+    request.sendInitialValues = reconnect.session_lost;
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid url (size)");
+    size_t i = 0;
+    for(Mirrored_subscription *subscription = reconnect.subscriptions; subscription != NULL; subscription = subscription->next) {
+        if(!subscription->dropped)
+            request.subscriptionIds[i++] = subscription->id;
+    }
 
-    char url[term_size + 1];
-    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid url");
-    url[binary_len] = '\0';
+    UA_TransferSubscriptionsResponse response;
+    __UA_Client_Service(client, &request, &UA_TYPES[UA_TYPES_TRANSFERSUBSCRIPTIONSREQUEST],
+                        &response, &UA_TYPES[UA_TYPES_TRANSFERSUBSCRIPTIONSRESPONSE]);
+
+    for(i = 0; i < count; i++) {
+        if(response.responseHeader.serviceResult == UA_STATUSCODE_GOOD && i < response.resultsSize &&
+           response.results[i].statusCode == UA_STATUSCODE_GOOD) {
+            Mirrored_subscription *subscription = mirror_find_subscription(request.subscriptionIds[i]);
+            if(subscription != NULL)
+                recovery_republish(subscription, &response.results[i]);
+            continue;
+        }
 
-    UA_StatusCode retval = UA_Client_findServers(client, url, 0, NULL, 0, NULL, &applicationDescriptionArraySize, &applicationDescriptionArray);
-    
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        UA_Array_delete(applicationDescriptionArray, applicationDescriptionArraySize, &UA_TYPES[UA_TYPES_APPLICATIONDESCRIPTION]);
-        return;
+        // Still running in the session that survived
+        if(!reconnect.session_lost)
+            continue;
+
+        // Marked as dropped by deleteSubscriptionCallback, the outage is not over
+        UA_Client_Subscriptions_deleteSingle(client, request.subscriptionIds[i]);
+        Mirrored_subscription *subscription = mirror_find_subscription(request.subscriptionIds[i]);
+        if(subscription != NULL)
+            subscription->dropped = true;
     }
-    
-    send_data_response(applicationDescriptionArray, 9, applicationDescriptionArraySize);
 
-    UA_Array_delete(applicationDescriptionArray, applicationDescriptionArraySize, &UA_TYPES[UA_TYPES_APPLICATIONDESCRIPTION]);
+    UA_TransferSubscriptionsRequest_clear(&request);
+    UA_TransferSubscriptionsResponse_clear(&response);
 }
 
-/* Gets a list of endpoints of a server
- *
- * @param url to connect (for example "opc.tcp://localhost:4840")
- * @return Indicates whether the operation succeeded or returns an error code */
-static void handle_get_endpoints(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  Creates a batch of monitored items of the same kind with a single CreateMonitoredItems request.
+ */
+static void recovery_create_items(Mirrored_subscription *subscription, Mirrored_item **items, size_t count, bool event)
 {
-    int term_size;
-    int term_type;
-    long binary_len = 0;
+    UA_MonitoredItemCreateRequest requests[RECOVERY_BATCH_SIZE];
+    void *contexts[RECOVERY_BATCH_SIZE];
+    UA_Client_DataChangeNotificationCallback data_callbacks[RECOVERY_BATCH_SIZE];
+    UA_Client_EventNotificationCallback event_callbacks[RECOVERY_BATCH_SIZE];
+    UA_Client_DeleteMonitoredItemCallback delete_callbacks[RECOVERY_BATCH_SIZE];
+
+    for(size_t i = 0; i < count; i++) {
+        // Shallow copies, the mirror keeps the requests
+        requests[i] = items[i]->request;
+        contexts[i] = NULL;
+
+        if(event) {
+            // Released in deleteEventItemCallback, which the stack also calls for failed items.
+            event_items++;
+            event_callbacks[i] = eventNotificationCallback;
+            delete_callbacks[i] = deleteEventItemCallback;
+            continue;
+        }
 
-    UA_EndpointDescription *endpointArray = NULL;
-    size_t endpointArraySize = 0;
+        Monitored_item_context *context = (Monitored_item_context *)calloc(1, sizeof(Monitored_item_context));
+        if(context != NULL) {
+            UA_NodeId_copy(&items[i]->request.itemToMonitor.nodeId, &context->node_id);
+            value_cache_retain(&context->node_id);
+            context->cached = true;
+        }
+        contexts[i] = context;
+        data_callbacks[i] = dataChangeNotificationCallback;
+        delete_callbacks[i] = deleteMonitoredItemCallback;
+    }
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid url (size)");
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = subscription->id;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+    request.itemsToCreate = requests;
+    request.itemsToCreateSize = count;
 
-    char url[term_size + 1];
-    if (ei_decode_binary(req, req_index, url, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid url");
-    url[binary_len] = '\0';
+    UA_CreateMonitoredItemsResponse response = event ?
+        UA_Client_MonitoredItems_createEvents(client, request, contexts, event_callbacks, delete_callbacks) :
+        UA_Client_MonitoredItems_createDataChanges(client, request, contexts, data_callbacks, delete_callbacks);
 
-    UA_StatusCode retval = UA_Client_getEndpoints(client, url, &endpointArraySize, &endpointArray);
-    
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        UA_Array_delete(endpointArray, endpointArraySize, &UA_TYPES[UA_TYPES_ENDPOINTDESCRIPTION]);
-        return;
+    for(size_t i = 0; i < count; i++) {
+        items[i]->previous_id = items[i]->id;
+
+        if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+            items[i]->status = response.responseHeader.serviceResult;
+        else if(i >= response.resultsSize)
+            items[i]->status = UA_STATUSCODE_BADUNEXPECTEDERROR;
+        else
+            items[i]->status = response.results[i].statusCode;
+
+        if(items[i]->status == UA_STATUSCODE_GOOD)
+            items[i]->id = response.results[i].monitoredItemId;
     }
-    
-    send_data_response(endpointArray, 10, endpointArraySize);
-    
-    UA_Array_delete(endpointArray, endpointArraySize, &UA_TYPES[UA_TYPES_ENDPOINTDESCRIPTION]);
-}
 
-/******************************/
-/* Node Addition and Deletion */
-/******************************/
+    UA_CreateMonitoredItemsResponse_clear(&response);
+}
 
-/* 
- *  Add a new reference to the server. 
- */
-void handle_add_reference(void *entity, bool entity_type, const char *req, int *req_index)
+static void recovery_recreate(Mirrored_subscription *subscription)
 {
-    int term_size;
-    int term_type;
-    long binary_len;
-    unsigned long target_node_class;
+    subscription->recreated = true;
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 6)
-        errx(EXIT_FAILURE, ":handle_add_reference requires a 6-tuple, term_size = %d", term_size);
-    
-    UA_NodeId source_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_id = assemble_node_id(req, req_index);
-    UA_ExpandedNodeId target_id = assemble_expanded_node_id(req, req_index);
+    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+    request.requestedPublishingInterval = subscription->publishing_interval;
+    UA_CreateSubscriptionResponse response = UA_Client_Subscriptions_create(client, request, NULL, NULL, deleteSubscriptionCallback);
 
-    int is_forward;
-    ei_decode_boolean(req, req_index, &is_forward);
+    subscription->status = response.responseHeader.serviceResult;
+    if(subscription->status != UA_STATUSCODE_GOOD)
+        return;
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid target_server_uri (size)");
+    subscription->id = response.subscriptionId;
+    subscription->dropped = false;
+    subscription->last_sequence = 0;
+    subscription->sequence_current = true;
+
+    // Data change items first, then event items, in batches
+    for(int event = 0; event < 2; event++) {
+        Mirrored_item *batch[RECOVERY_BATCH_SIZE];
+        size_t count = 0;
+
+        for(Mirrored_item *item = subscription->items; item != NULL; item = item->next) {
+            if(item->event != (bool)event)
+                continue;
 
-    char target_server_uri_str[term_size + 1];
-    if (ei_decode_binary(req, req_index, target_server_uri_str, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid target_server_uri_str");
-    target_server_uri_str[binary_len] = '\0';
+            batch[count++] = item;
+            if(count == RECOVERY_BATCH_SIZE) {
+                recovery_create_items(subscription, batch, count, event);
+                count = 0;
+            }
+        }
 
-    UA_String target_server_uri = UA_STRING(target_server_uri_str);
+        if(count > 0)
+            recovery_create_items(subscription, batch, count, event);
+    }
+}
 
-    if (ei_decode_ulong(req, req_index, &target_node_class) < 0) {
-        send_error_response("einval");
-        return;
+/*
+ *  {:connection, {:recovered, {previous_subscription_id, subscription_id | status,
+ *                              [{previous_monitored_id, monitored_id | status}]}}}
+ *  Recreated items are reported in chunks of RECOVERY_REPORT_ITEMS, transferred subscriptions
+ *  keep their ids and items.
+ */
+static void encode_recovered(char *resp, int *resp_index, const Mirrored_subscription *subscription,
+                             const Mirrored_item *items, size_t count)
+{
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "connection");
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "recovered");
+    ei_encode_tuple_header(resp, resp_index, 3);
+    ei_encode_ulong(resp, resp_index, subscription->recreated ? subscription->previous_id : subscription->id);
+
+    if(subscription->status != UA_STATUSCODE_GOOD) {
+        const char *status_code = UA_StatusCode_name(subscription->status);
+        ei_encode_binary(resp, resp_index, status_code, strlen(status_code));
+    } else {
+        ei_encode_ulong(resp, resp_index, subscription->id);
     }
 
-    UA_StatusCode retval = UA_Client_addReference(client, source_id, reference_type_id, (UA_Boolean)is_forward, target_server_uri, target_id, target_node_class);
+    if(count > 0)
+        ei_encode_list_header(resp, resp_index, count);
 
-    UA_NodeId_clear(&source_id);
-    UA_NodeId_clear(&reference_type_id);
-    UA_ExpandedNodeId_clear(&target_id);
+    for(const Mirrored_item *item = items; count > 0 && item != NULL; item = item->next, count--) {
+        ei_encode_tuple_header(resp, resp_index, 2);
+        ei_encode_ulong(resp, resp_index, item->previous_id);
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+        if(item->status != UA_STATUSCODE_GOOD) {
+            const char *status_code = UA_StatusCode_name(item->status);
+            ei_encode_binary(resp, resp_index, status_code, strlen(status_code));
+        } else {
+            ei_encode_ulong(resp, resp_index, item->id);
+        }
     }
 
-    send_ok_response();
+    ei_encode_empty_list(resp, resp_index);
 }
 
-/***************************************/
-/* Reading and Writing Node Attributes */
-/***************************************/
+static void send_recovered(const Mirrored_subscription *subscription, const Mirrored_item *items, size_t count)
+{
+    int resp_size = sizeof(uint16_t) + 1;
+    encode_recovered(NULL, &resp_size, subscription, items, count);
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL)
+        errx(EXIT_FAILURE, "Out of memory (recovered)");
+
+    int resp_index = sizeof(uint16_t); // Space for payload size
+    resp[resp_index++] = response_id;
+    encode_recovered(resp, &resp_index, subscription, items, count);
+    erlcmd_send(resp, resp_index);
+    free(resp);
+}
 
-/* 
- *  Change 'data type' of a node in the server. 
+/*
+ *  Restores the mirrored subscriptions in the session connected after an outage and reports
+ *  their (new) ids. Whatever failed to be restored leaves the mirror.
  */
-void handle_write_node_node_id(void *entity, bool entity_type, const char *req, int *req_index)
+static void reconnect_recover()
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    recovery_transfer();
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_node_id requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-    UA_NodeId new_node_id = assemble_node_id(req, req_index);
+    for(Mirrored_subscription *subscription = reconnect.subscriptions; subscription != NULL; subscription = subscription->next) {
+        subscription->recreated = false;
+        subscription->previous_id = subscription->id;
+        subscription->status = UA_STATUSCODE_GOOD;
 
-    retval = UA_Client_writeNodeIdAttribute(client, node_id, &new_node_id);
+        if(subscription->dropped)
+            recovery_recreate(subscription);
 
-    UA_NodeId_clear(&node_id);
-    UA_NodeId_clear(&new_node_id);
+        if(!subscription->recreated || subscription->status != UA_STATUSCODE_GOOD) {
+            send_recovered(subscription, NULL, 0);
+            continue;
+        }
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+        const Mirrored_item *chunk = subscription->items;
+        while(chunk != NULL) {
+            size_t count = 0;
+            const Mirrored_item *item = chunk;
+            while(item != NULL && count < RECOVERY_REPORT_ITEMS) {
+                item = item->next;
+                count++;
+            }
+
+            send_recovered(subscription, chunk, count);
+            chunk = item;
+        }
+
+        if(subscription->items == NULL)
+            send_recovered(subscription, NULL, 0);
+
+        Mirrored_item **link = &subscription->items;
+        while(*link != NULL) {
+            Mirrored_item *item = *link;
+            if(item->status == UA_STATUSCODE_GOOD) {
+                link = &item->next;
+                continue;
+            }
+
+            *link = item->next;
+            mirror_free_item(item);
+        }
     }
 
-    send_ok_response();
+    Mirrored_subscription *subscription = reconnect.subscriptions;
+    while(subscription != NULL) {
+        Mirrored_subscription *next = subscription->next;
+        if(subscription->status != UA_STATUSCODE_GOOD)
+            mirror_remove_subscription(subscription->id);
+        subscription = next;
+    }
 }
 
-/* 
- *  Change 'node class' attribute of a node in the server. 
- */
-void handle_write_node_node_class(void *entity, bool entity_type, const char *req, int *req_index)
+static void reconnect_backoff()
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    UA_UInt32 shift = reconnect.attempt > 16 ? 15 : (reconnect.attempt > 0 ? reconnect.attempt - 1 : 0);
+    uint64_t base = (uint64_t)reconnect.min_backoff << shift;
+    if(base > reconnect.max_backoff)
+        base = reconnect.max_backoff;
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_node_class requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-    unsigned long node_class;
-    
-    if (ei_decode_ulong(req, req_index, &node_class) < 0) {
-        send_error_response("einval");
+    // Jitter, so clients dropped together don't reconnect together
+    uint64_t delay = base / 2 + (uint64_t)rand() % (base / 2 + 1);
+
+    reconnect.phase = RECONNECT_BACKOFF;
+    reconnect.next_attempt = current_time() + delay;
+    send_connection_event("backoff", delay, UA_STATUSCODE_GOOD);
+}
+
+static void reconnect_failed(UA_StatusCode status)
+{
+    if(reconnect.enabled) {
+        reconnect_backoff();
         return;
     }
 
-    retval = UA_Client_writeNodeClassAttribute(client, node_id, (UA_NodeClass *) &node_class);
+    reconnect_stop();
+    send_connection_event("failed", 0, status != UA_STATUSCODE_GOOD ? status : UA_STATUSCODE_BADCONNECTIONCLOSED);
+}
 
-    UA_NodeId_clear(&node_id);
+static void reconnect_attempt()
+{
+    reconnect.attempt++;
+    send_connection_event("connecting", reconnect.attempt, UA_STATUSCODE_GOOD);
 
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+    config->stateCallback = clientStateCallback;
+
+    UA_StatusCode retval = UA_Client_connectAsync(client, reconnect.url);
     if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+        reconnect_failed(retval);
         return;
     }
 
-    send_ok_response();
+    reconnect.phase = RECONNECT_CONNECTING;
+    reconnect.attempt_deadline = current_time() + 2 * (uint64_t)config->timeout;
 }
 
-/* 
- *  Change 'user_write_mask' attribute of a node in the server. 
+/*
+ *  Runs the reconnection state machine of the current session, after its client iterated.
  */
-void handle_write_node_user_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+static void reconnect_iterate()
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_user_write_mask requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-    unsigned long user_write_mask;
-    
-    if (ei_decode_ulong(req, req_index, &user_write_mask) < 0) {
-        send_error_response("einval");
+    if(reconnect.phase == RECONNECT_IDLE)
         return;
-    }
 
-    UA_UInt32 ua_user_write_mask = (UA_UInt32) user_write_mask;
+    UA_SecureChannelState channel_state;
+    UA_SessionState session_state;
+    UA_StatusCode status;
+    UA_Client_getState(client, &channel_state, &session_state, &status);
+    uint64_t now = current_time();
 
-    retval = UA_Client_writeUserWriteMaskAttribute(client, node_id, &ua_user_write_mask);
+    if(session_state == UA_SESSIONSTATE_ACTIVATED && channel_state == UA_SECURECHANNELSTATE_OPEN) {
+        if(reconnect.phase == RECONNECT_CONNECTED)
+            return;
 
-    UA_NodeId_clear(&node_id);
+        uint64_t outage = reconnect.outage ? now - reconnect.outage_start : 0;
+        if(reconnect.outage) {
+            // The server may have restarted with another address space. The cached values decoded
+            // with the discovered types are dropped with them (data_type_values_release).
+            data_type_cache_clear();
+            path_cache_clear();
+            reconnect_recover();
+        }
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+        reconnect.phase = RECONNECT_CONNECTED;
+        reconnect.attempt = 0;
+        reconnect.outage = false;
+        reconnect.session_lost = false;
+        send_connection_event("connected", outage, UA_STATUSCODE_GOOD);
         return;
     }
 
-    send_ok_response();
+    switch(reconnect.phase) {
+        case RECONNECT_CONNECTED:
+            if(!reconnect.enabled) {
+                reconnect_stop();
+                return;
+            }
+
+            // The connection dropped, the first attempt is immediate
+            reconnect.outage = true;
+            reconnect.session_lost = session_state == UA_SESSIONSTATE_CLOSED;
+            reconnect.outage_start = now;
+            reconnect.attempt = 0;
+            reconnect.phase = RECONNECT_BACKOFF;
+            reconnect.next_attempt = now;
+            send_connection_event("disconnected", 0, status != UA_STATUSCODE_GOOD ? status : UA_STATUSCODE_BADCONNECTIONCLOSED);
+            break;
+
+        case RECONNECT_CONNECTING:
+            // The stack sets the connect status when the attempt fails
+            if(status == UA_STATUSCODE_GOOD && now < reconnect.attempt_deadline)
+                break;
+
+            if(channel_state != UA_SECURECHANNELSTATE_CLOSED)
+                UA_Client_disconnectSecureChannel(client);
+
+            reconnect_failed(status);
+            break;
+
+        case RECONNECT_BACKOFF:
+            if(now >= reconnect.next_attempt)
+                reconnect_attempt();
+            break;
+
+        default:
+            break;
+    }
 }
 
-/* 
- *  Change 'symmetric' of a node in the server. 
+/*
+ *  Enables or disables the automatic reconnection of the client.
+ *  Input: {enabled, min_backoff_ms, max_backoff_ms}
  */
-void handle_write_node_symmetric(void *entity, bool entity_type, const char *req, int *req_index)
+static void handle_set_reconnect(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    int enabled;
+    unsigned long min_backoff;
+    unsigned long max_backoff;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_symmetric requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_set_reconnect requires a 3-tuple, term_size = %d", term_size);
 
-    // write_mask
-    int symmetric;
-    if (ei_decode_boolean(req, req_index, &symmetric) < 0) {
+    if(ei_decode_boolean(req, req_index, &enabled) < 0 ||
+       ei_decode_ulong(req, req_index, &min_backoff) < 0 ||
+       ei_decode_ulong(req, req_index, &max_backoff) < 0 ||
+       min_backoff == 0 || max_backoff < min_backoff || max_backoff > UA_UINT32_MAX) {
         send_error_response("einval");
         return;
     }
 
-    UA_Boolean symmetric_bool = symmetric;
-    
-    retval = UA_Client_writeSymmetricAttribute(client, node_id, &symmetric_bool);
-
-    UA_NodeId_clear(&node_id);
-
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+    reconnect.enabled = enabled;
+    reconnect.min_backoff = (UA_UInt32)min_backoff;
+    reconnect.max_backoff = (UA_UInt32)max_backoff;
 
     send_ok_response();
 }
 
-/* 
- *  Change 'contains_no_loops' of a node in the server. 
+/*
+ *  Starts connecting to the server and returns at once, the outcome is pushed as connection
+ *  events. Failed attempts are retried while the reconnection is enabled.
  */
-void handle_write_node_contains_no_loops(void *entity, bool entity_type, const char *req, int *req_index)
+static void handle_connect_client_async(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
-    UA_StatusCode retval;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_contains_no_loops requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    int contains_no_loops;
-    if (ei_decode_boolean(req, req_index, &contains_no_loops) < 0) {
-        send_error_response("einval");
-        return;
-    }
+    long binary_len = 0;
 
-    UA_Boolean contains_no_loops_bool = contains_no_loops;
-    
-    retval = UA_Client_writeContainsNoLoopsAttribute(client, node_id, &contains_no_loops_bool);
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid url (size)");
 
-    UA_NodeId_clear(&node_id);
+    char *url = (char *)malloc(term_size + 1);
+    if (ei_decode_binary(req, req_index, url, &binary_len) < 0)
+        errx(EXIT_FAILURE, "Invalid url");
+    url[binary_len] = '\0';
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+    // Custom data types and browse paths are resolved once per session.
+    data_type_cache_clear();
+    path_cache_clear();
 
+    reconnect_stop();
+    reconnect.url = url;
     send_ok_response();
+
+    reconnect_attempt();
 }
 
-/* 
- *  Change 'user_access_level' of a node in the server. 
+/*
+ *  Output: {:ok, [{subscription_id, gaps, republished, lost, late, max_lateness_ms}]}
  */
-void handle_write_node_user_access_level(void *entity, bool entity_type, const char *req, int *req_index)
+static void encode_subscription_stats_response(char *resp, int *resp_index)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_caller_metadata(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "ok");
+
+    for(Mirrored_subscription *subscription = reconnect.subscriptions; subscription != NULL; subscription = subscription->next) {
+        ei_encode_list_header(resp, resp_index, 1);
+        ei_encode_tuple_header(resp, resp_index, 6);
+        ei_encode_ulong(resp, resp_index, subscription->id);
+        ei_encode_ulonglong(resp, resp_index, subscription->gaps);
+        ei_encode_ulonglong(resp, resp_index, subscription->republished);
+        ei_encode_ulonglong(resp, resp_index, subscription->lost);
+        ei_encode_ulonglong(resp, resp_index, subscription->late);
+        ei_encode_ulonglong(resp, resp_index, subscription->max_lateness);
+    }
+    ei_encode_empty_list(resp, resp_index);
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_user_access_level requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+/*
+ *  Gap and lateness counters of the subscriptions of the client.
+ */
+static void handle_get_subscription_stats(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    // Size pass first: the response must fit the {:packet, 2} port frame.
+    int resp_size = sizeof(uint16_t);
+    encode_subscription_stats_response(NULL, &resp_size);
 
-    unsigned long user_access_level;
-    if (ei_decode_ulong(req, req_index, &user_access_level) < 0) {
-        send_error_response("einval");
+    if(resp_size > erlcmd_frame_limit()) {
+        send_error_response("overflow");
         return;
     }
-    
-    UA_Byte ua_user_access_level = (UA_Byte) user_access_level;
-
-    retval = UA_Client_writeAccessLevelAttribute(client, node_id, &ua_user_access_level);
-
-    UA_NodeId_clear(&node_id);
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        send_error_response("enomem");
         return;
     }
 
-    send_ok_response();
+    int resp_index = sizeof(uint16_t);
+    encode_subscription_stats_response(resp, &resp_index);
+    erlcmd_send(resp, resp_index);
+    free(resp);
 }
 
-/* 
- *  Change 'user_executable' of a node in the server. 
+/***********************/
+/* State notifications */
+/***********************/
+
+/*
+ *  Pushes {:state, channel_state, session_state, status} whenever the state of the client changes,
+ *  so it doesn't have to be polled with get_client_state. The state is compared once per loop
+ *  iteration, transitions within the same iteration are coalesced.
  */
-void handle_write_node_user_executable(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+typedef struct {
+    bool enabled;
+    bool sent;                          // the last state was pushed
+    const char *channel_state;
+    UA_SessionState session_state;
+    UA_StatusCode status;
+} State_notifications;
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_user_executable requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+static State_notifications state_notifications;
 
-    int user_executable;
-    if (ei_decode_boolean(req, req_index, &user_executable) < 0) {
-        send_error_response("einval");
-        return;
-    }
+static const char *channel_state_name(UA_SecureChannelState channel_state)
+{
+    switch(channel_state) {
+        case UA_SECURECHANNELSTATE_CLOSED:
+            return "closed";
 
-    UA_Boolean user_executable_bool = user_executable;
-    
-    retval = UA_Client_writeUserExecutableAttribute(client, node_id, &user_executable_bool);
+        case UA_SECURECHANNELSTATE_OPEN:
+            return "open";
 
-    UA_NodeId_clear(&node_id);
+        case UA_SECURECHANNELSTATE_CLOSING:
+            return "closing";
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+        // Connection and handshake steps
+        default:
+            return "connecting";
     }
-
-    send_ok_response();
 }
 
-/* 
- *  Reads 'user_write_mask' attribute of a node in the server. 
- */
-void handle_read_node_user_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+static const char *session_state_name(UA_SessionState session_state)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
-    UA_UInt32 user_write_mask;
+    switch(session_state) {
+        case UA_SESSIONSTATE_CLOSED:
+            return "closed";
 
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+        case UA_SESSIONSTATE_CREATE_REQUESTED:
+            return "create_requested";
 
-    retval = UA_Client_readUserWriteMaskAttribute(client, node_id, &user_write_mask);
+        case UA_SESSIONSTATE_CREATED:
+            return "created";
+
+        case UA_SESSIONSTATE_ACTIVATE_REQUESTED:
+            return "activate_requested";
+
+        case UA_SESSIONSTATE_ACTIVATED:
+            return "activated";
 
-    UA_NodeId_clear(&node_id);
+        case UA_SESSIONSTATE_CLOSING:
+            return "closing";
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+        default:
+            return "unknown";
     }
+}
 
-    send_data_response(&user_write_mask, 27, 0);
+static bool state_notifications_active(const State_notifications *notifications)
+{
+    // A disconnected client doesn't change its state on its own
+    return notifications->enabled &&
+           (!notifications->sent || notifications->session_state != UA_SESSIONSTATE_CLOSED ||
+            strcmp(notifications->channel_state, "closed") != 0);
 }
 
-/* 
- *  Reads 'user_access_level' Attribute from a node. 
+/*
+ *  Compares the state of the current client with the last pushed one.
  */
-void handle_read_node_user_access_level(void *entity, bool entity_type, const char *req, int *req_index)
+static void state_notify()
 {
-    UA_StatusCode retval;
-    UA_Byte user_access_level;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    retval = UA_Client_readUserAccessLevelAttribute(client, node_id, &user_access_level);
+    if(!state_notifications.enabled)
+        return;
 
-    UA_NodeId_clear(&node_id);
+    UA_SecureChannelState channel_state;
+    UA_SessionState session_state;
+    UA_StatusCode status;
+    UA_Client_getState(client, &channel_state, &session_state, &status);
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    const char *channel_state_atom = channel_state_name(channel_state);
+    if(state_notifications.sent && state_notifications.channel_state == channel_state_atom &&
+       state_notifications.session_state == session_state && state_notifications.status == status)
         return;
-    }
 
-    send_data_response(&user_access_level, 24, 0);
+    state_notifications.sent = true;
+    state_notifications.channel_state = channel_state_atom;
+    state_notifications.session_state = session_state;
+    state_notifications.status = status;
+
+    const char *status_code = UA_StatusCode_name(status);
+
+    char resp[256];
+    int resp_index = sizeof(uint16_t); // Space for payload size
+    resp[resp_index++] = response_id;
+    ei_encode_version(resp, &resp_index);
+    ei_encode_tuple_header(resp, &resp_index, 4);
+    ei_encode_atom(resp, &resp_index, "state");
+    ei_encode_atom(resp, &resp_index, channel_state_atom);
+    ei_encode_atom(resp, &resp_index, session_state_name(session_state));
+    ei_encode_binary(resp, &resp_index, status_code, strlen(status_code));
+    erlcmd_send(resp, resp_index);
 }
 
-/* 
- *  Reads 'user_executable' Attribute from a node. 
+/*
+ *  Enables or disables the state notifications, the current state is pushed once enabled.
  */
-void handle_read_node_user_executable(void *entity, bool entity_type, const char *req, int *req_index)
+static void handle_set_state_notifications(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    UA_StatusCode retval;
-    UA_Boolean user_executable;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    int enabled;
 
-    retval = UA_Client_readUserExecutableAttribute(client, node_id, &user_executable);
-
-    UA_NodeId_clear(&node_id);
-
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    if(ei_decode_boolean(req, req_index, &enabled) < 0) {
+        send_error_response("einval");
         return;
     }
 
-    send_data_response(&user_executable, 0, 0);
+    state_notifications.enabled = enabled;
+    state_notifications.sent = false;
+    send_ok_response();
 }
 
+/************/
+/* Sessions */
+/************/
 
-/***********************************************/
-/* Subscriptions and Monitored Items functions */
-/***********************************************/
-
-/*  Subscriptions
- *
- *  Subscriptions in OPC UA are asynchronous. That is, the client sends several PublishRequests to the server. 
- *  The server returns PublishResponses with notifications. But only when a notification has been generated. 
- *  The client does not wait for the responses and continues normal operations.
- *  Note the difference between Subscriptions and MonitoredItems. Subscriptions are used to report back notifications. 
- *  MonitoredItems are used to generate notifications. Every MonitoredItem is attached to exactly one Subscription. 
- *  And a Subscription can contain many MonitoredItems.
+/*
+ *  One port can multiplex many clients (sessions), so hundreds of connections don't cost hundreds
+ *  of OS processes. Every session owns a UA_Client and its client state (caches, poll groups,
+ *  event items): the state of the current session lives in the globals above, the state of the
+ *  others in their Session entry. Session 0 is the client created at startup, the requests of the
+ *  other sessions (and their responses and notifications) are framed as <<?s, session::32, frame>>.
  */
+#define SESSION_FRAME_ID 's'
+#define SESSION_PREFIX_SIZE 5
+
+// Copy of a request frame waiting for a worker to release the client of its session
+typedef struct Deferred_request {
+    UA_DateTime received;
+    int req_index;                      // start of the request term
+    struct Deferred_request *next;
+    char req[];
+} Deferred_request;
+
+typedef struct Session {
+    UA_UInt32 id;
+    UA_Client *client;
+    Value_cache_entry **value_cache;
+    size_t value_cache_buckets;
+    size_t value_cache_size;
+    bool value_cache_enabled;
+    UA_DataTypeArray *custom_types;
+    UA_DataTypeArray *retired_types;
+    UA_Variant custom_types_namespaces;
+    uint64_t custom_types_checked;
+    UA_NodeId *unknown_encodings;
+    size_t unknown_encodings_size;
+    Path_cache_entry **path_cache;
+    size_t path_cache_buckets;
+    size_t path_cache_size;
+    UA_String *path_cache_namespaces;
+    size_t path_cache_namespaces_size;
+    UA_UInt32 translate_chunk_size;
+    uint64_t path_cache_checked;
+    Poll_group *poll_groups;
+    UA_UInt32 next_poll_group_id;
+    size_t event_items;
+    Reconnect reconnect;
+    State_notifications state_notifications;
+    Job *job;                           // connection job owning the client
+    size_t jobs;                        // jobs of the session in the workers
+    Deferred_request *deferred;
+    bool delete_pending;                // deleted while its client was owned by a job
+    struct Session *next;
+} Session;
+
+// Session 0 is the client of a standalone port, a host port keeps it (unused) next to its sessions
+static Session default_session;
+static Session *sessions = &default_session;
+static Session *current_session = &default_session;
+static UA_UInt32 next_session_id = 1;
+
+// Every per-session global must be saved and loaded here (and released in session_close)
+static void session_save(Session *session)
+{
+    session->client = client;
+    session->value_cache = value_cache;
+    session->value_cache_buckets = value_cache_buckets;
+    session->value_cache_size = value_cache_size;
+    session->value_cache_enabled = value_cache_enabled;
+    session->custom_types = custom_types;
+    session->retired_types = retired_types;
+    session->custom_types_namespaces = custom_types_namespaces;
+    session->custom_types_checked = custom_types_checked;
+    session->unknown_encodings = unknown_encodings;
+    session->unknown_encodings_size = unknown_encodings_size;
+    session->path_cache = path_cache;
+    session->path_cache_buckets = path_cache_buckets;
+    session->path_cache_size = path_cache_size;
+    session->path_cache_namespaces = path_cache_namespaces;
+    session->path_cache_namespaces_size = path_cache_namespaces_size;
+    session->translate_chunk_size = translate_chunk_size;
+    session->path_cache_checked = path_cache_checked;
+    session->poll_groups = poll_groups;
+    session->next_poll_group_id = next_poll_group_id;
+    session->event_items = event_items;
+    session->reconnect = reconnect;
+    session->state_notifications = state_notifications;
+}
 
-void handle_add_subscription(void *entity, bool entity_type, const char *req, int *req_index)
+static void session_load(Session *session)
 {
-    int term_size;
-    int term_type;
-    UA_CreateSubscriptionResponse response;
+    client = session->client;
+    value_cache = session->value_cache;
+    value_cache_buckets = session->value_cache_buckets;
+    value_cache_size = session->value_cache_size;
+    value_cache_enabled = session->value_cache_enabled;
+    custom_types = session->custom_types;
+    retired_types = session->retired_types;
+    custom_types_namespaces = session->custom_types_namespaces;
+    custom_types_checked = session->custom_types_checked;
+    unknown_encodings = session->unknown_encodings;
+    unknown_encodings_size = session->unknown_encodings_size;
+    path_cache = session->path_cache;
+    path_cache_buckets = session->path_cache_buckets;
+    path_cache_size = session->path_cache_size;
+    path_cache_namespaces = session->path_cache_namespaces;
+    path_cache_namespaces_size = session->path_cache_namespaces_size;
+    translate_chunk_size = session->translate_chunk_size;
+    path_cache_checked = session->path_cache_checked;
+    poll_groups = session->poll_groups;
+    next_poll_group_id = session->next_poll_group_id;
+    event_items = session->event_items;
+    reconnect = session->reconnect;
+    state_notifications = session->state_notifications;
+}
 
-    double publishing_interval;
-    if (ei_decode_double(req, req_index, &publishing_interval) < 0) {
-        send_error_response("einval");
+// Frame prefix of the session, none for session 0
+static size_t session_prefix(const Session *session, char *prefix)
+{
+    if(session->id == 0)
+        return 0;
+
+    prefix[0] = SESSION_FRAME_ID;
+    prefix[1] = (char)(session->id >> 24);
+    prefix[2] = (char)(session->id >> 16);
+    prefix[3] = (char)(session->id >> 8);
+    prefix[4] = (char)session->id;
+    return SESSION_PREFIX_SIZE;
+}
+
+/*
+ *  Makes session the current one, every request handler and client callback works on the
+ *  current session.
+ */
+static void session_enter(Session *session)
+{
+    if(session == current_session)
         return;
-    }
 
-    UA_ClientConfig *client_config = UA_Client_getConfig(client);
-    client_config->subscriptionInactivityCallback = subscriptionInactivityCallback;
+    // Buffered events belong to the session being left
+    events_flush();
+    session_save(current_session);
+    session_load(session);
+    current_session = session;
 
-    UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
-    request.requestedPublishingInterval = (UA_Double) publishing_interval;
-    response = UA_Client_Subscriptions_create(client, request, NULL, NULL, deleteSubscriptionCallback);
+    char prefix[SESSION_PREFIX_SIZE];
+    size_t prefix_size = session_prefix(session, prefix);
+    erlcmd_set_prefix(prefix_size > 0 ? prefix : NULL, prefix_size);
+}
 
-    if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
-        send_opex_response(response.responseHeader.serviceResult);
-        return;
+static Session *find_session(UA_UInt32 session_id)
+{
+    Session *session = sessions;
+    while(session != NULL && session->id != session_id)
+        session = session->next;
+
+    return session;
+}
+
+/*
+ *  Releases the client of the current session and all its state.
+ */
+static void session_close()
+{
+    reconnect_stop();
+    UA_Client_disconnect(client);
+    // The cached values go before the data types they were decoded with.
+    value_cache_reset();
+    free(value_cache);
+    value_cache = NULL;
+    value_cache_buckets = 0;
+    poll_groups_clear(true);
+    data_type_cache_clear();
+    path_cache_clear();
+    free(path_cache);
+    path_cache = NULL;
+    path_cache_buckets = 0;
+    UA_Client_delete(client);
+    client = NULL;
+    reconnect_clear();
+    events_flush();
+}
+
+static void session_free(Session *session)
+{
+    while(session->deferred != NULL) {
+        Deferred_request *next = session->deferred->next;
+        free(session->deferred);
+        session->deferred = next;
     }
 
-    send_data_response(&(response.subscriptionId), 27, 0);
+    if(session != &default_session)
+        free(session);
 }
 
-void handle_delete_subscription(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  Removes a session (closed and not current) from the list and frees it.
+ */
+static void session_remove(Session *session)
 {
-    unsigned long subscription_id;
-    if (ei_decode_ulong(req, req_index, &subscription_id) < 0) {
-        send_error_response("einval");
-        return;
+    Session **link = &sessions;
+    while(*link != session)
+        link = &(*link)->next;
+    *link = session->next;
+    session_free(session);
+}
+
+/*
+ *  Hands a job to the workers, connection jobs take the client of the current session until
+ *  they complete. Answered by jobs_complete.
+ */
+static void job_submit(Job *job)
+{
+    job->session = current_session;
+    job->prefix_size = session_prefix(current_session, job->prefix);
+    take_caller_metadata(&job->caller);
+
+    if(!job_is_discovery(job)) {
+        job->client = client;
+        current_session->job = job;
     }
+    current_session->jobs++;
 
-    UA_StatusCode retval = UA_Client_Subscriptions_deleteSingle(client, (UA_UInt32) subscription_id);
+    pthread_mutex_lock(&jobs_lock);
+    jobs_append(&jobs_pending, job);
+    pthread_cond_signal(&jobs_ready);
+    pthread_mutex_unlock(&jobs_lock);
+}
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+// Poll groups, event items, reconnections and state notifications need their client to iterate on its own.
+static bool sessions_iterate_alone()
+{
+    for(Session *session = sessions; session != NULL; session = session->next) {
+        if(session == current_session ? poll_groups != NULL || event_items > 0 || reconnect_active(&reconnect) ||
+                                        state_notifications_active(&state_notifications)
+                                      : session->poll_groups != NULL || session->event_items > 0 ||
+                                        reconnect_active(&session->reconnect) ||
+                                        state_notifications_active(&session->state_notifications))
+            return true;
     }
 
-    send_ok_response();
+    return false;
 }
 
-/*  Monitored Items
- *
- *  Subscriptions in OPC UA are asynchronous. That is, the client sends several PublishRequests to the server. 
- *  The server returns PublishResponses with notifications. But only when a notification has been generated. 
- *  The client does not wait for the responses and continues normal operations.
- *  Note the difference between Subscriptions and MonitoredItems. Subscriptions are used to report back notifications. 
- *  MonitoredItems are used to generate notifications. Every MonitoredItem is attached to exactly one Subscription. 
- *  And a Subscription can contain many MonitoredItems.
+/*
+ *  Iterates the client of every connected session, each one with its own state.
  */
-
-void handle_add_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+static void sessions_run_iterate()
 {
-    int term_size;
-    int term_type;
-    UA_MonitoredItemCreateResult monitored_item_response;
+    for(Session *session = sessions; session != NULL; session = session->next) {
+        // A worker owns the client
+        if(session->job != NULL)
+            continue;
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 3)
-        errx(EXIT_FAILURE, ":handle_add_monitored_item requires a 3-tuple, term_size = %d", term_size);
+        session_enter(session);
 
-    UA_NodeId monitored_node = assemble_node_id(req, req_index);
+        // v1.4.x: Check session state to determine if connected
+        UA_SecureChannelState channelState;
+        UA_SessionState sessionState;
+        UA_StatusCode connectStatus;
+        UA_Client_getState(client, &channelState, &sessionState, &connectStatus);
 
-    unsigned long subscription_id;
-    if (ei_decode_ulong(req, req_index, &subscription_id) < 0) {
-        send_error_response("einval");
-        return;
+        if(sessionState >= UA_SESSIONSTATE_CREATED || reconnect.phase == RECONNECT_CONNECTING)
+            UA_Client_run_iterate(client, 0);
+
+        reconnect_iterate();
+        state_notify();
+
+        // Events notified during the iteration (or a request) go in one frame
+        events_flush();
     }
+}
 
-    double sampling_interval;
-    if (ei_decode_double(req, req_index, &sampling_interval) < 0) {
-        send_error_response("einval");
+/*
+ *  Creates a new session with a default client configuration.
+ *  {:ok, session_id}
+ */
+static void handle_new_session(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    Session *session = (Session *)calloc(1, sizeof(Session));
+    if(session == NULL) {
+        send_opex_response(UA_STATUSCODE_BADOUTOFMEMORY);
         return;
     }
-    
-    UA_MonitoredItemCreateRequest monitored_item_request = UA_MonitoredItemCreateRequest_default(monitored_node);
 
-    monitored_item_request.requestedParameters.samplingInterval = (UA_Double) sampling_interval;
-
-    monitored_item_response = UA_Client_MonitoredItems_createDataChange(client, subscription_id,
-                                                                        UA_TIMESTAMPSTORETURN_BOTH, monitored_item_request,
-                                                                        NULL, dataChangeNotificationCallback, deleteMonitoredItemCallback);
-
-    UA_NodeId_clear(&monitored_node);
-
-    if(monitored_item_response.statusCode != UA_STATUSCODE_GOOD) {
-        send_opex_response(monitored_item_response.statusCode);
+    session->client = UA_Client_new();
+    if(session->client == NULL) {
+        free(session);
+        send_opex_response(UA_STATUSCODE_BADOUTOFMEMORY);
         return;
     }
 
-    send_data_response(&(monitored_item_response.monitoredItemId), 27, 0);
+    UA_ClientConfig_setDefault(UA_Client_getConfig(session->client));
+    UA_Variant_init(&session->custom_types_namespaces);
+    session->next_poll_group_id = 1;
+    session->reconnect = reconnect_defaults;
+    session->id = next_session_id++;
+    session->next = sessions;
+    sessions = session;
+
+    send_data_response(&session->id, 27, 0);
 }
 
-void handle_delete_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  Disconnects and deletes a session (other than session 0 and the calling one).
+ */
+static void handle_delete_session(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_delete_monitored_item requires a 2-tuple, term_size = %d", term_size);
-
-    unsigned long subscription_id;
-    if (ei_decode_ulong(req, req_index, &subscription_id) < 0) {
+    unsigned long session_id;
+    if(ei_decode_ulong(req, req_index, &session_id) < 0) {
         send_error_response("einval");
         return;
     }
 
-    unsigned long monitored_item_id;
-    if (ei_decode_ulong(req, req_index, &monitored_item_id) < 0) {
-        send_error_response("einval");
+    Session *session = find_session((UA_UInt32)session_id);
+    if(session == NULL) {
+        send_opex_response(UA_STATUSCODE_BADSESSIONIDINVALID);
         return;
     }
 
-    retval = UA_Client_MonitoredItems_deleteSingle(client, (UA_UInt32) subscription_id, (UA_UInt32) monitored_item_id);
+    if(session == &default_session || session == current_session) {
+        send_error_response("einval");
+        return;
+    }
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    // Closed once its jobs complete
+    if(session->jobs > 0) {
+        session->delete_pending = true;
+        send_ok_response();
         return;
     }
 
+    Session *caller = current_session;
+    session_enter(session);
+    session_close();
+    session_enter(caller);
+    session_remove(session);
+
     send_ok_response();
 }
 
@@ -1086,6 +7636,9 @@ static struct request_handler request_handlers[] = {
     {"connect_client_by_username", handle_connect_client_by_username},     
     {"connect_client_secure_channel", handle_connect_client_secure_channel},     
     {"disconnect_client", handle_disconnect_client}, 
+    {"connect_client_async", handle_connect_client_async},
+    {"set_reconnect", handle_set_reconnect},
+    {"set_state_notifications", handle_set_state_notifications},
     // discovery functions
     {"find_servers_on_network", handle_find_servers_on_network},
     {"find_servers", handle_find_servers}, 
@@ -1093,8 +7646,31 @@ static struct request_handler request_handlers[] = {
     // Subscriptions and Monitored Items functions.
     {"add_subscription", handle_add_subscription},
     {"delete_subscription", handle_delete_subscription},
+    {"get_subscription_stats", handle_get_subscription_stats},
     {"add_monitored_item", handle_add_monitored_item},
     {"delete_monitored_item", handle_delete_monitored_item},
+    {"add_event_monitored_item", handle_add_event_monitored_item},
+    // Browse
+    {"browse", handle_browse},
+    {"browse_next", handle_browse_next},
+    // Browse path resolution
+    {"translate_browse_paths", handle_translate_browse_paths},
+    // Method calls
+    {"call_methods", handle_call_methods},
+    // History read
+    {"history_read_raw", handle_history_read_raw},
+    // Address space crawler
+    {"crawl", handle_crawl},
+    // Polling engine
+    {"add_poll_group", handle_add_poll_group},
+    {"delete_poll_group", handle_delete_poll_group},
+    // Last value cache
+    {"set_value_cache", handle_set_value_cache},
+    {"read_cached", handle_read_cached},
+    {"read_cached_many", handle_read_cached_many},
+    // Custom data types
+    {"load_data_types", handle_load_data_types},
+    {"clear_data_types", handle_clear_data_types},
     // Node Addition and Deletion
     {"add_variable_node", handle_add_variable_node},
     {"add_variable_type_node", handle_add_variable_type_node},
@@ -1106,21 +7682,27 @@ static struct request_handler request_handlers[] = {
     {"add_reference", handle_add_reference},
     {"delete_reference", handle_delete_reference},
     {"delete_node", handle_delete_node},
+    // Sessions
+    {"new_session", handle_new_session},
+    {"delete_session", handle_delete_session},
+    // Statistics
+    {"get_port_stats", handle_get_port_stats},
     { NULL, NULL }
 };
 
 /**
- * @brief Decode and forward requests from Elixir to the appropriate handlers
+ * @brief Decode and forward the request of a session to the appropriate handler
+ * @param session the session of the request
  * @param req the undecoded request
- * @param cookie
+ * @param req_index start of the request term
+ * @param received when the request frame was received
  */
-static void handle_elixir_request(const char *req, void *cookie)
+static void session_dispatch(Session *session, const char *req, int req_index, UA_DateTime received)
 {
-    (void) cookie;
+    session_enter(session);
 
     // Commands are of the form {Command, Arguments}:
     // { atom(), term() }
-    int req_index = sizeof(uint16_t);
     if (ei_decode_version(req, &req_index, NULL) < 0)
         errx(EXIT_FAILURE, "Message version issue?");
 
@@ -1137,8 +7719,12 @@ static void handle_elixir_request(const char *req, void *cookie)
     for (struct request_handler *rh = request_handlers; rh->name != NULL; rh++) {
         if (strcmp(cmd, rh->name) == 0) {
             handle_caller_metadata(req, &req_index, cmd);
+            UA_DateTime decoded = UA_DateTime_nowMonotonic();
+            uint64_t send_ns = erlcmd_send_ns;
             rh->handler(client, 1, req, &req_index);
             free_caller_metadata();
+            port_stats_record((size_t)(rh - request_handlers), rh->name, received, decoded,
+                              UA_DateTime_nowMonotonic(), erlcmd_send_ns - send_ns);
             return;
         }
     }
@@ -1146,22 +7732,178 @@ static void handle_elixir_request(const char *req, void *cookie)
     errx(EXIT_FAILURE, "unknown command: %s", cmd);
 }
 
+/**
+ * @brief Decode and forward requests from Elixir to the appropriate handlers
+ * @param req the undecoded request
+ * @param cookie
+ */
+static void handle_elixir_request(const char *req, void *cookie)
+{
+    (void) cookie;
+    UA_DateTime received = UA_DateTime_nowMonotonic();
+
+    // Requests of a session other than session 0 are prefixed by its id
+    Session *session = &default_session;
+    int req_index = sizeof(uint16_t);
+    size_t len = ((size_t)(unsigned char)req[0] << 8) | (unsigned char)req[1];
+    if (len > 0 && req[req_index] == SESSION_FRAME_ID) {
+        // The id and at least the version byte of the request term
+        if (len <= SESSION_PREFIX_SIZE)
+            errx(EXIT_FAILURE, "Session frame too short: %d bytes", (int) len);
+
+        const unsigned char *id = (const unsigned char *)req + req_index + 1;
+        session = find_session(((UA_UInt32)id[0] << 24) | ((UA_UInt32)id[1] << 16) |
+                               ((UA_UInt32)id[2] << 8) | (UA_UInt32)id[3]);
+        req_index += SESSION_PREFIX_SIZE;
+
+        // Nobody waits for the requests of deleted sessions (the owner exited)
+        if (session == NULL || session->delete_pending)
+            return;
+    }
+
+    // The requests of a session wait (in order) while a worker owns its client
+    if (session->job != NULL || session->deferred != NULL) {
+        Deferred_request *deferred = (Deferred_request *)malloc(sizeof(Deferred_request) + sizeof(uint16_t) + len);
+        if (deferred == NULL)
+            errx(EXIT_FAILURE, "Out of memory (deferred request)");
+
+        deferred->received = received;
+        deferred->req_index = req_index;
+        deferred->next = NULL;
+        memcpy(deferred->req, req, sizeof(uint16_t) + len);
+
+        Deferred_request **link = &session->deferred;
+        while (*link != NULL)
+            link = &(*link)->next;
+        *link = deferred;
+        return;
+    }
+
+    session_dispatch(session, req, req_index, received);
+}
+
+/*
+ *  Runs the client callbacks of a completed job, in order, on its (current) session.
+ */
+static void job_replay_callbacks(Job *job)
+{
+    while(job->callbacks != NULL) {
+        Deferred_callback *callback = job->callbacks;
+        job->callbacks = callback->next;
+
+        switch(callback->kind) {
+            case CALLBACK_SUBSCRIPTION_INACTIVE:
+                subscriptionInactivityCallback(client, callback->subscription_id, NULL);
+                break;
+
+            case CALLBACK_SUBSCRIPTION_DELETED:
+                deleteSubscriptionCallback(client, callback->subscription_id, NULL);
+                break;
+
+            case CALLBACK_DATA_CHANGE:
+                dataChangeNotificationCallback(client, callback->subscription_id, NULL, callback->monitored_id,
+                                               callback->context, &callback->value);
+                break;
+
+            case CALLBACK_MONITORED_ITEM_DELETED:
+                deleteMonitoredItemCallback(client, callback->subscription_id, NULL, callback->monitored_id,
+                                            callback->context);
+                break;
+
+            case CALLBACK_EVENT:
+                eventNotificationCallback(client, callback->subscription_id, NULL, callback->monitored_id, NULL,
+                                          callback->fields_size, callback->fields);
+                break;
+
+            case CALLBACK_EVENT_ITEM_DELETED:
+                deleteEventItemCallback(client, callback->subscription_id, NULL, callback->monitored_id, NULL);
+                break;
+        }
+
+        callback_free(callback);
+    }
+    job->callbacks_tail = NULL;
+}
+
+/*
+ *  Answers the jobs completed by the workers and gives the clients back to their sessions.
+ */
+static void jobs_complete()
+{
+    Job *job = jobs_take_done();
+    while (job != NULL) {
+        Job *next = job->next;
+        Session *session = job->session;
+
+        session->jobs--;
+        if (session->job == job)
+            session->job = NULL;
+
+        if (session->delete_pending) {
+            // Nobody waits for the answer
+            job_drop(job);
+
+            if (session->jobs == 0) {
+                session_enter(session);
+                session_close();
+                session_enter(&default_session);
+                session_remove(session);
+            }
+
+            job = next;
+            continue;
+        }
+
+        session_enter(session);
+        job_replay_callbacks(job);
+        restore_caller_metadata(&job->caller);
+        job_respond(job);
+        free_caller_metadata();
+        job_free(job);
+
+        // Until a request hands the client to a worker again
+        while (session->job == NULL && session->deferred != NULL) {
+            Deferred_request *deferred = session->deferred;
+            session->deferred = deferred->next;
+            session_dispatch(session, deferred->req, deferred->req_index, deferred->received);
+            free(deferred);
+        }
+
+        job = next;
+    }
+}
+
 int main()
 {
+    main_thread = pthread_self();
     client = UA_Client_new();
+    decode_extension_objects = decode_client_extension_objects;
+    srand((unsigned int)current_time());
 
     struct erlcmd *handler = malloc(sizeof(struct erlcmd));
     erlcmd_init(handler, handle_elixir_request, NULL);
 
+    size_t handlers = 0;
+    for(struct request_handler *rh = request_handlers; rh->name != NULL; rh++)
+        handlers++;
+    port_stats_init(handlers);
+    workers_start();
+
     for (;;) {
-        struct pollfd fdset;
+        struct pollfd fdset[2];
 
-        fdset.fd = STDIN_FILENO;
-        fdset.events = POLLIN;
-        fdset.revents = 0;
+        fdset[0].fd = STDIN_FILENO;
+        fdset[0].events = POLLIN;
+        fdset[0].revents = 0;
 
-        int timeout = -1; // Wait forever unless told by otherwise
-        int rc = poll(&fdset, 1, timeout);
+        // Completed worker jobs
+        fdset[1].fd = jobs_wake[0];
+        fdset[1].events = POLLIN;
+        fdset[1].revents = 0;
+
+        // Wait forever unless told by otherwise, poll groups and event items need the client to iterate on its own.
+        int timeout = sessions_iterate_alone() ? POLL_ITERATE_TIMEOUT_MS : -1;
+        int rc = poll(fdset, 2, timeout);
 
         if (rc < 0) {
             // Retry if EINTR
@@ -1171,24 +7913,33 @@ int main()
             err(EXIT_FAILURE, "poll");
         }
 
-        if (fdset.revents & (POLLIN | POLLHUP)) {
+        if (fdset[1].revents & POLLIN)
+            jobs_complete();
+
+        if (fdset[0].revents & (POLLIN | POLLHUP)) {
             if (erlcmd_process(handler))
                 break;
         }
 
-        // v1.4.x: Check session state to determine if connected
-        UA_SecureChannelState channelState;
-        UA_SessionState sessionState;
-        UA_StatusCode connectStatus;
-        UA_Client_getState(client, &channelState, &sessionState, &connectStatus);
-        
-        if(sessionState >= UA_SESSIONSTATE_CREATED)
-        {
-            UA_Client_run_iterate(client, 0);
-        }
+        sessions_run_iterate();
     }
+
+    // The clients owned by the workers are given back first
+    workers_stop();
     
-    /* Disconnects the client internally */
-    UA_Client_delete(client); 
+    /* Disconnects the clients internally */
+    for(Session *session = sessions; session != NULL; session = session->next) {
+        session->job = NULL;
+        session_enter(session);
+        session_close();
+    }
+
+    while(sessions != &default_session) {
+        Session *next = sessions->next;
+        session_free(sessions);
+        sessions = next;
+    }
+    session_free(&default_session);
+    port_stats_clear();
     free(handler);
 }
\ No newline at end of file
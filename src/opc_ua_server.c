@@ -2,11 +2,18 @@
 #include "open62541.h"
 #include <err.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <poll.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
 #include "erlcmd.h"
 #include "common.h"
 
@@ -30,6 +37,7 @@ typedef struct {
 pthread_t server_tid;
 pthread_attr_t server_attr;
 UA_Boolean running = true;
+bool server_tid_joinable = false;
 
 UA_Server *server;
 UA_Client *discoveryClient;
@@ -146,12 +154,143 @@ static void periodicServerRegister(UA_Server *srv, void *data) {
     UA_Client_disconnect(callbackData->client);
 }
 
+/*****************/
+/* Command queue */
+/*****************/
+
+/*
+ *  While the server thread runs, the requests from Elixir are not executed by the port thread: they
+ *  are queued and executed by the server thread between two iterations, in arrival order and without
+ *  racing the server callbacks (e.g. the onWrite echo of a write from Elixir).
+ *  The server waits for network events in the poll of its event loop, a delayed callback wakes it up
+ *  (through the event loop self-pipe) when a request is queued.
+ *  start_server and stop_server are never queued: the port thread executes them, stop_server waits
+ *  for the server thread to execute the queued requests and exit before it replies.
+ */
+typedef struct Command {
+    struct Command *next;
+    UA_DateTime received;                   // monotonic
+    char req[];                             // {:packet, 2} frame, length included
+} Command;
+
+static pthread_mutex_t commands_lock = PTHREAD_MUTEX_INITIALIZER;
+static Command *commands_head = NULL;
+static Command *commands_tail = NULL;
+static bool commands_queued = false;        // server thread running, requests go to the queue
+static bool commands_wake_pending = false;
+
+static void dispatch_elixir_request(const char *req, UA_DateTime received);
+static void writes_flush_iteration();
+
+static void commands_wake(void *application, void *context)
+{
+    free(context);
+}
+
+// With commands_lock held
+static void commands_wake_server()
+{
+    if(commands_wake_pending)
+        return;
+
+    UA_DelayedCallback *wake = (UA_DelayedCallback *)calloc(1, sizeof(UA_DelayedCallback));
+    if(wake == NULL)
+        return;
+
+    UA_EventLoop *el = UA_Server_getConfig(server)->eventLoop;
+    wake->callback = commands_wake;
+    wake->context = wake;
+    el->addDelayedCallback(el, wake);
+    commands_wake_pending = true;
+}
+
+/*
+ *  Queues a request for the server thread, false if the server thread is not running.
+ */
+static bool commands_push(const char *req, UA_DateTime received)
+{
+    uint16_t be_len;
+    memcpy(&be_len, req, sizeof(uint16_t));
+    size_t size = ntohs(be_len) + sizeof(uint16_t);
+
+    pthread_mutex_lock(&commands_lock);
+    if(!commands_queued) {
+        pthread_mutex_unlock(&commands_lock);
+        return false;
+    }
+
+    Command *command = (Command *)malloc(sizeof(Command) + size);
+    if(command == NULL)
+        errx(EXIT_FAILURE, "Can't queue the request");
+    memcpy(command->req, req, size);
+    command->received = received;
+    command->next = NULL;
+
+    if(commands_tail != NULL)
+        commands_tail->next = command;
+    else
+        commands_head = command;
+    commands_tail = command;
+
+    // One wake up per batch of requests
+    commands_wake_server();
+    pthread_mutex_unlock(&commands_lock);
+
+    return true;
+}
+
+/*
+ *  Executes the queued requests (server thread). With `last`, the queue is closed once empty and the
+ *  next requests are executed by the port thread.
+ */
+static void commands_run(bool last)
+{
+    for(;;) {
+        pthread_mutex_lock(&commands_lock);
+        Command *command = commands_head;
+        commands_head = NULL;
+        commands_tail = NULL;
+        commands_wake_pending = false;
+        if(command == NULL && last)
+            commands_queued = false;
+        pthread_mutex_unlock(&commands_lock);
+
+        if(command == NULL)
+            return;
+
+        while(command != NULL) {
+            Command *next = command->next;
+            dispatch_elixir_request(command->req, command->received);
+            free(command);
+            command = next;
+        }
+    }
+}
+
+/*
+ *  Runs the server until stop_server: after every iteration the queued requests are executed and
+ *  the write notifications are flushed. Once stopped, the requests queued meanwhile are executed and
+ *  the queue is closed.
+ */
 void* server_runner(void* arg)
 {
-	UA_StatusCode retval = UA_Server_run(server, &running);
+    UA_StatusCode retval = UA_Server_run_startup(server);
+    if(retval != UA_STATUSCODE_GOOD) {
+        errx(EXIT_FAILURE, "Unexpected Server error %s", UA_StatusCode_name(retval));
+    }
+
+    while(running) {
+        UA_Server_run_iterate(server, true);
+        commands_run(false);
+        writes_flush_iteration();
+    }
+
+    retval = UA_Server_run_shutdown(server);
     if(retval != UA_STATUSCODE_GOOD) {
         errx(EXIT_FAILURE, "Unexpected Server error %s", UA_StatusCode_name(retval));
     }
+
+    commands_run(true);
     return NULL;
 }
 
@@ -298,6 +437,26 @@ static void handle_set_port(void *entity, bool entity_type, const char *req, int
     send_ok_response();
 }
 
+/*
+ *  Sets the notification messages kept per subscription for Republish (0 for no limit), the
+ *  oldest are discarded when more are unacknowledged.
+ */
+static void handle_set_retransmission_queue_size(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long size;
+    if(ei_decode_ulong(req, req_index, &size) < 0 || size > UA_UINT32_MAX) {
+        send_error_response("einval");
+        return;
+    }
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    UA_Server_getConfig(server)->maxRetransmissionQueueSize = (UA_UInt32)size;
+    send_ok_response();
+#else
+    send_error_response("not_supported");
+#endif
+}
+
 /* 
 *   Configures users and passwords for authentication.
 *   v1.4.x: Uses the successful pattern from server_access_control.c example
@@ -426,16 +585,55 @@ static void handle_add_all_endpoints(void *entity, bool entity_type, const char
     send_ok_response();
 }
 
+/*
+ *  Port thread only (never queued), as stop_server.
+ */
 static void handle_start_server(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    if(server_tid_joinable) {
+        send_ok_response();
+        return;
+    }
+
     running = true;
-    pthread_create(&server_tid, NULL, server_runner, NULL);
+    pthread_mutex_lock(&commands_lock);
+    commands_queued = true;
+    commands_wake_pending = false;
+    pthread_mutex_unlock(&commands_lock);
+
+    server_tid_joinable = pthread_create(&server_tid, NULL, server_runner, NULL) == 0;
+    if(!server_tid_joinable) {
+        pthread_mutex_lock(&commands_lock);
+        commands_queued = false;
+        pthread_mutex_unlock(&commands_lock);
+        send_error_response("eagain");
+        return;
+    }
+
     send_ok_response();
 }
 
-static void handle_stop_server(void *entity, bool entity_type, const char *req, int *req_index)
+/*
+ *  Replies once the server thread executed the requests queued before it and exited, so a following
+ *  start_server starts a new one.
+ */
+static void server_thread_stop()
 {
     running = false;
+    if(!server_tid_joinable)
+        return;
+
+    pthread_mutex_lock(&commands_lock);
+    commands_wake_server();
+    pthread_mutex_unlock(&commands_lock);
+
+    pthread_join(server_tid, NULL);
+    server_tid_joinable = false;
+}
+
+static void handle_stop_server(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    server_thread_stop();
     send_ok_response();
 }
 
@@ -870,6 +1068,231 @@ void handle_add_reference(void *entity, bool entity_type, const char *req, int *
     send_ok_response();
 }
 
+/*
+ *  Server-defined structures. Their UA_DataType is registered in UA_ServerConfig.customDataTypes,
+ *  so the server can serve their DataTypeDefinition and encode their values; the chain is freed
+ *  with the server.
+ */
+#define STRUCTURE_MAX_FIELDS 32
+
+static UA_DataTypeArray *structure_types = NULL;
+
+static void structure_types_clear()
+{
+    while(structure_types != NULL) {
+        UA_DataTypeArray *next = (UA_DataTypeArray *)structure_types->next;
+        UA_DataType *type = (UA_DataType *)structure_types->types;
+
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+        free((char *)type->typeName);
+        for(size_t i = 0; i < type->membersSize; i++)
+            free((char *)type->members[i].memberName);
+#endif
+        free(type->members);
+        UA_NodeId_clear(&type->typeId);
+        UA_NodeId_clear(&type->binaryEncodingId);
+        free(type);
+        free(structure_types);
+        structure_types = next;
+    }
+}
+
+static char *structure_name(const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    long binary_len;
+
+    if(ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        return NULL;
+
+    char *name = (char *)malloc(term_size + 1);
+    if(name == NULL || ei_decode_binary(req, req_index, name, &binary_len) < 0) {
+        free(name);
+        return NULL;
+    }
+    name[binary_len] = '\0';
+
+    return name;
+}
+
+/*
+ *  Lays the builtin scalar fields out like the C compiler lays out the generated types.
+ */
+static UA_StatusCode structure_build(UA_DataType *type, const UA_DataTypeMember *fields, size_t fields_size)
+{
+    size_t offset = 0;
+    size_t alignment = 1;
+    UA_Boolean pointer_free = true;
+
+    UA_DataTypeMember *members = (UA_DataTypeMember *)calloc(fields_size + 1, sizeof(UA_DataTypeMember));
+    if(members == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    for(size_t i = 0; i < fields_size; i++) {
+        const UA_DataType *member_type = fields[i].memberType;
+        size_t member_alignment = !member_type->pointerFree ? sizeof(void *) :
+            member_type->memSize < sizeof(UA_UInt64) ? member_type->memSize : sizeof(UA_UInt64);
+        if(member_type->typeKind == UA_DATATYPEKIND_GUID)
+            member_alignment = sizeof(UA_UInt32);
+
+        size_t padding = (member_alignment - offset % member_alignment) % member_alignment;
+
+        members[i] = fields[i];
+        members[i].padding = (UA_Byte)padding;
+        offset += padding + member_type->memSize;
+        pointer_free = pointer_free && member_type->pointerFree;
+        if(member_alignment > alignment)
+            alignment = member_alignment;
+    }
+
+    offset += (alignment - offset % alignment) % alignment;
+
+    type->memSize = (UA_UInt32)offset;
+    type->typeKind = UA_DATATYPEKIND_STRUCTURE;
+    type->pointerFree = pointer_free;
+    type->overlayable = false;
+    type->membersSize = (UA_UInt32)fields_size;
+    type->members = members;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  Adds a structure data type with builtin scalar fields: its DataType node (a Structure subtype),
+ *  its "Default Binary" encoding node and the type itself to the server configuration.
+ *  Input: {data_type_node_id, encoding_node_id, browse_name, [{field_name, data_type}]}
+ */
+void handle_add_structure_type(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_count;
+    unsigned long data_type;
+    UA_DataTypeMember fields[STRUCTURE_MAX_FIELDS];
+    size_t fields_size = 0;
+    bool invalid = false;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_add_structure_type requires a 4-tuple, term_size = %d", term_size);
+
+    UA_NodeId type_id = assemble_node_id(req, req_index);
+    UA_NodeId encoding_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+
+    memset(fields, 0, sizeof(fields));
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0 || list_count == 0 ||
+       list_count > STRUCTURE_MAX_FIELDS)
+        invalid = true;
+
+    for(int i = 0; i < list_count && !invalid; i++) {
+        char *name = NULL;
+
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 2 ||
+           (name = structure_name(req, req_index)) == NULL ||
+           ei_decode_ulong(req, req_index, &data_type) < 0 || data_type > UA_TYPES_DIAGNOSTICINFO) {
+            free(name);
+            invalid = true;
+            break;
+        }
+
+        fields[fields_size].memberType = &UA_TYPES[data_type];
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+        fields[fields_size].memberName = name;
+#else
+        free(name);
+#endif
+        fields_size++;
+    }
+
+    // Decode list tail
+    if(!invalid)
+        ei_decode_list_header(req, req_index, &list_count);
+
+    UA_DataType *type = NULL;
+    UA_DataTypeArray *array = NULL;
+
+    if(invalid)
+        retval = UA_STATUSCODE_BADINVALIDARGUMENT;
+    else {
+        type = (UA_DataType *)calloc(1, sizeof(UA_DataType));
+        array = (UA_DataTypeArray *)calloc(1, sizeof(UA_DataTypeArray));
+        retval = (type == NULL || array == NULL) ? UA_STATUSCODE_BADOUTOFMEMORY : structure_build(type, fields, fields_size);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_DataTypeAttributes attr = UA_DataTypeAttributes_default;
+        attr.displayName.text = browse_name.name;
+        retval = UA_Server_addDataTypeNode(server, type_id, UA_NODEID_NUMERIC(0, UA_NS0ID_STRUCTURE),
+                                           UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE), browse_name, attr, NULL, NULL);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+        attr.displayName = UA_LOCALIZEDTEXT("", "Default Binary");
+        retval = UA_Server_addObjectNode(server, encoding_id, UA_NODEID_NULL, UA_NODEID_NULL,
+                                         UA_QUALIFIEDNAME(0, "Default Binary"),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_DATATYPEENCODINGTYPE), attr, NULL, NULL);
+        if(retval == UA_STATUSCODE_GOOD) {
+            UA_ExpandedNodeId target;
+            UA_ExpandedNodeId_init(&target);
+            target.nodeId = encoding_id;
+            retval = UA_Server_addReference(server, type_id, UA_NODEID_NUMERIC(0, UA_NS0ID_HASENCODING), target, true);
+        }
+
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_Server_deleteNode(server, encoding_id, true);
+            UA_Server_deleteNode(server, type_id, true);
+        }
+    }
+
+    if(retval == UA_STATUSCODE_GOOD) {
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+        type->typeName = (char *)malloc(browse_name.name.length + 1);
+        if(type->typeName != NULL) {
+            memcpy((char *)type->typeName, browse_name.name.data, browse_name.name.length);
+            ((char *)type->typeName)[browse_name.name.length] = '\0';
+        }
+#endif
+        UA_NodeId_copy(&type_id, &type->typeId);
+        UA_NodeId_copy(&encoding_id, &type->binaryEncodingId);
+
+        array->next = structure_types;
+        array->typesSize = 1;
+        array->types = type;
+        structure_types = array;
+        UA_Server_getConfig(server)->customDataTypes = structure_types;
+    }
+    else {
+#ifdef UA_ENABLE_TYPEDESCRIPTION
+        for(size_t i = 0; i < fields_size; i++)
+            free((char *)fields[i].memberName);
+#endif
+        if(type != NULL)
+            free(type->members);
+        free(type);
+        free(array);
+    }
+
+    UA_NodeId_clear(&type_id);
+    UA_NodeId_clear(&encoding_id);
+    UA_QualifiedName_clear(&browse_name);
+
+    if(invalid) {
+        send_error_response("einval");
+        return;
+    }
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
 /*************/
 /* Discovery */
 /*************/
@@ -1222,119 +1645,3318 @@ void handle_delete_monitored_item(void *entity, bool entity_type, const char *re
     send_ok_response();
 }
 
-/*******************************/
-/* Elixir -> C Message Handler */
-/*******************************/
+/***********/
+/* History */
+/***********/
+
+/*
+ *  History backend. Every configured node keeps its last `capacity` samples in a ring buffer with
+ *  timestamps, statuses and values in separate arrays: scalar values of a fixed size type (the type
+ *  of the first sample) are stored inline, anything else as Variants.
+ *  Samples are appended by the server historizing hook (every value write of a node with Historizing
+ *  set) and are kept in time order, so a read is a binary search followed by a sequential copy;
+ *  samples older than the newest one are dropped.
+ *
+ *  Nodes kept in the on-disk store use the ring buffer as a write buffer: when it is full (and every
+ *  flush interval) its samples are appended as one block to the active segment, a memory-mapped
+ *  append-only file shared by every node. Each node indexes its blocks, so reading a time range is
+ *  still a binary search (over the blocks, then inside one) followed by a sequential scan. Whole
+ *  segments are dropped by the retention policy (age of their newest sample and total size), and the
+ *  indexes are rebuilt scanning the segments when the store is opened. Blocks carry a CRC-32, and a
+ *  segment that can not be read is left untouched on disk: new segments always get a higher id.
+ *  The hook runs in the server thread, the configuration in the Elixir thread.
+ */
+#define HISTORY_MIN_BUCKETS 64
+#define HISTORY_MAX_CAPACITY 10000000
+#define HISTORY_MAX_VALUES_PER_READ 10000   // values per node and HistoryRead, the rest is continued
+#define HISTORY_MIN_SEGMENT_SIZE 65536
+#define HISTORY_MAX_SEGMENT_SIZE 4294967295UL
+#define HISTORY_MAX_FLUSH_INTERVAL 3600000  // ms
+
+#ifdef UA_ENABLE_HISTORIZING
+
+#define HISTORY_SEGMENT_MAGIC "OPEXHST2"
+#define HISTORY_SEGMENT_HEADER_SIZE 16
+#define HISTORY_BLOCK_MAGIC 0x4B4C4248      // "HBLK"
+#define HISTORY_VARIANT_VALUES 0xFFFF       // block values stored as encoded Variants
+#define HISTORY_LOADED_CAPACITY 1024        // write buffer of the nodes found in the store
+#define HISTORY_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+/*
+ *  On-disk block, 8 byte aligned. The header is followed by the encoded node id, the timestamps, the
+ *  statuses and the values: `count` inline values of the builtin type `type`, or `count + 1` offsets
+ *  (relative to the values) delimiting the encoded Variants.
+ */
+typedef struct {
+    UA_UInt32 magic;                        // written last
+    UA_UInt32 checksum;                     // CRC-32 of the block from `size` on
+    UA_UInt32 size;
+    UA_UInt32 count;
+    UA_UInt16 type;
+    UA_UInt16 node_id_size;
+    UA_UInt32 reserved;
+    UA_DateTime first;
+    UA_DateTime last;
+} History_block_header;
 
-struct request_handler {
-    const char *name;
-    void (*handler)(void *entity, bool entity_type, const char *req, int *req_index);
-};
+typedef struct {
+    UA_UInt64 sequence;                     // of the first sample
+    UA_UInt32 count;
+    UA_UInt32 segment;
+    size_t offset;
+} History_block;
 
-/*  Elixir request handler table
- *  FIXME: Order roughly based on most frequent calls to least (WIP).
- */
-static struct request_handler request_handlers[] = {
-    {"test", handle_test},
-    // Reading and Writing Node Attributes ??
-    // TODO: Add UA_Server_writeArrayDimensions, 
-    {"write_node_value", handle_write_node_value},
-    {"read_node_value", handle_read_node_value},
-    {"read_node_values", handle_read_node_values},
-    {"read_node_value_by_index", handle_read_node_value_by_index},
-    {"write_node_browse_name", handle_write_node_browse_name_server},
-    {"write_node_display_name", handle_write_node_display_name},
-    {"write_node_description", handle_write_node_description},
-    {"write_node_write_mask", handle_write_node_write_mask},
-    {"write_node_is_abstract", handle_write_node_is_abstract},
-    {"write_node_inverse_name", handle_write_node_inverse_name},
-    {"write_node_data_type", handle_write_node_data_type},
-    {"write_node_value_rank", handle_write_node_value_rank},
-    {"write_node_array_dimensions", handle_write_node_array_dimensions},
-    {"write_node_access_level", handle_write_node_access_level},
-    {"write_node_minimum_sampling_interval", handle_write_node_minimum_sampling_interval},
-    {"write_node_historizing", handle_write_node_historizing},
-    {"write_node_executable", handle_write_node_executable},
-    {"write_node_blank_array", handle_write_node_blank_array},
-    {"read_node_node_id", handle_read_node_node_id},
-    {"read_node_node_class", handle_read_node_node_class},
-    {"read_node_browse_name", handle_read_node_browse_name},
-    {"read_node_display_name", handle_read_node_display_name},
-    {"read_node_description", handle_read_node_description},
-    {"read_node_write_mask", handle_read_node_write_mask},
-    {"read_node_is_abstract", handle_read_node_is_abstract},
-    {"read_node_symmetric", handle_read_node_symmetric},
-    {"read_node_inverse_name", handle_read_node_inverse_name},
-    {"read_node_contains_no_loops", handle_read_node_contains_no_loops},
-    {"read_node_data_type", handle_read_node_data_type},
-    {"read_node_value_rank", handle_read_node_value_rank},
-    {"read_node_array_dimensions", handle_read_node_array_dimensions},
-    {"read_node_access_level", handle_read_node_access_level},
-    {"read_node_minimum_sampling_interval", handle_read_node_minimum_sampling_interval},
-    {"read_node_historizing", handle_read_node_historizing},
-    {"read_node_executable", handle_read_node_executable},
-    // Local MonitoredItems
-    {"add_monitored_item", handle_add_monitored_item},
-    {"delete_monitored_item", handle_delete_monitored_item},
-    // Node Addition and Deletion
-    {"add_namespace", handle_add_namespace},
-    {"add_variable_node", handle_add_variable_node},
-    {"add_variable_type_node", handle_add_variable_type_node},
-    {"add_object_node", handle_add_object_node},
-    {"add_object_type_node", handle_add_object_type_node},
-    {"add_view_node", handle_add_view_node},
-    {"add_reference_type_node", handle_add_reference_type_node},
-    {"add_data_type_node", handle_add_data_type_node},
-    {"add_reference", handle_add_reference},
-    {"delete_reference", handle_delete_reference},
-    {"delete_node", handle_delete_node},
-    // configuration & lifecycle functions
-    {"get_server_config", handle_get_server_config},
-    {"set_default_server_config", handle_set_default_server_config},
-    {"set_basics", handle_set_basics},
-    {"set_network_tcp_layer", handle_set_network_tcp_layer},
-    // "set_hostname" removed - UA_ServerConfig_setCustomHostname deprecated in v1.4.x
-    {"set_port", handle_set_port},
-    {"set_users", handle_set_users_and_passwords},
-    {"add_all_endpoints", handle_add_all_endpoints},
-    {"start_server", handle_start_server},
-    {"stop_server", handle_stop_server},
-    // Encryption
-    {"set_config_with_security_policies", handle_set_config_with_security_policies},
-    {"add_security_policy_none", handle_add_security_policy_none},
-    {"add_security_policy_basic128rsa15", handle_add_security_policy_basic128rsa15},
-    {"add_security_policy_basic256", handle_add_security_policy_basic256},
-    {"add_security_policy_basic256sha256", handle_add_security_policy_basic256sha256},
-    {"add_all_security_policies", handle_add_all_security_policies},
-    // Discovery
-    {"set_lds_config", handle_set_lds_config},
-    {"discovery_register", handle_discovery_register},
-    {"discovery_unregister", handle_discovery_unregister},
-    { NULL, NULL }
-};
+typedef struct {
+    UA_UInt32 id;
+    int fd;
+    char *data;
+    size_t size;                            // mapped bytes
+    size_t used;
+    UA_DateTime last;                       // newest sample
+    bool sealed;
+} History_segment;
+
+typedef struct {
+    char *path;                             // NULL: no store
+    size_t segment_size;
+    UA_DateTime retention;                  // 0 keeps every segment
+    size_t max_size;                        // 0 does not limit the size
+    History_segment *segments;              // oldest first (not contiguous ids), the last one is the active one
+    size_t segments_size;
+    size_t size;                            // used bytes of all the segments
+    UA_UInt32 next_id;                      // past every segment file found, readable or not
+} History_store;
+
+typedef struct History_node {
+    UA_NodeId node_id;
+    size_t capacity;
+    size_t head;                            // slot of the oldest sample
+    size_t count;
+    UA_UInt64 sequence;                     // samples appended so far, continuation points are sequences
+    UA_DateTime *timestamps;
+    UA_StatusCode *statuses;
+    const UA_DataType *type;                // type of the inline values, NULL: Variants
+    void *values;                           // capacity values (allocated with the first sample)
+    bool disk;                              // the ring buffer is the write buffer of the store
+    History_block *blocks;                  // samples in the store, oldest first
+    size_t blocks_size;
+    size_t blocks_capacity;
+    size_t stored;                          // samples in blocks, they precede the ring buffer ones
+    struct History_node *next;
+} History_node;
+
+static History_node **history_nodes = NULL;
+static size_t history_buckets = 0;
+static size_t history_size = 0;
+static History_store history_store;
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static History_node *history_add_node(const UA_NodeId *node_id, size_t capacity, bool disk);
+
+static History_node *history_find(const UA_NodeId *node_id)
+{
+    if(history_nodes == NULL)
+        return NULL;
 
+    History_node *node = history_nodes[UA_NodeId_hash(node_id) & (history_buckets - 1)];
+    while(node != NULL && !UA_NodeId_equal(&node->node_id, node_id))
+        node = node->next;
 
-/**
- * @brief Decode and forward requests from Elixir to the appropriate handlers
- * @param req the undecoded request
- * @param cookie
- */
-static void handle_elixir_request(const char *req, void *cookie)
+    return node;
+}
+
+static void history_resize(size_t buckets)
 {
-    (void) cookie;
+    History_node **resized = (History_node **)calloc(buckets, sizeof(History_node *));
+    if(resized == NULL)
+        return;
 
-    // Commands are of the form {Command, Arguments}:
-    // {atom(), {pid(), ref()}, term()}
-    int req_index = sizeof(uint16_t);
-    if (ei_decode_version(req, &req_index, NULL) < 0)
-        errx(EXIT_FAILURE, "Message version issue?");
+    for(size_t i = 0; i < history_buckets; i++) {
+        History_node *node = history_nodes[i];
+        while(node != NULL) {
+            History_node *next = node->next;
+            size_t bucket = UA_NodeId_hash(&node->node_id) & (buckets - 1);
+            node->next = resized[bucket];
+            resized[bucket] = node;
+            node = next;
+        }
+    }
 
-    int arity;
-    if (ei_decode_tuple_header(req, &req_index, &arity) < 0 ||
-            arity != 3)
-        errx(EXIT_FAILURE, "expecting {cmd, {pid, ref}, args} tuple");
+    free(history_nodes);
+    history_nodes = resized;
+    history_buckets = buckets;
+}
 
-    char cmd[MAXATOMLEN];
+static size_t history_slot(const History_node *node, size_t position)
+{
+    return (node->head + position) % node->capacity;
+}
+
+static size_t history_total(const History_node *node)
+{
+    return node->stored + node->count;
+}
+
+static void history_free_values(void *values, const UA_DataType *type, size_t capacity)
+{
+    if(values != NULL && type == NULL)
+        for(size_t i = 0; i < capacity; i++)
+            UA_Variant_clear(&((UA_Variant *)values)[i]);
+
+    free(values);
+}
+
+static void history_node_delete(History_node *node)
+{
+    UA_NodeId_clear(&node->node_id);
+    free(node->timestamps);
+    free(node->statuses);
+    history_free_values(node->values, node->type, node->capacity);
+    free(node->blocks);
+    free(node);
+}
+
+/*
+ *  Store blocks
+ */
+
+static const UA_DateTime *history_block_timestamps(const History_block_header *header)
+{
+    return (const UA_DateTime *)((const char *)header + sizeof(History_block_header) +
+                                 HISTORY_ALIGN(header->node_id_size));
+}
+
+static const UA_StatusCode *history_block_statuses(const History_block_header *header)
+{
+    return (const UA_StatusCode *)(history_block_timestamps(header) + header->count);
+}
+
+static const char *history_block_values(const History_block_header *header)
+{
+    return (const char *)history_block_statuses(header) + HISTORY_ALIGN(header->count * sizeof(UA_StatusCode));
+}
+
+static UA_UInt32 history_crc_table[256];
+
+// CRC-32 (IEEE 802.3) of the block, past its magic and checksum.
+static UA_UInt32 history_block_checksum(const History_block_header *header)
+{
+    if(history_crc_table[1] == 0)
+        for(UA_UInt32 i = 0; i < 256; i++) {
+            UA_UInt32 crc = i;
+            for(int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+            history_crc_table[i] = crc;
+        }
+
+    size_t start = offsetof(History_block_header, size);
+    const UA_Byte *bytes = (const UA_Byte *)header + start;
+    UA_UInt32 crc = 0xFFFFFFFF;
+    for(size_t i = 0; i < header->size - start; i++)
+        crc = (crc >> 8) ^ history_crc_table[(crc ^ bytes[i]) & 0xFF];
+
+    return ~crc;
+}
+
+// Checks a block read from a segment with `available` bytes left.
+static bool history_block_valid(const History_block_header *header, size_t available)
+{
+    if(available < sizeof(History_block_header) || header->magic != HISTORY_BLOCK_MAGIC ||
+       header->size < sizeof(History_block_header) || header->size > available || header->count == 0 ||
+       (header->type != HISTORY_VARIANT_VALUES &&
+        (header->type > UA_DATATYPEKIND_DIAGNOSTICINFO || !UA_TYPES[header->type].pointerFree)))
+        return false;
+
+    if(history_block_checksum(header) != header->checksum)
+        return false;
+
+    size_t values_offset = (size_t)(history_block_values(header) - (const char *)header);
+    if(header->type != HISTORY_VARIANT_VALUES)
+        return values_offset + header->count * UA_TYPES[header->type].memSize <= header->size;
+
+    size_t offsets_size = (header->count + 1) * sizeof(UA_UInt32);
+    return values_offset + offsets_size <= header->size &&
+           values_offset + ((const UA_UInt32 *)history_block_values(header))[header->count] <= header->size;
+}
+
+// The segments skipped when the store was opened leave gaps in the ids.
+static History_segment *history_segment(UA_UInt32 id)
+{
+    size_t low = 0;
+    size_t high = history_store.segments_size - 1;
+
+    while(low < high) {
+        size_t middle = low + (high - low) / 2;
+        if(history_store.segments[middle].id < id)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return &history_store.segments[low];
+}
+
+static const History_block_header *history_block_header(const History_block *block)
+{
+    return (const History_block_header *)(history_segment(block->segment)->data + block->offset);
+}
+
+// Block holding the stored sample at position (< node->stored).
+static const History_block *history_block_at(const History_node *node, size_t position)
+{
+    UA_UInt64 sequence = node->blocks[0].sequence + position;
+    size_t low = 0;
+    size_t high = node->blocks_size - 1;
+
+    while(low < high) {
+        size_t middle = low + (high - low + 1) / 2;
+        if(node->blocks[middle].sequence <= sequence)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    return &node->blocks[low];
+}
+
+static UA_StatusCode history_node_add_block(History_node *node, UA_UInt64 sequence, UA_UInt32 count,
+                                            UA_UInt32 segment, size_t offset)
+{
+    if(node->blocks_size == node->blocks_capacity) {
+        size_t capacity = node->blocks_capacity ? node->blocks_capacity * 2 : 16;
+        History_block *blocks = (History_block *)realloc(node->blocks, capacity * sizeof(History_block));
+        if(blocks == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        node->blocks = blocks;
+        node->blocks_capacity = capacity;
+    }
+
+    History_block *block = &node->blocks[node->blocks_size++];
+    block->sequence = sequence;
+    block->count = count;
+    block->segment = segment;
+    block->offset = offset;
+    node->stored += count;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static void history_node_drop_blocks(History_node *node)
+{
+    free(node->blocks);
+    node->blocks = NULL;
+    node->blocks_size = 0;
+    node->blocks_capacity = 0;
+    node->stored = 0;
+}
+
+/*
+ *  Store segments
+ */
+
+static char *history_segment_path(UA_UInt32 id)
+{
+    size_t size = strlen(history_store.path) + 17;
+    char *path = (char *)malloc(size);
+    if(path != NULL)
+        snprintf(path, size, "%s/%010u.hist", history_store.path, id);
+
+    return path;
+}
+
+static History_segment *history_segment_push()
+{
+    History_segment *segments = (History_segment *)realloc(history_store.segments,
+                                                           (history_store.segments_size + 1) * sizeof(History_segment));
+    if(segments == NULL)
+        return NULL;
+
+    history_store.segments = segments;
+    return &segments[history_store.segments_size];
+}
+
+// Releases the space preallocated for the active segment, it is not written anymore.
+static void history_segment_seal(History_segment *segment)
+{
+    msync(segment->data, segment->used, MS_ASYNC);
+    if(ftruncate(segment->fd, segment->used) < 0)
+        warn("history segment %u", segment->id);
+    segment->sealed = true;
+}
+
+static History_segment *history_segment_create(size_t size)
+{
+    History_segment *segment = history_segment_push();
+    UA_UInt32 id = history_store.next_id;
+    char *path = history_segment_path(id);
+    if(segment == NULL || path == NULL) {
+        free(path);
+        return NULL;
+    }
+
+    // Preallocated, so that writes to the mapping do not fail on a full disk. Never reuses a file.
+    char *data = MAP_FAILED;
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd >= 0 && posix_fallocate(fd, 0, (off_t)size) == 0)
+        data = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(data == MAP_FAILED) {
+        if(fd >= 0) {
+            close(fd);
+            unlink(path);
+        }
+        free(path);
+        return NULL;
+    }
+    free(path);
+
+    memcpy(data, HISTORY_SEGMENT_MAGIC, strlen(HISTORY_SEGMENT_MAGIC));
+    history_store.next_id = id + 1;
+    segment->id = id;
+    segment->fd = fd;
+    segment->data = data;
+    segment->size = size;
+    segment->used = HISTORY_SEGMENT_HEADER_SIZE;
+    segment->last = 0;
+    segment->sealed = false;
+
+    history_store.segments_size++;
+    history_store.size += segment->used;
+
+    return segment;
+}
+
+/*
+ *  Maps an existing segment and indexes its blocks, up to the first invalid one. The unused space
+ *  after a torn write (a block without magic) is released, a corrupted block is kept on disk.
+ *  A segment that can not be mapped is skipped.
+ */
+static void history_segment_load(UA_UInt32 id)
+{
+    char *path = history_segment_path(id);
+    int fd = path != NULL ? open(path, O_RDWR) : -1;
+    free(path);
+
+    struct stat info;
+    char *data = MAP_FAILED;
+    History_segment *segment = history_segment_push();
+    if(fd >= 0 && segment != NULL && fstat(fd, &info) == 0 && info.st_size >= HISTORY_SEGMENT_HEADER_SIZE)
+        data = (char *)mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if(data == MAP_FAILED || memcmp(data, HISTORY_SEGMENT_MAGIC, strlen(HISTORY_SEGMENT_MAGIC)) != 0) {
+        if(data != MAP_FAILED)
+            munmap(data, (size_t)info.st_size);
+        if(fd >= 0)
+            close(fd);
+        return;
+    }
+
+    segment->id = id;
+    segment->fd = fd;
+    segment->data = data;
+    segment->size = (size_t)info.st_size;
+    segment->last = 0;
+    segment->sealed = true;
+
+    size_t offset = HISTORY_SEGMENT_HEADER_SIZE;
+    while(offset < segment->size) {
+        const History_block_header *header = (const History_block_header *)(data + offset);
+        if(!history_block_valid(header, segment->size - offset))
+            break;
+
+        UA_NodeId node_id;
+        UA_ByteString encoded = {header->node_id_size, (UA_Byte *)(header + 1)};
+        if(UA_decodeBinary(&encoded, &node_id, &UA_TYPES[UA_TYPES_NODEID], NULL) != UA_STATUSCODE_GOOD)
+            break;
+
+        History_node *node = history_find(&node_id);
+        if(node == NULL)
+            node = history_add_node(&node_id, HISTORY_LOADED_CAPACITY, true);
+        UA_NodeId_clear(&node_id);
+
+        if(node == NULL || history_node_add_block(node, node->sequence, header->count, id, offset) != UA_STATUSCODE_GOOD)
+            break;
+
+        node->sequence += header->count;
+        if(header->last > segment->last)
+            segment->last = header->last;
+        offset += header->size;
+    }
+
+    segment->used = offset;
+    if(offset < segment->size && ((const History_block_header *)(data + offset))->magic != HISTORY_BLOCK_MAGIC &&
+       ftruncate(fd, offset) < 0)
+        warn("history segment %u", id);
+
+    history_store.segments_size++;
+    history_store.size += segment->used;
+}
+
+static void history_segment_close(History_segment *segment)
+{
+    if(!segment->sealed)
+        history_segment_seal(segment);
+
+    munmap(segment->data, segment->size);
+    close(segment->fd);
+}
+
+// Drops the oldest segment and the blocks stored in it.
+static void history_segment_drop()
+{
+    History_segment *oldest = &history_store.segments[0];
+
+    for(size_t i = 0; i < history_buckets; i++)
+        for(History_node *node = history_nodes[i]; node != NULL; node = node->next) {
+            size_t dropped = 0;
+            while(dropped < node->blocks_size && node->blocks[dropped].segment == oldest->id)
+                node->stored -= node->blocks[dropped++].count;
+
+            if(dropped > 0) {
+                node->blocks_size -= dropped;
+                memmove(node->blocks, node->blocks + dropped, node->blocks_size * sizeof(History_block));
+            }
+        }
+
+    char *path = history_segment_path(oldest->id);
+    history_segment_close(oldest);
+    if(path != NULL)
+        unlink(path);
+    free(path);
+
+    history_store.size -= oldest->used;
+    history_store.segments_size--;
+    memmove(history_store.segments, history_store.segments + 1, history_store.segments_size * sizeof(History_segment));
+}
+
+// The active segment is never dropped.
+static void history_store_retain()
+{
+    UA_DateTime now = UA_DateTime_now();
+
+    while(history_store.segments_size > 1) {
+        bool expired = history_store.retention > 0 && history_store.segments[0].last < now - history_store.retention;
+        bool oversized = history_store.max_size > 0 && history_store.size > history_store.max_size;
+        if(!expired && !oversized)
+            break;
+
+        history_segment_drop();
+    }
+}
+
+// Active segment with room for a block of size bytes, rolling over to a new one when full.
+static History_segment *history_store_reserve(size_t size)
+{
+    History_segment *active = &history_store.segments[history_store.segments_size - 1];
+    if(!active->sealed && active->used + size <= active->size)
+        return active;
+
+    if(!active->sealed)
+        history_segment_seal(active);
+    history_store_retain();
+
+    size_t segment_size = history_store.segment_size;
+    if(size + HISTORY_SEGMENT_HEADER_SIZE > segment_size)
+        segment_size = size + HISTORY_SEGMENT_HEADER_SIZE;
+
+    return history_segment_create(segment_size);
+}
+
+static int history_segment_compare(const void *a, const void *b)
+{
+    UA_UInt32 x = *(const UA_UInt32 *)a;
+    UA_UInt32 y = *(const UA_UInt32 *)b;
+
+    return (x > y) - (x < y);
+}
+
+static UA_StatusCode history_store_open(const char *path, size_t segment_size, UA_DateTime retention, size_t max_size)
+{
+    if(mkdir(path, 0755) < 0 && errno != EEXIST)
+        return UA_STATUSCODE_BADNOTFOUND;
+
+    DIR *dir = opendir(path);
+    if(dir == NULL)
+        return UA_STATUSCODE_BADNOTFOUND;
+
+    history_store.path = strdup(path);
+    history_store.segment_size = segment_size;
+    history_store.retention = retention;
+    history_store.max_size = max_size;
+
+    UA_UInt32 *ids = NULL;
+    size_t ids_size = 0;
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL) {
+        unsigned int id;
+        char extra;
+        if(sscanf(entry->d_name, "%10u.hist%c", &id, &extra) != 1)
+            continue;
+
+        UA_UInt32 *resized = (UA_UInt32 *)realloc(ids, (ids_size + 1) * sizeof(UA_UInt32));
+        if(resized == NULL)
+            break;
+        ids = resized;
+        ids[ids_size++] = id;
+    }
+    closedir(dir);
+
+    if(ids_size > 0)
+        qsort(ids, ids_size, sizeof(UA_UInt32), history_segment_compare);
+
+    // Every segment is indexed, the ones that can not be read are skipped and kept
+    for(size_t i = 0; history_store.path != NULL && i < ids_size; i++)
+        history_segment_load(ids[i]);
+    history_store.next_id = ids_size > 0 ? ids[ids_size - 1] + 1 : 0;
+    free(ids);
+
+    if(history_store.path == NULL || history_segment_create(segment_size) == NULL) {
+        for(size_t i = 0; i < history_buckets; i++)
+            for(History_node *node = history_nodes[i]; node != NULL; node = node->next) {
+                history_node_drop_blocks(node);
+                node->disk = false;
+            }
+
+        for(size_t i = 0; i < history_store.segments_size; i++)
+            history_segment_close(&history_store.segments[i]);
+        free(history_store.segments);
+        free(history_store.path);
+        memset(&history_store, 0, sizeof(History_store));
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+    }
+
+    history_store_retain();
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  The value of a ring buffer sample as a Variant (not copied).
+ */
+static void history_ring_variant(const History_node *node, size_t slot, UA_Variant *variant)
+{
+    if(node->type == NULL) {
+        *variant = ((UA_Variant *)node->values)[slot];
+        return;
+    }
+
+    // Inline samples with a bad status are the zeros stored for a missing value
+    UA_Variant_init(variant);
+    if(node->statuses[slot] == UA_STATUSCODE_GOOD)
+        UA_Variant_setScalar(variant, (char *)node->values + slot * node->type->memSize, node->type);
+}
+
+/*
+ *  Appends the ring buffer samples of a store node to the active segment as one block.
+ */
+static UA_StatusCode history_flush_node(History_node *node)
+{
+    if(!node->disk || node->count == 0)
+        return UA_STATUSCODE_GOOD;
+
+    if(history_store.path == NULL)
+        return UA_STATUSCODE_BADINVALIDSTATE;
+
+    // Builtin fixed size types are stored inline, anything else as Variants
+    bool packed = node->type != NULL && node->type->typeKind <= UA_DATATYPEKIND_DIAGNOSTICINFO &&
+                  node->type == &UA_TYPES[node->type->typeKind];
+
+    size_t values_size = (node->count + 1) * sizeof(UA_UInt32);
+    if(packed) {
+        values_size = node->count * node->type->memSize;
+    } else {
+        for(size_t i = 0; i < node->count; i++) {
+            UA_Variant variant;
+            history_ring_variant(node, history_slot(node, i), &variant);
+            values_size += UA_calcSizeBinary(&variant, &UA_TYPES[UA_TYPES_VARIANT]);
+        }
+    }
+
+    size_t node_id_size = UA_calcSizeBinary(&node->node_id, &UA_TYPES[UA_TYPES_NODEID]);
+    size_t size = HISTORY_ALIGN(sizeof(History_block_header) + HISTORY_ALIGN(node_id_size) +
+                                node->count * sizeof(UA_DateTime) + HISTORY_ALIGN(node->count * sizeof(UA_StatusCode)) +
+                                values_size);
+    if(size > UINT32_MAX || node_id_size > UINT16_MAX)
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+
+    History_segment *segment = history_store_reserve(size);
+    if(segment == NULL)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    History_block_header *header = (History_block_header *)(segment->data + segment->used);
+    header->size = (UA_UInt32)size;
+    header->count = (UA_UInt32)node->count;
+    header->type = packed ? (UA_UInt16)node->type->typeKind : HISTORY_VARIANT_VALUES;
+    header->node_id_size = (UA_UInt16)node_id_size;
+
+    UA_ByteString buffer = {node_id_size, (UA_Byte *)(header + 1)};
+    UA_encodeBinary(&node->node_id, &UA_TYPES[UA_TYPES_NODEID], &buffer);
+
+    UA_DateTime *timestamps = (UA_DateTime *)history_block_timestamps(header);
+    UA_StatusCode *statuses = (UA_StatusCode *)history_block_statuses(header);
+    char *values = (char *)history_block_values(header);
+    UA_UInt32 *offsets = (UA_UInt32 *)values;
+    size_t value_offset = (node->count + 1) * sizeof(UA_UInt32);
+
+    for(size_t i = 0; i < node->count; i++) {
+        size_t slot = history_slot(node, i);
+        timestamps[i] = node->timestamps[slot];
+        statuses[i] = node->statuses[slot];
+
+        if(packed) {
+            memcpy(values + i * node->type->memSize, (char *)node->values + slot * node->type->memSize,
+                   node->type->memSize);
+            continue;
+        }
+
+        UA_Variant variant;
+        history_ring_variant(node, slot, &variant);
+        offsets[i] = (UA_UInt32)value_offset;
+        buffer.length = values_size - value_offset;
+        buffer.data = (UA_Byte *)values + value_offset;
+        UA_encodeBinary(&variant, &UA_TYPES[UA_TYPES_VARIANT], &buffer);
+        value_offset += buffer.length;
+    }
+
+    if(!packed)
+        offsets[node->count] = (UA_UInt32)value_offset;
+
+    header->reserved = 0;
+    header->first = timestamps[0];
+    header->last = timestamps[node->count - 1];
+    header->checksum = history_block_checksum(header);
+    header->magic = HISTORY_BLOCK_MAGIC;
+
+    UA_StatusCode retval = history_node_add_block(node, node->sequence - node->count, header->count, segment->id,
+                                                  segment->used);
+    if(retval != UA_STATUSCODE_GOOD) {
+        header->magic = 0;
+        return retval;
+    }
+
+    segment->used += size;
+    history_store.size += size;
+    if(header->last > segment->last)
+        segment->last = header->last;
+
+    node->count = 0;
+    node->head = 0;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static void history_flush_all()
+{
+    for(size_t i = 0; i < history_buckets; i++)
+        for(History_node *node = history_nodes[i]; node != NULL; node = node->next)
+            history_flush_node(node);
+}
+
+static void history_flush(UA_Server *server, void *data)
+{
+    pthread_mutex_lock(&history_lock);
+    history_flush_all();
+    pthread_mutex_unlock(&history_lock);
+}
+
+static void history_store_close()
+{
+    if(history_store.path == NULL)
+        return;
+
+    history_flush_all();
+
+    for(size_t i = 0; i < history_store.segments_size; i++)
+        history_segment_close(&history_store.segments[i]);
+
+    free(history_store.segments);
+    free(history_store.path);
+    memset(&history_store, 0, sizeof(History_store));
+}
+
+/*
+ *  Nodes
+ */
+
+/*
+ *  (Re)allocates the ring buffer of node for capacity samples, keeping the newest ones (store nodes
+ *  are flushed first).
+ */
+static UA_StatusCode history_node_set_capacity(History_node *node, size_t capacity)
+{
+    history_flush_node(node);
+
+    UA_DateTime *timestamps = (UA_DateTime *)calloc(capacity, sizeof(UA_DateTime));
+    UA_StatusCode *statuses = (UA_StatusCode *)calloc(capacity, sizeof(UA_StatusCode));
+    void *values = NULL;
+    if(node->values != NULL)
+        values = calloc(capacity, node->type != NULL ? node->type->memSize : sizeof(UA_Variant));
+
+    if(timestamps == NULL || statuses == NULL || (node->values != NULL && values == NULL)) {
+        free(timestamps);
+        free(statuses);
+        free(values);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    size_t count = node->count < capacity ? node->count : capacity;
+    for(size_t i = 0; i < count; i++) {
+        size_t slot = history_slot(node, node->count - count + i);
+        timestamps[i] = node->timestamps[slot];
+        statuses[i] = node->statuses[slot];
+
+        if(node->type != NULL) {
+            memcpy((char *)values + i * node->type->memSize, (char *)node->values + slot * node->type->memSize,
+                   node->type->memSize);
+        } else if(node->values != NULL) {
+            // Moved, the source slot is left empty
+            ((UA_Variant *)values)[i] = ((UA_Variant *)node->values)[slot];
+            UA_Variant_init(&((UA_Variant *)node->values)[slot]);
+        }
+    }
+
+    free(node->timestamps);
+    free(node->statuses);
+    history_free_values(node->values, node->type, node->capacity);
+
+    node->timestamps = timestamps;
+    node->statuses = statuses;
+    node->values = values;
+    node->capacity = capacity;
+    node->head = 0;
+    node->count = count;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static History_node *history_add_node(const UA_NodeId *node_id, size_t capacity, bool disk)
+{
+    if(history_size >= history_buckets)
+        history_resize(history_buckets ? history_buckets * 2 : HISTORY_MIN_BUCKETS);
+
+    History_node *node = NULL;
+    if(history_nodes != NULL)
+        node = (History_node *)calloc(1, sizeof(History_node));
+    if(node == NULL)
+        return NULL;
+
+    node->disk = disk;
+    if(history_node_set_capacity(node, capacity) != UA_STATUSCODE_GOOD ||
+       UA_NodeId_copy(node_id, &node->node_id) != UA_STATUSCODE_GOOD) {
+        history_node_delete(node);
+        return NULL;
+    }
+
+    size_t bucket = UA_NodeId_hash(node_id) & (history_buckets - 1);
+    node->next = history_nodes[bucket];
+    history_nodes[bucket] = node;
+    history_size++;
+
+    return node;
+}
+
+static UA_StatusCode history_add(const UA_NodeId *node_id, size_t capacity, bool disk)
+{
+    if(disk && history_store.path == NULL)
+        return UA_STATUSCODE_BADINVALIDSTATE;
+
+    History_node *node = history_find(node_id);
+    if(node == NULL)
+        return history_add_node(node_id, capacity, disk) != NULL ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADOUTOFMEMORY;
+
+    // Stored samples stay in their segments until retention
+    if(!disk)
+        history_node_drop_blocks(node);
+
+    node->disk = disk;
+    return history_node_set_capacity(node, capacity);
+}
+
+static void history_remove(const UA_NodeId *node_id)
+{
+    if(history_nodes == NULL)
+        return;
+
+    History_node **link = &history_nodes[UA_NodeId_hash(node_id) & (history_buckets - 1)];
+    while(*link != NULL && !UA_NodeId_equal(&(*link)->node_id, node_id))
+        link = &(*link)->next;
+
+    History_node *node = *link;
+    if(node == NULL)
+        return;
+
+    *link = node->next;
+    history_node_delete(node);
+    history_size--;
+}
+
+static void history_clear()
+{
+    for(size_t i = 0; i < history_buckets; i++) {
+        History_node *node = history_nodes[i];
+        while(node != NULL) {
+            History_node *next = node->next;
+            history_node_delete(node);
+            node = next;
+        }
+    }
+
+    free(history_nodes);
+    history_nodes = NULL;
+    history_buckets = 0;
+    history_size = 0;
+}
+
+/*
+ *  The first sample chooses how values are stored; a value that does not match the inline type
+ *  switches the node to Variants, dropping its samples (store nodes are flushed first and choose
+ *  again).
+ */
+static UA_StatusCode history_node_set_layout(History_node *node, const UA_Variant *value)
+{
+    if(history_flush_node(node) != UA_STATUSCODE_GOOD)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    const UA_DataType *type = NULL;
+    if((node->values == NULL || node->disk) && UA_Variant_isScalar(value) && value->type->pointerFree)
+        type = value->type;
+
+    void *values = calloc(node->capacity, type != NULL ? type->memSize : sizeof(UA_Variant));
+    if(values == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    history_free_values(node->values, node->type, node->capacity);
+    node->type = type;
+    node->values = values;
+    node->head = 0;
+    node->count = 0;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_DateTime history_timestamp(const History_node *node, size_t position)
+{
+    if(position >= node->stored)
+        return node->timestamps[history_slot(node, position - node->stored)];
+
+    const History_block *block = history_block_at(node, position);
+    return history_block_timestamps(history_block_header(block))[node->blocks[0].sequence + position - block->sequence];
+}
+
+static void history_append(History_node *node, const UA_DataValue *value)
+{
+    UA_DateTime timestamp = value->hasSourceTimestamp ? value->sourceTimestamp :
+                            value->hasServerTimestamp ? value->serverTimestamp : UA_DateTime_now();
+
+    if(history_total(node) > 0 && timestamp < history_timestamp(node, history_total(node) - 1))
+        return;
+
+    const UA_Variant *variant = &value->value;
+    bool empty = UA_Variant_isEmpty(variant);
+    bool mismatch = node->type != NULL && !empty && (!UA_Variant_isScalar(variant) || variant->type != node->type);
+    if((node->values == NULL || mismatch) && history_node_set_layout(node, variant) != UA_STATUSCODE_GOOD)
+        return;
+
+    // Store nodes drop the samples they can not write instead of overwriting the oldest ones
+    if(node->count == node->capacity && node->disk && history_flush_node(node) != UA_STATUSCODE_GOOD)
+        return;
+
+    size_t slot;
+    if(node->count < node->capacity) {
+        slot = history_slot(node, node->count);
+        node->count++;
+    } else {
+        slot = node->head;
+        node->head = (node->head + 1) % node->capacity;
+    }
+
+    node->timestamps[slot] = timestamp;
+    node->statuses[slot] = value->hasStatus ? value->status : UA_STATUSCODE_GOOD;
+
+    if(node->type != NULL) {
+        char *stored = (char *)node->values + slot * node->type->memSize;
+        if(empty)
+            memset(stored, 0, node->type->memSize);
+        else
+            memcpy(stored, variant->data, node->type->memSize);
+    } else {
+        UA_Variant *stored = &((UA_Variant *)node->values)[slot];
+        UA_Variant_clear(stored);
+        UA_Variant_copy(variant, stored);
+    }
+
+    node->sequence++;
+}
+
+/*
+ *  Reads
+ */
+
+// First position with a timestamp >= time (> time if after is set).
+static size_t history_lower_bound(const History_node *node, UA_DateTime time, bool after)
+{
+    size_t low = 0;
+    size_t high = history_total(node);
+
+    while(low < high) {
+        size_t middle = low + (high - low) / 2;
+        UA_DateTime timestamp = history_timestamp(node, middle);
+
+        if(timestamp < time || (after && timestamp == time))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+static void history_set_timestamp(UA_DataValue *data_value, UA_DateTime timestamp, UA_TimestampsToReturn timestamps)
+{
+    if(timestamps == UA_TIMESTAMPSTORETURN_SOURCE || timestamps == UA_TIMESTAMPSTORETURN_BOTH) {
+        data_value->hasSourceTimestamp = true;
+        data_value->sourceTimestamp = timestamp;
+    }
+
+    if(timestamps == UA_TIMESTAMPSTORETURN_SERVER || timestamps == UA_TIMESTAMPSTORETURN_BOTH) {
+        data_value->hasServerTimestamp = true;
+        data_value->serverTimestamp = timestamp;
+    }
+}
+
+static void history_sample(const History_node *node, size_t position, UA_TimestampsToReturn timestamps,
+                           UA_DataValue *data_value)
+{
+    UA_DateTime timestamp;
+    UA_StatusCode status;
+
+    if(position >= node->stored) {
+        size_t slot = history_slot(node, position - node->stored);
+        timestamp = node->timestamps[slot];
+        status = node->statuses[slot];
+
+        UA_Variant value;
+        history_ring_variant(node, slot, &value);
+        UA_Variant_copy(&value, &data_value->value);
+    } else {
+        const History_block *block = history_block_at(node, position);
+        const History_block_header *header = history_block_header(block);
+        size_t index = (size_t)(node->blocks[0].sequence + position - block->sequence);
+        const char *values = history_block_values(header);
+        timestamp = history_block_timestamps(header)[index];
+        status = history_block_statuses(header)[index];
+
+        if(header->type != HISTORY_VARIANT_VALUES) {
+            const UA_DataType *type = &UA_TYPES[header->type];
+            if(status == UA_STATUSCODE_GOOD)
+                UA_Variant_setScalarCopy(&data_value->value, values + index * type->memSize, type);
+        } else {
+            const UA_UInt32 *offsets = (const UA_UInt32 *)values;
+            UA_ByteString encoded = {offsets[index + 1] - offsets[index], (UA_Byte *)values + offsets[index]};
+            UA_decodeBinary(&encoded, &data_value->value, &UA_TYPES[UA_TYPES_VARIANT], NULL);
+        }
+    }
+
+    if(status != UA_STATUSCODE_GOOD) {
+        data_value->hasStatus = true;
+        data_value->status = status;
+    }
+
+    data_value->hasValue = !UA_Variant_isEmpty(&data_value->value);
+    history_set_timestamp(data_value, timestamp, timestamps);
+}
+
+// The sample at position, or a BadBoundNotFound value at time when position is out of the history.
+static void history_bound(const History_node *node, size_t position, UA_DateTime time, UA_TimestampsToReturn timestamps,
+                          UA_DataValue *data_value)
+{
+    if(position < history_total(node)) {
+        history_sample(node, position, timestamps, data_value);
+        return;
+    }
+
+    data_value->hasStatus = true;
+    data_value->status = UA_STATUSCODE_BADBOUNDNOTFOUND;
+    history_set_timestamp(data_value, time, timestamps);
+}
+
+/*
+ *  Reads the raw history of a node. Values are returned in forward order when only startTime is set
+ *  or startTime < endTime (startTime <= t < endTime) and in reverse order when only endTime is set or
+ *  startTime > endTime (endTime < t <= startTime). Bounds are not counted in numValuesPerNode.
+ */
+static UA_StatusCode history_read_node(const History_node *node, const UA_ReadRawModifiedDetails *details,
+                                       UA_TimestampsToReturn timestamps, const UA_ByteString *continuation_point,
+                                       UA_ByteString *next_continuation_point, UA_HistoryData *data)
+{
+    bool start_set = details->startTime != 0;
+    bool end_set = details->endTime != 0;
+
+    if((!start_set && !end_set) || ((!start_set || !end_set) && details->numValuesPerNode == 0))
+        return UA_STATUSCODE_BADHISTORYOPERATIONINVALID;
+
+    bool reverse = !start_set || (end_set && details->startTime > details->endTime);
+    UA_DateTime first_time = start_set ? details->startTime : details->endTime;
+    size_t total = history_total(node);
+
+    size_t low, high;
+    if(!reverse) {
+        low = history_lower_bound(node, details->startTime, false);
+        high = end_set ? history_lower_bound(node, details->endTime, false) : total;
+    } else {
+        high = history_lower_bound(node, first_time, true);
+        low = start_set ? history_lower_bound(node, details->endTime, true) : 0;
+    }
+
+    bool first = continuation_point->length == 0;
+    if(!first) {
+        UA_UInt64 sequence;
+        if(continuation_point->length != sizeof(sequence))
+            return UA_STATUSCODE_BADCONTINUATIONPOINTINVALID;
+        memcpy(&sequence, continuation_point->data, sizeof(sequence));
+
+        // Samples overwritten or dropped since the previous read are skipped
+        UA_UInt64 first_sequence = node->sequence - total;
+        size_t position = sequence < first_sequence ? 0 : (size_t)(sequence - first_sequence);
+
+        if(!reverse && position > low)
+            low = position;
+        else if(reverse && (sequence < first_sequence || position + 1 < high))
+            high = sequence < first_sequence ? low : position + 1;
+    }
+
+    size_t available = high > low ? high - low : 0;
+    size_t limit = HISTORY_MAX_VALUES_PER_READ;
+    if(details->numValuesPerNode > 0 && details->numValuesPerNode < limit)
+        limit = details->numValuesPerNode;
+
+    size_t taken = available < limit ? available : limit;
+    bool complete = taken == available;
+    bool first_bound = details->returnBounds && first;
+    bool last_bound = details->returnBounds && complete && (reverse ? start_set : end_set);
+    size_t values_size = taken + first_bound + last_bound;
+
+    if(values_size > 0) {
+        data->dataValues = (UA_DataValue *)UA_Array_new(values_size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+        if(data->dataValues == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        data->dataValuesSize = values_size;
+    }
+
+    size_t k = 0;
+    if(first_bound)
+        history_bound(node, reverse ? high : (low > 0 ? low - 1 : total), first_time, timestamps,
+                      &data->dataValues[k++]);
+
+    for(size_t i = 0; i < taken; i++)
+        history_sample(node, reverse ? high - 1 - i : low + i, timestamps, &data->dataValues[k++]);
+
+    if(last_bound)
+        history_bound(node, reverse ? (low > 0 ? low - 1 : total) : high, details->endTime, timestamps,
+                      &data->dataValues[k++]);
+
+    if(!complete) {
+        UA_UInt64 next = node->sequence - total + (reverse ? high - taken - 1 : low + taken);
+        UA_StatusCode retval = UA_ByteString_allocBuffer(next_continuation_point, sizeof(next));
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        memcpy(next_continuation_point->data, &next, sizeof(next));
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  History database plugin
+ */
+
+static void history_set_value(UA_Server *server, void *hdbContext, const UA_NodeId *sessionId, void *sessionContext,
+                              const UA_NodeId *nodeId, UA_Boolean historizing, const UA_DataValue *value)
+{
+    if(!historizing)
+        return;
+
+    pthread_mutex_lock(&history_lock);
+    History_node *node = history_find(nodeId);
+    if(node != NULL)
+        history_append(node, value);
+    pthread_mutex_unlock(&history_lock);
+}
+
+static void history_read_raw(UA_Server *server, void *hdbContext, const UA_NodeId *sessionId, void *sessionContext,
+                             const UA_RequestHeader *requestHeader, const UA_ReadRawModifiedDetails *historyReadDetails,
+                             UA_TimestampsToReturn timestampsToReturn, UA_Boolean releaseContinuationPoints,
+                             size_t nodesToReadSize, const UA_HistoryReadValueId *nodesToRead,
+                             UA_HistoryReadResponse *response, UA_HistoryData * const * const historyData)
+{
+    pthread_mutex_lock(&history_lock);
+    for(size_t i = 0; i < nodesToReadSize; i++) {
+        History_node *node = history_find(&nodesToRead[i].nodeId);
+
+        if(node == NULL)
+            response->results[i].statusCode = UA_STATUSCODE_BADHISTORYOPERATIONUNSUPPORTED;
+        else if(!releaseContinuationPoints)
+            response->results[i].statusCode =
+                history_read_node(node, historyReadDetails, timestampsToReturn, &nodesToRead[i].continuationPoint,
+                                  &response->results[i].continuationPoint, historyData[i]);
+    }
+    pthread_mutex_unlock(&history_lock);
+}
+
+static void history_database_clear(UA_HistoryDatabase *hdb)
+{
+    pthread_mutex_lock(&history_lock);
+    history_store_close();
+    history_clear();
+    pthread_mutex_unlock(&history_lock);
+}
+
+static void history_install()
+{
+    UA_HistoryDatabase *database = &UA_Server_getConfig(server)->historyDatabase;
+    if(database->setValue == history_set_value)
+        return;
+
+    if(database->clear != NULL)
+        database->clear(database);
+
+    memset(database, 0, sizeof(UA_HistoryDatabase));
+    database->clear = history_database_clear;
+    database->setValue = history_set_value;
+    database->readRaw = history_read_raw;
+}
+
+#endif
+
+/*
+ *  Opens the on-disk history store in a directory (created if needed), indexing the segments found
+ *  in it. Can only be opened once.
+ *  Input: {path, segment_size, retention (s, 0 = keep), max_size (bytes, 0 = no limit), flush_interval (ms)}
+ */
+static void handle_set_history_store(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    unsigned long segment_size;
+    unsigned long retention;
+    unsigned long max_size;
+    unsigned long flush_interval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 5)
+        errx(EXIT_FAILURE, ":handle_set_history_store requires a 5-tuple, term_size = %d", term_size);
+
+    if(ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid history store path (size)");
+
+    char *path = (char *)malloc(term_size + 1);
+    long binary_len;
+    if(path == NULL || ei_decode_binary(req, req_index, path, &binary_len) < 0)
+        errx(EXIT_FAILURE, "Invalid history store path");
+    path[binary_len] = '\0';
+
+    if(ei_decode_ulong(req, req_index, &segment_size) < 0 ||
+       ei_decode_ulong(req, req_index, &retention) < 0 ||
+       ei_decode_ulong(req, req_index, &max_size) < 0 ||
+       ei_decode_ulong(req, req_index, &flush_interval) < 0 ||
+       binary_len == 0 || segment_size < HISTORY_MIN_SEGMENT_SIZE || segment_size > HISTORY_MAX_SEGMENT_SIZE ||
+       flush_interval == 0 || flush_interval > HISTORY_MAX_FLUSH_INTERVAL) {
+        free(path);
+        send_error_response("einval");
+        return;
+    }
+
+#ifdef UA_ENABLE_HISTORIZING
+    history_install();
+
+    UA_StatusCode retval = UA_STATUSCODE_BADINVALIDSTATE;
+    pthread_mutex_lock(&history_lock);
+    if(history_store.path == NULL)
+        retval = history_store_open(path, segment_size, (UA_DateTime)retention * UA_DATETIME_SEC, max_size);
+    pthread_mutex_unlock(&history_lock);
+    free(path);
+
+    UA_UInt64 callback_id;
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_addRepeatedCallback(server, history_flush, NULL, (UA_Double)flush_interval, &callback_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+#else
+    free(path);
+    send_error_response("not_supported");
+#endif
+}
+
+/*
+ *  Keeps the last `capacity` values of a variable in the in-memory history (0 drops its history), or
+ *  appends them to the on-disk store using `capacity` values as write buffer.
+ *  The node Historizing attribute and the HistoryRead bit of its AccessLevel follow.
+ *  Input: {node_id, capacity, disk}
+ */
+static void handle_set_node_history(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int disk;
+    unsigned long capacity;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_set_node_history requires a 3-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(ei_decode_ulong(req, req_index, &capacity) < 0 || capacity > HISTORY_MAX_CAPACITY ||
+       ei_decode_boolean(req, req_index, &disk) < 0) {
+        UA_NodeId_clear(&node_id);
+        send_error_response("einval");
+        return;
+    }
+
+#ifdef UA_ENABLE_HISTORIZING
+    UA_Byte access_level;
+    UA_StatusCode retval = UA_Server_readAccessLevel(server, node_id, &access_level);
+
+    pthread_mutex_lock(&history_lock);
+    if(retval == UA_STATUSCODE_GOOD && disk && capacity > 0 && history_store.path == NULL)
+        retval = UA_STATUSCODE_BADINVALIDSTATE;
+    pthread_mutex_unlock(&history_lock);
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        if(capacity > 0)
+            access_level |= UA_ACCESSLEVELMASK_HISTORYREAD;
+        else
+            access_level &= (UA_Byte)~UA_ACCESSLEVELMASK_HISTORYREAD;
+        retval = UA_Server_writeAccessLevel(server, node_id, access_level);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_writeHistorizing(server, node_id, capacity > 0);
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        history_install();
+
+        pthread_mutex_lock(&history_lock);
+        if(capacity > 0)
+            retval = history_add(&node_id, capacity, disk);
+        else
+            history_remove(&node_id);
+        pthread_mutex_unlock(&history_lock);
+    }
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+#else
+    UA_NodeId_clear(&node_id);
+    send_error_response("not_supported");
+#endif
+}
+
+/**********/
+/* Events */
+/**********/
+
+/*
+ *  Events are instances of an event type (a BaseEventType subtype) created in the address space,
+ *  their fields are the properties of the instance. Triggering an event hands a snapshot of its
+ *  fields to the event monitored items of the origin node and its ancestors up to the Server object.
+ *  The batch trigger reuses one instance per event type (a template), so a burst of events does not
+ *  add and delete a node (and its properties) per event. The template keeps the original value of
+ *  every field an event wrote and restores it before the next event, whose SourceNode and SourceName
+ *  are set from its origin: events do not inherit the fields of the previous one.
+ */
+#define MAX_EVENT_TEMPLATES 64
+#define MAX_EVENT_FAILURES 256
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+typedef struct {
+    UA_QualifiedName name;
+    UA_Variant value;
+} Event_field;
+
+typedef struct {
+    UA_NodeId event_type;
+    UA_NodeId event_node;
+    Event_field *defaults;      // original value of the fields written by the events
+    size_t defaults_size;
+} Event_template;
+
+static Event_template event_templates[MAX_EVENT_TEMPLATES];
+static size_t event_templates_size = 0;
+
+/*
+ *  Returns the template of an event type, creating it if needed. Once MAX_EVENT_TEMPLATES types are
+ *  cached a new instance is created and `*entry` is NULL, the caller deletes it when triggered.
+ */
+static UA_StatusCode event_template(const UA_NodeId *event_type, UA_NodeId *event_node, Event_template **entry)
+{
+    *entry = NULL;
+
+    for(size_t i = 0; i < event_templates_size; i++) {
+        if(UA_NodeId_equal(&event_templates[i].event_type, event_type)) {
+            *event_node = event_templates[i].event_node;
+            *entry = &event_templates[i];
+            return UA_STATUSCODE_GOOD;
+        }
+    }
+
+    UA_StatusCode retval = UA_Server_createEvent(server, *event_type, event_node);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    if(event_templates_size == MAX_EVENT_TEMPLATES)
+        return UA_STATUSCODE_GOOD;
+
+    Event_template *new_entry = &event_templates[event_templates_size];
+    if(UA_NodeId_copy(event_type, &new_entry->event_type) != UA_STATUSCODE_GOOD)
+        return UA_STATUSCODE_GOOD;
+    new_entry->event_node = *event_node;
+    new_entry->defaults = NULL;
+    new_entry->defaults_size = 0;
+    event_templates_size++;
+    *entry = new_entry;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static void event_template_clear(Event_template *entry)
+{
+    UA_NodeId_clear(&entry->event_type);
+    UA_NodeId_clear(&entry->event_node);
+    for(size_t i = 0; i < entry->defaults_size; i++) {
+        UA_QualifiedName_clear(&entry->defaults[i].name);
+        UA_Variant_clear(&entry->defaults[i].value);
+    }
+    free(entry->defaults);
+    entry->defaults = NULL;
+    entry->defaults_size = 0;
+}
+
+// Forgets the template of an event type whose instance is gone (e.g. deleted with delete_node).
+static void event_template_drop(const UA_NodeId *event_type)
+{
+    for(size_t i = 0; i < event_templates_size; i++) {
+        if(UA_NodeId_equal(&event_templates[i].event_type, event_type)) {
+            event_template_clear(&event_templates[i]);
+            event_templates[i] = event_templates[--event_templates_size];
+            return;
+        }
+    }
+}
+
+static void event_templates_clear()
+{
+    for(size_t i = 0; i < event_templates_size; i++)
+        event_template_clear(&event_templates[i]);
+    event_templates_size = 0;
+}
+
+// Saves the original value of a field before an event of the template writes it for the first time.
+static UA_StatusCode event_template_save(Event_template *entry, const UA_QualifiedName *field)
+{
+    for(size_t i = 0; i < entry->defaults_size; i++) {
+        if(UA_QualifiedName_equal(&entry->defaults[i].name, field))
+            return UA_STATUSCODE_GOOD;
+    }
+
+    Event_field *defaults = (Event_field *)realloc(entry->defaults, (entry->defaults_size + 1) * sizeof(Event_field));
+    if(defaults == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    entry->defaults = defaults;
+
+    Event_field *saved = &defaults[entry->defaults_size];
+    UA_StatusCode retval = UA_Server_readObjectProperty(server, entry->event_node, *field, &saved->value);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    retval = UA_QualifiedName_copy(field, &saved->name);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_Variant_clear(&saved->value);
+        return retval;
+    }
+    entry->defaults_size++;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+// Restores the fields written by the previous events of the template.
+static UA_StatusCode event_template_reset(Event_template *entry)
+{
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    for(size_t i = 0; i < entry->defaults_size && retval == UA_STATUSCODE_GOOD; i++)
+        retval = UA_Server_writeObjectProperty(server, entry->event_node, entry->defaults[i].name,
+                                               entry->defaults[i].value);
+
+    return retval;
+}
+
+static UA_StatusCode event_write_time(const UA_NodeId event_node)
+{
+    UA_DateTime now = UA_DateTime_now();
+    UA_Variant value;
+    UA_Variant_setScalar(&value, &now, &UA_TYPES[UA_TYPES_DATETIME]);
+    return UA_Server_writeObjectProperty(server, event_node, UA_QUALIFIEDNAME(0, "Time"), value);
+}
+
+// SourceNode is the origin, SourceName its browse name.
+static UA_StatusCode event_write_source(const UA_NodeId event_node, UA_NodeId *origin)
+{
+    UA_Variant value;
+    UA_Variant_setScalar(&value, origin, &UA_TYPES[UA_TYPES_NODEID]);
+    UA_StatusCode retval = UA_Server_writeObjectProperty(server, event_node, UA_QUALIFIEDNAME(0, "SourceNode"), value);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    UA_QualifiedName browse_name;
+    retval = UA_Server_readBrowseName(server, *origin, &browse_name);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    UA_Variant_setScalar(&value, &browse_name.name, &UA_TYPES[UA_TYPES_STRING]);
+    retval = UA_Server_writeObjectProperty(server, event_node, UA_QUALIFIEDNAME(0, "SourceName"), value);
+    UA_QualifiedName_clear(&browse_name);
+
+    return retval;
+}
+
+/*
+ *  Writes event fields, stopping at the first failure. The original values are saved in `entry`, if any.
+ *  Input: [{qualified_name, {data_type, is_array, value}}]
+ */
+static UA_StatusCode event_write_fields(const UA_NodeId event_node, Event_template *entry, const char *req,
+                                        int *req_index)
+{
+    int term_size;
+    int list_count;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0)
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    for(int i = 0; i < list_count && retval == UA_STATUSCODE_GOOD; i++) {
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 2)
+            errx(EXIT_FAILURE, ":event_write_fields requires 2-tuple fields, term_size = %d", term_size);
+
+        UA_QualifiedName field = assemble_qualified_name(req, req_index);
+        UA_Variant value;
+        retval = assemble_variant(req, req_index, &value);
+
+        if(retval == UA_STATUSCODE_GOOD && entry != NULL)
+            retval = event_template_save(entry, &field);
+
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = UA_Server_writeObjectProperty(server, event_node, field, value);
+
+        UA_QualifiedName_clear(&field);
+        UA_Variant_clear(&value);
+    }
+
+    // Decode list tail
+    if(retval == UA_STATUSCODE_GOOD && list_count > 0)
+        ei_decode_list_header(req, req_index, &list_count);
+
+    return retval;
+}
+
+/*
+ *  Triggers one event of the batch from its template: the fields of the previous event are restored,
+ *  Time, SourceNode and SourceName are set before the given fields are written.
+ *  Input: {event_type, origin_node_id, [field]}
+ */
+static UA_StatusCode event_trigger_batched(const char *req, int *req_index)
+{
+    int term_size;
+    Event_template *entry;
+    UA_NodeId event_node;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":event_trigger_batched requires a 3-tuple, term_size = %d", term_size);
+
+    UA_NodeId event_type = assemble_node_id(req, req_index);
+    UA_NodeId origin = assemble_node_id(req, req_index);
+
+    UA_StatusCode retval = event_template(&event_type, &event_node, &entry);
+    bool owned = retval == UA_STATUSCODE_GOOD && entry == NULL;
+    if(retval == UA_STATUSCODE_GOOD) {
+        retval = event_write_time(event_node);
+        if(retval == UA_STATUSCODE_BADNODEIDUNKNOWN && entry != NULL) {
+            event_template_drop(&event_type);
+            retval = event_template(&event_type, &event_node, &entry);
+            owned = retval == UA_STATUSCODE_GOOD && entry == NULL;
+            if(retval == UA_STATUSCODE_GOOD)
+                retval = event_write_time(event_node);
+        }
+    }
+
+    if(retval == UA_STATUSCODE_GOOD && entry != NULL)
+        retval = event_template_reset(entry);
+
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = event_write_source(event_node, &origin);
+
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = event_write_fields(event_node, entry, req, req_index);
+
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_triggerEvent(server, event_node, origin, NULL, owned);
+    else if(owned)
+        UA_Server_deleteNode(server, event_node, true);
+
+    if(owned)
+        UA_NodeId_clear(&event_node);
+    UA_NodeId_clear(&event_type);
+    UA_NodeId_clear(&origin);
+
+    return retval;
+}
+#endif
+
+/*
+ *  Creates an instance of an event type, replies its node id.
+ *  Input: event_type
+ */
+static void handle_create_event(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_NodeId event_type = assemble_node_id(req, req_index);
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+    UA_NodeId event_node;
+    UA_StatusCode retval = UA_Server_createEvent(server, event_type, &event_node);
+
+    UA_NodeId_clear(&event_type);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_data_response(&event_node, 12, 0);
+    UA_NodeId_clear(&event_node);
+#else
+    UA_NodeId_clear(&event_type);
+    send_error_response("not_supported");
+#endif
+}
+
+/*
+ *  Writes the fields (properties) of an event instance.
+ *  Input: {event_node_id, [{qualified_name, {data_type, is_array, value}}]}
+ */
+static void handle_set_event_fields(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_event_fields requires a 2-tuple, term_size = %d", term_size);
+
+    UA_NodeId event_node = assemble_node_id(req, req_index);
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+    UA_StatusCode retval = event_write_fields(event_node, NULL, req, req_index);
+
+    UA_NodeId_clear(&event_node);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+#else
+    UA_NodeId_clear(&event_node);
+    send_error_response("not_supported");
+#endif
+}
+
+/*
+ *  Triggers an event instance from an origin node, replies the EventId. The instance is deleted
+ *  afterwards unless `keep` is set.
+ *  Input: {event_node_id, origin_node_id, keep}
+ */
+static void handle_trigger_event(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int keep;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_trigger_event requires a 3-tuple, term_size = %d", term_size);
+
+    UA_NodeId event_node = assemble_node_id(req, req_index);
+    UA_NodeId origin = assemble_node_id(req, req_index);
+
+    if(ei_decode_boolean(req, req_index, &keep) < 0) {
+        UA_NodeId_clear(&event_node);
+        UA_NodeId_clear(&origin);
+        send_error_response("einval");
+        return;
+    }
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+    UA_ByteString event_id;
+    UA_ByteString_init(&event_id);
+    UA_StatusCode retval = UA_Server_triggerEvent(server, event_node, origin, &event_id, !keep);
+
+    UA_NodeId_clear(&event_node);
+    UA_NodeId_clear(&origin);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_data_response(event_id.data, 5, event_id.length);
+    UA_ByteString_clear(&event_id);
+#else
+    UA_NodeId_clear(&event_node);
+    UA_NodeId_clear(&origin);
+    send_error_response("not_supported");
+#endif
+}
+
+/*
+ *  Triggers many events in one request: replies :ok, or {:error, [{index, status}]} listing the
+ *  first MAX_EVENT_FAILURES events that failed. A failed event does not stop the batch.
+ *  Input: [{event_type, origin_node_id, [field]}]
+ */
+static void handle_trigger_events(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int list_count;
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0 || list_count == 0) {
+        send_error_response("einval");
+        return;
+    }
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+    char resp[ERLCMD_BUF_SIZE];
+    int resp_index = sizeof(uint16_t); // Space for payload size
+    int failures = 0;
+
+    resp[resp_index++] = response_id;
+    ei_encode_version(resp, &resp_index);
+    ei_encode_tuple_header(resp, &resp_index, 3);
+    encode_caller_metadata(resp, &resp_index);
+    int result_index = resp_index;
+
+    for(int i = 0; i < list_count; i++) {
+        // A failed event may leave its fields undecoded, the next one starts after the whole term.
+        int next_index = *req_index;
+        if(ei_skip_term(req, &next_index) < 0)
+            errx(EXIT_FAILURE, ":handle_trigger_events malformed event %d", i);
+
+        UA_StatusCode retval = event_trigger_batched(req, req_index);
+        *req_index = next_index;
+
+        if(retval == UA_STATUSCODE_GOOD || failures++ >= MAX_EVENT_FAILURES)
+            continue;
+
+        if(failures == 1) {
+            ei_encode_tuple_header(resp, &resp_index, 2);
+            ei_encode_atom(resp, &resp_index, "error");
+        }
+        const char *status = UA_StatusCode_name(retval);
+        ei_encode_list_header(resp, &resp_index, 1);
+        ei_encode_tuple_header(resp, &resp_index, 2);
+        ei_encode_long(resp, &resp_index, i);
+        ei_encode_binary(resp, &resp_index, status, strlen(status));
+    }
+
+    if(failures == 0) {
+        resp_index = result_index;
+        ei_encode_atom(resp, &resp_index, "ok");
+    } else {
+        ei_encode_empty_list(resp, &resp_index);
+    }
+
+    erlcmd_send(resp, resp_index);
+#else
+    send_error_response("not_supported");
+#endif
+}
+
+/***********/
+/* Methods */
+/***********/
+
+/*
+ *  Method nodes added from Elixir are async: instead of running a callback on the server thread, the
+ *  server queues their calls and keeps serving the other requests. Queued calls are dispatched to
+ *  Elixir as {:method_call, call_id, {object_id, method_id, [input]}} frames and answered with
+ *  set_method_result. At most `method_max_calls` calls are dispatched at a time, the others wait in
+ *  the server queue (bounded by the same limit). Calls still pending after `method_timeout` ms are
+ *  answered with BadTimeout by the server.
+ */
+#define METHOD_DEFAULT_TIMEOUT 10000
+#define METHOD_DEFAULT_MAX_CALLS 64
+#define METHOD_MAX_CALLS 4096
+#define METHOD_MAX_ARGUMENTS 64
+
+static unsigned long method_timeout = METHOD_DEFAULT_TIMEOUT;
+static unsigned long method_max_calls = METHOD_DEFAULT_MAX_CALLS;
+
+#if UA_MULTITHREADING >= 100
+typedef struct {
+    UA_UInt32 id;                           // 0 for a free slot
+    void *context;                          // server async operation
+    UA_DateTime deadline;
+} Method_call;
+
+static pthread_mutex_t method_lock = PTHREAD_MUTEX_INITIALIZER;
+static Method_call *method_calls = NULL;
+static size_t method_calls_capacity = 0;
+static size_t method_calls_pending = 0;
+static UA_UInt32 method_call_id = 0;
+
+static Method_call *method_call_find(UA_UInt32 id)
+{
+    for(size_t i = 0; i < method_calls_capacity; i++) {
+        if(method_calls[i].id == id)
+            return &method_calls[i];
+    }
+    return NULL;
+}
+
+static void method_call_remove(Method_call *call)
+{
+    call->id = 0;
+    call->context = NULL;
+    method_calls_pending--;
+}
+
+// The server already answered the calls past their deadline.
+static void method_calls_expire()
+{
+    UA_DateTime now = UA_DateTime_now();
+    for(size_t i = 0; i < method_calls_capacity && method_calls_pending > 0; i++) {
+        if(method_calls[i].id != 0 && method_calls[i].deadline < now)
+            method_call_remove(&method_calls[i]);
+    }
+}
+
+/*
+ *  Output: {:method_call, call_id, {object_id, method_id, [input]}}
+ */
+static void encode_method_call(char *resp, int *resp_index, UA_UInt32 id, const UA_CallMethodRequest *request)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    ei_encode_atom(resp, resp_index, "method_call");
+    ei_encode_ulong(resp, resp_index, id);
+    ei_encode_tuple_header(resp, resp_index, 3);
+    encode_node_id(resp, resp_index, (void *)&request->objectId);
+    encode_node_id(resp, resp_index, (void *)&request->methodId);
+
+    if(request->inputArgumentsSize > 0)
+        ei_encode_list_header(resp, resp_index, (int)request->inputArgumentsSize);
+    for(size_t i = 0; i < request->inputArgumentsSize; i++)
+        encode_variant_struct(resp, resp_index, (void *)&request->inputArguments[i]);
+    ei_encode_empty_list(resp, resp_index);
+}
+
+static UA_StatusCode method_send_call(UA_UInt32 id, const UA_CallMethodRequest *request)
+{
+    // Size pass first: the call must fit the {:packet, 2} port frame
+    int resp_size = sizeof(uint16_t);
+    encode_method_call(NULL, &resp_size, id, request);
+
+    if(resp_size > erlcmd_frame_limit())
+        return UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    int resp_index = sizeof(uint16_t);
+    encode_method_call(resp, &resp_index, id, request);
+    erlcmd_send(resp, resp_index);
+    free(resp);
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static void method_set_status(UA_Server *server, void *context, UA_StatusCode status)
+{
+    UA_AsyncOperationResponse response;
+    UA_CallMethodResult_init(&response.callMethodResult);
+    response.callMethodResult.statusCode = status;
+    UA_Server_setAsyncOperationResult(server, &response, context);
+}
+
+/*
+ *  Moves queued calls to Elixir while there is room for them. Called by the server when a call is
+ *  queued and after every result. Calls are registered before their frame is sent, and answered
+ *  with method_lock released.
+ */
+static void method_dispatch(UA_Server *server)
+{
+    UA_AsyncOperationType type;
+    const UA_AsyncOperationRequest *request;
+    void *context;
+    UA_DateTime deadline;
+
+    for(;;) {
+        UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+        pthread_mutex_lock(&method_lock);
+        method_calls_expire();
+
+        if(method_calls_pending == method_calls_capacity ||
+           !UA_Server_getAsyncOperationNonBlocking(server, &type, &request, &context, &deadline)) {
+            pthread_mutex_unlock(&method_lock);
+            return;
+        }
+
+        if(type != UA_ASYNCOPERATIONTYPE_CALL) {
+            retval = UA_STATUSCODE_BADNOTSUPPORTED;
+        } else {
+            if(++method_call_id == 0)
+                method_call_id = 1;
+
+            Method_call *call = method_call_find(0);
+            call->id = method_call_id;
+            call->context = context;
+            call->deadline = deadline;
+            method_calls_pending++;
+
+            retval = method_send_call(call->id, &request->callMethodRequest);
+            if(retval != UA_STATUSCODE_GOOD)
+                method_call_remove(call);
+        }
+        pthread_mutex_unlock(&method_lock);
+
+        if(retval != UA_STATUSCODE_GOOD)
+            method_set_status(server, context, retval);
+    }
+}
+
+/*
+ *  Applies the timeout and the call limit. The limit can't change while calls are dispatched.
+ */
+static UA_StatusCode method_install()
+{
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+
+    pthread_mutex_lock(&method_lock);
+    if(method_calls_capacity != method_max_calls) {
+        if(method_calls_pending > 0) {
+            retval = UA_STATUSCODE_BADINVALIDSTATE;
+        } else {
+            Method_call *calls = (Method_call *)calloc(method_max_calls, sizeof(Method_call));
+            if(calls == NULL) {
+                retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            } else {
+                free(method_calls);
+                method_calls = calls;
+                method_calls_capacity = method_max_calls;
+            }
+        }
+    }
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        config->asyncOperationTimeout = (UA_Double)method_timeout;
+        config->maxAsyncOperationQueueSize = method_max_calls;
+        config->asyncOperationNotifyCallback = method_dispatch;
+    }
+    pthread_mutex_unlock(&method_lock);
+
+    return retval;
+}
+#endif
+
+/*
+ *  Decodes method arguments definitions.
+ *  Input: [{name, data_type, value_rank}]
+ */
+static UA_StatusCode assemble_method_arguments(const char *req, int *req_index, UA_Argument **arguments, size_t *arguments_size)
+{
+    int term_size;
+    int term_type;
+    int list_count;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    *arguments = NULL;
+    *arguments_size = 0;
+
+    if(ei_decode_list_header(req, req_index, &list_count) < 0 || list_count > METHOD_MAX_ARGUMENTS)
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+
+    if(list_count == 0)
+        return UA_STATUSCODE_GOOD;
+
+    *arguments = (UA_Argument *)UA_Array_new(list_count, &UA_TYPES[UA_TYPES_ARGUMENT]);
+    if(*arguments == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    *arguments_size = list_count;
+
+    for(int i = 0; i < list_count && retval == UA_STATUSCODE_GOOD; i++) {
+        UA_Argument *argument = &(*arguments)[i];
+        unsigned long data_type;
+        long value_rank;
+        long name_len;
+
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 3)
+            errx(EXIT_FAILURE, ":assemble_method_arguments requires 3-tuple arguments, term_size = %d", term_size);
+
+        if(ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            return UA_STATUSCODE_BADINVALIDARGUMENT;
+
+        argument->name.data = (UA_Byte *)UA_malloc(term_size + 1);
+        if(argument->name.data == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        if(ei_decode_binary(req, req_index, argument->name.data, &name_len) < 0)
+            return UA_STATUSCODE_BADINVALIDARGUMENT;
+        argument->name.length = name_len;
+
+        if(ei_decode_ulong(req, req_index, &data_type) < 0 || data_type >= UA_TYPES_COUNT)
+            return UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+        if(ei_decode_long(req, req_index, &value_rank) < 0)
+            return UA_STATUSCODE_BADINVALIDARGUMENT;
+
+        argument->dataType = UA_TYPES[data_type].typeId;
+        argument->valueRank = (UA_Int32)value_rank;
+    }
+
+    // Decode list tail
+    ei_decode_list_header(req, req_index, &list_count);
+
+    return retval;
+}
+
+// Only called for method nodes that are not async.
+static UA_StatusCode method_not_implemented(UA_Server *server,
+                                            const UA_NodeId *sessionId, void *sessionContext,
+                                            const UA_NodeId *methodId, void *methodContext,
+                                            const UA_NodeId *objectId, void *objectContext,
+                                            size_t inputSize, const UA_Variant *input,
+                                            size_t outputSize, UA_Variant *output)
+{
+    return UA_STATUSCODE_BADNOTIMPLEMENTED;
+}
+
+/*
+ *  Adds a method node whose calls are answered from Elixir.
+ *  Input: {requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, [input_argument], [output_argument]}
+ */
+static void handle_add_method_node(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    UA_Argument *inputs = NULL;
+    UA_Argument *outputs = NULL;
+    size_t inputs_size = 0;
+    size_t outputs_size = 0;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 6)
+        errx(EXIT_FAILURE, ":handle_add_method_node requires a 6-tuple, term_size = %d", term_size);
+
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+
+    UA_StatusCode retval = assemble_method_arguments(req, req_index, &inputs, &inputs_size);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = assemble_method_arguments(req, req_index, &outputs, &outputs_size);
+
+#if UA_MULTITHREADING >= 100
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = method_install();
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_MethodAttributes attr = UA_MethodAttributes_default;
+        attr.displayName.text = browse_name.name;
+        attr.executable = true;
+        attr.userExecutable = true;
+
+        retval = UA_Server_addMethodNode(server, requested_new_node_id, parent_node_id, reference_type_node_id,
+                                         browse_name, attr, method_not_implemented, inputs_size, inputs,
+                                         outputs_size, outputs, NULL, NULL);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_setMethodNodeAsync(server, requested_new_node_id, true);
+#else
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_STATUSCODE_BADNOTSUPPORTED;
+#endif
+
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
+    UA_Array_delete(inputs, inputs_size, &UA_TYPES[UA_TYPES_ARGUMENT]);
+    UA_Array_delete(outputs, outputs_size, &UA_TYPES[UA_TYPES_ARGUMENT]);
+
+    if(retval == UA_STATUSCODE_BADNOTSUPPORTED) {
+        send_error_response("not_supported");
+        return;
+    }
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/*
+ *  Input: {timeout_ms, max_calls}
+ */
+static void handle_set_method_call_config(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    unsigned long timeout;
+    unsigned long max_calls;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_method_call_config requires a 2-tuple, term_size = %d", term_size);
+
+    if(ei_decode_ulong(req, req_index, &timeout) < 0 || timeout == 0 ||
+       ei_decode_ulong(req, req_index, &max_calls) < 0 || max_calls == 0 || max_calls > METHOD_MAX_CALLS) {
+        send_error_response("einval");
+        return;
+    }
+
+#if UA_MULTITHREADING >= 100
+    // A rejected config leaves the installed one (and the server config) as it was
+    unsigned long previous_timeout = method_timeout;
+    unsigned long previous_max_calls = method_max_calls;
+    method_timeout = timeout;
+    method_max_calls = max_calls;
+
+    UA_StatusCode retval = method_install();
+    if(retval != UA_STATUSCODE_GOOD) {
+        method_timeout = previous_timeout;
+        method_max_calls = previous_max_calls;
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+#else
+    send_error_response("not_supported");
+#endif
+}
+
+/*
+ *  Answers a dispatched call: a Good status comes with the output arguments.
+ *  Input: {call_id, status_code, [{data_type, is_array, value}]}
+ */
+static void handle_set_method_result(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_count;
+    unsigned long id;
+    unsigned long status;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_set_method_result requires a 3-tuple, term_size = %d", term_size);
+
+    if(ei_decode_ulong(req, req_index, &id) < 0 || id == 0 || id > UA_UINT32_MAX ||
+       ei_decode_ulong(req, req_index, &status) < 0 || status > UA_UINT32_MAX ||
+       ei_decode_list_header(req, req_index, &list_count) < 0 || list_count > METHOD_MAX_ARGUMENTS) {
+        send_error_response("einval");
+        return;
+    }
+
+#if UA_MULTITHREADING >= 100
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_AsyncOperationResponse response;
+    UA_CallMethodResult *result = &response.callMethodResult;
+    UA_CallMethodResult_init(result);
+    result->statusCode = (UA_StatusCode)status;
+
+    if(list_count > 0) {
+        result->outputArguments = (UA_Variant *)UA_Array_new(list_count, &UA_TYPES[UA_TYPES_VARIANT]);
+        if(result->outputArguments == NULL) {
+            send_error_response("enomem");
+            return;
+        }
+        result->outputArgumentsSize = list_count;
+
+        for(int i = 0; i < list_count && retval == UA_STATUSCODE_GOOD; i++)
+            retval = assemble_variant(req, req_index, &result->outputArguments[i]);
+    }
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_CallMethodResult_clear(result);
+        send_error_response("einval");
+        return;
+    }
+
+    void *context = NULL;
+    pthread_mutex_lock(&method_lock);
+    Method_call *call = method_call_find((UA_UInt32)id);
+    if(call == NULL) {
+        retval = UA_STATUSCODE_BADNOTFOUND;
+    } else {
+        if(call->deadline < UA_DateTime_now())
+            retval = UA_STATUSCODE_BADTIMEOUT;
+        else
+            context = call->context;
+        method_call_remove(call);
+    }
+    pthread_mutex_unlock(&method_lock);
+
+    // The server copies the result.
+    if(context != NULL)
+        UA_Server_setAsyncOperationResult(server, &response, context);
+    UA_CallMethodResult_clear(result);
+
+    // A slot is free, queued calls can go on.
+    method_dispatch(server);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+#else
+    send_error_response("not_supported");
+#endif
+}
+
+/***************/
+/* Lazy values */
+/***************/
+
+/*
+ *  Lazy variables get their value from Elixir on demand. A read of a variable whose value is older
+ *  than its TTL sends a {:lazy_read, node_id} frame and is served the cached value; the fresh value
+ *  comes back with set_lazy_value and is served until the TTL expires again. While a fetch is in
+ *  flight no other is sent, so a burst of reads costs one round trip to Elixir. The state of a node
+ *  is its node context, it is never freed while the server runs because the server thread may hold it.
+ */
+#define LAZY_MAX_TTL 86400000               // 1 day (ms)
+#define LAZY_FETCH_RETRY 1000               // ms until a fetch without answer is sent again
+
+typedef struct Lazy_node {
+    UA_NodeId node_id;
+    UA_DateTime ttl;                        // 0 when disabled
+    UA_DateTime expires;                    // monotonic
+    UA_DateTime fetch_deadline;             // monotonic, 0 when no fetch is in flight
+    struct Lazy_node *next;
+} Lazy_node;
+
+static pthread_mutex_t lazy_lock = PTHREAD_MUTEX_INITIALIZER;
+static Lazy_node *lazy_nodes = NULL;
+
+/*
+ *  Output: {:lazy_read, node_id}
+ */
+static void send_lazy_read(const UA_NodeId *node_id)
+{
+    char resp[ERLCMD_BUF_SIZE];
+    int resp_index = sizeof(uint16_t); // Space for payload size
+    resp[resp_index++] = response_id;
+    ei_encode_version(resp, &resp_index);
+    ei_encode_tuple_header(resp, &resp_index, 2);
+    ei_encode_atom(resp, &resp_index, "lazy_read");
+    encode_node_id(resp, &resp_index, (void *)node_id);
+    erlcmd_send(resp, resp_index);
+}
+
+static void lazy_on_read(UA_Server *server,
+                         const UA_NodeId *sessionId, void *sessionContext,
+                         const UA_NodeId *nodeId, void *nodeContext,
+                         const UA_NumericRange *range, const UA_DataValue *value)
+{
+    Lazy_node *node = (Lazy_node *)nodeContext;
+    if(node == NULL)
+        return;
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    bool fetch = false;
+
+    pthread_mutex_lock(&lazy_lock);
+    if(node->ttl > 0 && now >= node->expires && now >= node->fetch_deadline) {
+        node->fetch_deadline = now + LAZY_FETCH_RETRY * UA_DATETIME_MSEC;
+        fetch = true;
+    }
+    pthread_mutex_unlock(&lazy_lock);
+
+    if(fetch)
+        send_lazy_read(nodeId);
+}
+
+static Lazy_node *lazy_find(const UA_NodeId *node_id)
+{
+    for(Lazy_node *node = lazy_nodes; node != NULL; node = node->next) {
+        if(UA_NodeId_equal(&node->node_id, node_id))
+            return node;
+    }
+    return NULL;
+}
+
+static void lazy_clear()
+{
+    while(lazy_nodes != NULL) {
+        Lazy_node *node = lazy_nodes;
+        lazy_nodes = node->next;
+        UA_NodeId_clear(&node->node_id);
+        free(node);
+    }
+}
+
+/*
+ *  Makes a variable lazy with a TTL in ms, 0 makes it a plain variable again (written by Elixir).
+ *  Input: {node_id, ttl}
+ */
+static void handle_set_node_lazy_read(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    unsigned long ttl;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_node_lazy_read requires a 2-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(ei_decode_ulong(req, req_index, &ttl) < 0 || ttl > LAZY_MAX_TTL) {
+        UA_NodeId_clear(&node_id);
+        send_error_response("einval");
+        return;
+    }
+
+    UA_NodeClass node_class;
+    UA_StatusCode retval = UA_Server_readNodeClass(server, node_id, &node_class);
+    if(retval == UA_STATUSCODE_GOOD && node_class != UA_NODECLASS_VARIABLE)
+        retval = UA_STATUSCODE_BADNODECLASSINVALID;
+
+    Lazy_node *node = NULL;
+    if(retval == UA_STATUSCODE_GOOD) {
+        pthread_mutex_lock(&lazy_lock);
+        node = lazy_find(&node_id);
+        if(node == NULL && ttl > 0) {
+            node = (Lazy_node *)calloc(1, sizeof(Lazy_node));
+            if(node == NULL || UA_NodeId_copy(&node_id, &node->node_id) != UA_STATUSCODE_GOOD) {
+                free(node);
+                node = NULL;
+                retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            } else {
+                node->next = lazy_nodes;
+                lazy_nodes = node;
+            }
+        }
+        if(node != NULL) {
+            node->ttl = (UA_DateTime)ttl * UA_DATETIME_MSEC;
+            node->expires = 0;
+            node->fetch_deadline = 0;
+        }
+        pthread_mutex_unlock(&lazy_lock);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD && node != NULL) {
+        UA_ValueCallback callback;
+        callback.onRead = ttl > 0 ? lazy_on_read : NULL;
+        callback.onWrite = send_write_response;
+        retval = UA_Server_setNodeContext(server, node_id, ttl > 0 ? node : NULL);
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = UA_Server_setVariableNode_valueCallback(server, node_id, callback);
+    }
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/*
+ *  Caches the value fetched for a lazy variable, it is served for the node TTL.
+ *  Input: {node_id, {data_type, is_array, value}}
+ */
+static void handle_set_lazy_value(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    UA_Variant value;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_lazy_value requires a 2-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    UA_StatusCode retval = assemble_variant(req, req_index, &value);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeId_clear(&node_id);
+        send_error_response("einval");
+        return;
+    }
+
+    pthread_mutex_lock(&lazy_lock);
+    Lazy_node *node = lazy_find(&node_id);
+    if(node == NULL || node->ttl == 0)
+        retval = UA_STATUSCODE_BADINVALIDSTATE;
+    pthread_mutex_unlock(&lazy_lock);
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        server_is_writing = true;
+        retval = UA_Server_writeValue(server, node_id, value);
+        server_is_writing = false;
+    }
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        UA_DateTime now = UA_DateTime_nowMonotonic();
+        pthread_mutex_lock(&lazy_lock);
+        node->expires = now + node->ttl;
+        node->fetch_deadline = 0;
+        pthread_mutex_unlock(&lazy_lock);
+    }
+
+    UA_Variant_clear(&value);
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/***********************/
+/* Write notifications */
+/***********************/
+
+/*
+ *  Values written by clients are sent to Elixir in {:writes, [{node_id, value}]} frames. The
+ *  writes of a server iteration are sent together once it ends or, with a window, every `window` ms
+ *  and then only the last value written to a node within the window is sent.
+ *  A node is notified according to its own setting, else the setting of its namespace, else the
+ *  default (notify every node).
+ */
+#define WRITES_MIN_BUCKETS 64
+#define WRITES_MAX_WINDOW 60000
+#define WRITES_FRAME_SIZE (ERLCMD_BUF_SIZE * 2)
+#define WRITES_NO_ENTRY SIZE_MAX
+
+typedef struct Write_filter {
+    UA_NodeId node_id;
+    bool notify;
+    struct Write_filter *next;
+} Write_filter;
+
+typedef struct {
+    UA_NodeId node_id;
+    UA_Variant value;
+    size_t next;                            // next entry of the bucket (window only)
+} Write_entry;
+
+static pthread_mutex_t writes_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool writes_default = true;
+static signed char *writes_namespaces = NULL;   // -1 default, 0 off, 1 on
+static size_t writes_namespaces_size = 0;
+static Write_filter **writes_filters = NULL;
+static size_t writes_filters_buckets = 0;
+static size_t writes_filters_size = 0;
+static unsigned long writes_window = 0;
+static UA_UInt64 writes_callback_id = 0;
+static Write_entry *writes = NULL;
+static size_t writes_size = 0;
+static size_t writes_capacity = 0;
+static size_t *writes_buckets = NULL;       // entry indexes, WRITES_NO_ENTRY when empty
+static size_t writes_buckets_size = 0;
+
+static Write_filter *writes_filter_find(const UA_NodeId *node_id)
+{
+    if(writes_filters == NULL)
+        return NULL;
+
+    Write_filter *filter = writes_filters[UA_NodeId_hash(node_id) & (writes_filters_buckets - 1)];
+    while(filter != NULL && !UA_NodeId_equal(&filter->node_id, node_id))
+        filter = filter->next;
+
+    return filter;
+}
+
+static UA_StatusCode writes_filter_resize(size_t buckets)
+{
+    Write_filter **resized = (Write_filter **)calloc(buckets, sizeof(Write_filter *));
+    if(resized == NULL)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    for(size_t i = 0; i < writes_filters_buckets; i++) {
+        Write_filter *filter = writes_filters[i];
+        while(filter != NULL) {
+            Write_filter *next = filter->next;
+            size_t bucket = UA_NodeId_hash(&filter->node_id) & (buckets - 1);
+            filter->next = resized[bucket];
+            resized[bucket] = filter;
+            filter = next;
+        }
+    }
+
+    free(writes_filters);
+    writes_filters = resized;
+    writes_filters_buckets = buckets;
+    return UA_STATUSCODE_GOOD;
+}
+
+// Sets (mode 0 or 1) or removes (mode 2) the setting of a node.
+static UA_StatusCode writes_filter_set(const UA_NodeId *node_id, unsigned long mode)
+{
+    Write_filter *filter = writes_filter_find(node_id);
+
+    if(mode == 2) {
+        if(filter == NULL)
+            return UA_STATUSCODE_GOOD;
+
+        Write_filter **link = &writes_filters[UA_NodeId_hash(node_id) & (writes_filters_buckets - 1)];
+        while(*link != filter)
+            link = &(*link)->next;
+        *link = filter->next;
+        UA_NodeId_clear(&filter->node_id);
+        free(filter);
+        writes_filters_size--;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    if(filter == NULL) {
+        if(writes_filters_size >= writes_filters_buckets) {
+            UA_StatusCode retval = writes_filter_resize(writes_filters_buckets ? writes_filters_buckets * 2 : WRITES_MIN_BUCKETS);
+            if(retval != UA_STATUSCODE_GOOD)
+                return retval;
+        }
+
+        filter = (Write_filter *)calloc(1, sizeof(Write_filter));
+        if(filter == NULL || UA_NodeId_copy(node_id, &filter->node_id) != UA_STATUSCODE_GOOD) {
+            free(filter);
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+
+        size_t bucket = UA_NodeId_hash(node_id) & (writes_filters_buckets - 1);
+        filter->next = writes_filters[bucket];
+        writes_filters[bucket] = filter;
+        writes_filters_size++;
+    }
+
+    filter->notify = mode == 1;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode writes_namespace_set(size_t ns_index, unsigned long mode)
+{
+    if(ns_index >= writes_namespaces_size) {
+        if(mode == 2)
+            return UA_STATUSCODE_GOOD;
+
+        signed char *namespaces = (signed char *)realloc(writes_namespaces, ns_index + 1);
+        if(namespaces == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        memset(namespaces + writes_namespaces_size, -1, ns_index + 1 - writes_namespaces_size);
+        writes_namespaces = namespaces;
+        writes_namespaces_size = ns_index + 1;
+    }
+
+    writes_namespaces[ns_index] = mode == 2 ? -1 : (signed char)mode;
+    return UA_STATUSCODE_GOOD;
+}
+
+static bool writes_enabled(const UA_NodeId *node_id)
+{
+    Write_filter *filter = writes_filter_find(node_id);
+    if(filter != NULL)
+        return filter->notify;
+
+    if(node_id->namespaceIndex < writes_namespaces_size && writes_namespaces[node_id->namespaceIndex] >= 0)
+        return writes_namespaces[node_id->namespaceIndex] == 1;
+
+    return writes_default;
+}
+
+// Pending write of a node within the window.
+static Write_entry *writes_find(const UA_NodeId *node_id)
+{
+    if(writes_buckets == NULL)
+        return NULL;
+
+    size_t index = writes_buckets[UA_NodeId_hash(node_id) & (writes_buckets_size - 1)];
+    while(index != WRITES_NO_ENTRY && !UA_NodeId_equal(&writes[index].node_id, node_id))
+        index = writes[index].next;
+
+    return index == WRITES_NO_ENTRY ? NULL : &writes[index];
+}
+
+static void writes_index(size_t index)
+{
+    size_t bucket = UA_NodeId_hash(&writes[index].node_id) & (writes_buckets_size - 1);
+    writes[index].next = writes_buckets[bucket];
+    writes_buckets[bucket] = index;
+}
+
+static UA_StatusCode writes_append(const UA_NodeId *node_id, const UA_Variant *value)
+{
+    if(writes_size == writes_capacity) {
+        size_t capacity = writes_capacity ? writes_capacity * 2 : WRITES_MIN_BUCKETS;
+        Write_entry *entries = (Write_entry *)realloc(writes, capacity * sizeof(Write_entry));
+        if(entries == NULL)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        writes = entries;
+        writes_capacity = capacity;
+    }
+
+    Write_entry *entry = &writes[writes_size];
+    UA_StatusCode retval = UA_NodeId_copy(node_id, &entry->node_id);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    retval = UA_Variant_copy(value, &entry->value);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeId_clear(&entry->node_id);
+        return retval;
+    }
+    writes_size++;
+
+    if(writes_window == 0)
+        return UA_STATUSCODE_GOOD;
+
+    // One bucket per entry at most, rehashed as the window collects more nodes.
+    if(writes_buckets_size < writes_capacity) {
+        size_t *buckets = (size_t *)realloc(writes_buckets, writes_capacity * sizeof(size_t));
+        if(buckets == NULL)
+            return UA_STATUSCODE_GOOD;
+        writes_buckets = buckets;
+        writes_buckets_size = writes_capacity;
+        memset(writes_buckets, 0xFF, writes_buckets_size * sizeof(size_t));
+        for(size_t i = 0; i < writes_size; i++)
+            writes_index(i);
+    } else {
+        writes_index(writes_size - 1);
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+// Hook of the onWrite value callback (server thread).
+static void writes_notify(const UA_NodeId *node_id, const UA_Variant *value)
+{
+    pthread_mutex_lock(&writes_lock);
+    if(writes_enabled(node_id)) {
+        Write_entry *entry = writes_window > 0 ? writes_find(node_id) : NULL;
+        if(entry != NULL) {
+            UA_Variant_clear(&entry->value);
+            UA_Variant_copy(value, &entry->value);
+        } else {
+            writes_append(node_id, value);
+        }
+    }
+    pthread_mutex_unlock(&writes_lock);
+}
+
+static void encode_writes_header(char *resp, int *resp_index)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "writes");
+}
+
+// Output: {node_id, value} as a list cell, {node_id, {:error, status}} if it can't fit a frame.
+static void encode_write(char *resp, int *resp_index, Write_entry *entry, bool fits)
+{
+    ei_encode_list_header(resp, resp_index, 1);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    encode_node_id(resp, resp_index, &entry->node_id);
+
+    if(fits) {
+        encode_variant_struct(resp, resp_index, &entry->value);
+        return;
+    }
+
+    const char *status = UA_StatusCode_name(UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "error");
+    ei_encode_binary(resp, resp_index, status, strlen(status));
+}
+
+/*
+ *  Sends the pending writes in as few frames as possible.
+ */
+static void writes_flush()
+{
+    static char frame[WRITES_FRAME_SIZE];
+    int header_size = sizeof(uint16_t);
+    int frame_index = 0;
+
+    encode_writes_header(NULL, &header_size);
+
+    pthread_mutex_lock(&writes_lock);
+    for(size_t i = 0; i < writes_size; i++) {
+        int size = 0;
+        encode_write(NULL, &size, &writes[i], true);
+        bool fits = header_size + size + 1 <= erlcmd_frame_limit();
+        if(!fits) {
+            size = 0;
+            encode_write(NULL, &size, &writes[i], false);
+        }
+
+        // The frame ends with the list tail
+        if(frame_index > 0 && frame_index + size + 1 > erlcmd_frame_limit()) {
+            ei_encode_empty_list(frame, &frame_index);
+            erlcmd_send(frame, frame_index);
+            frame_index = 0;
+        }
+
+        if(frame_index == 0) {
+            frame_index = sizeof(uint16_t);
+            encode_writes_header(frame, &frame_index);
+        }
+
+        encode_write(frame, &frame_index, &writes[i], fits);
+    }
+
+    if(frame_index > 0) {
+        ei_encode_empty_list(frame, &frame_index);
+        erlcmd_send(frame, frame_index);
+    }
+
+    for(size_t i = 0; i < writes_size; i++) {
+        UA_NodeId_clear(&writes[i].node_id);
+        UA_Variant_clear(&writes[i].value);
+    }
+    writes_size = 0;
+    if(writes_buckets != NULL)
+        memset(writes_buckets, 0xFF, writes_buckets_size * sizeof(size_t));
+    pthread_mutex_unlock(&writes_lock);
+}
+
+// Called by the server thread after every iteration.
+static void writes_flush_iteration()
+{
+    if(writes_window == 0)
+        writes_flush();
+}
+
+static void writes_flush_callback(UA_Server *server, void *data)
+{
+    writes_flush();
+}
+
+static void writes_clear()
+{
+    for(size_t i = 0; i < writes_filters_buckets; i++) {
+        while(writes_filters[i] != NULL) {
+            Write_filter *filter = writes_filters[i];
+            writes_filters[i] = filter->next;
+            UA_NodeId_clear(&filter->node_id);
+            free(filter);
+        }
+    }
+    free(writes_filters);
+    writes_filters = NULL;
+    writes_filters_buckets = 0;
+    writes_filters_size = 0;
+
+    for(size_t i = 0; i < writes_size; i++) {
+        UA_NodeId_clear(&writes[i].node_id);
+        UA_Variant_clear(&writes[i].value);
+    }
+    free(writes);
+    writes = NULL;
+    writes_size = 0;
+    writes_capacity = 0;
+    free(writes_buckets);
+    writes_buckets = NULL;
+    writes_buckets_size = 0;
+    free(writes_namespaces);
+    writes_namespaces = NULL;
+    writes_namespaces_size = 0;
+}
+
+/*
+ *  Input: {notify_by_default, window_ms}
+ */
+static void handle_set_write_notifications(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int notify_default;
+    unsigned long window;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_write_notifications requires a 2-tuple, term_size = %d", term_size);
+
+    if(ei_decode_boolean(req, req_index, &notify_default) < 0 ||
+       ei_decode_ulong(req, req_index, &window) < 0 || window > WRITES_MAX_WINDOW) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(window != writes_window) {
+        if(writes_callback_id != 0) {
+            UA_Server_removeRepeatedCallback(server, writes_callback_id);
+            writes_callback_id = 0;
+        }
+
+        if(window > 0)
+            retval = UA_Server_addRepeatedCallback(server, writes_flush_callback, NULL, (UA_Double)window, &writes_callback_id);
+    }
+
+    pthread_mutex_lock(&writes_lock);
+    writes_default = notify_default;
+    if(retval == UA_STATUSCODE_GOOD)
+        writes_window = window;
+    else
+        writes_window = 0;
+    pthread_mutex_unlock(&writes_lock);
+
+    // Writes collected with the previous settings.
+    writes_flush();
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/*
+ *  Mode 0 disables the notifications of a node or namespace, 1 enables them, 2 restores the default.
+ *  Input: {{:node, node_id} | {:namespace, ns_index}, mode}
+ */
+static void handle_set_write_notification(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    char kind[MAXATOMLEN];
+    unsigned long ns_index = 0;
+    unsigned long mode;
+    UA_NodeId node_id = UA_NODEID_NULL;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2 ||
+        ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2 ||
+        ei_decode_atom(req, req_index, kind) < 0)
+        errx(EXIT_FAILURE, ":handle_set_write_notification requires a {{kind, target}, mode} tuple");
+
+    bool node = !strcmp(kind, "node");
+    if(node)
+        node_id = assemble_node_id(req, req_index);
+    else if(strcmp(kind, "namespace") || ei_decode_ulong(req, req_index, &ns_index) < 0 || ns_index > UA_UINT16_MAX) {
+        send_error_response("einval");
+        return;
+    }
+
+    if(ei_decode_ulong(req, req_index, &mode) < 0 || mode > 2) {
+        UA_NodeId_clear(&node_id);
+        send_error_response("einval");
+        return;
+    }
+
+    pthread_mutex_lock(&writes_lock);
+    UA_StatusCode retval = node ? writes_filter_set(&node_id, mode) : writes_namespace_set(ns_index, mode);
+    pthread_mutex_unlock(&writes_lock);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/**************/
+/* Statistics */
+/**************/
+
+/*
+ *  Load of the server: open62541 statistics (sessions and secure channels), diagnostics of the
+ *  current sessions and subscriptions (UA_ENABLE_DIAGNOSTICS), node count, process I/O and RSS, and
+ *  the latency (queue wait and execution) of the port commands. open62541 doesn't time its services,
+ *  so the per-service numbers are request and error counts.
+ */
+#define STATS_MAX_INTERVAL 3600000
+
+typedef struct {
+    UA_ServerStatistics server;
+    bool diagnostics;
+    UA_UInt64 subscriptions;
+    UA_UInt64 monitored_items;
+    UA_UInt64 retransmission_queue;
+    UA_UInt64 late_publish_requests;
+    UA_UInt64 discarded_messages;
+    UA_UInt64 queue_overflows;
+    UA_UInt64 services[2 * 30];             // total and error count per service
+    UA_UInt64 nodes;
+    UA_UInt64 process_read_bytes;        // rchar/wchar of /proc/self/io: every read()/write() of the
+    UA_UInt64 process_write_bytes;       // process (sockets, port pipes, files), not network traffic alone
+    UA_UInt64 rss;
+} Server_stats;
+
+#ifdef UA_ENABLE_DIAGNOSTICS
+static const struct {
+    const char *name;
+    size_t offset;
+} stats_services[] = {
+    {"total", offsetof(UA_SessionDiagnosticsDataType, totalRequestCount)},
+    {"read", offsetof(UA_SessionDiagnosticsDataType, readCount)},
+    {"history_read", offsetof(UA_SessionDiagnosticsDataType, historyReadCount)},
+    {"write", offsetof(UA_SessionDiagnosticsDataType, writeCount)},
+    {"history_update", offsetof(UA_SessionDiagnosticsDataType, historyUpdateCount)},
+    {"call", offsetof(UA_SessionDiagnosticsDataType, callCount)},
+    {"create_monitored_items", offsetof(UA_SessionDiagnosticsDataType, createMonitoredItemsCount)},
+    {"modify_monitored_items", offsetof(UA_SessionDiagnosticsDataType, modifyMonitoredItemsCount)},
+    {"set_monitoring_mode", offsetof(UA_SessionDiagnosticsDataType, setMonitoringModeCount)},
+    {"set_triggering", offsetof(UA_SessionDiagnosticsDataType, setTriggeringCount)},
+    {"delete_monitored_items", offsetof(UA_SessionDiagnosticsDataType, deleteMonitoredItemsCount)},
+    {"create_subscription", offsetof(UA_SessionDiagnosticsDataType, createSubscriptionCount)},
+    {"modify_subscription", offsetof(UA_SessionDiagnosticsDataType, modifySubscriptionCount)},
+    {"set_publishing_mode", offsetof(UA_SessionDiagnosticsDataType, setPublishingModeCount)},
+    {"publish", offsetof(UA_SessionDiagnosticsDataType, publishCount)},
+    {"republish", offsetof(UA_SessionDiagnosticsDataType, republishCount)},
+    {"transfer_subscriptions", offsetof(UA_SessionDiagnosticsDataType, transferSubscriptionsCount)},
+    {"delete_subscriptions", offsetof(UA_SessionDiagnosticsDataType, deleteSubscriptionsCount)},
+    {"add_nodes", offsetof(UA_SessionDiagnosticsDataType, addNodesCount)},
+    {"add_references", offsetof(UA_SessionDiagnosticsDataType, addReferencesCount)},
+    {"delete_nodes", offsetof(UA_SessionDiagnosticsDataType, deleteNodesCount)},
+    {"delete_references", offsetof(UA_SessionDiagnosticsDataType, deleteReferencesCount)},
+    {"browse", offsetof(UA_SessionDiagnosticsDataType, browseCount)},
+    {"browse_next", offsetof(UA_SessionDiagnosticsDataType, browseNextCount)},
+    {"translate_browse_paths", offsetof(UA_SessionDiagnosticsDataType, translateBrowsePathsToNodeIdsCount)},
+    {"register_nodes", offsetof(UA_SessionDiagnosticsDataType, registerNodesCount)},
+    {"unregister_nodes", offsetof(UA_SessionDiagnosticsDataType, unregisterNodesCount)},
+    {NULL, 0}
+};
+#endif
+
+static UA_UInt64 stats_callback_id = 0;
+
+static void stats_count_node(void *context, const UA_Node *node)
+{
+    (*(UA_UInt64 *)context)++;
+}
+
+static void stats_read_process(Server_stats *stats)
+{
+    FILE *file = fopen("/proc/self/io", "r");
+    if(file != NULL) {
+        char key[32];
+        unsigned long long value;
+        while(fscanf(file, "%31[^:]: %llu\n", key, &value) == 2) {
+            if(!strcmp(key, "rchar"))
+                stats->process_read_bytes = value;
+            else if(!strcmp(key, "wchar"))
+                stats->process_write_bytes = value;
+        }
+        fclose(file);
+    }
+
+    file = fopen("/proc/self/statm", "r");
+    if(file != NULL) {
+        unsigned long long size, resident;
+        if(fscanf(file, "%llu %llu", &size, &resident) == 2)
+            stats->rss = resident * (UA_UInt64)sysconf(_SC_PAGESIZE);
+        fclose(file);
+    }
+}
+
+#ifdef UA_ENABLE_DIAGNOSTICS
+static void stats_read_diagnostics(Server_stats *stats)
+{
+    UA_Variant value;
+    UA_NodeId node_id = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERDIAGNOSTICS_SUBSCRIPTIONDIAGNOSTICSARRAY);
+
+    if(UA_Server_readValue(server, node_id, &value) == UA_STATUSCODE_GOOD) {
+        if(UA_Variant_hasArrayType(&value, &UA_TYPES[UA_TYPES_SUBSCRIPTIONDIAGNOSTICSDATATYPE])) {
+            UA_SubscriptionDiagnosticsDataType *subscriptions = (UA_SubscriptionDiagnosticsDataType *)value.data;
+            stats->diagnostics = true;
+            stats->subscriptions = value.arrayLength;
+            for(size_t i = 0; i < value.arrayLength; i++) {
+                stats->monitored_items += subscriptions[i].monitoredItemCount;
+                stats->retransmission_queue += subscriptions[i].unacknowledgedMessageCount;
+                stats->late_publish_requests += subscriptions[i].latePublishRequestCount;
+                stats->discarded_messages += subscriptions[i].discardedMessageCount;
+                stats->queue_overflows += subscriptions[i].monitoringQueueOverflowCount;
+            }
+        }
+        UA_Variant_clear(&value);
+    }
+
+    node_id = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERDIAGNOSTICS_SESSIONSDIAGNOSTICSSUMMARY_SESSIONDIAGNOSTICSARRAY);
+    if(UA_Server_readValue(server, node_id, &value) == UA_STATUSCODE_GOOD) {
+        if(UA_Variant_hasArrayType(&value, &UA_TYPES[UA_TYPES_SESSIONDIAGNOSTICSDATATYPE])) {
+            UA_SessionDiagnosticsDataType *sessions = (UA_SessionDiagnosticsDataType *)value.data;
+            stats->diagnostics = true;
+            for(size_t i = 0; i < value.arrayLength; i++) {
+                for(size_t s = 0; stats_services[s].name != NULL; s++) {
+                    const UA_ServiceCounterDataType *counter =
+                        (const UA_ServiceCounterDataType *)((const char *)&sessions[i] + stats_services[s].offset);
+                    stats->services[2 * s] += counter->totalCount;
+                    stats->services[2 * s + 1] += counter->errorCount;
+                }
+            }
+        }
+        UA_Variant_clear(&value);
+    }
+}
+#endif
+
+static void stats_read(Server_stats *stats)
+{
+    memset(stats, 0, sizeof(Server_stats));
+    stats->server = UA_Server_getStatistics(server);
+
+#ifdef UA_ENABLE_DIAGNOSTICS
+    stats_read_diagnostics(stats);
+#endif
+
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    config->nodestore.iterate(config->nodestore.context, stats_count_node, &stats->nodes);
+
+    stats_read_process(stats);
+}
+
+static void encode_stat(char *resp, int *resp_index, const char *name, UA_UInt64 value)
+{
+    ei_encode_list_header(resp, resp_index, 1);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, name);
+    ei_encode_ulonglong(resp, resp_index, value);
+}
+
+/*
+ *  Output: [{name, count}, ..., {:services, [{name, total, errors}]},
+ *           {:commands, [{name, count, p50_us, p90_us, p99_us, max_us}]}]
+ */
+static void encode_server_stats(char *resp, int *resp_index, const Server_stats *stats)
+{
+    encode_stat(resp, resp_index, "sessions", stats->server.ss.currentSessionCount);
+    encode_stat(resp, resp_index, "cumulated_sessions", stats->server.ss.cumulatedSessionCount);
+    encode_stat(resp, resp_index, "rejected_sessions",
+                stats->server.ss.rejectedSessionCount + stats->server.ss.securityRejectedSessionCount);
+    encode_stat(resp, resp_index, "session_timeouts", stats->server.ss.sessionTimeoutCount);
+    encode_stat(resp, resp_index, "session_aborts", stats->server.ss.sessionAbortCount);
+    encode_stat(resp, resp_index, "secure_channels", stats->server.scs.currentChannelCount);
+    encode_stat(resp, resp_index, "cumulated_secure_channels", stats->server.scs.cumulatedChannelCount);
+    encode_stat(resp, resp_index, "rejected_secure_channels", stats->server.scs.rejectedChannelCount);
+    encode_stat(resp, resp_index, "secure_channel_timeouts", stats->server.scs.channelTimeoutCount);
+    encode_stat(resp, resp_index, "secure_channel_aborts", stats->server.scs.channelAbortCount);
+    encode_stat(resp, resp_index, "nodes", stats->nodes);
+    encode_stat(resp, resp_index, "process_read_bytes", stats->process_read_bytes);
+    encode_stat(resp, resp_index, "process_write_bytes", stats->process_write_bytes);
+    encode_stat(resp, resp_index, "rss", stats->rss);
+
+#ifdef UA_ENABLE_DIAGNOSTICS
+    if(stats->diagnostics) {
+        encode_stat(resp, resp_index, "subscriptions", stats->subscriptions);
+        encode_stat(resp, resp_index, "monitored_items", stats->monitored_items);
+        encode_stat(resp, resp_index, "retransmission_queue", stats->retransmission_queue);
+        encode_stat(resp, resp_index, "late_publish_requests", stats->late_publish_requests);
+        encode_stat(resp, resp_index, "discarded_messages", stats->discarded_messages);
+        encode_stat(resp, resp_index, "queue_overflows", stats->queue_overflows);
+
+        ei_encode_list_header(resp, resp_index, 1);
+        ei_encode_tuple_header(resp, resp_index, 2);
+        ei_encode_atom(resp, resp_index, "services");
+        for(size_t s = 0; stats_services[s].name != NULL; s++) {
+            ei_encode_list_header(resp, resp_index, 1);
+            ei_encode_tuple_header(resp, resp_index, 3);
+            ei_encode_binary(resp, resp_index, stats_services[s].name, strlen(stats_services[s].name));
+            ei_encode_ulonglong(resp, resp_index, stats->services[2 * s]);
+            ei_encode_ulonglong(resp, resp_index, stats->services[2 * s + 1]);
+        }
+        ei_encode_empty_list(resp, resp_index);
+    }
+#endif
+
+    ei_encode_list_header(resp, resp_index, 1);
+    ei_encode_tuple_header(resp, resp_index, 2);
+    ei_encode_atom(resp, resp_index, "commands");
+    encode_command_latencies(resp, resp_index);
+
+    ei_encode_empty_list(resp, resp_index);
+}
+
+static void encode_server_stats_response(char *resp, int *resp_index, const Server_stats *stats, bool push)
+{
+    if(resp != NULL)
+        resp[*resp_index] = response_id;
+    *resp_index = *resp_index + 1;
+    ei_encode_version(resp, resp_index);
+
+    if(push) {
+        ei_encode_tuple_header(resp, resp_index, 2);
+        ei_encode_atom(resp, resp_index, "server_stats");
+    } else {
+        ei_encode_tuple_header(resp, resp_index, 3);
+        encode_caller_metadata(resp, resp_index);
+        ei_encode_tuple_header(resp, resp_index, 2);
+        ei_encode_atom(resp, resp_index, "ok");
+    }
+
+    encode_server_stats(resp, resp_index, stats);
+}
+
+static void send_server_stats(bool push)
+{
+    Server_stats stats;
+    stats_read(&stats);
+
+    // Size pass first: the response must fit the {:packet, 2} port frame.
+    int resp_size = sizeof(uint16_t);
+    encode_server_stats_response(NULL, &resp_size, &stats, push);
+
+    if(resp_size > erlcmd_frame_limit()) {
+        if(!push)
+            send_error_response("overflow");
+        return;
+    }
+
+    char *resp = (char *)malloc(resp_size);
+    if(resp == NULL) {
+        if(!push)
+            send_error_response("enomem");
+        return;
+    }
+
+    int resp_index = sizeof(uint16_t);
+    encode_server_stats_response(resp, &resp_index, &stats, push);
+    erlcmd_send(resp, resp_index);
+
+    free(resp);
+}
+
+static void stats_push_callback(UA_Server *server, void *data)
+{
+    send_server_stats(true);
+}
+
+static void handle_get_server_stats(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    send_server_stats(false);
+}
+
+/*
+ *  Sends {:server_stats, stats} every `interval` ms, 0 stops it.
+ *  Input: interval_ms
+ */
+static void handle_set_server_stats_interval(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long interval;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    if(ei_decode_ulong(req, req_index, &interval) < 0 || interval > STATS_MAX_INTERVAL) {
+        send_error_response("einval");
+        return;
+    }
+
+    if(interval == 0) {
+        if(stats_callback_id != 0)
+            UA_Server_removeRepeatedCallback(server, stats_callback_id);
+        stats_callback_id = 0;
+    }
+    else if(stats_callback_id != 0)
+        retval = UA_Server_changeRepeatedCallbackInterval(server, stats_callback_id, (UA_Double)interval);
+    else
+        retval = UA_Server_addRepeatedCallback(server, stats_push_callback, NULL, (UA_Double)interval, &stats_callback_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/*******************************/
+/* Elixir -> C Message Handler */
+/*******************************/
+
+struct request_handler {
+    const char *name;
+    void (*handler)(void *entity, bool entity_type, const char *req, int *req_index);
+};
+
+/*  Elixir request handler table
+ *  FIXME: Order roughly based on most frequent calls to least (WIP).
+ */
+static struct request_handler request_handlers[] = {
+    {"test", handle_test},
+    // Reading and Writing Node Attributes ??
+    // TODO: Add UA_Server_writeArrayDimensions, 
+    {"write_node_value", handle_write_node_value},
+    {"read_node_value", handle_read_node_value},
+    {"read_node_values", handle_read_node_values},
+    {"read_node_value_by_index", handle_read_node_value_by_index},
+    {"write_node_browse_name", handle_write_node_browse_name_server},
+    {"write_node_display_name", handle_write_node_display_name},
+    {"write_node_description", handle_write_node_description},
+    {"write_node_write_mask", handle_write_node_write_mask},
+    {"write_node_is_abstract", handle_write_node_is_abstract},
+    {"write_node_inverse_name", handle_write_node_inverse_name},
+    {"write_node_data_type", handle_write_node_data_type},
+    {"write_node_value_rank", handle_write_node_value_rank},
+    {"write_node_array_dimensions", handle_write_node_array_dimensions},
+    {"write_node_access_level", handle_write_node_access_level},
+    {"write_node_minimum_sampling_interval", handle_write_node_minimum_sampling_interval},
+    {"write_node_historizing", handle_write_node_historizing},
+    {"write_node_executable", handle_write_node_executable},
+    {"write_node_blank_array", handle_write_node_blank_array},
+    {"read_node_node_id", handle_read_node_node_id},
+    {"read_node_node_class", handle_read_node_node_class},
+    {"read_node_browse_name", handle_read_node_browse_name},
+    {"read_node_display_name", handle_read_node_display_name},
+    {"read_node_description", handle_read_node_description},
+    {"read_node_write_mask", handle_read_node_write_mask},
+    {"read_node_is_abstract", handle_read_node_is_abstract},
+    {"read_node_symmetric", handle_read_node_symmetric},
+    {"read_node_inverse_name", handle_read_node_inverse_name},
+    {"read_node_contains_no_loops", handle_read_node_contains_no_loops},
+    {"read_node_data_type", handle_read_node_data_type},
+    {"read_node_value_rank", handle_read_node_value_rank},
+    {"read_node_array_dimensions", handle_read_node_array_dimensions},
+    {"read_node_access_level", handle_read_node_access_level},
+    {"read_node_minimum_sampling_interval", handle_read_node_minimum_sampling_interval},
+    {"read_node_historizing", handle_read_node_historizing},
+    {"read_node_executable", handle_read_node_executable},
+    // Local MonitoredItems
+    {"add_monitored_item", handle_add_monitored_item},
+    {"delete_monitored_item", handle_delete_monitored_item},
+    // History
+    {"set_history_store", handle_set_history_store},
+    {"set_node_history", handle_set_node_history},
+    // Events
+    {"create_event", handle_create_event},
+    {"set_event_fields", handle_set_event_fields},
+    {"trigger_event", handle_trigger_event},
+    {"trigger_events", handle_trigger_events},
+    // Methods
+    {"add_method_node", handle_add_method_node},
+    {"set_method_call_config", handle_set_method_call_config},
+    {"set_method_result", handle_set_method_result},
+    // Lazy values
+    {"set_node_lazy_read", handle_set_node_lazy_read},
+    {"set_lazy_value", handle_set_lazy_value},
+    // Write notifications
+    {"set_write_notifications", handle_set_write_notifications},
+    {"set_write_notification", handle_set_write_notification},
+    // Statistics
+    {"get_server_stats", handle_get_server_stats},
+    {"get_port_stats", handle_get_port_stats},
+    {"set_server_stats_interval", handle_set_server_stats_interval},
+    // Node Addition and Deletion
+    {"add_namespace", handle_add_namespace},
+    {"add_variable_node", handle_add_variable_node},
+    {"add_variable_type_node", handle_add_variable_type_node},
+    {"add_object_node", handle_add_object_node},
+    {"add_object_type_node", handle_add_object_type_node},
+    {"add_view_node", handle_add_view_node},
+    {"add_reference_type_node", handle_add_reference_type_node},
+    {"add_data_type_node", handle_add_data_type_node},
+    {"add_structure_type", handle_add_structure_type},
+    {"add_reference", handle_add_reference},
+    {"delete_reference", handle_delete_reference},
+    {"delete_node", handle_delete_node},
+    // configuration & lifecycle functions
+    {"get_server_config", handle_get_server_config},
+    {"set_default_server_config", handle_set_default_server_config},
+    {"set_basics", handle_set_basics},
+    {"set_network_tcp_layer", handle_set_network_tcp_layer},
+    // "set_hostname" removed - UA_ServerConfig_setCustomHostname deprecated in v1.4.x
+    {"set_port", handle_set_port},
+    {"set_retransmission_queue_size", handle_set_retransmission_queue_size},
+    {"set_users", handle_set_users_and_passwords},
+    {"add_all_endpoints", handle_add_all_endpoints},
+    {"start_server", handle_start_server},
+    {"stop_server", handle_stop_server},
+    // Encryption
+    {"set_config_with_security_policies", handle_set_config_with_security_policies},
+    {"add_security_policy_none", handle_add_security_policy_none},
+    {"add_security_policy_basic128rsa15", handle_add_security_policy_basic128rsa15},
+    {"add_security_policy_basic256", handle_add_security_policy_basic256},
+    {"add_security_policy_basic256sha256", handle_add_security_policy_basic256sha256},
+    {"add_all_security_policies", handle_add_all_security_policies},
+    // Discovery
+    {"set_lds_config", handle_set_lds_config},
+    {"discovery_register", handle_discovery_register},
+    {"discovery_unregister", handle_discovery_unregister},
+    { NULL, NULL }
+};
+
+
+// start_server and stop_server requests, executed by the port thread
+static bool request_is_lifecycle(const char *req)
+{
+    int req_index = sizeof(uint16_t);
+    int arity;
+    char cmd[MAXATOMLEN];
+
+    if(ei_decode_version(req, &req_index, NULL) < 0 ||
+       ei_decode_tuple_header(req, &req_index, &arity) < 0 ||
+       ei_decode_atom(req, &req_index, cmd) < 0)
+        return false;
+
+    return strcmp(cmd, "start_server") == 0 || strcmp(cmd, "stop_server") == 0;
+}
+
+/**
+ * @brief Decode and forward requests from Elixir to the appropriate handlers
+ * @param req the undecoded request
+ * @param cookie
+ */
+static void handle_elixir_request(const char *req, void *cookie)
+{
+    (void) cookie;
+
+    UA_DateTime received = UA_DateTime_nowMonotonic();
+    if(request_is_lifecycle(req) || !commands_push(req, received))
+        dispatch_elixir_request(req, received);
+}
+
+/**
+ * @brief Decode and execute a request (port thread, or server thread while it runs)
+ * @param req the undecoded request
+ * @param received monotonic time the request was read, for the command statistics
+ */
+static void dispatch_elixir_request(const char *req, UA_DateTime received)
+{
+    // Commands are of the form {Command, Arguments}:
+    // {atom(), {pid(), ref()}, term()}
+    int req_index = sizeof(uint16_t);
+    if (ei_decode_version(req, &req_index, NULL) < 0)
+        errx(EXIT_FAILURE, "Message version issue?");
+
+    int arity;
+    if (ei_decode_tuple_header(req, &req_index, &arity) < 0 ||
+            arity != 3)
+        errx(EXIT_FAILURE, "expecting {cmd, {pid, ref}, args} tuple");
+
+    char cmd[MAXATOMLEN];
     if (ei_decode_atom(req, &req_index, cmd) < 0)
         errx(EXIT_FAILURE, "expecting command atom");
     
@@ -1342,8 +4964,12 @@ static void handle_elixir_request(const char *req, void *cookie)
     for (struct request_handler *rh = request_handlers; rh->name != NULL; rh++) {
         if (strcmp(cmd, rh->name) == 0) {
             handle_caller_metadata(req, &req_index, cmd);
+            UA_DateTime decoded = UA_DateTime_nowMonotonic();
+            uint64_t send_ns = erlcmd_send_ns;
             rh->handler(server, 0, req, &req_index);
             free_caller_metadata();
+            port_stats_record((size_t)(rh - request_handlers), rh->name, received, decoded,
+                              UA_DateTime_nowMonotonic(), erlcmd_send_ns - send_ns);
             return;
         }
     }
@@ -1357,6 +4983,12 @@ int main()
 
     struct erlcmd *handler = malloc(sizeof(struct erlcmd));
     erlcmd_init(handler, handle_elixir_request, NULL);
+    notify_write = writes_notify;
+
+    size_t handlers = 0;
+    for(struct request_handler *rh = request_handlers; rh->name != NULL; rh++)
+        handlers++;
+    port_stats_init(handlers);
 
     for (;;) {
         struct pollfd fdset;
@@ -1384,10 +5016,19 @@ int main()
     
     /* Disconnects the client internally */
     free(handler);
-    running = false;
+    // Release threads memory
+    server_thread_stop();
     delete_users_list();
     delete_discovery_params();
-    // Release threads memory
-    pthread_join(server_tid, NULL);
+#ifdef UA_ENABLE_SUBSCRIPTIONS_EVENTS
+    event_templates_clear();
+#endif
+#if UA_MULTITHREADING >= 100
+    free(method_calls);
+#endif
+    lazy_clear();
+    writes_clear();
+    port_stats_clear();
     UA_Server_delete(server); 
+    structure_types_clear();
 }
\ No newline at end of file
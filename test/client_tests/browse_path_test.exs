@@ -0,0 +1,93 @@
+defmodule ClientBrowsePathTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4036)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "PathTest")
+
+    line_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Line1")
+
+    :ok =
+      Server.add_object_node(s_pid,
+        requested_new_node_id: line_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Line1"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+      )
+
+    temp_id = NodeId.new(ns_index: ns_index, identifier_type: "integer", identifier: 1001)
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: temp_id,
+        parent_node_id: line_id,
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Temp"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4036/")
+
+    %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, line_id: line_id, temp_id: temp_id}
+  end
+
+  test "translate many browse paths", %{c_pid: c_pid, ns_index: ns_index, line_id: line_id, temp_id: temp_id} do
+    objects_folder = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+
+    paths = [
+      "0:Objects/#{ns_index}:Line1/#{ns_index}:Temp",
+      {objects_folder, "Line1/Temp"},
+      {line_id, [QualifiedName.new(ns_index: ns_index, name: "Temp")]},
+      "0:Objects/#{ns_index}:Line2"
+    ]
+
+    assert {:ok, [{:ok, ^temp_id}, {:ok, ^temp_id}, {:ok, ^temp_id}, {:error, "BadNoMatch"}]} =
+             Client.translate_browse_paths(c_pid, paths, ns_index: ns_index)
+  end
+
+  test "resolved paths are cached", %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, temp_id: temp_id} do
+    path = "0:Objects/#{ns_index}:Line1/#{ns_index}:Temp"
+    assert {:ok, [{:ok, ^temp_id}]} = Client.translate_browse_paths(c_pid, [path])
+
+    :ok = Server.delete_node(s_pid, node_id: temp_id, delete_references: true)
+
+    assert {:ok, [{:ok, ^temp_id}]} = Client.translate_browse_paths(c_pid, [path])
+    assert {:ok, [{:error, "BadNoMatch"}]} = Client.translate_browse_paths(c_pid, [path], cached: false)
+
+    # Reconnecting drops the cache.
+    :ok = Client.disconnect(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4036/")
+    assert {:ok, [{:error, "BadNoMatch"}]} = Client.translate_browse_paths(c_pid, [path])
+  end
+
+  test "cache hits check the namespace array", %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, temp_id: temp_id} do
+    path = "0:Objects/#{ns_index}:Line1/#{ns_index}:Temp"
+    assert {:ok, [{:ok, ^temp_id}]} = Client.translate_browse_paths(c_pid, [path])
+
+    :ok = Server.delete_node(s_pid, node_id: temp_id, delete_references: true)
+    {:ok, _ns_index} = Server.add_namespace(s_pid, "PathTestModel")
+
+    # Hits are served without reading the NamespaceArray for a second.
+    assert {:ok, [{:ok, ^temp_id}]} = Client.translate_browse_paths(c_pid, [path])
+    Process.sleep(1100)
+    assert {:ok, [{:error, "BadNoMatch"}]} = Client.translate_browse_paths(c_pid, [path])
+  end
+
+  test "invalid browse paths", %{c_pid: c_pid} do
+    assert {:error, :einval} == Client.translate_browse_paths(c_pid, [])
+    assert {:error, :einval} == Client.translate_browse_paths(c_pid, [""])
+    assert {:error, :einval} == Client.translate_browse_paths(c_pid, [:path])
+    assert {:error, :einval} == Client.translate_browse_paths(c_pid, ["0:Objects"], ns_index: -1)
+  end
+end
@@ -0,0 +1,109 @@
+defmodule ClientBrowseTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4034)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "BrowseTest")
+
+    parent_id =
+      NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "BrowseParent")
+
+    :ok =
+      Server.add_object_node(s_pid,
+        requested_new_node_id: parent_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "BrowseParent"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+      )
+
+    node_ids =
+      for i <- 1..5 do
+        node_id =
+          NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Browsed_#{i}")
+
+        :ok =
+          Server.add_variable_node(s_pid,
+            requested_new_node_id: node_id,
+            parent_node_id: parent_id,
+            reference_type_node_id:
+              NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+            browse_name: QualifiedName.new(ns_index: ns_index, name: "Browsed #{i}"),
+            type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+          )
+
+        node_id
+      end
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4034/")
+
+    %{c_pid: c_pid, ns_index: ns_index, parent_id: parent_id, node_ids: node_ids}
+  end
+
+  test "browse many nodes", %{c_pid: c_pid, ns_index: ns_index, parent_id: parent_id, node_ids: node_ids} do
+    objects_folder = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+    unknown = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Unknown")
+
+    assert {:ok, [{:ok, parent}, {:ok, objects}, {:error, "BadNodeIdUnknown"}]} =
+             Client.browse(c_pid, [parent_id, objects_folder, unknown], node_classes: [:variable])
+
+    assert parent.continuation_point == nil
+    assert Enum.map(parent.references, & &1.node_id) -- node_ids == []
+    assert length(parent.references) == 5
+
+    assert %{
+             browse_name: %QualifiedName{name: "Browsed 1"},
+             node_class: "Variable",
+             is_forward: true,
+             reference_type: %NodeId{identifier: 47},
+             type_definition: %NodeId{identifier: 63}
+           } = Enum.find(parent.references, &(&1.node_id == hd(node_ids)))
+
+    assert objects.references == []
+  end
+
+  test "trimmed result fields", %{c_pid: c_pid, parent_id: parent_id} do
+    assert {:ok, [{:ok, %{references: [reference | _]}}]} =
+             Client.browse(c_pid, [parent_id], result_fields: [:browse_name], node_classes: [:variable])
+
+    assert [:browse_name, :node_id] == reference |> Map.keys() |> Enum.sort()
+  end
+
+  test "continuation points", %{c_pid: c_pid, parent_id: parent_id} do
+    opts = [node_classes: [:variable], max_references: 2]
+
+    # Followed in the port
+    assert {:ok, [{:ok, %{references: references, continuation_point: nil}}]} =
+             Client.browse(c_pid, [parent_id], opts)
+
+    assert length(references) == 5
+
+    # Followed by the caller
+    assert {:ok, [{:ok, %{references: [_, _], continuation_point: cp}}]} =
+             Client.browse(c_pid, [parent_id], [follow: false] ++ opts)
+
+    assert is_binary(cp)
+
+    assert {:ok, [{:ok, %{references: [_, _], continuation_point: cp}}]} =
+             Client.browse_next(c_pid, [cp])
+
+    assert {:ok, []} == Client.browse_next(c_pid, [cp], release: true)
+  end
+
+  test "invalid browse requests", %{c_pid: c_pid, parent_id: parent_id} do
+    assert {:error, :einval} == Client.browse(c_pid, [])
+    assert {:error, :einval} == Client.browse(c_pid, [parent_id], direction: :sideways)
+    assert {:error, :einval} == Client.browse(c_pid, [parent_id], node_classes: [:table])
+    assert {:error, :einval} == Client.browse(c_pid, [parent_id], result_fields: [:value])
+    assert {:error, :einval} == Client.browse_next(c_pid, [:cp])
+  end
+end
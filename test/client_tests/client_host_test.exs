@@ -0,0 +1,49 @@
+defmodule ClientHostTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, Client, ClientHost}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4049)
+    :ok = Server.start(s_pid)
+
+    {:ok, host} = ClientHost.start_link()
+
+    # Server_ServerStatus_CurrentTime
+    node_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2258)
+
+    %{host: host, node_id: node_id}
+  end
+
+  test "many clients share one port", %{host: host, node_id: node_id} do
+    c_pids =
+      for _ <- 1..10 do
+        {:ok, c_pid} = Client.start_link(host: host)
+        :ok = Client.set_config(c_pid)
+        :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4049/")
+        c_pid
+      end
+
+    assert ClientHost.sessions(host) == 10
+
+    for c_pid <- c_pids do
+      assert {:ok, _current_time} = Client.read_node_value(c_pid, node_id)
+      assert {:ok, "Session"} == Client.get_state(c_pid)
+    end
+
+    [c_pid | c_pids] = c_pids
+    :ok = Client.stop(c_pid)
+    # The host deletes the session once it sees the client exit.
+    Process.sleep(100)
+    assert ClientHost.sessions(host) == 9
+
+    :ok = Client.disconnect(hd(c_pids))
+    assert {:ok, "Disconnected"} == Client.get_state(hd(c_pids))
+
+    for c_pid <- tl(c_pids) do
+      assert {:ok, _current_time} = Client.read_node_value(c_pid, node_id)
+    end
+  end
+end
@@ -54,6 +54,23 @@ defmodule ClientConnectionTest do
     assert {:ok,  "Disconnected"} == Client.get_state(c_pid)
   end
 
+  test "Pushes the client state changes", %{c_pid: c_pid} do
+    url = "opc.tcp://localhost:4001/"
+
+    assert :ok == Client.set_state_notifications(c_pid, true)
+    assert_receive({:state, :closed, :closed, "Good"}, 1000)
+
+    assert :ok == Client.connect_by_url(c_pid, url: url)
+    assert_receive({:state, :open, :activated, "Good"}, 1000)
+
+    assert :ok == Client.disconnect(c_pid)
+    assert_receive({:state, :closed, :closed, _status}, 1000)
+
+    assert :ok == Client.set_state_notifications(c_pid, false)
+    assert :ok == Client.connect_by_url(c_pid, url: url)
+    refute_receive({:state, _channel_state, _session_state, _status}, 200)
+  end
+
   test "Connect client by url, user, password", %{c_pid: c_pid} do
     url = "opc.tcp://localhost:4002/"
     user = "alde103"
@@ -0,0 +1,122 @@
+defmodule ClientCrawlTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4035)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "CrawlTest")
+
+    root_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "CrawlRoot")
+    add_object(s_pid, ns_index, root_id, NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85))
+
+    for i <- 1..2 do
+      area_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Area_#{i}")
+      add_object(s_pid, ns_index, area_id, root_id)
+
+      for j <- 1..3,
+          do: add_variable(s_pid, ns_index, "Tag_#{i}_#{j}", area_id)
+    end
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4035/")
+
+    cache_path = Path.join(System.tmp_dir!(), "opex62541_crawl_test.cache")
+    File.rm(cache_path)
+    on_exit(fn -> File.rm(cache_path) end)
+
+    %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, root_id: root_id, cache_path: cache_path}
+  end
+
+  test "crawl a subtree", %{c_pid: c_pid, ns_index: ns_index, root_id: root_id} do
+    assert {:ok, %{source: :crawled, truncated: false, nodes: nodes}} = Client.crawl(c_pid, root_id)
+    assert length(nodes) == 9
+
+    assert [%{node_id: ^root_id, parent: nil, node_class: "Object"} | _] = nodes
+
+    tag_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Tag_2_1")
+    area_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Area_2")
+
+    assert %{
+             parent: ^area_id,
+             node_class: "Variable",
+             browse_name: %QualifiedName{name: "Tag_2_1"},
+             data_type: %NodeId{},
+             access_level: 3
+           } = Enum.find(nodes, &(&1.node_id == tag_id))
+
+    assert {:ok, %{nodes: [_, _, _]}} = Client.crawl(c_pid, root_id, max_depth: 1)
+    assert {:ok, %{truncated: true, nodes: [_, _, _, _]}} = Client.crawl(c_pid, root_id, max_nodes: 4)
+  end
+
+  test "cached crawl", %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, root_id: root_id, cache_path: cache_path} do
+    assert {:ok, %{source: :crawled, nodes: nodes}} = Client.crawl(c_pid, root_id, cache_path: cache_path)
+    assert File.exists?(cache_path)
+    assert {:ok, %{source: :cache, nodes: ^nodes}} = Client.crawl(c_pid, root_id, cache_path: cache_path)
+
+    area_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Area_1")
+    add_variable(s_pid, ns_index, "Tag_1_4", area_id)
+
+    # The cache does not see the change until it is re-validated.
+    assert {:ok, %{source: :cache, nodes: ^nodes}} = Client.crawl(c_pid, root_id, cache_path: cache_path)
+
+    assert {:ok, %{source: :validated, nodes: validated}} =
+             Client.crawl(c_pid, root_id, cache_path: cache_path, validate: true)
+
+    assert length(validated) == 10
+    assert {:ok, %{source: :cache, nodes: ^validated}} = Client.crawl(c_pid, root_id, cache_path: cache_path)
+  end
+
+  test "a corrupt cache is crawled again", %{c_pid: c_pid, ns_index: ns_index, root_id: root_id, cache_path: cache_path} do
+    assert {:ok, %{source: :crawled, nodes: nodes}} = Client.crawl(c_pid, root_id, cache_path: cache_path)
+
+    # Area_1 (string NodeId) points to a parent after it.
+    data = File.read!(cache_path)
+    {position, length} = :binary.match(data, <<3, ns_index::16-little, 6::32-little, "Area_1">>)
+    <<head::binary-size(position + length), 0::32-little, rest::binary>> = data
+    File.write!(cache_path, <<head::binary, 1000::32-little, rest::binary>>)
+
+    assert {:ok, %{source: :crawled, nodes: ^nodes}} = Client.crawl(c_pid, root_id, cache_path: cache_path)
+    assert {:ok, %{source: :cache, nodes: ^nodes}} = Client.crawl(c_pid, root_id, cache_path: cache_path)
+  end
+
+  test "invalid crawls", %{c_pid: c_pid, ns_index: ns_index, root_id: root_id} do
+    unknown = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Unknown")
+    assert {:error, "BadNodeIdUnknown"} == Client.crawl(c_pid, unknown)
+    assert {:error, :einval} == Client.crawl(c_pid, root_id, max_nodes: 0)
+    assert {:error, :einval} == Client.crawl(c_pid, root_id, cache_path: :file)
+  end
+
+  defp add_object(s_pid, ns_index, node_id, parent_id) do
+    :ok =
+      Server.add_object_node(s_pid,
+        requested_new_node_id: node_id,
+        parent_node_id: parent_id,
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: node_id.identifier),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+      )
+  end
+
+  defp add_variable(s_pid, ns_index, name, parent_id) do
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: name)
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: node_id,
+        parent_node_id: parent_id,
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: name),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.write_node_access_level(s_pid, node_id, 3)
+  end
+end
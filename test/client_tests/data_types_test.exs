@@ -0,0 +1,136 @@
+defmodule ClientDataTypesTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, QualifiedName, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4030)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "DataTypesTest")
+
+    # Server-defined structure: Point {x: Double, y: Double}
+    point_type = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Point")
+    point_encoding = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Point_Binary")
+    position = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Position")
+
+    :ok =
+      Server.add_structure_type(s_pid,
+        requested_new_node_id: point_type,
+        encoding_node_id: point_encoding,
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Point"),
+        fields: [{"x", 10}, {"y", 10}]
+      )
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: position,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Position"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    # Lazy values are written with the generic variant encoding, which takes encoded structures.
+    :ok = Server.set_node_lazy_read(s_pid, position, 60_000)
+    body = <<1.5::float-little-64, -2.0::float-little-64>>
+    :ok = Server.set_lazy_value(s_pid, position, 21, {point_encoding, body})
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4030/")
+
+    %{c_pid: c_pid, s_pid: s_pid, ns_index: ns_index, point_type: point_type, position: position}
+  end
+
+  test "structures are read as maps of field => value", %{c_pid: c_pid} do
+    # Server_ServerStatus (ServerStatusDataType)
+    server_status = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2256)
+
+    assert {:ok, status} = Client.read_node_value(c_pid, server_status)
+    assert is_map(status)
+    assert map_size(status) == 6
+    # BuildInfo is a nested structure.
+    assert Enum.any?(Map.values(status), &is_map/1)
+  end
+
+  test "structures are read as maps in batch reads", %{c_pid: c_pid} do
+    server_status = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2256)
+
+    assert {:ok, [{:ok, status}]} = Client.read_node_values(c_pid, [server_status])
+    assert is_map(status)
+  end
+
+  test "server-defined structures are discovered and read as maps", %{c_pid: c_pid, position: position} do
+    server_status = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2256)
+
+    assert {:ok, %{"x" => 1.5, "y" => -2.0}} == Client.read_node_value(c_pid, position)
+
+    # The discovered type is cached, batches mixing it with ns0 structures decode both.
+    assert {:ok, [{:ok, %{"x" => 1.5, "y" => -2.0}}, {:ok, status}, {:ok, %{"x" => 1.5, "y" => -2.0}}]} =
+             Client.read_node_values(c_pid, [position, server_status, position])
+
+    assert is_map(status)
+  end
+
+  test "server-defined structures are rediscovered after the cache is cleared",
+       %{c_pid: c_pid, point_type: point_type, position: position} do
+    assert {:ok, [:ok]} = Client.load_data_types(c_pid, [point_type])
+    assert :ok = Client.clear_data_types(c_pid)
+    assert {:ok, [{:ok, %{"x" => 1.5}}, {:ok, %{"y" => -2.0}}]} = Client.read_node_values(c_pid, [position, position])
+  end
+
+  test "cached structures are dropped with their data types",
+       %{c_pid: c_pid, point_type: point_type, position: position} do
+    :ok = Client.set_value_cache(c_pid, true)
+    assert {:ok, [:ok]} = Client.load_data_types(c_pid, [point_type])
+
+    {:ok, subscription_id} = Client.add_subscription(c_pid, 50.0)
+    {:ok, monitored_id} = Client.add_monitored_item(c_pid, monitored_item: position, subscription_id: subscription_id)
+    assert_receive {:data, ^subscription_id, ^monitored_id, %{"x" => 1.5, "y" => -2.0}}, 2000
+    assert {:ok, %{value: %{"x" => 1.5, "y" => -2.0}}} = Client.read_cached(c_pid, position)
+
+    # The cached value was decoded with the cleared type.
+    assert :ok = Client.clear_data_types(c_pid)
+    assert {:error, :not_cached} == Client.read_cached(c_pid, position)
+    assert {:ok, %{"x" => 1.5, "y" => -2.0}} == Client.read_node_value(c_pid, position)
+  end
+
+  test "load known data types", %{c_pid: c_pid} do
+    # Range
+    range = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 884)
+
+    assert {:ok, [:ok]} = Client.load_data_types(c_pid, [range])
+    # Cached types answer without discovery.
+    assert {:ok, [:ok]} = Client.load_data_types(c_pid, [range])
+  end
+
+  test "load unknown data types returns per-type errors", %{c_pid: c_pid, ns_index: ns_index} do
+    range = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 884)
+    unknown = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "NoType")
+
+    assert {:ok, [:ok, {:error, _reason}]} = Client.load_data_types(c_pid, [range, unknown])
+  end
+
+  test "load data types requires 1 to 100 types", %{c_pid: c_pid} do
+    assert {:error, :einval} = Client.load_data_types(c_pid, [])
+  end
+
+  test "invalid structure types", %{s_pid: s_pid, ns_index: ns_index} do
+    args = [
+      requested_new_node_id: NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Bad"),
+      encoding_node_id: NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Bad_Binary"),
+      browse_name: QualifiedName.new(ns_index: ns_index, name: "Bad")
+    ]
+
+    assert {:error, :einval} == Server.add_structure_type(s_pid, [{:fields, []} | args])
+    assert {:error, :einval} == Server.add_structure_type(s_pid, [{:fields, [{"x", 1000}]} | args])
+    assert {:error, :einval} == Server.add_structure_type(s_pid, [{:fields, [{:x, 10}]} | args])
+  end
+
+  test "clear data types", %{c_pid: c_pid} do
+    assert :ok = Client.clear_data_types(c_pid)
+  end
+end
@@ -0,0 +1,52 @@
+defmodule ClientEventTest do
+  use ExUnit.Case, async: false
+
+  @moduletag :events
+
+  alias OpcUA.{NodeId, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4041)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4041/")
+    {:ok, subscription_id} = Client.add_subscription(c_pid)
+
+    %{c_pid: c_pid, subscription_id: subscription_id}
+  end
+
+  test "add & delete an event monitored item", %{c_pid: c_pid, subscription_id: subscription_id} do
+    # BaseModelChangeEventType and the Severity of the events.
+    model_change_type = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2132)
+
+    assert {:ok, monitored_id} =
+             Client.add_event_monitored_item(c_pid,
+               subscription_id: subscription_id,
+               select: ["EventId", "EventType", "0:Message", "Severity"],
+               where: {:or, {:of_type, model_change_type}, {:gte, {:field, "Severity"}, {4, 500}}}
+             )
+
+    assert :ok ==
+             Client.delete_monitored_item(c_pid, subscription_id: subscription_id, monitored_item_id: monitored_id)
+  end
+
+  test "invalid event monitored items", %{c_pid: c_pid, subscription_id: subscription_id} do
+    assert {:error, :einval} == Client.add_event_monitored_item(c_pid, subscription_id: subscription_id)
+    assert {:error, :einval} == Client.add_event_monitored_item(c_pid, subscription_id: subscription_id, select: [])
+    assert {:error, :einval} == Client.add_event_monitored_item(c_pid, select: ["Message"])
+
+    assert {:error, :einval} ==
+             Client.add_event_monitored_item(c_pid,
+               subscription_id: subscription_id,
+               select: ["Message"],
+               where: {:xor, {:field, "Severity"}, {4, 1}}
+             )
+
+    assert {:error, _reason} =
+             Client.add_event_monitored_item(c_pid, subscription_id: subscription_id + 100, select: ["Message"])
+  end
+end
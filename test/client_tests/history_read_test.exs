@@ -0,0 +1,79 @@
+defmodule ClientHistoryReadTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, Client, QualifiedName}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4038)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "Room")
+
+    variable_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: variable_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Temperature"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4038/")
+
+    node_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2258)
+
+    %{s_pid: s_pid, c_pid: c_pid, node_id: node_id, variable_id: variable_id}
+  end
+
+  test "history read without a server history backend", %{c_pid: c_pid, node_id: node_id} do
+    start_time = DateTime.add(DateTime.utc_now(), -3600, :second)
+
+    assert {:error, _reason} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: DateTime.utc_now())
+  end
+
+  @tag :historizing
+  test "history read of many nodes", %{s_pid: s_pid, c_pid: c_pid, node_id: node_id, variable_id: variable_id} do
+    :ok = Server.set_node_history(s_pid, variable_id, 100)
+
+    for value <- 1..25 do
+      :ok = Server.write_node_value(s_pid, variable_id, 10, value * 0.5)
+      Process.sleep(2)
+    end
+
+    start_time = DateTime.add(DateTime.utc_now(), -3600, :second)
+    end_time = DateTime.add(DateTime.utc_now(), 3600, :second)
+    expected = for value <- 1..25, into: <<>>, do: <<value * 0.5::float-64-native>>
+
+    # Continuation points are followed in the port, 10 values per round.
+    assert {:ok, [{:ok, history}, {:error, _reason}]} =
+             Client.history_read_raw(c_pid, [variable_id, node_id],
+               start_time: start_time,
+               end_time: end_time,
+               num_values: 10
+             )
+
+    assert history.data_type == 10
+    assert history.values == expected
+    assert byte_size(history.timestamps) == 25 * 8
+    assert history.statuses == nil
+
+    timestamps = for <<timestamp::signed-64-native <- history.timestamps>>, do: timestamp
+    assert timestamps == Enum.sort(timestamps)
+  end
+
+  test "invalid history reads", %{c_pid: c_pid, node_id: node_id} do
+    assert {:error, :einval} == Client.history_read_raw(c_pid, [], start_time: 1)
+    assert {:error, :einval} == Client.history_read_raw(c_pid, [:node], start_time: 1)
+    assert {:error, :einval} == Client.history_read_raw(c_pid, [node_id])
+    assert {:error, :einval} == Client.history_read_raw(c_pid, [node_id], start_time: -1)
+    assert {:error, :einval} == Client.history_read_raw(c_pid, [node_id], start_time: 1, num_values: -1)
+    assert {:error, :einval} == Client.history_read_raw(c_pid, [node_id], start_time: 1, return_bounds: 1)
+  end
+end
@@ -0,0 +1,73 @@
+defmodule ClientMethodCallTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, QualifiedName, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4037)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4037/")
+
+    # Server object and its GetMonitoredItems method (namespace 0).
+    server_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2253)
+    method_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 11492)
+
+    %{s_pid: s_pid, c_pid: c_pid, server_id: server_id, method_id: method_id}
+  end
+
+  test "call many methods in one request", %{c_pid: c_pid, server_id: server_id, method_id: method_id} do
+    {:ok, subscription_id} = Client.add_subscription(c_pid)
+    objects_folder = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+
+    calls = [
+      {server_id, method_id, [{6, subscription_id}]},
+      {server_id, method_id, [{6, subscription_id + 100}]},
+      {server_id, objects_folder, []}
+    ]
+
+    assert {:ok, [{:ok, [[], []]}, {:error, "BadSubscriptionIdInvalid"}, {:error, _reason}]} =
+             Client.call_methods(c_pid, calls)
+
+    many_calls = List.duplicate({server_id, method_id, [{6, subscription_id}]}, 200)
+    assert {:ok, results} = Client.call_methods(c_pid, many_calls)
+    assert length(results) == 200
+    assert Enum.all?(results, &(&1 == {:ok, [[], []]}))
+  end
+
+  # Answered by the test process (method node of the server, async calls)
+  @tag :multithreading
+  test "array inputs and output values", %{s_pid: s_pid, c_pid: c_pid} do
+    {:ok, ns_index} = Server.add_namespace(s_pid, "Line")
+    object_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+    method_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Scale")
+
+    :ok =
+      Server.add_method_node(s_pid,
+        requested_new_node_id: method_id,
+        parent_node_id: object_id,
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Scale"),
+        input_arguments: [{"values", 10, 1}, {"factor", 10}],
+        output_arguments: [{"scaled", 10, 1}, {"count", 6}]
+      )
+
+    call = {object_id, method_id, [{10, [1.0, 2.0, 3.0]}, {10, 2.0}]}
+    task = Task.async(fn -> Client.call_methods(c_pid, [call]) end)
+
+    assert_receive {:method_call, call_id, ^object_id, ^method_id, [[1.0, 2.0, 3.0], 2.0]}, 2000
+    assert :ok == Server.set_method_result(s_pid, call_id, {:ok, [{10, [2.0, 4.0, 6.0]}, {6, 3}]})
+    assert {:ok, [{:ok, [[2.0, 4.0, 6.0], 3]}]} == Task.await(task)
+  end
+
+  test "invalid method calls", %{c_pid: c_pid, server_id: server_id, method_id: method_id} do
+    assert {:error, :einval} == Client.call_methods(c_pid, [])
+    assert {:error, :einval} == Client.call_methods(c_pid, [{server_id, method_id}])
+    assert {:error, :einval} == Client.call_methods(c_pid, [{server_id, method_id, [1]}])
+    assert {:error, :einval} == Client.call_methods(c_pid, [{server_id, method_id, [{:uint32, 1}]}])
+  end
+end
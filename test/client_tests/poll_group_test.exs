@@ -0,0 +1,87 @@
+defmodule ClientPollGroupTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4033)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "PollTest")
+
+    parent_id =
+      NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "PollParent")
+
+    :ok =
+      Server.add_object_node(s_pid,
+        requested_new_node_id: parent_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "PollParent"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+      )
+
+    node_ids =
+      for i <- 1..2 do
+        node_id =
+          NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Polled_#{i}")
+
+        :ok =
+          Server.add_variable_node(s_pid,
+            requested_new_node_id: node_id,
+            parent_node_id: parent_id,
+            reference_type_node_id:
+              NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+            browse_name: QualifiedName.new(ns_index: ns_index, name: "Polled #{i}"),
+            type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+          )
+
+        :ok = Server.write_node_access_level(s_pid, node_id, 3)
+        :ok = Server.write_node_value(s_pid, node_id, 10, 1.0)
+        node_id
+      end
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4033/")
+
+    %{c_pid: c_pid, node_ids: node_ids}
+  end
+
+  test "reports only changed values", %{c_pid: c_pid, node_ids: [node_id_1, node_id_2] = node_ids} do
+    {:ok, group_id} = Client.add_poll_group(c_pid, node_ids, interval: 100.0)
+
+    # The first cycle reports every node.
+    assert_receive {:poll, ^group_id, [_, _] = changes}, 2000
+    assert {:ok, 1.0} == :proplists.get_value(node_id_1, changes)
+    assert {:ok, 1.0} == :proplists.get_value(node_id_2, changes)
+    refute_receive {:poll, ^group_id, _}, 500
+
+    :ok = Client.write_node_value(c_pid, node_id_2, 10, 2.0)
+    assert_receive {:poll, ^group_id, [{^node_id_2, {:ok, 2.0}}]}, 2000
+
+    assert :ok == Client.delete_poll_group(c_pid, group_id)
+    assert {:error, :einval} == Client.delete_poll_group(c_pid, group_id)
+  end
+
+  test "deadband filters small changes", %{c_pid: c_pid, node_ids: [node_id | _]} do
+    {:ok, group_id} = Client.add_poll_group(c_pid, [node_id], interval: 50.0, deadband: 1.0)
+    assert_receive {:poll, ^group_id, [{^node_id, {:ok, 1.0}}]}, 2000
+
+    :ok = Client.write_node_value(c_pid, node_id, 10, 1.5)
+    refute_receive {:poll, ^group_id, _}, 500
+
+    :ok = Client.write_node_value(c_pid, node_id, 10, 2.5)
+    assert_receive {:poll, ^group_id, [{^node_id, {:ok, 2.5}}]}, 2000
+  end
+
+  test "invalid poll groups", %{c_pid: c_pid, node_ids: node_ids} do
+    assert {:error, :einval} == Client.add_poll_group(c_pid, [])
+    assert {:error, :einval} == Client.add_poll_group(c_pid, node_ids, interval: 1.0)
+    assert {:error, :einval} == Client.add_poll_group(c_pid, node_ids, deadband: -1.0)
+    assert {:error, :einval} == Client.add_poll_group(c_pid, node_ids, interval: :fast)
+  end
+end
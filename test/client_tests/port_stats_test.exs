@@ -0,0 +1,73 @@
+defmodule ClientPortStatsTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4047)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4047/")
+
+    node_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2258)
+
+    %{c_pid: c_pid, node_id: node_id}
+  end
+
+  test "command latencies and port traffic", %{c_pid: c_pid, node_id: node_id} do
+    for _ <- 1..50, do: {:ok, _value} = Client.read_node_value(c_pid, node_id)
+
+    assert {:ok, stats} = Client.get_port_stats(c_pid)
+    assert stats.frames_in > 50 and stats.frames_out > 50
+    assert stats.bytes_in > 0 and stats.bytes_out > 0
+
+    assert %{count: 50, decode: decode, call: call, send: send, total: total} = stats.commands["read_node_value"]
+    for latency <- [decode, call, send, total], do: assert(latency.p50 <= latency.p90 and latency.p99 <= latency.max)
+    assert call.p50 <= total.max
+
+    {:ok, _browse_name} = Client.read_node_browse_name(c_pid, node_id)
+    assert {:ok, stats} = Client.get_port_stats(c_pid)
+    assert %{count: 1, call: nil, total: %{max: _max}} = stats.commands["read_node_browse_name"]
+
+    assert {:ok, _stats} = Client.get_port_stats(c_pid, reset: true)
+    assert {:ok, stats} = Client.get_port_stats(c_pid)
+    refute Map.has_key?(stats.commands, "read_node_value")
+    assert {:error, :einval} == Client.get_port_stats(c_pid, reset: 1)
+  end
+
+  test "periodic telemetry events", %{c_pid: c_pid, node_id: node_id} do
+    test_pid = self()
+    handler_id = "port-stats-#{inspect(test_pid)}"
+
+    :telemetry.attach(
+      handler_id,
+      [:opex62541, :port, :stats],
+      fn _event, measurements, metadata, _config -> send(test_pid, {:port_stats, measurements, metadata}) end,
+      nil
+    )
+
+    on_exit(fn -> :telemetry.detach(handler_id) end)
+
+    {:ok, _value} = Client.read_node_value(c_pid, node_id)
+    :ok = Client.set_port_stats_interval(c_pid, 100)
+    assert_receive {:port_stats, %{frames_in: _frames_in}, %{pid: ^c_pid, commands: %{"read_node_value" => _}}}, 1000
+    assert_receive {:port_stats, _measurements, _metadata}, 1000
+
+    :ok = Client.set_port_stats_interval(c_pid, 0)
+    Process.sleep(150)
+    flush_port_stats()
+    refute_receive {:port_stats, _measurements, _metadata}, 300
+  end
+
+  defp flush_port_stats() do
+    receive do
+      {:port_stats, _measurements, _metadata} -> flush_port_stats()
+    after
+      0 -> :ok
+    end
+  end
+end
@@ -0,0 +1,231 @@
+defmodule ClientReconnectTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client}
+
+  @url "opc.tcp://localhost:4051/"
+
+  setup do
+    {s_pid, node_id} = start_server()
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid, %{"timeout" => 1000})
+
+    %{c_pid: c_pid, s_pid: s_pid, node_id: node_id}
+  end
+
+  test "async connect reports its outcome", %{c_pid: c_pid} do
+    assert :ok == Client.connect_async(c_pid, url: @url)
+    assert_receive({:connection, {:connecting, 1}}, 1000)
+    assert_receive({:connection, {:connected, 0}}, 2000)
+    assert {:ok, "Session"} == Client.get_state(c_pid)
+
+    :ok = Client.disconnect(c_pid)
+    assert :ok == Client.connect_async(c_pid, url: "opc.tcp://localhost:4052/")
+    assert_receive({:connection, {:failed, _status}}, 3000)
+  end
+
+  test "reconnects and recovers the subscriptions", %{c_pid: c_pid, s_pid: s_pid, node_id: node_id} do
+    :ok = Client.set_reconnect(c_pid, min_backoff: 100, max_backoff: 400)
+    :ok = Client.connect_by_url(c_pid, url: @url)
+
+    {:ok, subscription_id} = Client.add_subscription(c_pid)
+    {:ok, monitored_id} = Client.add_monitored_item(c_pid, monitored_item: node_id, subscription_id: subscription_id)
+
+    # The restarted server lost the session and its subscriptions.
+    :ok = Server.stop(s_pid)
+    assert_receive({:connection, {:disconnected, _status}}, 5000)
+    assert_receive({:connection, {:backoff, delay}}, 5000)
+    assert delay <= 400
+
+    {s_pid, node_id} = start_server()
+    assert_receive({:connection, {:connected, outage}}, 10000)
+    assert outage > 0
+
+    assert_receive(
+      {:connection, {:recovered, {^subscription_id, new_subscription_id, [{^monitored_id, new_monitored_id}]}}},
+      1000
+    )
+
+    assert is_integer(new_subscription_id)
+    assert is_integer(new_monitored_id)
+    refute_received({:delete, ^subscription_id})
+
+    :ok = Server.write_node_value(s_pid, node_id, 10, 103.0)
+    assert_receive({:data, ^new_subscription_id, ^new_monitored_id, 103.0}, 3000)
+
+    # Recreated: the server had nothing to republish
+    assert {:ok, [%{subscription_id: ^new_subscription_id, gaps: 0, republished: 0, lost: 0}]} =
+             Client.get_subscription_stats(c_pid)
+  end
+
+  test "republishes the retained messages and reports the discarded ones", %{c_pid: c_pid, s_pid: s_pid, node_id: node_id} do
+    # The server keeps one unacknowledged message per subscription.
+    :ok = Server.stop(s_pid)
+    {s_pid, node_id} = start_server(retransmission_queue_size: 1)
+    proxy = start_proxy(4054, 4051)
+
+    :ok = Client.set_reconnect(c_pid, min_backoff: 100, max_backoff: 400)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4054/")
+
+    {:ok, subscription_id} = Client.add_subscription(c_pid, 100.0)
+    {:ok, monitored_id} = Client.add_monitored_item(c_pid, monitored_item: node_id, subscription_id: subscription_id)
+    assert_receive({:data, ^subscription_id, ^monitored_id, _initial}, 3000)
+
+    # The messages published while the client receives nothing are not acknowledged: the server
+    # only retains the last one.
+    outage(proxy, s_pid, node_id, [1.0, 2.0, 3.0])
+    assert_receive({:connection, {:recovered, _recovery}}, 10000)
+    assert_receive({:data, ^subscription_id, ^monitored_id, 3.0}, 3000)
+    refute_received({:data, ^subscription_id, ^monitored_id, 1.0})
+    refute_received({:gap, ^subscription_id, _sequence_numbers})
+
+    # Nothing was received since the recovery, so the discarded messages are known.
+    outage(proxy, s_pid, node_id, [4.0, 5.0, 6.0])
+    assert_receive({:connection, {:recovered, _recovery}}, 10000)
+    assert_receive({:data, ^subscription_id, ^monitored_id, 6.0}, 3000)
+    assert_receive({:gap, ^subscription_id, [first, second]}, 1000)
+    assert second == first + 1
+
+    assert {:ok, [%{subscription_id: ^subscription_id, gaps: 2, republished: 2, lost: 2}]} =
+             Client.get_subscription_stats(c_pid)
+  end
+
+  test "reconnects with the user of connect_by_username", %{c_pid: c_pid, s_pid: s_pid} do
+    :ok = Server.stop(s_pid)
+    s_pid = start_users_server("secret")
+
+    :ok = Client.set_reconnect(c_pid, min_backoff: 100, max_backoff: 200)
+    :ok = Client.connect_by_username(c_pid, url: @url, user: "alde103", password: "secret")
+
+    # Anonymous sessions are allowed: the attempts only fail if the user is presented.
+    :ok = Server.stop(s_pid)
+    assert_receive({:connection, {:disconnected, _status}}, 5000)
+    s_pid = start_users_server("changed")
+    assert_receive({:connection, {:backoff, _delay}}, 5000)
+    refute_receive({:connection, {:connected, _outage}}, 1500)
+
+    :ok = Server.stop(s_pid)
+    start_users_server("secret")
+    assert_receive({:connection, {:connected, _outage}}, 10000)
+    assert {:ok, "Session"} == Client.get_state(c_pid)
+  end
+
+  test "drops the cached browse paths when it reconnects", %{c_pid: c_pid, s_pid: s_pid, node_id: node_id} do
+    :ok = Client.set_reconnect(c_pid, min_backoff: 100, max_backoff: 400)
+    :ok = Client.connect_by_url(c_pid, url: @url)
+    path = "0:Objects/#{node_id.ns_index}:Temperature"
+
+    assert {:ok, [{:ok, %NodeId{identifier: "R1_TS1_Temperature"}}]} =
+             Client.translate_browse_paths(c_pid, [path])
+
+    # Same namespaces, the node has another id
+    :ok = Server.stop(s_pid)
+    assert_receive({:connection, {:disconnected, _status}}, 5000)
+    start_server(identifier: "R1_TS1_Temperature_v2")
+    assert_receive({:connection, {:connected, _outage}}, 10000)
+
+    assert {:ok, [{:ok, %NodeId{identifier: "R1_TS1_Temperature_v2"}}]} =
+             Client.translate_browse_paths(c_pid, [path])
+  end
+
+  test "subscription stats", %{c_pid: c_pid} do
+    :ok = Client.connect_by_url(c_pid, url: @url)
+    assert {:ok, []} == Client.get_subscription_stats(c_pid)
+
+    {:ok, subscription_id} = Client.add_subscription(c_pid)
+
+    assert {:ok, [%{subscription_id: ^subscription_id, gaps: 0, republished: 0, lost: 0, late: 0, max_lateness: 0}]} =
+             Client.get_subscription_stats(c_pid)
+
+    :ok = Client.delete_subscription(c_pid, subscription_id)
+    assert {:ok, []} == Client.get_subscription_stats(c_pid)
+  end
+
+  test "invalid reconnection settings", %{c_pid: c_pid} do
+    assert {:error, :einval} == Client.set_reconnect(c_pid, min_backoff: 0)
+    assert {:error, :einval} == Client.set_reconnect(c_pid, min_backoff: 1000, max_backoff: 10)
+    assert {:error, :einval} == Client.set_reconnect(c_pid, enabled: 1)
+    assert :ok == Client.set_reconnect(c_pid, enabled: false)
+  end
+
+  defp outage(proxy, s_pid, node_id, values) do
+    :ok = proxy_freeze(proxy)
+
+    for value <- values do
+      :ok = Server.write_node_value(s_pid, node_id, 10, value)
+      Process.sleep(300)
+    end
+
+    :ok = proxy_drop(proxy)
+    assert_receive({:connection, {:disconnected, _status}}, 5000)
+  end
+
+  # TCP proxy to the server. Frozen, it stops forwarding the server traffic (the client receives
+  # nothing, while the server believes its messages were sent); dropped, it closes every connection.
+  defp start_proxy(listen_port, target_port) do
+    {:ok, listen} = :gen_tcp.listen(listen_port, [:binary, active: false, reuseaddr: true])
+    {:ok, proxy} = Agent.start_link(fn -> %{frozen: :atomics.new(1, []), sockets: []} end)
+
+    spawn_link(fn -> proxy_accept(proxy, listen, target_port) end)
+    proxy
+  end
+
+  defp proxy_accept(proxy, listen, target_port) do
+    {:ok, downstream} = :gen_tcp.accept(listen)
+    {:ok, upstream} = :gen_tcp.connect(~c"localhost", target_port, [:binary, active: false])
+    frozen = Agent.get_and_update(proxy, &{&1.frozen, %{&1 | sockets: [downstream, upstream | &1.sockets]}})
+
+    spawn(fn -> proxy_pump(downstream, upstream, nil) end)
+    spawn(fn -> proxy_pump(upstream, downstream, frozen) end)
+    proxy_accept(proxy, listen, target_port)
+  end
+
+  defp proxy_pump(from, to, frozen) do
+    with {:ok, data} <- :gen_tcp.recv(from, 0) do
+      if frozen == nil or :atomics.get(frozen, 1) == 0, do: :gen_tcp.send(to, data)
+      proxy_pump(from, to, frozen)
+    end
+  end
+
+  defp proxy_freeze(proxy), do: Agent.get(proxy, &:atomics.put(&1.frozen, 1, 1))
+
+  defp proxy_drop(proxy) do
+    Agent.update(proxy, fn %{frozen: frozen, sockets: sockets} = state ->
+      Enum.each(sockets, &:gen_tcp.close/1)
+      :atomics.put(frozen, 1, 0)
+      %{state | sockets: []}
+    end)
+  end
+
+  defp start_server(opts \\ []) do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4051)
+    :ok = Server.set_retransmission_queue_size(s_pid, Keyword.get(opts, :retransmission_queue_size, 0))
+    {:ok, ns_index} = Server.add_namespace(s_pid, "Room")
+
+    identifier = Keyword.get(opts, :identifier, "R1_TS1_Temperature")
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: identifier)
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: node_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Temperature"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.write_node_access_level(s_pid, node_id, 3)
+    :ok = Server.start(s_pid)
+
+    {s_pid, node_id}
+  end
+
+  defp start_users_server(password) do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_users(s_pid, [{"alde103", password}], 4051)
+    :ok = Server.start(s_pid)
+    s_pid
+  end
+end
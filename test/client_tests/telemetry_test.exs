@@ -0,0 +1,64 @@
+defmodule ClientTelemetryTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, Client}
+
+  @events [
+    [:opex62541, :command, :start],
+    [:opex62541, :command, :stop],
+    [:opex62541, :command, :exception],
+    [:opex62541, :process, :stats]
+  ]
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4048)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4048/")
+
+    test_pid = self()
+    handler_id = "telemetry-#{inspect(test_pid)}"
+
+    :telemetry.attach_many(
+      handler_id,
+      @events,
+      fn event, measurements, metadata, _config -> send(test_pid, {event, measurements, metadata}) end,
+      nil
+    )
+
+    on_exit(fn -> :telemetry.detach(handler_id) end)
+
+    %{c_pid: c_pid}
+  end
+
+  test "port command spans", %{c_pid: c_pid} do
+    node_ids = for id <- [2258, 2259, 2256], do: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: id)
+    {:ok, _values} = Client.read_node_values(c_pid, node_ids)
+
+    assert_received {[:opex62541, :command, :start], %{monotonic_time: _},
+                     %{pid: ^c_pid, command: :read_node_values, node_count: 3, payload_size: size}}
+    assert size > 0
+    assert_received {[:opex62541, :command, :stop], %{duration: duration},
+                     %{command: :read_node_values, result: :ok}}
+    assert duration > 0
+
+    unknown = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 1_000_000)
+    {:error, _reason} = Client.read_node_value(c_pid, unknown)
+    assert_received {[:opex62541, :command, :stop], _measurements, %{command: :read_node_value, result: :error}}
+    refute_received {[:opex62541, :command, :exception], _measurements, _metadata}
+  end
+
+  test "process load measurements", %{c_pid: c_pid} do
+    :ok = Client.set_port_stats_interval(c_pid, 100)
+
+    assert_receive {[:opex62541, :process, :stats],
+                    %{message_queue_len: _, port_queue_size: _, port_busy: _, pending_commands: 0}, %{pid: ^c_pid}},
+                   1000
+
+    :ok = Client.set_port_stats_interval(c_pid, 0)
+  end
+end
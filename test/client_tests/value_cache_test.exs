@@ -0,0 +1,101 @@
+defmodule ClientValueCacheTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4031)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "CacheTest")
+
+    parent_id =
+      NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "CacheParent")
+
+    :ok =
+      Server.add_object_node(s_pid,
+        requested_new_node_id: parent_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "CacheParent"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+      )
+
+    node_ids =
+      for i <- 1..2 do
+        node_id =
+          NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Cached_#{i}")
+
+        :ok =
+          Server.add_variable_node(s_pid,
+            requested_new_node_id: node_id,
+            parent_node_id: parent_id,
+            reference_type_node_id:
+              NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+            browse_name: QualifiedName.new(ns_index: ns_index, name: "Cached #{i}"),
+            type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+          )
+
+        :ok = Server.write_node_access_level(s_pid, node_id, 3)
+        node_id
+      end
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4031/")
+
+    %{c_pid: c_pid, ns_index: ns_index, node_ids: node_ids}
+  end
+
+  test "monitored values are read from the cache", %{c_pid: c_pid, node_ids: [node_id | _]} do
+    :ok = Client.set_value_cache(c_pid, true)
+    assert {:error, :not_cached} == Client.read_cached(c_pid, node_id)
+
+    {:ok, sub_id} = Client.add_subscription(c_pid, 100.0)
+    {:ok, mon_id} = Client.add_monitored_item(c_pid, monitored_item: node_id, subscription_id: sub_id, sampling_time: 50.0)
+
+    :ok = Client.write_node_value(c_pid, node_id, 10, 21.5)
+    Process.sleep(500)
+    # Any port call lets the client process the pending publish responses.
+    {:ok, _} = Client.get_state(c_pid)
+    assert_receive {:data, ^sub_id, ^mon_id, 21.5}, 1000
+
+    assert {:ok, %{value: 21.5, server_timestamp: ts, age: age}} = Client.read_cached(c_pid, node_id)
+    assert is_integer(ts)
+    assert age >= 0
+  end
+
+  test "read many cached values", %{c_pid: c_pid, node_ids: [node_id_1, node_id_2]} do
+    :ok = Client.set_value_cache(c_pid, true)
+
+    {:ok, sub_id} = Client.add_subscription(c_pid, 100.0)
+    {:ok, mon_id} = Client.add_monitored_item(c_pid, monitored_item: node_id_1, subscription_id: sub_id, sampling_time: 50.0)
+
+    :ok = Client.write_node_value(c_pid, node_id_1, 6, 7)
+    Process.sleep(500)
+    {:ok, _} = Client.get_state(c_pid)
+    assert_receive {:data, ^sub_id, ^mon_id, 7}, 1000
+
+    assert {:ok, [{:ok, %{value: 7}}, {:error, :not_cached}]} =
+             Client.read_cached_many(c_pid, [node_id_1, node_id_2])
+  end
+
+  test "disabled cache does not answer", %{c_pid: c_pid, node_ids: [node_id | _]} do
+    {:ok, sub_id} = Client.add_subscription(c_pid, 100.0)
+    {:ok, mon_id} = Client.add_monitored_item(c_pid, monitored_item: node_id, subscription_id: sub_id, sampling_time: 50.0)
+
+    :ok = Client.write_node_value(c_pid, node_id, 10, 1.0)
+    Process.sleep(500)
+    {:ok, _} = Client.get_state(c_pid)
+    assert_receive {:data, ^sub_id, ^mon_id, 1.0}, 1000
+
+    assert {:error, :not_cached} == Client.read_cached(c_pid, node_id)
+  end
+
+  test "read many cached values requires 1 to 1000 nodes", %{c_pid: c_pid} do
+    assert {:error, :einval} == Client.read_cached_many(c_pid, [])
+  end
+end
@@ -0,0 +1,60 @@
+defmodule ClientWorkerPoolTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client}
+
+  # Nothing answers there, connecting blocks until the client timeout.
+  @unreachable_url "opc.tcp://10.255.255.1:4840/"
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4050)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "Room")
+
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: node_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Temperature"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.write_node_access_level(s_pid, node_id, 3)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid, %{"timeout" => 3000})
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4050/")
+
+    %{c_pid: c_pid, node_id: node_id}
+  end
+
+  test "a slow discovery doesn't stall the client", %{c_pid: c_pid, node_id: node_id} do
+    {:ok, subscription_id} = Client.add_subscription(c_pid)
+    {:ok, monitored_id} = Client.add_monitored_item(c_pid, monitored_item: node_id, subscription_id: subscription_id)
+
+    discovery = Task.async(fn -> Client.get_endpoints(c_pid, @unreachable_url) end)
+    Process.sleep(100)
+
+    {time, :ok} = :timer.tc(fn -> Client.write_node_value(c_pid, node_id, 10, 21.5) end)
+    assert time < 1_000_000
+    assert {:ok, 21.5} == Client.read_node_value(c_pid, node_id)
+    assert_receive({:data, ^subscription_id, ^monitored_id, 21.5}, 2000)
+
+    assert {:error, _reason} = Task.await(discovery, 5000)
+  end
+
+  test "requests wait for the connection in order", %{c_pid: c_pid, node_id: node_id} do
+    :ok = Client.disconnect(c_pid)
+
+    connect = Task.async(fn -> Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4050/") end)
+    Process.sleep(10)
+    assert {:ok, "Session"} == Client.get_state(c_pid)
+    assert :ok == Task.await(connect)
+    assert {:ok, _value} = Client.read_node_value(c_pid, node_id)
+  end
+end
@@ -0,0 +1,62 @@
+defmodule TagTableTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, QualifiedName, Client, TagTable}
+
+  setup do
+    {:ok, s_pid} = Server.start_link(tag_table: :server_tags)
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4032)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "TagTableTest")
+
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Tag")
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: node_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id:
+          NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Tag"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.write_node_access_level(s_pid, node_id, 3)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link(tag_table: :client_tags)
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4032/")
+
+    %{c_pid: c_pid, s_pid: s_pid, node_id: node_id}
+  end
+
+  test "server tag table is populated by client writes", %{c_pid: c_pid, node_id: node_id} do
+    assert {:error, :not_found} == TagTable.read(:server_tags, node_id)
+
+    :ok = Client.write_node_value(c_pid, node_id, 10, 12.5)
+    assert_receive {^node_id, 12.5}, 1000
+
+    assert {:ok, 12.5} == TagTable.read(:server_tags, node_id)
+    assert {:ok, {12.5, updated_at}} = TagTable.read_with_timestamp(:server_tags, node_id)
+    assert is_integer(updated_at)
+  end
+
+  test "client tag table is populated by monitored items", %{c_pid: c_pid, node_id: node_id} do
+    {:ok, sub_id} = Client.add_subscription(c_pid, 100.0)
+
+    {:ok, mon_id} =
+      Client.add_monitored_item(c_pid, monitored_item: node_id, subscription_id: sub_id, sampling_time: 50.0)
+
+    :ok = Client.write_node_value(c_pid, node_id, 6, 3)
+    Process.sleep(500)
+    {:ok, _} = Client.get_state(c_pid)
+    assert_receive {:data, ^sub_id, ^mon_id, 3}, 1000
+
+    assert [{:ok, 3}] == TagTable.read_many(:client_tags, [node_id])
+
+    :ok = Client.delete_monitored_item(c_pid, monitored_item_id: mon_id, subscription_id: sub_id)
+    assert_receive {:delete, ^sub_id, ^mon_id}, 1000
+    assert {:error, :not_found} == TagTable.read(:client_tags, node_id)
+  end
+end
@@ -0,0 +1,123 @@
+defmodule ServerEventTest do
+  use ExUnit.Case, async: false
+
+  @moduletag :events
+
+  alias OpcUA.{NodeId, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4042)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4042/")
+    {:ok, subscription_id} = Client.add_subscription(c_pid, 50.0)
+
+    {:ok, _monitored_id} =
+      Client.add_event_monitored_item(c_pid,
+        subscription_id: subscription_id,
+        select: ["Message", "Severity"],
+        where: {:gte, {:field, "Severity"}, {4, 50}}
+      )
+
+    base_event_type = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2041)
+
+    %{s_pid: s_pid, c_pid: c_pid, subscription_id: subscription_id, base_event_type: base_event_type}
+  end
+
+  test "create, fill & trigger an event", %{s_pid: s_pid, base_event_type: base_event_type} do
+    assert {:ok, %NodeId{} = event_node} = Server.create_event(s_pid, base_event_type)
+
+    assert :ok ==
+             Server.set_event_fields(s_pid, event_node, [
+               {"Message", {20, {"en-US", "Line 1 trip"}}},
+               {"Severity", {4, 800}}
+             ])
+
+    assert {:ok, event_id} = Server.trigger_event(s_pid, event_node)
+    assert is_binary(event_id)
+
+    assert_receive {:events, [{_sub, _mon, [_message, 800]}]}, 2000
+
+    # The instance is deleted once triggered.
+    assert {:error, _reason} = Server.trigger_event(s_pid, event_node)
+  end
+
+  test "trigger a burst of events", %{s_pid: s_pid, base_event_type: base_event_type} do
+    events =
+      for severity <- 1..100 do
+        {base_event_type, [{"Message", {20, {"en-US", "Alarm #{severity}"}}}, {"Severity", {4, severity}}]}
+      end
+
+    assert :ok == Server.trigger_events(s_pid, events)
+
+    severities = receive_severities([])
+    assert severities == Enum.to_list(50..100)
+  end
+
+  test "batched events do not inherit the fields of the previous event", %{
+    s_pid: s_pid,
+    c_pid: c_pid,
+    subscription_id: subscription_id,
+    base_event_type: base_event_type
+  } do
+    {:ok, _monitored_id} =
+      Client.add_event_monitored_item(c_pid,
+        subscription_id: subscription_id,
+        select: ["SourceName", "Message", "Severity"],
+        where: {:eq, {:field, "Severity"}, {4, 42}}
+      )
+
+    server = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2253)
+    server_status = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2256)
+
+    events = [
+      {base_event_type, server, [{"Message", {20, {"en-US", "Line 1 trip"}}}, {"Severity", {4, 42}}]},
+      {base_event_type, server_status, [{"Severity", {4, 42}}]}
+    ]
+
+    assert :ok == Server.trigger_events(s_pid, events)
+
+    assert [["Server", first_message, 42], ["ServerStatus", second_message, 42]] = receive_fields([])
+    assert first_message != second_message
+  end
+
+  test "failed events are reported by index", %{s_pid: s_pid, base_event_type: base_event_type} do
+    folder_type = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 61)
+
+    events = [
+      {base_event_type, [{"Severity", {4, 200}}]},
+      {folder_type, [{"Severity", {4, 200}}]},
+      {base_event_type, [{"Unknown", {4, 200}}]}
+    ]
+
+    assert {:error, [{1, _reason1}, {2, _reason2}]} = Server.trigger_events(s_pid, events)
+  end
+
+  test "invalid events", %{s_pid: s_pid, base_event_type: base_event_type} do
+    assert {:error, :einval} == Server.trigger_events(s_pid, [])
+    assert {:error, :einval} == Server.trigger_events(s_pid, [{base_event_type, [{"Severity", 1}]}])
+    assert {:error, :einval} == Server.trigger_events(s_pid, [{:type, []}])
+    assert {:error, :einval} == Server.trigger_event(s_pid, base_event_type, keep: 1)
+  end
+
+  defp receive_fields(fields) do
+    receive do
+      {:events, events} -> receive_fields(fields ++ Enum.map(events, fn {_sub, _mon, event_fields} -> event_fields end))
+    after
+      1000 -> fields
+    end
+  end
+
+  defp receive_severities(severities) do
+    receive do
+      {:events, events} ->
+        receive_severities(severities ++ Enum.map(events, fn {_sub, _mon, [_message, severity]} -> severity end))
+    after
+      1000 -> severities
+    end
+  end
+end
@@ -0,0 +1,194 @@
+defmodule ServerHistoryTest do
+  use ExUnit.Case, async: false
+
+  @moduletag :historizing
+
+  alias OpcUA.{NodeId, Server, Client, QualifiedName}
+
+  setup do
+    {:ok, pid} = Server.start_link()
+    :ok = Server.set_default_config(pid)
+    :ok = Server.set_port(pid, 4039)
+    {:ok, ns_index} = Server.add_namespace(pid, "Room")
+
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    :ok = Server.add_variable_node(pid,
+      requested_new_node_id: node_id,
+      parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+      reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+      browse_name: QualifiedName.new(ns_index: ns_index, name: "Temperature"),
+      type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+    )
+
+    :ok = Server.start(pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4039/")
+
+    %{pid: pid, c_pid: c_pid, node_id: node_id}
+  end
+
+  test "ring buffer history keeps the last values of a node", %{pid: pid, c_pid: c_pid, node_id: node_id} do
+    assert :ok == Server.set_node_history(pid, node_id, 3)
+
+    for value <- 1..5 do
+      assert :ok == Server.write_node_value(pid, node_id, 10, value * 1.0)
+      Process.sleep(2)
+    end
+
+    start_time = DateTime.add(DateTime.utc_now(), -3600, :second)
+    end_time = DateTime.add(DateTime.utc_now(), 3600, :second)
+
+    assert {:ok, [{:ok, history}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time)
+
+    assert history.data_type == 10
+    assert history.values == <<3.0::float-64-native, 4.0::float-64-native, 5.0::float-64-native>>
+    assert byte_size(history.timestamps) == 24
+    assert history.statuses == nil
+
+    # Continuation points are followed by the client.
+    assert {:ok, [{:ok, ^history}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time, num_values: 2)
+
+    # Reverse order when only the end time is given.
+    assert {:ok, [{:ok, %{values: <<5.0::float-64-native, 4.0::float-64-native, 3.0::float-64-native>>}}]} =
+             Client.history_read_raw(c_pid, [node_id], end_time: end_time, num_values: 2)
+
+    # Resized and deleted history.
+    assert :ok == Server.set_node_history(pid, node_id, 1)
+
+    assert {:ok, [{:ok, %{values: <<5.0::float-64-native>>}}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time)
+
+    assert :ok == Server.set_node_history(pid, node_id, 0)
+
+    assert {:ok, [{:error, _reason}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time)
+  end
+
+  test "on-disk history store survives a server restart", %{pid: pid, c_pid: c_pid, node_id: node_id} do
+    path = Path.join(System.tmp_dir!(), "opex_history_#{System.unique_integer([:positive])}")
+    on_exit(fn -> File.rm_rf!(path) end)
+
+    assert {:error, "BadInvalidState"} == Server.set_node_history(pid, node_id, 2, store: :disk)
+    assert :ok == Server.set_history_store(pid, path, segment_size: 65_536, flush_interval: 50)
+    assert {:error, "BadInvalidState"} == Server.set_history_store(pid, path)
+
+    # Two values are buffered in memory between appends to the store.
+    assert :ok == Server.set_node_history(pid, node_id, 2, store: :disk)
+
+    for value <- 1..5 do
+      assert :ok == Server.write_node_value(pid, node_id, 10, value * 1.0)
+      Process.sleep(2)
+    end
+
+    expected = for value <- 1..5, into: <<>>, do: <<value * 1.0::float-64-native>>
+    start_time = DateTime.add(DateTime.utc_now(), -3600, :second)
+    end_time = DateTime.add(DateTime.utc_now(), 3600, :second)
+
+    assert {:ok, [{:ok, %{values: ^expected}}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time)
+
+    Process.sleep(200)
+    assert [_segment] = File.ls!(path)
+    GenServer.stop(c_pid)
+    GenServer.stop(pid)
+
+    {:ok, pid} = Server.start_link()
+    :ok = Server.set_default_config(pid)
+    :ok = Server.set_port(pid, 4040)
+    :ok = Server.set_history_store(pid, path)
+    :ok = Server.start(pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4040/")
+
+    assert {:ok, [{:ok, %{values: ^expected}}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time)
+
+    reversed = for value <- 5..1//-1, into: <<>>, do: <<value * 1.0::float-64-native>>
+
+    assert {:ok, [{:ok, %{values: ^reversed}}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: end_time, end_time: start_time, num_values: 2)
+  end
+
+  test "opening the history store keeps every segment file", %{pid: pid, node_id: node_id} do
+    path = Path.join(System.tmp_dir!(), "opex_history_#{System.unique_integer([:positive])}")
+    on_exit(fn -> File.rm_rf!(path) end)
+
+    :ok = Server.set_history_store(pid, path, segment_size: 65_536, flush_interval: 50)
+    :ok = Server.set_node_history(pid, node_id, 2, store: :disk)
+
+    for value <- 1..4 do
+      :ok = Server.write_node_value(pid, node_id, 10, value * 1.0)
+      Process.sleep(2)
+    end
+
+    Process.sleep(200)
+    GenServer.stop(pid)
+
+    # A gap in the segment ids and a file that is not a segment.
+    File.rename!(Path.join(path, "0000000000.hist"), Path.join(path, "0000000005.hist"))
+    File.write!(Path.join(path, "0000000002.hist"), :binary.copy(<<0xAB>>, 100))
+
+    {pid, c_pid} = restart_server(path)
+    start_time = DateTime.add(DateTime.utc_now(), -3600, :second)
+    end_time = DateTime.add(DateTime.utc_now(), 3600, :second)
+    expected = for value <- 1..4, into: <<>>, do: <<value * 1.0::float-64-native>>
+
+    assert {:ok, [{:ok, %{values: ^expected}}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time)
+
+    assert File.read!(Path.join(path, "0000000002.hist")) == :binary.copy(<<0xAB>>, 100)
+    assert ["0000000002.hist", "0000000005.hist", "0000000006.hist"] == path |> File.ls!() |> Enum.sort()
+    GenServer.stop(c_pid)
+    GenServer.stop(pid)
+
+    # Flipping the last byte of the segment fails the checksum of the last block (holding 4.0): the
+    # blocks before it are still read and the file is kept as is.
+    segment = Path.join(path, "0000000005.hist")
+    data = File.read!(segment)
+    size = byte_size(data) - 1
+    <<head::binary-size(size), last>> = data
+    File.write!(segment, <<head::binary, Bitwise.bxor(last, 0xFF)>>)
+
+    {_pid, c_pid} = restart_server(path)
+
+    assert {:ok, [{:ok, %{values: values}}]} =
+             Client.history_read_raw(c_pid, [node_id], start_time: start_time, end_time: end_time)
+
+    assert byte_size(values) in [16, 24]
+    assert values == binary_part(expected, 0, byte_size(values))
+    assert byte_size(File.read!(segment)) == byte_size(data)
+  end
+
+  test "invalid history configurations", %{pid: pid, node_id: node_id} do
+    unknown_node = NodeId.new(ns_index: 1, identifier_type: "string", identifier: "unknown")
+
+    assert {:error, _reason} = Server.set_node_history(pid, unknown_node, 10)
+    assert {:error, :einval} == Server.set_node_history(pid, node_id, -1)
+    assert {:error, :einval} == Server.set_node_history(pid, node_id, 100_000_000)
+    assert {:error, :einval} == Server.set_node_history(pid, node_id, 10, store: :cloud)
+    assert {:error, :einval} == Server.set_history_store(pid, "", [])
+    assert {:error, :einval} == Server.set_history_store(pid, "/tmp/opex_history", segment_size: 1024)
+    assert {:error, :einval} == Server.set_history_store(pid, "/tmp/opex_history", flush_interval: 0)
+  end
+
+  defp restart_server(path) do
+    {:ok, pid} = Server.start_link()
+    :ok = Server.set_default_config(pid)
+    :ok = Server.set_port(pid, 4040)
+    :ok = Server.set_history_store(pid, path)
+    :ok = Server.start(pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4040/")
+
+    {pid, c_pid}
+  end
+end
@@ -0,0 +1,67 @@
+defmodule ServerLazyReadTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, QualifiedName, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4044)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "Room")
+
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Computed")
+
+    :ok =
+      Server.add_variable_node(s_pid,
+        requested_new_node_id: node_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Computed"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+    :ok = Server.write_node_access_level(s_pid, node_id, 3)
+    :ok = Server.write_node_value(s_pid, node_id, 10, 0.0)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4044/")
+
+    %{s_pid: s_pid, c_pid: c_pid, node_id: node_id}
+  end
+
+  test "a burst of reads fetches the value once per TTL", %{s_pid: s_pid, c_pid: c_pid, node_id: node_id} do
+    :ok = Server.set_node_lazy_read(s_pid, node_id, 500)
+
+    # The first read is served the cached value and requests a fresh one.
+    assert {:ok, 0.0} == Client.read_node_value(c_pid, node_id)
+    assert_receive {:lazy_read, ^node_id}, 1000
+    assert :ok == Server.set_lazy_value(s_pid, node_id, 10, 42.0)
+
+    for _ <- 1..100, do: assert({:ok, 42.0} == Client.read_node_value(c_pid, node_id))
+    refute_received {:lazy_read, _node_id}
+
+    # Expired: the next read requests the value again.
+    Process.sleep(600)
+    assert {:ok, 42.0} == Client.read_node_value(c_pid, node_id)
+    assert_receive {:lazy_read, ^node_id}, 1000
+    for _ <- 1..100, do: Client.read_node_value(c_pid, node_id)
+    refute_receive {:lazy_read, _node_id}, 200
+  end
+
+  test "plain variables again", %{s_pid: s_pid, c_pid: c_pid, node_id: node_id} do
+    :ok = Server.set_node_lazy_read(s_pid, node_id, 500)
+    :ok = Server.set_node_lazy_read(s_pid, node_id, 0)
+
+    assert {:ok, 0.0} == Client.read_node_value(c_pid, node_id)
+    refute_receive {:lazy_read, _node_id}, 200
+    assert {:error, "BadInvalidState"} == Server.set_lazy_value(s_pid, node_id, 10, 42.0)
+  end
+
+  test "invalid lazy variables", %{s_pid: s_pid, node_id: node_id} do
+    objects_folder = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+    assert {:error, "BadNodeClassInvalid"} == Server.set_node_lazy_read(s_pid, objects_folder, 500)
+    assert {:error, :einval} == Server.set_node_lazy_read(s_pid, node_id, 100_000_000)
+  end
+end
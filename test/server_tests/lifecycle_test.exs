@@ -131,4 +131,19 @@ defmodule ServerLifecycleTest do
     response = Server.stop_server(state.pid)
     assert response == :ok
   end
+
+  test "Restart server", state do
+    :ok = Server.set_default_config(state.pid)
+    :ok = Server.set_port(state.pid, 4025)
+    :ok = Server.start(state.pid)
+
+    # The stop replies once the server thread is gone, so the start runs a new one.
+    assert :ok == Server.stop_server(state.pid)
+    assert :ok == Server.start(state.pid)
+
+    {:ok, c_pid} = OpcUA.Client.start_link()
+    :ok = OpcUA.Client.set_config(c_pid)
+    assert :ok == OpcUA.Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4025/")
+    assert {:ok, "Session"} == OpcUA.Client.get_state(c_pid)
+  end
 end
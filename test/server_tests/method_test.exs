@@ -0,0 +1,90 @@
+defmodule ServerMethodTest do
+  use ExUnit.Case, async: false
+
+  @moduletag :multithreading
+
+  alias OpcUA.{NodeId, QualifiedName, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4043)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "Room")
+
+    object_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+    method_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Add")
+
+    :ok =
+      Server.add_method_node(s_pid,
+        requested_new_node_id: method_id,
+        parent_node_id: object_id,
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Add"),
+        input_arguments: [{"a", 10}, {"b", 10}],
+        output_arguments: [{"sum", 10}]
+      )
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4043/")
+
+    %{s_pid: s_pid, c_pid: c_pid, object_id: object_id, method_id: method_id}
+  end
+
+  test "method calls are answered from Elixir", %{s_pid: s_pid, c_pid: c_pid, object_id: object_id, method_id: method_id} do
+    task = Task.async(fn -> Client.call_methods(c_pid, [{object_id, method_id, [{10, 1.0}, {10, 2.0}]}]) end)
+
+    assert_receive {:method_call, call_id, ^object_id, ^method_id, [1.0, 2.0]}, 2000
+    assert :ok == Server.set_method_result(s_pid, call_id, {:ok, [{10, 3.0}]})
+    assert {:ok, [{:ok, [3.0]}]} == Task.await(task)
+
+    # Answered calls are gone.
+    assert {:error, "BadNotFound"} == Server.set_method_result(s_pid, call_id, {:ok, [{10, 3.0}]})
+  end
+
+  test "the server reads values while a method call is pending", %{c_pid: c_pid, object_id: object_id, method_id: method_id} do
+    task = Task.async(fn -> Client.call_methods(c_pid, [{object_id, method_id, [{10, 1.0}, {10, 2.0}]}]) end)
+    assert_receive {:method_call, _call_id, _object_id, _method_id, _arguments}, 2000
+
+    {:ok, reader} = Client.start_link()
+    :ok = Client.set_config(reader)
+    :ok = Client.connect_by_url(reader, url: "opc.tcp://localhost:4043/")
+    current_time = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2258)
+    assert {:ok, _time} = Client.read_node_value(reader, current_time)
+
+    Task.shutdown(task, :brutal_kill)
+  end
+
+  test "calls beyond the limit wait and calls time out", %{s_pid: s_pid, c_pid: c_pid, object_id: object_id, method_id: method_id} do
+    :ok = Server.set_method_call_config(s_pid, timeout: 1000, max_calls: 1)
+
+    call = {object_id, method_id, [{10, 1.0}, {10, 2.0}]}
+    task = Task.async(fn -> Client.call_methods(c_pid, [call, call]) end)
+
+    assert_receive {:method_call, first_id, _object_id, _method_id, _arguments}, 2000
+    refute_receive {:method_call, _call_id, _object_id, _method_id, _arguments}, 200
+
+    assert :ok == Server.set_method_result(s_pid, first_id, {:error, 0x80740000})
+    assert_receive {:method_call, _second_id, _object_id, _method_id, _arguments}, 2000
+
+    # The second call is never answered.
+    assert {:ok, [{:error, "BadTypeMismatch"}, {:error, "BadTimeout"}]} = Task.await(task, 5000)
+  end
+
+  test "invalid method nodes and results", %{s_pid: s_pid, object_id: object_id} do
+    assert {:error, :einval} ==
+             Server.add_method_node(s_pid,
+               requested_new_node_id: NodeId.new(ns_index: 1, identifier_type: "string", identifier: "Bad"),
+               parent_node_id: object_id,
+               reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+               browse_name: QualifiedName.new(ns_index: 1, name: "Bad"),
+               input_arguments: [{:a, 10}]
+             )
+
+    assert {:error, :einval} == Server.set_method_call_config(s_pid, timeout: 0)
+    assert {:error, :einval} == Server.set_method_result(s_pid, 1, {:ok, [3.0]})
+    assert {:error, :einval} == Server.set_method_result(s_pid, 1, :ok)
+  end
+end
@@ -0,0 +1,60 @@
+defmodule ServerStatsTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4046)
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4046/")
+
+    %{s_pid: s_pid, c_pid: c_pid}
+  end
+
+  @tag :diagnostics
+  test "server load statistics", %{s_pid: s_pid, c_pid: c_pid} do
+    {:ok, subscription_id} = Client.add_subscription(c_pid)
+    server_status = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2256)
+    {:ok, _monitored_item_id} = Client.add_monitored_item(c_pid, monitored_item: server_status, subscription_id: subscription_id)
+    for _ <- 1..10, do: {:ok, _value} = Client.read_node_value(c_pid, server_status)
+
+    assert {:ok, stats} = Server.get_server_stats(s_pid)
+    assert stats.sessions == 1
+    assert stats.secure_channels == 1
+    assert stats.subscriptions == 1
+    assert stats.monitored_items == 1
+    assert stats.nodes > 1000
+    assert stats.rss > 0
+    assert stats.process_read_bytes > 0 and stats.process_write_bytes > 0
+    refute Map.has_key?(stats, :bytes_in)
+    assert stats.services["read"].total >= 10
+    assert %{count: count, p50: p50, p99: p99, max: max} = stats.commands["start_server"]
+    assert count == 1 and p50 <= p99 and p99 <= max
+  end
+
+  test "periodic statistics", %{s_pid: s_pid} do
+    :ok = Server.set_server_stats_interval(s_pid, 100)
+    assert_receive {:server_stats, %{sessions: 1}}, 1000
+    assert_receive {:server_stats, _stats}, 1000
+
+    :ok = Server.set_server_stats_interval(s_pid, 0)
+    Process.sleep(150)
+    flush_stats()
+    refute_receive {:server_stats, _stats}, 300
+
+    assert {:error, :einval} == Server.set_server_stats_interval(s_pid, 3_600_001)
+  end
+
+  defp flush_stats() do
+    receive do
+      {:server_stats, _stats} -> flush_stats()
+    after
+      0 -> :ok
+    end
+  end
+end
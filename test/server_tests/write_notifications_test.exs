@@ -0,0 +1,95 @@
+defmodule ServerWriteNotificationsTest do
+  use ExUnit.Case, async: false
+
+  alias OpcUA.{NodeId, QualifiedName, Server, Client}
+
+  setup do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, 4045)
+    {:ok, ns_index} = Server.add_namespace(s_pid, "Room")
+
+    nodes =
+      for name <- ["Temperature", "Pressure"] do
+        node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: name)
+
+        :ok =
+          Server.add_variable_node(s_pid,
+            requested_new_node_id: node_id,
+            parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+            reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+            browse_name: QualifiedName.new(ns_index: ns_index, name: name),
+            type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+          )
+
+        :ok = Server.write_node_access_level(s_pid, node_id, 3)
+        :ok = Server.write_node_value(s_pid, node_id, 10, 0.0)
+        node_id
+      end
+
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4045/")
+
+    %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, nodes: nodes}
+  end
+
+  test "writes within a window are coalesced in one message", %{s_pid: s_pid, c_pid: c_pid, nodes: [temp, pressure]} do
+    # The window starts with the settings, the writes below all fall in the first one.
+    :ok = Server.set_write_notifications(s_pid, window: 2000, batch: true)
+
+    for value <- [1.0, 2.0, 3.0], do: :ok = Client.write_node_value(c_pid, temp, 10, value)
+    :ok = Client.write_node_value(c_pid, pressure, 10, 7.0)
+
+    assert_receive {:writes, writes}, 3000
+    assert [{temp, 3.0}, {pressure, 7.0}] == writes
+    refute_receive {:writes, _writes}, 500
+
+    # Back to one message per write.
+    :ok = Server.set_write_notifications(s_pid, window: 0)
+    :ok = Client.write_node_value(c_pid, temp, 10, 4.0)
+    assert_receive {^temp, 4.0}, 1000
+  end
+
+  test "writes are filtered per namespace and per node", %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, nodes: [temp, pressure]} do
+    :ok = Server.set_write_notification(s_pid, ns_index, false)
+    :ok = Server.set_write_notification(s_pid, pressure, true)
+
+    :ok = Client.write_node_value(c_pid, temp, 10, 1.0)
+    :ok = Client.write_node_value(c_pid, pressure, 10, 2.0)
+    assert_receive {^pressure, 2.0}, 1000
+    refute_receive {^temp, _value}, 200
+
+    :ok = Server.set_write_notification(s_pid, ns_index, :default)
+    :ok = Server.set_write_notifications(s_pid, default: false)
+    :ok = Client.write_node_value(c_pid, temp, 10, 3.0)
+    :ok = Client.write_node_value(c_pid, pressure, 10, 4.0)
+    assert_receive {^pressure, 4.0}, 1000
+    refute_receive {^temp, _value}, 200
+  end
+
+  test "only the writes of clients are notified", %{s_pid: s_pid, c_pid: c_pid, ns_index: ns_index, nodes: [temp, pressure]} do
+    # A rejected server write must not swallow the next client write.
+    unknown = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Unknown")
+    assert {:error, _reason} = Server.write_node_value(s_pid, unknown, 10, 1.0)
+    :ok = Client.write_node_value(c_pid, temp, 10, 1.0)
+    assert_receive {^temp, 1.0}, 1000
+
+    task = Task.async(fn -> for v <- 1..200, do: :ok = Server.write_node_value(s_pid, pressure, 10, v * 1.0) end)
+    for v <- 1..20, do: :ok = Client.write_node_value(c_pid, temp, 10, v * 1.0)
+    Task.await(task)
+
+    for v <- 1..20, do: assert_receive({^temp, value} when value == v * 1.0, 1000)
+    refute_receive {^pressure, _value}, 200
+  end
+
+  test "invalid write notification settings", %{s_pid: s_pid, nodes: [temp, _pressure]} do
+    assert {:error, :einval} == Server.set_write_notifications(s_pid, window: -1)
+    assert {:error, :einval} == Server.set_write_notifications(s_pid, batch: 1)
+    assert {:error, :einval} == Server.set_write_notifications(s_pid, window: 100_000)
+    assert {:error, :einval} == Server.set_write_notification(s_pid, temp, :off)
+    assert {:error, :einval} == Server.set_write_notification(s_pid, :temp, true)
+  end
+end
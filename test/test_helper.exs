@@ -1 +1,19 @@
-ExUnit.start()
+# Some server features depend on the open62541 build flags (see "Customized builds" in the README):
+# the tests tagged with a feature the port reports as not supported are excluded.
+{:ok, pid} = OpcUA.Server.start_link()
+server_object = OpcUA.NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2253)
+base_event_type = OpcUA.NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 2041)
+
+missing_features =
+  [
+    historizing: OpcUA.Server.set_node_history(pid, server_object, 0),
+    events: OpcUA.Server.create_event(pid, base_event_type),
+    multithreading: OpcUA.Server.set_method_call_config(pid, []),
+    diagnostics: with({:ok, stats} <- OpcUA.Server.get_server_stats(pid), do: Map.has_key?(stats, :services))
+  ]
+  |> Enum.filter(fn {_feature, result} -> result in [{:error, :not_supported}, false] end)
+  |> Keyword.keys()
+
+OpcUA.Server.stop(pid)
+
+ExUnit.start(exclude: missing_features)